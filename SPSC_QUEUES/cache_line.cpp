@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+
+/// Cache line size for alignas() and padding that keep data written by
+/// different threads off each other's lines (false sharing).
+///
+/// std::hardware_destructive_interference_size is not used directly: GCC
+/// warns on it (-Winterference-size) because its value can vary between
+/// compiler versions and -mtune/-mcpu flags, which would silently change the
+/// layout of anything that uses it across translation units or processes.
+/// 64 bytes is the line size of the x86-64 and most Arm cores this targets.
+inline constexpr std::size_t cacheLineSize = 64;
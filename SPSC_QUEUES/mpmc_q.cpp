@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "cache_line.cpp"
+
+
+/// Whether BoundedFifo's pop side may be called from several threads
+enum class Consumers { Single, Multi };
+
+
+/// Threadsafe bounded circular FIFO for many producers (Vyukov-style).
+///
+/// Every slot carries a sequence number that says whose turn it is: a slot at
+/// ring position p is free for the producer claiming cursor p when seq == p,
+/// and holds data for the consumer claiming cursor p when seq == p + 1.
+/// Producers claim cursors with a CAS on pushCursor_; with Consumers::Multi
+/// consumers do the same on popCursor_, with Consumers::Single the consumer
+/// owns popCursor_ and only stores it.
+///
+/// Capacity is rounded up to a power of two.
+template<typename T, typename Alloc = std::allocator<T>, Consumers consumers = Consumers::Multi>
+class BoundedFifo
+{
+    using CursorType = std::atomic<std::size_t>;
+    static_assert(CursorType::is_always_lock_free);
+
+    struct Slot {
+        CursorType seq;
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* value() noexcept { return reinterpret_cast<T*>(storage); }
+    };
+
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+
+public:
+    using value_type = T;
+    using allocator_traits = std::allocator_traits<SlotAlloc>;
+    using size_type = typename allocator_traits::size_type;
+
+    explicit BoundedFifo(size_type capacity, Alloc const& alloc = Alloc{})
+        : alloc_{alloc}
+        , capacity_{std::bit_ceil(capacity < 2 ? size_type{2} : capacity)}
+        , ring_{allocator_traits::allocate(alloc_, capacity_)}
+    {
+        for (size_type i = 0; i < capacity_; ++i) {
+            new (&ring_[i].seq) CursorType{i};
+        }
+    }
+
+    BoundedFifo(BoundedFifo const&) = delete;
+    BoundedFifo& operator=(BoundedFifo const&) = delete;
+
+    ~BoundedFifo() {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        for (auto c = popCursor_.load(std::memory_order_relaxed); c != pushCursor; ++c) {
+            ring_[c & (capacity_ - 1)].value()->~T();
+        }
+        allocator_traits::deallocate(alloc_, ring_, capacity_);
+    }
+
+
+    /// Returns the number of elements in the fifo; approximate while other
+    /// threads are pushing or popping
+    auto size() const noexcept {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        return pushCursor > popCursor ? pushCursor - popCursor : size_type{0};
+    }
+
+    /// Returns whether the container has no elements
+    auto empty() const noexcept { return size() == 0; }
+
+    /// Returns whether the container has capacity_() elements
+    auto full() const noexcept { return size() >= capacity(); }
+
+    /// Returns the number of elements that can be held in the fifo
+    auto capacity() const noexcept { return capacity_; }
+
+
+    /// Push one object onto the fifo; callable from any thread.
+    /// @return `true` if the operation is successful; `false` if fifo is full.
+    auto push(T const& value) {
+        return emplace(value);
+    }
+
+    /// Construct one object in place at the back of the fifo.
+    /// @return `true` if the operation is successful; `false` if fifo is full.
+    template<typename... Args>
+    auto emplace(Args&&... args) {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &ring_[pushCursor & (capacity_ - 1)];
+            auto seq = slot->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq - pushCursor);
+            if (diff == 0) {
+                if (pushCursor_.compare_exchange_weak(pushCursor, pushCursor + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // slot still holds data from a lap ago
+            } else {
+                pushCursor = pushCursor_.load(std::memory_order_relaxed);
+            }
+        }
+        new (slot->value()) T(std::forward<Args>(args)...);
+        slot->seq.store(pushCursor + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Pop one object from the fifo. With Consumers::Single only one thread
+    /// may pop at a time.
+    /// @return `true` if the pop operation is successful; `false` if fifo is empty.
+    auto pop(T& value) {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        Slot* slot;
+        if constexpr (consumers == Consumers::Single) {
+            slot = &ring_[popCursor & (capacity_ - 1)];
+            if (slot->seq.load(std::memory_order_acquire) != popCursor + 1) {
+                return false;
+            }
+            popCursor_.store(popCursor + 1, std::memory_order_relaxed);
+        } else {
+            for (;;) {
+                slot = &ring_[popCursor & (capacity_ - 1)];
+                auto seq = slot->seq.load(std::memory_order_acquire);
+                auto diff = static_cast<std::intptr_t>(seq - (popCursor + 1));
+                if (diff == 0) {
+                    if (popCursor_.compare_exchange_weak(popCursor, popCursor + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;   // producer hasn't published this slot yet
+                } else {
+                    popCursor = popCursor_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        value = std::move(*slot->value());
+        slot->value()->~T();
+        slot->seq.store(popCursor + capacity_, std::memory_order_release);
+        return true;
+    }
+
+private:
+    [[no_unique_address]] SlotAlloc alloc_;
+    size_type capacity_;
+    Slot* ring_;
+
+    /// Claimed by producers with CAS
+    alignas(cacheLineSize) CursorType pushCursor_{};
+
+    /// Claimed by consumers with CAS, or owned by the single consumer
+    alignas(cacheLineSize) CursorType popCursor_{};
+
+    // Padding to avoid false sharing with adjacent objects
+    char padding_[cacheLineSize - sizeof(size_type)];
+};
+
+
+/// Many producers, many consumers
+template<typename T, typename Alloc = std::allocator<T>>
+using MpmcFifo = BoundedFifo<T, Alloc, Consumers::Multi>;
+
+/// Many producers, one consumer: pop is a plain load/compare/store
+template<typename T, typename Alloc = std::allocator<T>>
+using MpscFifo = BoundedFifo<T, Alloc, Consumers::Single>;
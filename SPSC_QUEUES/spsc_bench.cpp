@@ -0,0 +1,251 @@
+// Benchmarks for the fifos in this directory.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread spsc_bench.cpp -o spsc_bench
+//   ./spsc_bench --cpus 2,3 --messages 10000000 --roundtrips 200000 --capacities 1024,65536
+//
+// For each registered queue, element size and capacity it measures
+//  - single-thread: push/pop on one thread (the only mode Fifo1 is safe in)
+//  - throughput:    producer and consumer pinned to the two cpus
+//  - ping-pong:     round trip through a request and a response queue, with
+//                   a log2 histogram and percentiles from rdtsc samples
+//
+// New queue types are added in forEachQueue().
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../runtime/cpu_topology.cpp"
+#include "../runtime/tsc.cpp"
+#include "spsc_q1.cpp"
+#include "spsc_q2.cpp"
+#include "spsc_q3.cpp"
+#include "mpmc_q.cpp"
+#include "wait_strategy.cpp"
+
+
+/// Message of a given size; the first word carries a sequence number
+template<std::size_t Bytes>
+struct Payload {
+    static_assert(Bytes >= sizeof(std::uint64_t));
+    std::uint64_t seq;
+    char pad[Bytes - sizeof(std::uint64_t)];
+};
+
+template<>
+struct Payload<sizeof(std::uint64_t)> {
+    std::uint64_t seq;
+};
+
+
+/// Calls f(name, factory) for every benchmarked queue of T; factory()
+/// returns a unique_ptr to a queue of the requested capacity. Fixed-capacity
+/// forms are only registered for the capacities they were built with.
+/// threadsafe == false limits a queue to the single-thread run.
+template<typename T, typename F>
+void forEachQueue(std::size_t capacity, F&& f) {
+    f("Fifo1", false, [=] { return std::make_unique<Fifo1<T>>(capacity); });
+    f("Fifo2", true, [=] { return std::make_unique<Fifo2<T>>(capacity); });
+    f("Fifo3", true, [=] { return std::make_unique<Fifo3<T>>(capacity); });
+    f("Fifo3/pow2", true, [=] { return std::make_unique<Fifo3<T, std::allocator<T>, PowerOfTwoCapacity>>(capacity); });
+    if (capacity == 1024) {
+        f("Fifo<T,1024>", true, [] { return std::make_unique<Fifo<T, 1024>>(); });
+    }
+    if (capacity == 65536) {
+        f("Fifo<T,65536>", true, [] { return std::make_unique<Fifo<T, 65536>>(); });
+    }
+    f("Fifo3+yield", true, [=] { return std::make_unique<WaitingFifo<Fifo3<T>, SpinYieldWait>>(capacity); });
+    f("Fifo3+futex", true, [=] { return std::make_unique<WaitingFifo<Fifo3<T>, FutexWait>>(capacity); });
+    f("MpscFifo", true, [=] { return std::make_unique<MpscFifo<T>>(capacity); });
+    f("MpmcFifo", true, [=] { return std::make_unique<MpmcFifo<T>>(capacity); });
+}
+
+
+struct Config {
+    int producerCpu = 0;
+    int consumerCpu = 1;
+    std::uint64_t messages = 10'000'000;
+    std::uint64_t roundtrips = 100'000;
+    std::vector<std::size_t> capacities{1024, 65536};
+};
+
+static void pin(int cpu) {
+    if (tryPinCurrentThread(cpu) != 0) {
+        std::fprintf(stderr, "warning: could not pin to cpu %d\n", cpu);
+    }
+}
+
+/// Blocking pop where the queue has one (WaitingFifo), else spin on pop
+template<typename Q, typename T>
+void popSpin(Q& q, T& v) {
+    if constexpr (requires { q.pop_wait(v); }) {
+        q.pop_wait(v);
+    } else {
+        while (not q.pop(v)) {}
+    }
+}
+
+template<typename Q>
+double singleThread(Q& q, std::uint64_t messages) {
+    using T = typename Q::value_type;
+    T in{}, out{};
+    auto batch = std::min<std::uint64_t>(q.capacity(), 256);
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < messages; i += batch) {
+        for (std::uint64_t j = 0; j < batch; ++j) {
+            in.seq = i + j;
+            q.push(in);
+        }
+        for (std::uint64_t j = 0; j < batch; ++j) {
+            q.pop(out);
+        }
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return messages / secs.count();
+}
+
+template<typename Q>
+double throughput(Q& q, Config const& cfg) {
+    using T = typename Q::value_type;
+    std::atomic<bool> go{false};
+    std::thread consumer([&] {
+        pin(cfg.consumerCpu);
+        T v;
+        while (not go.load(std::memory_order_acquire)) {}
+        for (std::uint64_t i = 0; i < cfg.messages; ++i) {
+            popSpin(q, v);
+            if (v.seq != i) {
+                std::fprintf(stderr, "out of order: %lu != %lu\n", (unsigned long)v.seq, (unsigned long)i);
+                std::abort();
+            }
+        }
+    });
+    pin(cfg.producerCpu);
+    T v{};
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::uint64_t i = 0; i < cfg.messages; ++i) {
+        v.seq = i;
+        while (not q.push(v)) {}
+    }
+    consumer.join();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return cfg.messages / secs.count();
+}
+
+/// Power-of-two buckets of round-trip nanoseconds plus exact percentiles
+struct LatencyReport {
+    std::vector<std::uint32_t> samples;
+
+    void print(double nsPerTick) {
+        std::sort(samples.begin(), samples.end());
+        auto ns = [&](double p) {
+            return samples[std::min(samples.size() - 1, std::size_t(p * samples.size()))] * nsPerTick;
+        };
+        std::printf("      rtt p50=%.0fns p99=%.0fns p99.9=%.0fns max=%.0fns\n",
+                    ns(0.5), ns(0.99), ns(0.999), samples.back() * nsPerTick);
+        std::array<std::uint64_t, 32> buckets{};
+        for (auto s : samples) {
+            auto n = static_cast<std::uint64_t>(s * nsPerTick);
+            ++buckets[std::min<int>(31, n ? 64 - __builtin_clzll(n) : 0)];
+        }
+        for (int b = 0; b < 32; ++b) {
+            if (buckets[b] != 0) {
+                std::printf("      < %8lluns %6.2f%%\n", 1ULL << b, 100.0 * buckets[b] / samples.size());
+            }
+        }
+    }
+};
+
+template<typename Q>
+void pingPong(Q& request, Q& response, Config const& cfg, double nsPerTick) {
+    using T = typename Q::value_type;
+    std::thread pong([&] {
+        pin(cfg.consumerCpu);
+        T v;
+        for (std::uint64_t i = 0; i < cfg.roundtrips; ++i) {
+            popSpin(request, v);
+            while (not response.push(v)) {}
+        }
+    });
+    pin(cfg.producerCpu);
+    LatencyReport report;
+    report.samples.reserve(cfg.roundtrips);
+    T v{};
+    for (std::uint64_t i = 0; i < cfg.roundtrips; ++i) {
+        v.seq = i;
+        auto t0 = readTscOrdered();
+        while (not request.push(v)) {}
+        popSpin(response, v);
+        report.samples.push_back(static_cast<std::uint32_t>(std::min<std::uint64_t>(readTscOrdered() - t0, UINT32_MAX)));
+    }
+    pong.join();
+    report.print(nsPerTick);
+}
+
+
+template<std::size_t Bytes>
+void runSize(Config const& cfg, double nsPerTick) {
+    using T = Payload<Bytes>;
+    for (auto capacity : cfg.capacities) {
+        forEachQueue<T>(capacity, [&](char const* name, bool threadsafe, auto factory) {
+            std::printf("%-14s %4zuB cap=%-7zu", name, Bytes, capacity);
+            auto q = factory();
+            std::printf(" single=%7.1fM/s", singleThread(*q, cfg.messages) / 1e6);
+            if (threadsafe) {
+                auto q2 = factory();
+                std::printf(" spsc=%7.1fM/s\n", throughput(*q2, cfg) / 1e6);
+                auto request = factory();
+                auto response = factory();
+                pingPong(*request, *response, cfg, nsPerTick);
+            } else {
+                std::printf("  (not threadsafe)\n");
+            }
+        });
+    }
+}
+
+static std::vector<std::size_t> parseList(char const* s) {
+    std::vector<std::size_t> out;
+    for (char const* p = s; *p;) {
+        out.push_back(std::strtoull(p, const_cast<char**>(&p), 10));
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    Config cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        if (k == "--cpus") {
+            auto cpus = parseList(argv[i + 1]);
+            cfg.producerCpu = int(cpus.at(0));
+            cfg.consumerCpu = int(cpus.at(1));
+        } else if (k == "--messages") {
+            cfg.messages = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (k == "--roundtrips") {
+            cfg.roundtrips = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (k == "--capacities") {
+            cfg.capacities = parseList(argv[i + 1]);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", k.c_str());
+            return 1;
+        }
+    }
+    auto tick = TscClock::nsPerTick();
+    std::printf("producer cpu %d, consumer cpu %d, %.3f ns/tick\n", cfg.producerCpu, cfg.consumerCpu, tick);
+    runSize<8>(cfg, tick);
+    runSize<64>(cfg, tick);
+    runSize<256>(cfg, tick);
+}
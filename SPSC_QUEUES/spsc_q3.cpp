@@ -1,32 +1,120 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
+#include <cstddef>
 #include <memory>
 #include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
 
+#include "../runtime/probe.cpp"
+#include "cache_line.cpp"
 
-/// Threadsafe, efficient circular FIFO
-template<typename T, typename Alloc = std::allocator<T>>
-class Fifo3 : private Alloc
+
+/// Ring capacity policies for Fifo3
+
+/// Capacity as requested; the ring index is cursor % capacity
+struct AnyCapacity {};
+
+/// Capacity rounded up to a power of two; the ring index is a mask
+struct PowerOfTwoCapacity {};
+
+/// Compile-time capacity with the ring stored inline in the fifo
+template<std::size_t N>
+struct FixedCapacity { static_assert(N > 0); };
+
+
+namespace detail {
+
+/// Heap-allocated ring storage and cursor-to-slot mapping
+template<typename T, typename Alloc, typename Capacity>
+class FifoRing : private Alloc
 {
 public:
-    using value_type = T;
     using allocator_traits = std::allocator_traits<Alloc>;
     using size_type = typename allocator_traits::size_type;
+    static constexpr bool masked = std::is_same_v<Capacity, PowerOfTwoCapacity>;
 
-    explicit Fifo3(size_type capacity, Alloc const& alloc = Alloc{})
+    FifoRing(size_type capacity, Alloc const& alloc)
         : Alloc{alloc}
-        , capacity_{capacity}
-        , ring_{allocator_traits::allocate(*this, capacity)}
+        , capacity_{masked ? std::bit_ceil(capacity) : capacity}
+        , ring_{allocator_traits::allocate(*this, capacity_)}
     {}
 
+    FifoRing(FifoRing const&) = delete;
+    FifoRing& operator=(FifoRing const&) = delete;
+
+    ~FifoRing() {
+        allocator_traits::deallocate(*this, ring_, capacity_);
+    }
+
+    auto capacity() const noexcept { return capacity_; }
+
+    size_type offset(size_type cursor) const noexcept {
+        if constexpr (masked) {
+            return cursor & (capacity_ - 1);
+        } else {
+            return cursor % capacity_;
+        }
+    }
+
+    T* element(size_type cursor) noexcept { return &ring_[offset(cursor)]; }
+
+private:
+    size_type capacity_;
+    T* ring_;
+};
+
+/// Inline ring storage; N is a constant so % compiles to a mask or multiply
+template<typename T, typename Alloc, std::size_t N>
+class FifoRing<T, Alloc, FixedCapacity<N>>
+{
+public:
+    using size_type = std::size_t;
+
+    static constexpr auto capacity() noexcept { return size_type{N}; }
+
+    static size_type offset(size_type cursor) noexcept { return cursor % N; }
+
+    T* element(size_type cursor) noexcept {
+        return reinterpret_cast<T*>(storage_ + offset(cursor) * sizeof(T));
+    }
+
+private:
+    alignas(cacheLineSize) alignas(T) std::byte storage_[N * sizeof(T)];
+};
+
+} // namespace detail
+
+
+/// Threadsafe, efficient circular FIFO
+template<typename T, typename Alloc = std::allocator<T>, typename Capacity = AnyCapacity>
+class Fifo3
+{
+    using Ring = detail::FifoRing<T, Alloc, Capacity>;
+    static constexpr bool fixedCapacity = !std::is_same_v<Capacity, AnyCapacity>
+                                       && !std::is_same_v<Capacity, PowerOfTwoCapacity>;
+
+public:
+    using value_type = T;
+    using size_type = typename Ring::size_type;
+
+    /// @param capacity rounded up to a power of two with PowerOfTwoCapacity
+    explicit Fifo3(size_type capacity, Alloc const& alloc = Alloc{}) requires (!fixedCapacity)
+        : ring_{capacity, alloc}
+    {}
+
+    Fifo3() requires fixedCapacity = default;
+
     ~Fifo3() {
         while(not empty()) {
             element(popCursor_)->~T();
             ++popCursor_;
         }
-        allocator_traits::deallocate(*this, ring_, capacity_);
     }
 
 
@@ -46,68 +134,183 @@ public:
     auto full() const noexcept { return size() == capacity(); }
 
     /// Returns the number of elements that can be held in the fifo
-    auto capacity() const noexcept { return capacity_; }
+    auto capacity() const noexcept { return ring_.capacity(); }
 
 
     /// Push one object onto the fifo.
     /// @return `true` if the operation is successful; `false` if fifo is full.
     auto push(T const& value) {
-        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
-        auto popCursor = popCursor_.load(std::memory_order_acquire);
-        if (full(pushCursor, popCursor)) {
-            return false;
-        }
-        new (element(pushCursor)) T(value);
-        pushCursor_.store(pushCursor + 1, std::memory_order_release);
-        return true;
+        LATENCY_PROBE_SCOPE("Fifo3::push");
+        return emplace(value);
     }
 
     /// Pop one object from the fifo.
     /// @return `true` if the pop operation is successful; `false` if fifo is empty.
     auto pop(T& value) {
-        auto pushCursor = pushCursor_.load(std::memory_order_acquire);
         auto popCursor = popCursor_.load(std::memory_order_relaxed);
-        if (empty(pushCursor, popCursor)) {
-            return false;
+        if (empty(cachedPushCursor_, popCursor)) {
+            cachedPushCursor_ = pushCursor_.load(std::memory_order_acquire);
+            if (empty(cachedPushCursor_, popCursor)) {
+                return false;
+            }
         }
-        value = *element(popCursor);
+        value = std::move(*element(popCursor));
         element(popCursor)->~T();
         popCursor_.store(popCursor + 1, std::memory_order_release);
         return true;
     }
 
+    /// Construct one object in place at the back of the fifo.
+    /// @return `true` if the operation is successful; `false` if fifo is full.
+    template<typename... Args>
+    auto emplace(Args&&... args) {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        if (full(pushCursor, cachedPopCursor_)) {
+            cachedPopCursor_ = popCursor_.load(std::memory_order_acquire);
+            if (full(pushCursor, cachedPopCursor_)) {
+                return false;
+            }
+        }
+        new (element(pushCursor)) T(std::forward<Args>(args)...);
+        pushCursor_.store(pushCursor + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Returns the oldest element in place, or nullptr if fifo is empty.
+    /// The element stays valid until the matching pop().
+    T* front() {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        if (empty(cachedPushCursor_, popCursor)) {
+            cachedPushCursor_ = pushCursor_.load(std::memory_order_acquire);
+            if (empty(cachedPushCursor_, popCursor)) {
+                return nullptr;
+            }
+        }
+        return element(popCursor);
+    }
+
+    /// Destroy and release the element returned by front().
+    void pop() {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        assert(not empty(cachedPushCursor_, popCursor));
+        element(popCursor)->~T();
+        popCursor_.store(popCursor + 1, std::memory_order_release);
+    }
+
+    /// Push up to count objects from first, publishing them with one store.
+    /// @return the number of objects pushed.
+    template<typename InputIt>
+    size_type push_n(InputIt first, size_type count) {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        if (free(pushCursor, cachedPopCursor_) < count) {
+            cachedPopCursor_ = popCursor_.load(std::memory_order_acquire);
+        }
+        auto n = std::min(count, free(pushCursor, cachedPopCursor_));
+        for (size_type i = 0; i < n; ++i, ++first) {
+            new (element(pushCursor + i)) T(*first);
+        }
+        if (n != 0) {
+            pushCursor_.store(pushCursor + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    /// Pop up to count objects into out, releasing them with one store.
+    /// @return the number of objects popped.
+    template<typename OutputIt>
+    size_type pop_n(OutputIt out, size_type count) {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        if (cachedPushCursor_ - popCursor < count) {
+            cachedPushCursor_ = pushCursor_.load(std::memory_order_acquire);
+        }
+        auto n = std::min(count, cachedPushCursor_ - popCursor);
+        for (size_type i = 0; i < n; ++i, ++out) {
+            auto e = element(popCursor + i);
+            *out = std::move(*e);
+            e->~T();
+        }
+        if (n != 0) {
+            popCursor_.store(popCursor + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    /// Contiguous uninitialized slots at the back of the fifo, at most count
+    /// and never wrapping. Construct objects in them (or, for trivially
+    /// copyable T, write bytes, e.g. recv() straight in), then commit_write().
+    std::span<T> write_span(size_type count) {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        if (free(pushCursor, cachedPopCursor_) < count) {
+            cachedPopCursor_ = popCursor_.load(std::memory_order_acquire);
+        }
+        auto n = std::min({count, free(pushCursor, cachedPopCursor_), capacity() - ring_.offset(pushCursor)});
+        return {element(pushCursor), n};
+    }
+
+    /// Publish the first count slots of the last write_span().
+    void commit_write(size_type count) {
+        auto pushCursor = pushCursor_.load(std::memory_order_relaxed);
+        assert(count <= free(pushCursor, cachedPopCursor_));
+        pushCursor_.store(pushCursor + count, std::memory_order_release);
+    }
+
+    /// Contiguous readable elements at the front of the fifo, never wrapping.
+    std::span<T> read_span() {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        cachedPushCursor_ = pushCursor_.load(std::memory_order_acquire);
+        auto n = std::min(cachedPushCursor_ - popCursor, capacity() - ring_.offset(popCursor));
+        return {element(popCursor), n};
+    }
+
+    /// Destroy and release the first count elements of the last read_span().
+    void commit_read(size_type count) {
+        auto popCursor = popCursor_.load(std::memory_order_relaxed);
+        assert(count <= cachedPushCursor_ - popCursor);
+        for (size_type i = 0; i < count; ++i) {
+            element(popCursor + i)->~T();
+        }
+        popCursor_.store(popCursor + count, std::memory_order_release);
+    }
+
 private:
+    auto free(size_type pushCursor, size_type popCursor) const noexcept {
+        return capacity() - (pushCursor - popCursor);
+    }
     auto full(size_type pushCursor, size_type popCursor) const noexcept {
-        return (pushCursor - popCursor) == capacity_;
+        return (pushCursor - popCursor) == capacity();
     }
     static auto empty(size_type pushCursor, size_type popCursor) noexcept {
         return pushCursor == popCursor;
     }
     auto element(size_type cursor) noexcept {
-        return &ring_[cursor % capacity_];
+        return ring_.element(cursor);
     }
 
 private:
-    size_type capacity_;
-    T* ring_;
+    Ring ring_;
 
     using CursorType = std::atomic<size_type>;
     static_assert(CursorType::is_always_lock_free);
 
-    // N.B. std::hardware_destructive_interference_size is not used directly
-    // error: use of ‘std::hardware_destructive_interference_size’ [-Werror=interference-size]
-    // note: its value can vary between compiler versions or with different ‘-mtune’ or ‘-mcpu’ flags
-    // note: if this use is part of a public ABI, change it to instead use a constant variable you define
-    // note: the default value for the current CPU tuning is 64 bytes
-    // note: you can stabilize this value with ‘--param hardware_destructive_interference_size=64’, or disable this warning with ‘-Wno-interference-size’
-    static constexpr auto hardware_destructive_interference_size = size_type{64};
-
     /// Loaded and stored by the push thread; loaded by the pop thread
-    alignas(hardware_destructive_interference_size) CursorType pushCursor_;
+    alignas(cacheLineSize) CursorType pushCursor_;
+
+    /// Exclusive to the push thread; refreshed from popCursor_ only when the
+    /// fifo looks full, so pushes don't touch the pop thread's cache line
+    alignas(cacheLineSize) size_type cachedPopCursor_{};
 
     /// Loaded and stored by the pop thread; loaded by the push thread
-    alignas(hardware_destructive_interference_size) CursorType popCursor_;
+    alignas(cacheLineSize) CursorType popCursor_;
+
+    /// Exclusive to the pop thread; refreshed from pushCursor_ only when the
+    /// fifo looks empty
+    alignas(cacheLineSize) size_type cachedPushCursor_{};
 
     // Padding to avoid false sharing with adjacent objects
-    char padding_[hardware_destructive_interference_size - sizeof(size_type)];
+    char padding_[cacheLineSize - sizeof(size_type)];
 };
+
+
+/// Fifo3 with a compile-time capacity and the ring stored inline
+template<typename T, std::size_t N>
+using Fifo = Fifo3<T, std::allocator<T>, FixedCapacity<N>>;
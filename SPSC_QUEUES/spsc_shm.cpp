@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spsc_q3.cpp"
+
+
+/// Where the segment lives. Plain segments are shm_open() names under
+/// /dev/shm; hugepage segments are files on a hugetlbfs mount, since tmpfs
+/// shm objects can't be mapped with MAP_HUGETLB.
+struct ShmOptions {
+    bool hugepages = false;
+    std::string hugetlbfsDir = "/dev/hugepages";
+    std::size_t hugepageSize = std::size_t{2} << 20;
+};
+
+
+/// Cross-process SPSC fifo: a Fifo<T, N> placed in a named shared-memory
+/// segment behind a versioned header. The inline ring makes the queue
+/// position-independent, so each process runs the unchanged Fifo3 cursor
+/// protocol on its own mapping. One process create()s and pushes, another
+/// attach()es and pops.
+template<typename T, std::size_t N>
+class ShmFifo
+{
+public:
+    using Queue = Fifo<T, N>;
+
+    static_assert(std::is_trivially_copyable_v<T>, "elements cross process boundaries as raw bytes");
+    static_assert(std::atomic<std::size_t>::is_always_lock_free, "cursors must be address-free");
+
+    static constexpr std::uint64_t magic = 0x4f46495346484d53;   // "SMHFSIFO"
+    static constexpr std::uint32_t version = 1;
+
+    /// Create and initialise a new segment; fails if name already exists.
+    static ShmFifo create(std::string const& name, ShmOptions const& options = {}) {
+        auto size = segmentSize(options);
+        int fd = openSegment(name, options, O_RDWR | O_CREAT | O_EXCL);
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto err = errno;
+            ::close(fd);
+            unlinkSegment(name, options);
+            throw std::system_error(err, std::generic_category(), "ftruncate " + name);
+        }
+        auto fifo = ShmFifo{map(fd, size, name), size};
+
+        auto& header = fifo.segment_->header;
+        header.magic = magic;
+        header.version = version;
+        header.elementSize = sizeof(T);
+        header.elementAlign = alignof(T);
+        header.capacity = N;
+        header.segmentSize = size;
+        new (&fifo.segment_->queue) Queue{};
+        header.state.store(ready, std::memory_order_release);
+        return fifo;
+    }
+
+    /// Map an existing segment created by a matching ShmFifo<T, N>.
+    static ShmFifo attach(std::string const& name, ShmOptions const& options = {}) {
+        int fd = openSegment(name, options, O_RDWR);
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + name);
+        }
+        auto size = static_cast<std::size_t>(st.st_size);
+        if (size < sizeof(Segment)) {
+            ::close(fd);
+            throw std::runtime_error("shm segment " + name + " is too small");
+        }
+        auto fifo = ShmFifo{map(fd, size, name), size};
+
+        auto const& header = fifo.segment_->header;
+        if (header.state.load(std::memory_order_acquire) != ready) {
+            throw std::runtime_error("shm segment " + name + " is not initialised");
+        }
+        if (header.magic != magic || header.version != version || header.elementSize != sizeof(T)
+            || header.elementAlign != alignof(T) || header.capacity != N || header.segmentSize != size) {
+            throw std::runtime_error("shm segment " + name + " has an incompatible layout");
+        }
+        return fifo;
+    }
+
+    /// Remove the name; existing mappings stay valid until unmapped.
+    static void remove(std::string const& name, ShmOptions const& options = {}) {
+        unlinkSegment(name, options);
+    }
+
+    ShmFifo(ShmFifo&& other) noexcept
+        : segment_{std::exchange(other.segment_, nullptr)}
+        , size_{other.size_}
+    {}
+
+    ShmFifo& operator=(ShmFifo&& other) noexcept {
+        std::swap(segment_, other.segment_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ShmFifo(ShmFifo const&) = delete;
+    ShmFifo& operator=(ShmFifo const&) = delete;
+
+    ~ShmFifo() {
+        if (segment_ != nullptr) {
+            ::munmap(segment_, size_);
+        }
+    }
+
+    Queue& queue() noexcept { return segment_->queue; }
+    Queue* operator->() noexcept { return &segment_->queue; }
+
+private:
+    static constexpr std::uint32_t ready = 1;
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t reserved;
+        std::uint64_t elementSize;
+        std::uint64_t elementAlign;
+        std::uint64_t capacity;
+        std::uint64_t segmentSize;
+
+        /// Set last by the creator; attachers refuse a half-built segment
+        std::atomic<std::uint32_t> state;
+    };
+
+    struct Segment {
+        Header header;
+        alignas(cacheLineSize) Queue queue;
+    };
+
+    ShmFifo(void* segment, std::size_t size) noexcept
+        : segment_{static_cast<Segment*>(segment)}
+        , size_{size}
+    {}
+
+    static std::size_t segmentSize(ShmOptions const& options) {
+        auto size = sizeof(Segment);
+        if (options.hugepages) {
+            size = (size + options.hugepageSize - 1) / options.hugepageSize * options.hugepageSize;
+        }
+        return size;
+    }
+
+    static std::string path(std::string const& name, ShmOptions const& options) {
+        return options.hugepages ? options.hugetlbfsDir + "/" + name : "/" + name;
+    }
+
+    static int openSegment(std::string const& name, ShmOptions const& options, int flags) {
+        int fd = options.hugepages ? ::open(path(name, options).c_str(), flags, 0600)
+                                   : ::shm_open(path(name, options).c_str(), flags, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open shm segment " + name);
+        }
+        return fd;
+    }
+
+    static void unlinkSegment(std::string const& name, ShmOptions const& options) {
+        if (options.hugepages) {
+            ::unlink(path(name, options).c_str());
+        } else {
+            ::shm_unlink(path(name, options).c_str());
+        }
+    }
+
+    /// Map and pre-fault the whole segment, then close fd. Files on hugetlbfs
+    /// are backed by huge pages without any extra mmap flag.
+    static void* map(int fd, std::size_t size, std::string const& name) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        auto err = errno;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw std::system_error(err, std::generic_category(), "mmap " + name);
+        }
+        return p;
+    }
+
+    Segment* segment_;
+    std::size_t size_;
+};
+
+
+#ifdef SPSC_SHM_DEMO
+#include <cstdio>
+#include <sys/wait.h>
+
+int main() {
+    constexpr auto name = "spsc_shm_demo";
+    constexpr long count = 1'000'000;
+    ShmFifo<long, 4096>::remove(name);
+    auto producer = ShmFifo<long, 4096>::create(name);
+
+    if (::fork() == 0) {
+        auto consumer = ShmFifo<long, 4096>::attach(name);
+        long expected = 0, value;
+        while (expected < count) {
+            if (consumer->pop(value)) {
+                if (value != expected) {
+                    std::printf("out of order: %ld != %ld\n", value, expected);
+                    return 1;
+                }
+                ++expected;
+            }
+        }
+        return 0;
+    }
+
+    for (long i = 0; i < count;) {
+        if (producer->push(i)) {
+            ++i;
+        }
+    }
+    int status = 0;
+    ::wait(&status);
+    ShmFifo<long, 4096>::remove(name);
+    std::printf("child %s after %ld messages\n", status == 0 ? "ok" : "failed", count);
+    return status;
+}
+#endif
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "cache_line.cpp"
+
+
+/// Hint to the core that we are in a spin loop
+inline void cpuRelax() noexcept {
+#if defined(__x86_64__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+
+/// Wait strategies for WaitingFifo.
+///
+/// wait(ready) returns once ready() returns true; ready is retried and may
+/// have side effects (WaitingFifo passes a pop attempt). notify() is called by
+/// the producer after every successful push.
+
+/// Busy-spin with pause: lowest latency, burns the consumer core
+struct SpinWait {
+    template<typename Ready>
+    void wait(Ready&& ready) noexcept(noexcept(ready())) {
+        while (not ready()) {
+            cpuRelax();
+        }
+    }
+
+    void notify() noexcept {}
+};
+
+/// Spin for a while, then yield the core between attempts
+struct SpinYieldWait {
+    explicit SpinYieldWait(unsigned spins = 1024) noexcept : spins_{spins} {}
+
+    template<typename Ready>
+    void wait(Ready&& ready) noexcept(noexcept(ready())) {
+        for (unsigned i = 0; i < spins_; ++i) {
+            if (ready()) {
+                return;
+            }
+            cpuRelax();
+        }
+        while (not ready()) {
+            std::this_thread::yield();
+        }
+    }
+
+    void notify() noexcept {}
+
+private:
+    unsigned spins_;
+};
+
+/// Spin for a while, then sleep on a futex. The consumer raises sleeping_
+/// before its last check; the producer only bumps epoch_ and makes the wake
+/// syscall when it sees the flag, so a push costs a fence and a load while
+/// the consumer is awake. The seq_cst fences on both sides make sure either
+/// the consumer's last check sees the push or the producer sees the flag.
+///
+/// The futex is process-private; don't use it for a queue in shared memory.
+class FutexWait
+{
+public:
+    explicit FutexWait(unsigned spins = 4096) noexcept : spins_{spins} {}
+
+    /// Copies the configuration only, so a strategy can be handed to WaitingFifo
+    FutexWait(FutexWait const& other) noexcept : spins_{other.spins_} {}
+
+    template<typename Ready>
+    void wait(Ready&& ready) noexcept(noexcept(ready())) {
+        for (unsigned i = 0; i < spins_; ++i) {
+            if (ready()) {
+                return;
+            }
+            cpuRelax();
+        }
+        for (;;) {
+            auto epoch = epoch_.load(std::memory_order_relaxed);
+            sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                sleeping_.store(false, std::memory_order_relaxed);
+                return;
+            }
+            futex(FUTEX_WAIT_PRIVATE, epoch);
+            sleeping_.store(false, std::memory_order_relaxed);
+            if (ready()) {
+                return;
+            }
+        }
+    }
+
+    void notify() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed)) {
+            epoch_.fetch_add(1, std::memory_order_relaxed);
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
+
+private:
+    void futex(int op, std::uint32_t value) noexcept {
+        static_assert(sizeof(epoch_) == sizeof(std::uint32_t));
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch_), op, value, nullptr, nullptr, 0);
+    }
+
+    unsigned spins_;
+
+    /// Written by the consumer; read by the producer on every notify
+    alignas(cacheLineSize) std::atomic<bool> sleeping_{false};
+
+    /// Futex word; bumped by the producer only to wake a sleeper
+    alignas(cacheLineSize) std::atomic<std::uint32_t> epoch_{0};
+};
+
+
+/// Adds a blocking pop_wait() to an unchanged single-consumer fifo (Fifo3,
+/// Fifo, MpscFifo, ...). push/emplace notify the wait strategy; pop stays
+/// non-blocking. close() releases a consumer blocked on an empty fifo.
+template<typename Queue, typename Wait = SpinWait>
+class WaitingFifo
+{
+public:
+    using value_type = typename Queue::value_type;
+    using size_type = typename Queue::size_type;
+
+    template<typename... Args>
+    explicit WaitingFifo(Wait wait, Args&&... args)
+        : queue_(std::forward<Args>(args)...)
+        , wait_{std::move(wait)}
+    {}
+
+    template<typename... Args>
+    explicit WaitingFifo(Args&&... args) requires std::is_default_constructible_v<Wait>
+        : queue_(std::forward<Args>(args)...)
+    {}
+
+    auto size() const noexcept { return queue_.size(); }
+    auto empty() const noexcept { return queue_.empty(); }
+    auto capacity() const noexcept { return queue_.capacity(); }
+
+    /// Push one object and wake the consumer if it is waiting.
+    /// @return `true` if the operation is successful; `false` if fifo is full.
+    auto push(value_type const& value) {
+        return emplace(value);
+    }
+
+    /// Construct one object in place and wake the consumer if it is waiting.
+    /// @return `true` if the operation is successful; `false` if fifo is full.
+    template<typename... Args>
+    auto emplace(Args&&... args) {
+        if (not queue_.emplace(std::forward<Args>(args)...)) {
+            return false;
+        }
+        wait_.notify();
+        return true;
+    }
+
+    /// Non-blocking pop, as in the underlying fifo.
+    auto pop(value_type& value) {
+        return queue_.pop(value);
+    }
+
+    /// Pop one object, waiting with the strategy while the fifo is empty.
+    /// @return `true` if an object was popped; `false` once the fifo is
+    /// closed and drained.
+    bool pop_wait(value_type& value) {
+        bool popped = false;
+        wait_.wait([&] {
+            popped = queue_.pop(value);
+            return popped || closed_.load(std::memory_order_acquire);
+        });
+        // Pushes made before close() are still delivered
+        return popped || queue_.pop(value);
+    }
+
+    /// Stop waiting consumers; called by the producer after its last push.
+    void close() noexcept {
+        closed_.store(true, std::memory_order_release);
+        wait_.notify();
+    }
+
+    Queue& queue() noexcept { return queue_; }
+
+private:
+    Queue queue_;
+    Wait wait_;
+    std::atomic<bool> closed_{false};
+};
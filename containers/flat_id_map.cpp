@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+/// Open-addressing map from 64-bit ids to a small value, stored inline as
+/// packed {key, value} slots. Linear probing over a power-of-two table with
+/// backward-shift deletion, so erase never leaves tombstones and probe chains
+/// stay as short as the load allows.
+///
+/// The key ~0 is reserved to mark empty slots. Call reserve() at startup with
+/// the session's maximum live count: the table never rehashes below that.
+template<typename V, typename Alloc = std::allocator<V>>
+class FlatIdMap
+{
+public:
+    using key_type = std::uint64_t;
+    using mapped_type = V;
+    static constexpr key_type emptyKey = ~key_type{0};
+
+    struct Slot {
+        key_type key;
+        V value;
+    };
+
+private:
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+    using allocator_traits = std::allocator_traits<SlotAlloc>;
+
+public:
+    using size_type = typename allocator_traits::size_type;
+
+    explicit FlatIdMap(Alloc const& alloc = Alloc{})
+        : alloc_{alloc}
+    {}
+
+    explicit FlatIdMap(size_type expected, Alloc const& alloc = Alloc{})
+        : alloc_{alloc}
+    {
+        reserve(expected);
+    }
+
+    FlatIdMap(FlatIdMap const&) = delete;
+    FlatIdMap& operator=(FlatIdMap const&) = delete;
+
+    ~FlatIdMap() {
+        release();
+    }
+
+    /// Size the table so that expected entries fit under the maximum load.
+    /// Only grows; existing entries are rehashed once.
+    void reserve(size_type expected) {
+        size_type capacity = 16;
+        while (capacity * maxLoadNum < expected * maxLoadDen) {
+            capacity *= 2;
+        }
+        if (capacity > capacity_) {
+            rehash(capacity);
+        }
+    }
+
+    /// Returns the number of entries
+    auto size() const noexcept { return size_; }
+
+    /// Returns whether the map has no entries
+    auto empty() const noexcept { return size_ == 0; }
+
+    /// Returns the number of slots in the table
+    auto capacity() const noexcept { return capacity_; }
+
+    /// Number of times an insert outgrew the reserved capacity
+    auto rehashes() const noexcept { return rehashes_; }
+
+    /// Returns a pointer to the value for key, or nullptr.
+    V* find(key_type key) noexcept {
+        if (capacity_ == 0) {
+            return nullptr;
+        }
+        for (auto i = home(key);; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) {
+                return &slots_[i].value;
+            }
+            if (slots_[i].key == emptyKey) {
+                return nullptr;
+            }
+        }
+    }
+
+    V const* find(key_type key) const noexcept {
+        return const_cast<FlatIdMap*>(this)->find(key);
+    }
+
+    bool contains(key_type key) const noexcept { return find(key) != nullptr; }
+
+    /// Pull key's home slot into cache ahead of a find, insert or erase.
+    void prefetch(key_type key) const noexcept {
+        if (capacity_ != 0) {
+            __builtin_prefetch(&slots_[home(key)]);
+        }
+    }
+
+    /// Insert key -> value unless key is present.
+    /// @return pointer to the stored value and whether it was inserted.
+    std::pair<V*, bool> try_emplace(key_type key, V const& value) {
+        assert(key != emptyKey);
+        if ((size_ + 1) * maxLoadDen > capacity_ * maxLoadNum) {
+            rehashes_ += capacity_ != 0;
+            rehash(capacity_ ? capacity_ * 2 : 16);
+        }
+        auto i = home(key);
+        for (; slots_[i].key != emptyKey; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) {
+                return {&slots_[i].value, false};
+            }
+        }
+        new (&slots_[i]) Slot{key, value};
+        ++size_;
+        return {&slots_[i].value, true};
+    }
+
+    /// Remove key, shifting the rest of its probe chain back one slot.
+    /// @return `true` if key was present.
+    bool erase(key_type key) noexcept {
+        if (capacity_ == 0) {
+            return false;
+        }
+        auto i = home(key);
+        for (; slots_[i].key != key; i = (i + 1) & mask_) {
+            if (slots_[i].key == emptyKey) {
+                return false;
+            }
+        }
+        for (auto j = (i + 1) & mask_; slots_[j].key != emptyKey; j = (j + 1) & mask_) {
+            // Entry at j moves into the hole at i unless its home lies cyclically in (i, j]
+            if (((j - home(slots_[j].key)) & mask_) >= ((j - i) & mask_)) {
+                slots_[i] = std::move(slots_[j]);
+                i = j;
+            }
+        }
+        slots_[i].key = emptyKey;
+        --size_;
+        return true;
+    }
+
+    /// Visit every entry as f(key, value).
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_type i = 0; i < capacity_; ++i) {
+            if (slots_[i].key != emptyKey) {
+                f(slots_[i].key, slots_[i].value);
+            }
+        }
+    }
+
+private:
+    // 7/8 is comfortable for linear probing with backward-shift deletion
+    static constexpr size_type maxLoadNum = 7;
+    static constexpr size_type maxLoadDen = 8;
+
+    size_type home(key_type key) const noexcept {
+        // Fibonacci hashing spreads dense, sequential ids across the table
+        return static_cast<size_type>((key * 0x9E3779B97F4A7C15ULL) >> shift_);
+    }
+
+    void rehash(size_type capacity) {
+        auto oldSlots = slots_;
+        auto oldCapacity = capacity_;
+
+        slots_ = allocator_traits::allocate(alloc_, capacity);
+        for (size_type i = 0; i < capacity; ++i) {
+            slots_[i].key = emptyKey;
+        }
+        capacity_ = capacity;
+        mask_ = capacity - 1;
+        shift_ = 64 - __builtin_ctzll(capacity);
+        size_ = 0;
+
+        for (size_type i = 0; i < oldCapacity; ++i) {
+            if (oldSlots[i].key != emptyKey) {
+                auto j = home(oldSlots[i].key);
+                while (slots_[j].key != emptyKey) {
+                    j = (j + 1) & mask_;
+                }
+                new (&slots_[j]) Slot{oldSlots[i].key, std::move(oldSlots[i].value)};
+                ++size_;
+            }
+        }
+        if (oldSlots) {
+            allocator_traits::deallocate(alloc_, oldSlots, oldCapacity);
+        }
+    }
+
+    void release() noexcept {
+        if (slots_) {
+            allocator_traits::deallocate(alloc_, slots_, capacity_);
+        }
+    }
+
+    static_assert(std::is_trivially_copyable_v<V>, "values are moved with plain stores");
+
+    SlotAlloc alloc_;
+    Slot* slots_{};
+    size_type capacity_{};
+    size_type mask_{};
+    unsigned shift_{64};
+    size_type size_{};
+    size_type rehashes_{};
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/// Direct-mapped map from 64-bit ids to a small value, for venues that hand
+/// out order ids densely. The id's high bits pick a page from a directory and
+/// its low bits pick the slot, so a lookup is two dependent loads with no
+/// hash and no probe. Drop-in for FlatIdMap where ids are dense.
+///
+/// Pages of pageSize slots are allocated the first time an id lands in them
+/// and recycled through a spare list once their last entry is erased. The
+/// directory covers a window of pages from the lowest page in use; when ids
+/// move past its end, empty pages at its front are dropped first, so the
+/// window slides forward with the live ids. A session whose ids march forward
+/// therefore keeps a bounded set of pages and, once reserve() has sized them
+/// and the directory for the live id span, does no allocation in steady state.
+///
+/// The window is at most maxPages wide (4G ids by default): an id that would
+/// stretch the span between the lowest and highest live page beyond it throws
+/// std::length_error, as that feed's ids are too sparse for direct mapping.
+template<typename V, typename Alloc = std::allocator<V>>
+class PagedIdMap
+{
+public:
+    using key_type = std::uint64_t;
+    using mapped_type = V;
+    using size_type = std::size_t;
+
+    static constexpr size_type pageBits = 12;
+    static constexpr size_type pageSize = size_type{1} << pageBits;
+    static constexpr size_type defaultMaxPages = size_type{1} << 20;
+
+private:
+    struct Page {
+        V values[pageSize];
+        std::uint64_t occupied[pageSize / 64];
+        size_type live;
+
+        bool test(size_type i) const noexcept { return occupied[i >> 6] >> (i & 63) & 1; }
+    };
+
+    using PageAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Page>;
+    using PageTraits = std::allocator_traits<PageAlloc>;
+    using DirectoryAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Page*>;
+
+public:
+    explicit PagedIdMap(Alloc const& alloc = Alloc{})
+        : PagedIdMap{defaultMaxPages, alloc}
+    {}
+
+    PagedIdMap(size_type maxPages, Alloc const& alloc)
+        : pageAlloc_{alloc}, directory_{DirectoryAlloc{alloc}}, spare_{DirectoryAlloc{alloc}}, maxPages_{maxPages}
+    {}
+
+    PagedIdMap(PagedIdMap const&) = delete;
+    PagedIdMap& operator=(PagedIdMap const&) = delete;
+
+    ~PagedIdMap() {
+        for (auto* page : directory_) {
+            if (page) {
+                PageTraits::deallocate(pageAlloc_, page, 1);
+            }
+        }
+        for (auto* page : spare_) {
+            PageTraits::deallocate(pageAlloc_, page, 1);
+        }
+    }
+
+    /// Allocate enough pages, and directory slots, up front for expected live
+    /// entries spread over a window of ids a little wider than expected.
+    void reserve(size_type expected) {
+        auto pages = (expected + pageSize - 1) / pageSize + 2;
+        directory_.reserve(pages);
+        spare_.reserve(pages);
+        while (pages_ < pages) {
+            spare_.push_back(newPage());
+        }
+    }
+
+    /// Returns the number of entries
+    auto size() const noexcept { return size_; }
+
+    /// Returns whether the map has no entries
+    auto empty() const noexcept { return size_ == 0; }
+
+    /// Pages allocated so far, in use or spare
+    auto pages() const noexcept { return pages_; }
+
+    /// Returns a pointer to the value for key, or nullptr.
+    V* find(key_type key) noexcept {
+        auto* page = pageFor(key);
+        if (page == nullptr) {
+            return nullptr;
+        }
+        auto i = key & slotMask;
+        return page->test(i) ? &page->values[i] : nullptr;
+    }
+
+    V const* find(key_type key) const noexcept {
+        return const_cast<PagedIdMap*>(this)->find(key);
+    }
+
+    bool contains(key_type key) const noexcept { return find(key) != nullptr; }
+
+    /// Pull key's slot into cache ahead of a find, insert or erase.
+    void prefetch(key_type key) const noexcept {
+        if (auto* page = pageFor(key)) {
+            __builtin_prefetch(&page->values[key & slotMask]);
+        }
+    }
+
+    /// Insert key -> value unless key is present.
+    /// @return pointer to the stored value and whether it was inserted.
+    std::pair<V*, bool> try_emplace(key_type key, V const& value) {
+        auto* page = pageFor(key);
+        if (page == nullptr) [[unlikely]] {
+            page = addPage(key >> pageBits);
+        }
+        auto i = key & slotMask;
+        if (page->test(i)) {
+            return {&page->values[i], false};
+        }
+        page->occupied[i >> 6] |= std::uint64_t{1} << (i & 63);
+        page->values[i] = value;
+        ++page->live;
+        ++size_;
+        return {&page->values[i], true};
+    }
+
+    /// Remove key; a page left empty goes back to the spare list.
+    /// @return `true` if key was present.
+    bool erase(key_type key) noexcept {
+        auto index = (key >> pageBits) - firstPage_;
+        if (index >= directory_.size() || directory_[index] == nullptr) {
+            return false;
+        }
+        auto* page = directory_[index];
+        auto i = key & slotMask;
+        if (!page->test(i)) {
+            return false;
+        }
+        page->occupied[i >> 6] &= ~(std::uint64_t{1} << (i & 63));
+        --size_;
+        if (--page->live == 0) {
+            // Bitmap is already clear, so the page is ready for reuse as is
+            directory_[index] = nullptr;
+            spare_.push_back(page);     // capacity reserved in newPage()
+        }
+        return true;
+    }
+
+    /// Visit every entry as f(key, value).
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_type p = 0; p < directory_.size(); ++p) {
+            if (auto* page = directory_[p]) {
+                for (size_type i = 0; i < pageSize; ++i) {
+                    if (page->test(i)) {
+                        f(((firstPage_ + p) << pageBits) | i, page->values[i]);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr key_type slotMask = pageSize - 1;
+
+    Page* pageFor(key_type key) const noexcept {
+        // Pages below firstPage_ wrap to huge indices and miss
+        auto index = (key >> pageBits) - firstPage_;
+        return index < directory_.size() ? directory_[index] : nullptr;
+    }
+
+    Page* addPage(key_type pageNo) {
+        if (directory_.empty()) {
+            firstPage_ = pageNo;
+        }
+        if (pageNo < firstPage_) {
+            auto shift = firstPage_ - pageNo;
+            checkSpan(directory_.size() + shift);
+            directory_.insert(directory_.begin(), shift, nullptr);
+            firstPage_ = pageNo;
+        } else if (pageNo - firstPage_ >= directory_.size()) {
+            slide(pageNo);
+            checkSpan(pageNo - firstPage_ + 1);
+            directory_.resize(pageNo - firstPage_ + 1, nullptr);
+        }
+        Page* page;
+        if (!spare_.empty()) {
+            page = spare_.back();
+            spare_.pop_back();
+        } else {
+            page = newPage();
+        }
+        directory_[pageNo - firstPage_] = page;
+        return page;
+    }
+
+    /// Drop the empty pages at the front of the directory, so ids marching
+    /// forward reuse its slots instead of growing it.
+    void slide(key_type pageNo) noexcept {
+        auto lead = std::find_if(directory_.begin(), directory_.end(), [](Page* p) { return p != nullptr; });
+        firstPage_ = lead == directory_.end() ? pageNo : firstPage_ + (lead - directory_.begin());
+        directory_.erase(directory_.begin(), lead);
+    }
+
+    void checkSpan(size_type pages) const {
+        if (pages > maxPages_) {
+            throw std::length_error("PagedIdMap: ids too sparse for the directory window");
+        }
+    }
+
+    Page* newPage() {
+        // Room to park every page on the spare list, so erase never allocates
+        spare_.reserve(pages_ + 1);
+        auto* page = PageTraits::allocate(pageAlloc_, 1);
+        new (page) Page;
+        std::memset(page->occupied, 0, sizeof(page->occupied));
+        page->live = 0;
+        ++pages_;
+        return page;
+    }
+
+    static_assert(std::is_trivially_copyable_v<V>, "values are stored with plain stores");
+    static_assert(std::is_trivially_destructible_v<Page>, "pages are freed without destruction");
+
+    PageAlloc pageAlloc_;
+    std::vector<Page*, DirectoryAlloc> directory_;
+    std::vector<Page*, DirectoryAlloc> spare_;
+    key_type firstPage_{};
+    size_type maxPages_;
+    size_type pages_{};
+    size_type size_{};
+};
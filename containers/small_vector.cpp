@@ -0,0 +1,387 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+/// Types whose objects can be moved to a new address with memcpy, leaving
+/// nothing to destroy at the old one. Every trivially copyable type is; a
+/// type that merely owns a pointer (a unique_ptr-like handle, say) can opt in
+/// by specializing this.
+template<typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {};
+
+
+/// Vector with the first N elements stored inline, so the common small case
+/// never touches the allocator. Past N it grows onto Alloc by doubling, and
+/// relocates on growth with one memcpy when T is trivially relocatable
+/// (moving element by element otherwise).
+///
+///     SmallVector<PriceLevel, 16> bids, asks;   // depth 10 snapshot: no heap
+///     book.get_snapshot(10, bids, asks);
+///
+/// Iterators and references are invalidated by growth and, unlike
+/// std::vector, by moving the container while it is inline.
+template<typename T, std::size_t N, typename Alloc = std::allocator<T>>
+class SmallVector
+{
+    static_assert(N > 0, "use std::vector for no inline capacity");
+
+    using AllocTraits = std::allocator_traits<Alloc>;
+
+public:
+    using value_type = T;
+    using allocator_type = Alloc;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = T const&;
+    using pointer = T*;
+    using const_pointer = T const*;
+    using iterator = T*;
+    using const_iterator = T const*;
+
+    static constexpr size_type inlineCapacity = N;
+
+    SmallVector() noexcept(noexcept(Alloc{})) : alloc_{} {}
+
+    explicit SmallVector(Alloc const& alloc) noexcept : alloc_{alloc} {}
+
+    explicit SmallVector(size_type count, T const& value = T{}, Alloc const& alloc = Alloc{})
+        : alloc_{alloc}
+    {
+        resize(count, value);
+    }
+
+    SmallVector(std::initializer_list<T> init, Alloc const& alloc = Alloc{})
+        : alloc_{alloc}
+    {
+        append(init.begin(), init.end());
+    }
+
+    SmallVector(SmallVector const& other)
+        : alloc_{AllocTraits::select_on_container_copy_construction(other.alloc_)}
+    {
+        append(other.begin(), other.end());
+    }
+
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        : alloc_{std::move(other.alloc_)}
+    {
+        takeFrom(other);
+    }
+
+    SmallVector& operator=(SmallVector const& other) {
+        if (this != &other) {
+            if constexpr (AllocTraits::propagate_on_container_copy_assignment::value) {
+                if (alloc_ != other.alloc_) {
+                    clear();
+                    release();
+                }
+                alloc_ = other.alloc_;
+            }
+            clear();
+            append(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        if (other.isInline() || !(AllocTraits::propagate_on_container_move_assignment::value || alloc_ == other.alloc_)) {
+            // Nothing to steal: move the elements across into our own storage
+            reserve(other.size_);
+            relocate(other.data_, other.size_, data_);
+            size_ = std::exchange(other.size_, 0);
+            return *this;
+        }
+        release();
+        if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+            alloc_ = std::move(other.alloc_);
+        }
+        takeFrom(other);
+        return *this;
+    }
+
+    ~SmallVector() {
+        clear();
+        release();
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == capacity_) [[unlikely]] {
+            return growAndEmplace(std::forward<Args>(args)...);
+        }
+        AllocTraits::construct(alloc_, data_ + size_, std::forward<Args>(args)...);
+        return data_[size_++];
+    }
+
+    void push_back(T const& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() noexcept { AllocTraits::destroy(alloc_, data_ + --size_); }
+
+    void clear() noexcept {
+        destroy(data_, size_);
+        size_ = 0;
+    }
+
+    /// Only grows; a heap buffer is never handed back before destruction.
+    void reserve(size_type capacity) {
+        if (capacity > capacity_) {
+            reallocate(capacity);
+        }
+    }
+
+    void resize(size_type count) { resizeWith(count); }
+    void resize(size_type count, T const& value) { resizeWith(count, value); }
+
+    /// Append [first, last), which must not point into this vector.
+    template<typename It>
+    void append(It first, It last) {
+        reserve(size_ + static_cast<size_type>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            AllocTraits::construct(alloc_, data_ + size_, *first);
+            ++size_;
+        }
+    }
+
+    T& operator[](size_type i) noexcept { return data_[i]; }
+    T const& operator[](size_type i) const noexcept { return data_[i]; }
+    T& front() noexcept { return data_[0]; }
+    T const& front() const noexcept { return data_[0]; }
+    T& back() noexcept { return data_[size_ - 1]; }
+    T const& back() const noexcept { return data_[size_ - 1]; }
+
+    T* data() noexcept { return data_; }
+    T const* data() const noexcept { return data_; }
+    iterator begin() noexcept { return data_; }
+    iterator end() noexcept { return data_ + size_; }
+    const_iterator begin() const noexcept { return data_; }
+    const_iterator end() const noexcept { return data_ + size_; }
+
+    size_type size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    size_type capacity() const noexcept { return capacity_; }
+    /// Whether the elements are still in the inline buffer
+    bool isInline() const noexcept { return data_ == inlineData(); }
+
+    allocator_type get_allocator() const noexcept { return alloc_; }
+
+private:
+    static constexpr bool relocatable = IsTriviallyRelocatable<T>::value;
+
+    T* inlineData() noexcept { return reinterpret_cast<T*>(inline_); }
+    T const* inlineData() const noexcept { return reinterpret_cast<T const*>(inline_); }
+
+    void destroy(T* first, size_type count) noexcept {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_type i = 0; i < count; ++i) {
+                AllocTraits::destroy(alloc_, first + i);
+            }
+        }
+    }
+
+    /// Move count elements from src into uninitialised dst and end the
+    /// lifetime of the originals. On a throwing copy dst is cleaned up and src
+    /// is left intact.
+    void relocate(T* src, size_type count, T* dst) {
+        if constexpr (relocatable) {
+            if (count != 0) {
+                std::memcpy(static_cast<void*>(dst), static_cast<void const*>(src), count * sizeof(T));
+            }
+        } else {
+            size_type i = 0;
+            try {
+                for (; i < count; ++i) {
+                    AllocTraits::construct(alloc_, dst + i, std::move_if_noexcept(src[i]));
+                }
+            } catch (...) {
+                destroy(dst, i);
+                throw;
+            }
+            destroy(src, count);
+        }
+    }
+
+    size_type grownCapacity(size_type atLeast) const noexcept { return std::max(capacity_ * 2, atLeast); }
+
+    void reallocate(size_type capacity) {
+        T* fresh = AllocTraits::allocate(alloc_, capacity);
+        try {
+            relocate(data_, size_, fresh);
+        } catch (...) {
+            AllocTraits::deallocate(alloc_, fresh, capacity);
+            throw;
+        }
+        release();
+        data_ = fresh;
+        capacity_ = capacity;
+    }
+
+    /// Builds the new element before relocating, so args may refer to an
+    /// existing element.
+    template<typename... Args>
+    T& growAndEmplace(Args&&... args) {
+        auto capacity = grownCapacity(size_ + 1);
+        T* fresh = AllocTraits::allocate(alloc_, capacity);
+        try {
+            AllocTraits::construct(alloc_, fresh + size_, std::forward<Args>(args)...);
+        } catch (...) {
+            AllocTraits::deallocate(alloc_, fresh, capacity);
+            throw;
+        }
+        try {
+            relocate(data_, size_, fresh);
+        } catch (...) {
+            AllocTraits::destroy(alloc_, fresh + size_);
+            AllocTraits::deallocate(alloc_, fresh, capacity);
+            throw;
+        }
+        release();
+        data_ = fresh;
+        capacity_ = capacity;
+        return data_[size_++];
+    }
+
+    template<typename... Value>
+    void resizeWith(size_type count, Value const&... value) {
+        if (count < size_) {
+            destroy(data_ + count, size_ - count);
+            size_ = count;
+            return;
+        }
+        if (count > capacity_) {
+            reallocate(grownCapacity(count));
+        }
+        for (; size_ < count; ++size_) {
+            AllocTraits::construct(alloc_, data_ + size_, value...);
+        }
+    }
+
+    /// Adopt other's elements; alloc_ already compares equal to other's.
+    void takeFrom(SmallVector& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (other.isInline()) {
+            relocate(other.data_, other.size_, data_);
+        } else {
+            data_ = other.data_;
+            capacity_ = other.capacity_;
+            other.data_ = other.inlineData();
+            other.capacity_ = N;
+        }
+        size_ = std::exchange(other.size_, 0);
+    }
+
+    /// Free a heap buffer (elements already destroyed) and go back inline.
+    void release() noexcept {
+        if (!isInline()) {
+            AllocTraits::deallocate(alloc_, data_, capacity_);
+            data_ = inlineData();
+            capacity_ = N;
+        }
+    }
+
+    [[no_unique_address]] Alloc alloc_;
+    T* data_{inlineData()};
+    size_type size_{};
+    size_type capacity_{N};
+    alignas(T) std::byte inline_[N * sizeof(T)];
+};
+
+
+/// SmallVector on any pmr resource, e.g. a pool over an ArenaResource.
+template<typename T, std::size_t N>
+using PmrSmallVector = SmallVector<T, N, std::pmr::polymorphic_allocator<T>>;
+
+
+#ifdef SMALL_VECTOR_DEMO
+// g++ -std=c++20 -O2 -march=native -DSMALL_VECTOR_DEMO -x c++ small_vector.cpp -o small_vector
+#define ALLOC_TRACKING
+#include "../memory/alloc_tracking.cpp"
+#include "../memory/arena.cpp"
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct Fill { std::uint64_t restingId; std::int64_t price; std::uint64_t quantity; };
+
+template<typename V>
+double perMessageNs(int messages) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t sink = 0;
+    for (int m = 0; m < messages; ++m) {
+        V fills;
+        for (int i = 0; i < 1 + m % 6; ++i) {
+            fills.push_back(Fill{std::uint64_t(i), m, std::uint64_t(i + 1)});
+        }
+        sink += fills.back().quantity;
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    assert(sink != 0);
+    return ns / messages;
+}
+
+int main() {
+    // Inline: no heap at all
+    {
+        SmallVector<Fill, 8> fills;
+        auto before = alloc_tracking::counts().allocations;
+        for (int i = 0; i < 8; ++i) {
+            fills.push_back({std::uint64_t(i), 100, 1});
+        }
+        assert(fills.isInline() && alloc_tracking::counts().allocations == before);
+        fills.push_back({8, 100, 1});                 // spills: one memcpy onto the heap
+        assert(!fills.isInline() && fills.size() == 9 && fills[8].restingId == 8);
+        assert(alloc_tracking::counts().allocations == before + 1);
+    }
+
+    // Non-trivial elements relocate by move, including a self-referencing push
+    {
+        SmallVector<std::string, 2> names{"alpha", "beta"};
+        names.push_back(names[0]);
+        names.emplace_back(40, 'x');
+        assert(names.size() == 4 && names[2] == "alpha" && names[3].size() == 40);
+        SmallVector<std::string, 2> moved{std::move(names)};
+        assert(names.empty() && moved[1] == "beta");
+        SmallVector<std::string, 2> small{"a"}, copy{small};
+        small = std::move(moved);
+        assert(small.size() == 4 && copy[0] == "a");
+        copy.resize(3, "z");
+        assert(copy.size() == 3 && copy[2] == "z");
+        copy.resize(1);
+        assert(copy.size() == 1);
+    }
+
+    // pmr: growth draws from an arena
+    {
+        Arena arena(1 << 20, {.hugePages = false, .prefault = false});
+        ArenaResource resource{arena};
+        PmrSmallVector<Fill, 4> fills{&resource};
+        for (int i = 0; i < 100; ++i) {
+            fills.push_back({std::uint64_t(i), 0, 0});
+        }
+        assert(!fills.isInline() && arena.used() >= 100 * sizeof(Fill));
+    }
+
+    constexpr int messages = 2'000'000;
+    auto small = perMessageNs<SmallVector<Fill, 8>>(messages);
+    auto heap = perMessageNs<std::vector<Fill>>(messages);
+    std::printf("per-message fill list (1-6 fills): SmallVector %.1f ns, std::vector %.1f ns\n", small, heap);
+    std::printf("ok\n");
+}
+#endif
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "wire_format.cpp"
+
+
+/// Which redundant line a message arrived on
+enum class Line : std::uint8_t { A, B };
+
+
+/// Lock-free record of which recent sequence numbers have been taken. Slot
+/// seq % size holds the newest sequence claimed there; claim() wins for the
+/// first caller with a sequence newer than the slot's, so two line threads
+/// can both call it and each sequence is taken exactly once while it is
+/// within size of the newest.
+template<std::size_t size>
+class DedupWindow
+{
+    static_assert(std::has_single_bit(size));
+
+public:
+    DedupWindow() : slots_{std::make_unique<std::atomic<std::uint64_t>[]>(size)} {}
+
+    /// @return `true` for the first copy of seq; `false` for a duplicate or a
+    /// sequence that has fallen out of the window (seq must be non-zero).
+    bool claim(std::uint64_t seq) noexcept {
+        auto& slot = slots_[seq & (size - 1)];
+        auto seen = slot.load(std::memory_order_relaxed);
+        while (seen < seq) {
+            if (slot.compare_exchange_weak(seen, seq, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slots_;
+};
+
+
+struct ArbitratorStats {
+    std::uint64_t delivered = 0;
+    std::uint64_t duplicates = 0;
+    std::uint64_t firstFrom[2] = {};   // delivered copies by line
+    std::uint64_t reordered = 0;       // held until a gap closed
+    std::uint64_t gapsOpened = 0;
+    std::uint64_t gapsRecovered = 0;   // handed to the recovery callback
+    std::uint64_t lost = 0;            // sequences inside those gaps
+};
+
+/// A/B arbitration over the wire format's sequence numbers.
+///
+/// Both lines feed onMessage() from one thread (typically one poll loop over
+/// two feed handlers). The first copy of each sequence wins; messages are
+/// handed to sink in sequence order. The happy path -- the next expected
+/// sequence, in place in the receive buffer -- is a compare and one
+/// uncontended CAS on the dedup window before the sink call.
+///
+/// A sequence ahead of the expected one opens a gap: it is copied into a
+/// reorder slot while the other line gets a chance to fill the gap. If the
+/// gap is still open after gapTimeoutNs (checked in poll()), or a message
+/// arrives too far ahead to hold, the missing range goes to
+/// recover(first, last) and delivery continues after it.
+template<typename Sink, typename Recover, std::size_t window = 1024, std::size_t slotBytes = 64>
+class FeedArbitrator
+{
+    static_assert(std::has_single_bit(window));
+
+public:
+    FeedArbitrator(Sink sink, Recover recover, std::uint64_t firstSeq = 1, std::uint64_t gapTimeoutNs = 1'000'000)
+        : sink_{std::move(sink)}
+        , recover_{std::move(recover)}
+        , expected_{firstSeq}
+        , gapTimeoutNs_{gapTimeoutNs}
+        , slots_{std::make_unique<Slot[]>(window)}
+    {}
+
+    /// Feed one framed message from a line.
+    void onMessage(Line line, std::span<std::byte const> message, std::uint64_t nowNs) {
+        if (message.size() < wire::headerSize) [[unlikely]] {
+            return;
+        }
+        auto seq = wire::load<std::uint64_t>(message.data() + wire::offset::seq);
+        if (seq == expected_ && dedup_.claim(seq)) [[likely]] {
+            deliver(line, message);
+            if (held_ != 0) [[unlikely]] {
+                drain();
+            }
+            return;
+        }
+        if (seq < expected_ || not dedup_.claim(seq)) {
+            ++stats_.duplicates;
+            return;
+        }
+        if (seq - expected_ >= window || message.size() > slotBytes) {
+            // Can't hold it: give up on everything before it
+            skipTo(seq);
+            deliver(line, message);
+            drain();
+            return;
+        }
+        if (held_ == 0) {
+            gapSince_ = nowNs;
+            ++stats_.gapsOpened;
+        }
+        auto& slot = slots_[seq & (window - 1)];
+        slot.seq = seq;
+        slot.line = line;
+        slot.length = static_cast<std::uint16_t>(message.size());
+        std::memcpy(slot.data, message.data(), message.size());
+        ++held_;
+    }
+
+    /// Expire a gap that has been open longer than the timeout.
+    void poll(std::uint64_t nowNs) {
+        if (held_ != 0 && nowNs - gapSince_ >= gapTimeoutNs_) {
+            skipTo(firstHeld());
+            drain();
+            gapSince_ = nowNs;
+        }
+    }
+
+    /// Next sequence the sink will see
+    std::uint64_t expected() const noexcept { return expected_; }
+
+    /// Messages held behind an open gap
+    std::size_t held() const noexcept { return held_; }
+
+    ArbitratorStats const& stats() const noexcept { return stats_; }
+
+private:
+    struct Slot {
+        std::uint64_t seq = 0;   // 0: empty
+        Line line = Line::A;
+        std::uint16_t length = 0;
+        alignas(8) std::byte data[slotBytes];
+    };
+
+    void deliver(Line line, std::span<std::byte const> message) {
+        sink_(message);
+        ++expected_;
+        ++stats_.delivered;
+        ++stats_.firstFrom[static_cast<int>(line)];
+    }
+
+    Slot* heldSlot(std::uint64_t seq) noexcept {
+        auto& slot = slots_[seq & (window - 1)];
+        return slot.seq == seq ? &slot : nullptr;
+    }
+
+    /// Deliver held messages that are now in sequence.
+    void drain() {
+        while (held_ != 0) {
+            auto slot = heldSlot(expected_);
+            if (slot == nullptr) {
+                return;
+            }
+            slot->seq = 0;
+            --held_;
+            ++stats_.reordered;
+            deliver(slot->line, {slot->data, slot->length});
+        }
+    }
+
+    std::uint64_t firstHeld() noexcept {
+        for (auto seq = expected_;; ++seq) {
+            if (heldSlot(seq) != nullptr) {
+                return seq;
+            }
+        }
+    }
+
+    /// Declare everything missing before target lost, delivering whatever is
+    /// held on the way.
+    void skipTo(std::uint64_t target) {
+        auto missingFrom = std::uint64_t{0};
+        while (expected_ < target) {
+            if (auto slot = held_ != 0 ? heldSlot(expected_) : nullptr) {
+                if (missingFrom != 0) {
+                    lose(missingFrom, expected_ - 1);
+                    missingFrom = 0;
+                }
+                slot->seq = 0;
+                --held_;
+                ++stats_.reordered;
+                deliver(slot->line, {slot->data, slot->length});
+            } else {
+                if (missingFrom == 0) {
+                    missingFrom = expected_;
+                }
+                if (held_ == 0) {
+                    expected_ = target;   // nothing held ahead: jump the rest
+                } else {
+                    ++expected_;
+                }
+            }
+        }
+        if (missingFrom != 0) {
+            lose(missingFrom, target - 1);
+        }
+    }
+
+    void lose(std::uint64_t first, std::uint64_t last) {
+        ++stats_.gapsRecovered;
+        stats_.lost += last - first + 1;
+        recover_(first, last);
+    }
+
+    Sink sink_;
+    Recover recover_;
+    std::uint64_t expected_;
+    std::uint64_t gapTimeoutNs_;
+    std::uint64_t gapSince_ = 0;
+    std::size_t held_ = 0;
+    DedupWindow<window> dedup_;
+    std::unique_ptr<Slot[]> slots_;
+    ArbitratorStats stats_;
+};
+
+
+#ifdef ARBITRATOR_DEMO
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+// Two lines carry the same ticks with independent 1% loss, jitter between
+// the lines, and the odd sequence dropped on both.
+int main() {
+    constexpr std::uint64_t count = 1'000'000;
+    std::mt19937_64 rng(3);
+    std::vector<std::array<std::byte, wire::tickSize>> packets(count + 1);
+    for (std::uint64_t seq = 1; seq <= count; ++seq) {
+        wire::encodeTick(packets[seq].data(), seq, {seq, 100.0, 1});
+    }
+    std::set<std::uint64_t> bothLost;
+    struct Arrival { std::uint64_t at; Line line; std::uint64_t seq; };
+    std::vector<Arrival> arrivals;
+    for (std::uint64_t seq = 1; seq <= count; ++seq) {
+        bool lostA = rng() % 100 == 0, lostB = rng() % 100 == 0;
+        if (rng() % 20000 == 0) {
+            lostA = lostB = true;
+        }
+        if (seq == count) {
+            lostA = false;   // a loss at the very end only shows with the next message
+        }
+        if (lostA && lostB) {
+            bothLost.insert(seq);
+        }
+        if (not lostA) {
+            arrivals.push_back({seq * 100 + rng() % 300, Line::A, seq});
+        }
+        if (not lostB) {
+            arrivals.push_back({seq * 100 + rng() % 300, Line::B, seq});
+        }
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](auto& a, auto& b) { return a.at < b.at; });
+
+    std::uint64_t last = 0;
+    std::set<std::uint64_t> recovered;
+    auto sink = [&](std::span<std::byte const> m) {
+        auto seq = wire::load<std::uint64_t>(m.data() + wire::offset::seq);
+        if (seq <= last) {
+            std::printf("out of order: %llu after %llu\n", (unsigned long long)seq, (unsigned long long)last);
+            std::abort();
+        }
+        last = seq;
+    };
+    auto recover = [&](std::uint64_t first, std::uint64_t lastMissing) {
+        for (auto s = first; s <= lastMissing; ++s) {
+            recovered.insert(s);
+        }
+    };
+    FeedArbitrator arb(sink, recover, 1, 10'000);
+    for (auto& a : arrivals) {
+        arb.poll(a.at);
+        arb.onMessage(a.line, packets[a.seq], a.at);
+    }
+    arb.poll(~0ULL);
+
+    auto& s = arb.stats();
+    std::printf("delivered %llu (A first %llu, B first %llu), duplicates %llu, reordered %llu, gaps %llu, lost %llu\n",
+                (unsigned long long)s.delivered, (unsigned long long)s.firstFrom[0], (unsigned long long)s.firstFrom[1],
+                (unsigned long long)s.duplicates, (unsigned long long)s.reordered, (unsigned long long)s.gapsRecovered,
+                (unsigned long long)s.lost);
+    bool ok = recovered == bothLost && s.delivered + s.lost == count;
+    std::printf("recovered ranges %s the sequences lost on both lines\n", ok ? "match" : "DO NOT match");
+    return not ok;
+}
+#endif
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/// Capture file layout, all little-endian:
+///
+///   header    64 bytes: magic, version, index offset and count, data end
+///   records   16-byte record header, payload, zero padding to 8 bytes
+///   index     one CaptureIndexEntry per checkpoint record (written by close())
+///
+/// Records are appended in receive order. A packet record holds one raw
+/// packet or stream read as received; a checkpoint record holds whatever
+/// snapshot the writer's owner serialized (e.g. a book) so a reader can
+/// start from it instead of from the open of the file. A file that was never
+/// closed has index offset 0 and zeros after the last record; the reader
+/// rebuilds the index by scanning.
+namespace capture {
+
+inline constexpr std::uint64_t magic = 0x3130504143544648;   // "HFTCAP01"
+inline constexpr std::uint32_t version = 1;
+inline constexpr std::size_t fileHeaderSize = 64;
+inline constexpr std::size_t recordHeaderSize = 16;
+
+enum class RecordKind : std::uint16_t { Packet = 1, Checkpoint = 2 };
+
+struct FileHeader {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t indexOffset;   // 0: not closed, scan for checkpoints
+    std::uint64_t indexCount;
+    std::uint64_t dataEnd;       // first byte after the last record
+    std::uint64_t padding[3];
+};
+static_assert(sizeof(FileHeader) == fileHeaderSize);
+
+struct RecordHeader {
+    std::uint32_t length;        // payload bytes; 0 marks the end of data
+    RecordKind kind;
+    std::uint16_t source;        // e.g. feed line
+    std::uint64_t rxNs;          // receive timestamp
+};
+static_assert(sizeof(RecordHeader) == recordHeaderSize);
+
+struct IndexEntry {
+    std::uint64_t rxNs;
+    std::uint64_t offset;        // of the checkpoint record
+    std::uint64_t packets;       // packet records before it
+};
+
+inline constexpr std::size_t padded(std::size_t n) noexcept { return (n + 7) & ~std::size_t{7}; }
+
+[[noreturn]] inline void fail(char const* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace capture
+
+
+/// Append-only writer over a growing shared mapping of the capture file.
+///
+/// append() is a bounds check, two memcpys into the mapping and a pointer
+/// bump; the file grows by growBytes at a time (ftruncate + mremap), so the
+/// kernel writes pages back behind the recorder instead of a write() per
+/// packet. Not thread-safe: one recording thread owns the writer.
+class CaptureWriter
+{
+public:
+    explicit CaptureWriter(std::string const& path, std::size_t growBytes = std::size_t{64} << 20)
+        : grow_{std::max(capture::padded(growBytes), std::size_t{4096})}
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) capture::fail("open");
+        resize(grow_);
+        capture::FileHeader header{capture::magic, capture::version, 0, 0, 0, capture::fileHeaderSize, {}};
+        std::memcpy(base_, &header, sizeof(header));
+        end_ = capture::fileHeaderSize;
+    }
+
+    CaptureWriter(CaptureWriter const&) = delete;
+    CaptureWriter& operator=(CaptureWriter const&) = delete;
+
+    ~CaptureWriter() {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    /// Record one received packet; returns the record's file offset.
+    std::uint64_t append(std::uint64_t rxNs, std::span<std::byte const> packet, std::uint16_t source = 0) {
+        ++packets_;
+        return put(capture::RecordKind::Packet, rxNs, packet, source);
+    }
+
+    /// Record a snapshot taken after every packet appended so far.
+    std::uint64_t checkpoint(std::uint64_t rxNs, std::span<std::byte const> snapshot) {
+        auto offset = put(capture::RecordKind::Checkpoint, rxNs, snapshot, 0);
+        index_.push_back({rxNs, offset, packets_});
+        return offset;
+    }
+
+    std::uint64_t packets() const noexcept { return packets_; }
+    std::uint64_t bytes() const noexcept { return end_; }
+
+    /// Write the index and header and trim the file to size. Called by the
+    /// destructor; appending after close() is an error.
+    void close() {
+        if (fd_ < 0) {
+            return;
+        }
+        auto indexBytes = index_.size() * sizeof(capture::IndexEntry);
+        reserve(indexBytes + capture::recordHeaderSize);
+        std::memcpy(base_ + end_, index_.data(), indexBytes);
+        capture::FileHeader header{capture::magic, capture::version, 0, end_, index_.size(), end_, {}};
+        std::memcpy(base_, &header, sizeof(header));
+        auto total = end_ + indexBytes;
+        ::munmap(base_, mapped_);
+        base_ = nullptr;
+        auto rc = ::ftruncate(fd_, static_cast<off_t>(total));
+        ::close(fd_);
+        fd_ = -1;
+        if (rc != 0) capture::fail("ftruncate");
+    }
+
+private:
+    std::uint64_t put(capture::RecordKind kind, std::uint64_t rxNs, std::span<std::byte const> payload,
+                      std::uint16_t source) {
+        if (payload.empty() || payload.size() > UINT32_MAX) [[unlikely]] {
+            throw std::invalid_argument("CaptureWriter: record must be 1 byte to 4 GiB");
+        }
+        auto size = capture::recordHeaderSize + capture::padded(payload.size());
+        reserve(size + capture::recordHeaderSize);   // keep a zero header after the last record
+        auto offset = end_;
+        // Payload first so a reader of a crashed file never sees a header
+        // without its bytes
+        std::memcpy(base_ + offset + capture::recordHeaderSize, payload.data(), payload.size());
+        capture::RecordHeader header{static_cast<std::uint32_t>(payload.size()), kind, source, rxNs};
+        std::memcpy(base_ + offset, &header, sizeof(header));
+        end_ += size;
+        return offset;
+    }
+
+    void reserve(std::size_t extra) {
+        if (end_ + extra > mapped_) [[unlikely]] {
+            resize(std::max(mapped_ + grow_, capture::padded(end_ + extra)));
+        }
+    }
+
+    void resize(std::size_t size) {
+        if (fd_ < 0) {
+            throw std::logic_error("CaptureWriter: closed");
+        }
+        if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) capture::fail("ftruncate");
+        void* p = base_ == nullptr ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)
+                                   : ::mremap(base_, mapped_, size, MREMAP_MAYMOVE);
+        if (p == MAP_FAILED) capture::fail("mmap");
+        base_ = static_cast<std::byte*>(p);
+        mapped_ = size;
+    }
+
+    int fd_ = -1;
+    std::byte* base_ = nullptr;
+    std::size_t mapped_ = 0;
+    std::size_t end_ = 0;
+    std::size_t grow_;
+    std::uint64_t packets_ = 0;
+    std::vector<capture::IndexEntry> index_;
+};
+
+
+/// Read-only view of a capture file. Records are read in place from the
+/// mapping; spans stay valid for the reader's lifetime.
+class CaptureReader
+{
+public:
+    struct Record {
+        std::uint64_t offset;
+        std::uint64_t rxNs;
+        capture::RecordKind kind;
+        std::uint16_t source;
+        std::span<std::byte const> payload;
+    };
+
+    explicit CaptureReader(std::string const& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) capture::fail("open");
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            capture::fail("fstat");
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        void* p = size_ == 0 ? MAP_FAILED : ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("CaptureReader: cannot map " + path);
+        }
+        base_ = static_cast<std::byte const*>(p);
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+
+        capture::FileHeader header;
+        if (size_ < sizeof(header)) {
+            release();
+            throw std::runtime_error("CaptureReader: not a capture file: " + path);
+        }
+        std::memcpy(&header, base_, sizeof(header));
+        if (header.magic != capture::magic || header.version != capture::version) {
+            release();
+            throw std::runtime_error("CaptureReader: not a capture file: " + path);
+        }
+        // Trust the index only if it lies after the data and inside the file;
+        // anything else (a torn or foreign header) falls back to a scan.
+        bool indexed = header.indexOffset != 0
+            && begin() <= header.dataEnd && header.dataEnd <= header.indexOffset
+            && header.indexOffset <= size_
+            && header.indexCount <= (size_ - header.indexOffset) / sizeof(capture::IndexEntry);
+        if (indexed) {
+            end_ = header.dataEnd;
+            index_.resize(header.indexCount);
+            std::memcpy(index_.data(), base_ + header.indexOffset, index_.size() * sizeof(capture::IndexEntry));
+        } else {
+            rebuild();
+        }
+    }
+
+    CaptureReader(CaptureReader const&) = delete;
+    CaptureReader& operator=(CaptureReader const&) = delete;
+
+    ~CaptureReader() { release(); }
+
+    /// Offset of the first record
+    static constexpr std::uint64_t begin() noexcept { return capture::fileHeaderSize; }
+
+    /// Offset one past the last record
+    std::uint64_t end() const noexcept { return end_; }
+
+    /// Read the record at offset (begin() or a previous next()); false at end().
+    bool read(std::uint64_t offset, Record& out) const noexcept {
+        capture::RecordHeader header;
+        if (offset + capture::recordHeaderSize > end_) {
+            return false;
+        }
+        std::memcpy(&header, base_ + offset, sizeof(header));
+        if (header.length == 0 || offset + capture::recordHeaderSize + header.length > end_) {
+            return false;
+        }
+        out = {offset, header.rxNs, header.kind, header.source,
+               {base_ + offset + capture::recordHeaderSize, header.length}};
+        return true;
+    }
+
+    /// Offset of the record after r
+    static std::uint64_t next(Record const& r) noexcept {
+        return r.offset + capture::recordHeaderSize + capture::padded(r.payload.size());
+    }
+
+    std::span<capture::IndexEntry const> checkpoints() const noexcept { return index_; }
+
+    /// Latest checkpoint taken at or before rxNs, or nullptr if there is none
+    capture::IndexEntry const* checkpointAt(std::uint64_t rxNs) const noexcept {
+        auto it = std::upper_bound(index_.begin(), index_.end(), rxNs,
+                                   [](std::uint64_t ns, capture::IndexEntry const& e) { return ns < e.rxNs; });
+        return it == index_.begin() ? nullptr : &*std::prev(it);
+    }
+
+private:
+    /// Walk the records of an unclosed file up to the first zero header.
+    void rebuild() {
+        end_ = size_;
+        Record r;
+        std::uint64_t offset = begin(), packets = 0;
+        while (read(offset, r)) {
+            if (r.kind == capture::RecordKind::Checkpoint) {
+                index_.push_back({r.rxNs, r.offset, packets});
+            } else {
+                ++packets;
+            }
+            offset = next(r);
+        }
+        end_ = offset;
+    }
+
+    void release() noexcept {
+        if (base_ != nullptr) {
+            ::munmap(const_cast<std::byte*>(base_), size_);
+            base_ = nullptr;
+        }
+    }
+
+    std::byte const* base_ = nullptr;
+    std::size_t size_ = 0;
+    std::uint64_t end_ = 0;
+    std::vector<capture::IndexEntry> index_;
+};
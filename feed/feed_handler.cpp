@@ -0,0 +1,463 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "market_data.cpp"
+#include "transport.cpp"
+
+
+namespace detail {
+
+/// Call onMessage(span) and report whether it accepted the message; a
+/// callback returning void always accepts.
+template<typename F>
+bool deliver(F& onMessage, std::span<std::byte const> message) {
+    if constexpr (std::is_void_v<std::invoke_result_t<F&, std::span<std::byte const>>>) {
+        onMessage(message);
+        return true;
+    } else {
+        return static_cast<bool>(onMessage(message));
+    }
+}
+
+/// As above, also passing the packet to callbacks that take it.
+template<typename F>
+bool deliver(F& onMessage, std::span<std::byte const> message, RxPacket const& packet) {
+    if constexpr (std::is_invocable_v<F&, std::span<std::byte const>, RxPacket const&>) {
+        auto forward = [&](std::span<std::byte const> m) { return onMessage(m, packet); };
+        return deliver(forward, message);
+    } else {
+        return deliver(onMessage, message);
+    }
+}
+
+inline bool wouldBlock(int err) noexcept {
+    return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
+}
+
+/// Cache-line aligned byte buffer
+struct AlignedBuffer {
+    static constexpr std::align_val_t alignment{64};
+
+    explicit AlignedBuffer(std::size_t size)
+        : data{static_cast<std::byte*>(::operator new(size, alignment))}
+    {}
+
+    AlignedBuffer(AlignedBuffer const&) = delete;
+    AlignedBuffer& operator=(AlignedBuffer const&) = delete;
+
+    ~AlignedBuffer() { ::operator delete(data, alignment); }
+
+    std::byte* data;
+};
+
+} // namespace detail
+
+
+/// Feed handler for a byte stream (TCP, unix stream socket).
+///
+/// Each poll() makes at most one non-blocking recv() into a large receive
+/// buffer and frames every complete message in place, passing it to the
+/// callback as a span into that buffer. A message cut by the end of a read
+/// stays in the buffer until the rest arrives; the only copy the handler
+/// makes is moving that short tail back to the front when the buffer runs
+/// low. If the callback refuses a message (returns false) nothing further is
+/// read until a later poll() has delivered it.
+///
+/// The fd is not owned and should be non-blocking or used with poll()
+/// readiness; recv() is called with MSG_DONTWAIT either way.
+template<typename Framer = MarketDataFramer>
+class StreamFeedHandler
+{
+public:
+    explicit StreamFeedHandler(int fd, std::size_t bufferSize = std::size_t{1} << 20)
+        : fd_{fd}
+        , size_{bufferSize}
+        , buffer_{bufferSize}
+    {
+        if (bufferSize < 2 * Framer::maxSize) {
+            throw std::invalid_argument("StreamFeedHandler: buffer smaller than two messages");
+        }
+    }
+
+    /// Deliver buffered messages, read once, deliver what arrived.
+    /// @return the number of messages delivered.
+    template<typename F>
+    std::size_t poll(F&& onMessage) {
+        std::size_t delivered = 0;
+        if (not frame(onMessage, delivered)) {
+            return delivered;   // consumer is backed up; leave the socket alone
+        }
+        if (closed_) {
+            return delivered;
+        }
+        makeRoom();
+        auto n = ::recv(fd_, buffer_.data + tail_, size_ - tail_, MSG_DONTWAIT);
+        if (n > 0) {
+            tail_ += static_cast<std::size_t>(n);
+            bytes_ += static_cast<std::uint64_t>(n);
+            ++reads_;
+            frame(onMessage, delivered);
+        } else if (n == 0) {
+            closed_ = true;
+        } else if (not detail::wouldBlock(errno)) {
+            throw std::system_error(errno, std::generic_category(), "recv");
+        }
+        return delivered;
+    }
+
+    /// poll() decoding MarketData into a fifo (anything with push(MarketData)).
+    template<typename Queue>
+    std::size_t pollInto(Queue& queue) {
+        return poll([&](std::span<std::byte const> m) { return queue.push(MarketDataView{m.data()}.decode()); });
+    }
+
+    /// Peer closed the stream; buffered messages may still be pending
+    bool closed() const noexcept { return closed_; }
+
+    /// Bytes received but not yet delivered (a partial message, or messages
+    /// the callback refused)
+    std::size_t buffered() const noexcept { return tail_ - head_; }
+
+    std::uint64_t bytes() const noexcept { return bytes_; }
+    std::uint64_t reads() const noexcept { return reads_; }
+
+private:
+    template<typename F>
+    bool frame(F& onMessage, std::size_t& delivered) {
+        while (head_ < tail_) {
+            auto length = Framer::size(buffer_.data + head_, tail_ - head_);
+            if (length == 0 || length > tail_ - head_) {
+                return true;   // partial message; wait for more bytes
+            }
+            if (not detail::deliver(onMessage, {buffer_.data + head_, length})) {
+                return false;
+            }
+            head_ += length;
+            ++delivered;
+        }
+        return true;
+    }
+
+    /// Keep at least a quarter of the buffer free for the next recv
+    void makeRoom() noexcept {
+        if (head_ == tail_) {
+            head_ = tail_ = 0;
+        } else if (size_ - tail_ < size_ / 4) {
+            std::memmove(buffer_.data, buffer_.data + head_, tail_ - head_);
+            tail_ -= head_;
+            head_ = 0;
+        }
+    }
+
+    int fd_;
+    std::size_t size_;
+    detail::AlignedBuffer buffer_;
+    std::size_t head_ = 0;
+    std::size_t tail_ = 0;
+    bool closed_ = false;
+    std::uint64_t bytes_ = 0;
+    std::uint64_t reads_ = 0;
+};
+
+
+/// Feed handler for packet transports (transport.cpp): UDP sockets, or a
+/// kernel-bypass ring behind RingTransport.
+///
+/// One receive() fills up to batch packets; each packet carries whole
+/// messages, which are framed in place. Packets the transport truncated, and
+/// bytes left over after the last whole message, are counted and skipped.
+/// Backpressure works as for StreamFeedHandler: the next receive() waits
+/// until the previous batch has been delivered.
+///
+/// The callback takes the message span, optionally followed by the
+/// RxPacket it came in (for its receive timestamp).
+template<typename Transport, typename Framer = MarketDataFramer>
+class PacketFeedHandler
+{
+public:
+    template<typename... Args>
+    explicit PacketFeedHandler(Args&&... args)
+        : transport_(std::forward<Args>(args)...)
+        , packets_(transport_.batch())
+    {}
+
+    /// Deliver the rest of the last batch, or receive a new one and deliver it.
+    /// @return the number of messages delivered.
+    template<typename F>
+    std::size_t poll(F&& onMessage) {
+        std::size_t delivered = 0;
+        if (index_ == count_) {
+            if (not receive()) {
+                return 0;
+            }
+        }
+        for (; index_ < count_; ++index_, offset_ = 0) {
+            auto const& packet = packets_[index_];
+            while (offset_ < packet.length) {
+                auto size = Framer::size(packet.data + offset_, packet.length - offset_);
+                if (size == 0 || size > packet.length - offset_) {
+                    ++malformed_;
+                    break;
+                }
+                if (not detail::deliver(onMessage, {packet.data + offset_, size}, packet)) {
+                    return delivered;
+                }
+                offset_ += size;
+                ++delivered;
+            }
+        }
+        return delivered;
+    }
+
+    /// poll() decoding MarketData into a fifo (anything with push(MarketData)).
+    template<typename Queue>
+    std::size_t pollInto(Queue& queue) {
+        return poll([&](std::span<std::byte const> m) { return queue.push(MarketDataView{m.data()}.decode()); });
+    }
+
+    Transport& transport() noexcept { return transport_; }
+
+    std::uint64_t datagrams() const noexcept { return datagrams_; }
+    std::uint64_t reads() const noexcept { return reads_; }
+    std::uint64_t truncated() const noexcept { return truncated_; }
+    std::uint64_t malformed() const noexcept { return malformed_; }
+
+private:
+    bool receive() {
+        count_ = transport_.receive(packets_);
+        index_ = 0;
+        offset_ = 0;
+        if (count_ == 0) {
+            return false;
+        }
+        datagrams_ += count_;
+        ++reads_;
+        for (std::size_t i = 0; i < count_; ++i) {
+            truncated_ += packets_[i].truncated;
+        }
+        return true;
+    }
+
+    Transport transport_;
+    std::vector<RxPacket> packets_;
+
+    std::size_t count_ = 0;    // packets in the current batch
+    std::size_t index_ = 0;    // next packet to deliver from
+    std::size_t offset_ = 0;   // next message within it
+
+    std::uint64_t datagrams_ = 0;
+    std::uint64_t reads_ = 0;
+    std::uint64_t truncated_ = 0;
+    std::uint64_t malformed_ = 0;
+};
+
+/// UDP unicast or multicast over the kernel socket, constructed with
+/// (fd, batch = 64, maxDatagram = 2048, SocketOptions = {}).
+template<typename Framer = MarketDataFramer>
+using DatagramFeedHandler = PacketFeedHandler<SocketTransport, Framer>;
+
+
+#ifdef FEED_HANDLER_DEMO
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+
+static MarketData tick(std::uint64_t i) {
+    return {i, 100.0 + double(i % 100) / 100, static_cast<std::uint32_t>(i % 1000)};
+}
+
+// Consumer side of the Fifo3 hand-off: checks every tick arrives in order
+static void consume(Fifo3<MarketData>& queue, std::uint64_t count) {
+    MarketData md;
+    for (std::uint64_t i = 0; i < count;) {
+        if (queue.pop(md)) {
+            if (md.timestamp != i || md.volume != i % 1000) {
+                std::printf("bad tick %llu\n", static_cast<unsigned long long>(i));
+                std::abort();
+            }
+            ++i;
+        }
+    }
+}
+
+// Writer sends ticks in random-sized chunks so messages straddle reads
+static void streamDemo() {
+    constexpr std::uint64_t count = 1'000'000;
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread writer([&] {
+        std::mt19937 rng(1);
+        std::vector<std::byte> out(count * marketDataWireSize);
+        for (std::uint64_t i = 0; i < count; ++i) {
+            MarketDataView::encode(tick(i), out.data() + i * marketDataWireSize);
+        }
+        for (std::size_t sent = 0; sent < out.size();) {
+            auto chunk = std::min<std::size_t>(1 + rng() % 4096, out.size() - sent);
+            auto n = ::send(fds[1], out.data() + sent, chunk, 0);
+            if (n > 0) {
+                sent += static_cast<std::size_t>(n);
+            }
+        }
+        ::close(fds[1]);
+    });
+
+    Fifo3<MarketData> queue(4096);
+    std::thread consumer(consume, std::ref(queue), count);
+    StreamFeedHandler<> feed(fds[0], 64 * 1024);
+    std::uint64_t n = 0;
+    while (not feed.closed() || feed.buffered() >= marketDataWireSize) {
+        n += feed.pollInto(queue);
+    }
+    writer.join();
+    consumer.join();
+    ::close(fds[0]);
+    std::printf("stream: %llu messages in %llu reads, %zu bytes left over\n", static_cast<unsigned long long>(n),
+                static_cast<unsigned long long>(feed.reads()), feed.buffered());
+}
+
+// Datagrams of 1..50 ticks over loopback UDP, received with recvmmsg
+static void datagramDemo() {
+    constexpr std::uint64_t count = 200'000;
+    int rx = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 8 << 20;
+    ::setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(rx, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    ::getsockname(rx, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    std::atomic<std::uint64_t> received{0};
+    std::thread writer([&] {
+        std::mt19937 rng(2);
+        std::byte datagram[50 * marketDataWireSize];
+        for (std::uint64_t i = 0; i < count;) {
+            auto k = std::min<std::uint64_t>(1 + rng() % 50, count - i);
+            for (std::uint64_t j = 0; j < k; ++j) {
+                MarketDataView::encode(tick(i + j), datagram + j * marketDataWireSize);
+            }
+            ::sendto(tx, datagram, k * marketDataWireSize, 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            i += k;
+            // Stay within the socket buffer so loopback doesn't drop
+            while (i > received.load(std::memory_order_relaxed) + 100'000) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    Fifo3<MarketData> queue(4096);
+    std::thread consumer(consume, std::ref(queue), count);
+    DatagramFeedHandler<> feed(rx);
+    while (received.load(std::memory_order_relaxed) < count) {
+        received.fetch_add(feed.pollInto(queue), std::memory_order_relaxed);
+    }
+    writer.join();
+    consumer.join();
+    ::close(rx);
+    ::close(tx);
+    std::printf("datagram: %llu messages in %llu datagrams, %llu recvmmsg calls\n",
+                static_cast<unsigned long long>(received.load()), static_cast<unsigned long long>(feed.datagrams()),
+                static_cast<unsigned long long>(feed.reads()));
+}
+
+// Kernel receive timestamps and busy polling on loopback (no NIC clock there)
+static void timestampDemo() {
+    int rx = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(rx, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    ::getsockname(rx, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    DatagramFeedHandler<> feed(rx, 16, 2048, SocketOptions{50, true});
+    std::uint64_t sources[4] = {}, late = 0, received = 0;
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        std::byte datagram[marketDataWireSize];
+        MarketDataView::encode(tick(i), datagram);
+        auto sent = realtimeNs();
+        ::sendto(tx, datagram, sizeof(datagram), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        while (feed.poll([&](std::span<std::byte const>, RxPacket const& p) {
+            ++sources[static_cast<int>(p.source)];
+            late += p.timestampNs < sent || p.timestampNs > realtimeNs();
+            ++received;
+        }) == 0) {}
+    }
+    ::close(rx);
+    ::close(tx);
+    std::printf("timestamps: %llu packets, %llu kernel, %llu user, %llu hardware, %llu out of range, busy poll %s\n",
+                static_cast<unsigned long long>(received), static_cast<unsigned long long>(sources[2]),
+                static_cast<unsigned long long>(sources[1]), static_cast<unsigned long long>(sources[3]),
+                static_cast<unsigned long long>(late), feed.transport().busyPolling() ? "on" : "refused");
+    if (received != 1000 || late != 0) {
+        std::abort();
+    }
+}
+
+// The same handler over an in-process descriptor ring, as for AF_XDP
+static void ringDemo() {
+    constexpr std::uint64_t count = 1'000'000;
+    PacketFeedHandler<RingTransport<MemoryRing>> feed(32, 1024, 1024);
+    Fifo3<MarketData> queue(4096);
+    std::thread producer([&] {
+        std::byte packet[25 * marketDataWireSize];
+        for (std::uint64_t i = 0; i < count; i += 25) {
+            for (std::uint64_t j = 0; j < 25; ++j) {
+                MarketDataView::encode(tick(i + j), packet + j * marketDataWireSize);
+            }
+            while (not feed.transport().ring().produce(packet, i + 1)) {}
+        }
+    });
+    std::thread consumer(consume, std::ref(queue), count);
+    std::uint64_t received = 0, lastStamp = 0;
+    bool ordered = true;
+    while (received < count) {
+        received += feed.poll([&](std::span<std::byte const> m, RxPacket const& p) {
+            ordered &= p.timestampNs >= lastStamp && p.source == TimestampSource::Hardware;
+            lastStamp = p.timestampNs;
+            return queue.push(MarketDataView{m.data()}.decode());
+        });
+    }
+    producer.join();
+    consumer.join();
+    std::printf("ring: %llu messages in %llu frames, %llu receives, stamps %s\n",
+                static_cast<unsigned long long>(received), static_cast<unsigned long long>(feed.datagrams()),
+                static_cast<unsigned long long>(feed.reads()), ordered ? "in order" : "OUT OF ORDER");
+    if (not ordered) {
+        std::abort();
+    }
+}
+
+int main() {
+    streamDemo();
+    datagramDemo();
+    timestampDemo();
+    ringDemo();
+}
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+/// Tick as used by the strategy side; natural alignment (24 bytes).
+struct MarketData {
+    std::uint64_t timestamp;
+    double price;
+    std::uint32_t volume;
+};
+
+/// On the wire the same fields are packed little-endian with no padding,
+/// 20 bytes per message (struct.pack('QdI') in L1/mocks/dummy_market_server.py).
+/// Note sizeof(MarketData) is 24, which is why read(sock, buf, sizeof(MarketData))
+/// in L1/mocks/MarketFeed.cpp drifts out of frame.
+inline constexpr std::size_t marketDataWireSize = 20;
+
+/// Zero-copy view of one framed message inside a receive buffer. Fields are
+/// read with memcpy since wire messages are not aligned. Valid until the
+/// handler that produced it is polled again.
+class MarketDataView
+{
+public:
+    explicit MarketDataView(std::byte const* p) noexcept : p_{p} {}
+
+    std::uint64_t timestamp() const noexcept { return load<std::uint64_t>(0); }
+    double price() const noexcept { return load<double>(8); }
+    std::uint32_t volume() const noexcept { return load<std::uint32_t>(16); }
+
+    MarketData decode() const noexcept { return {timestamp(), price(), volume()}; }
+
+    std::byte const* data() const noexcept { return p_; }
+
+    /// Write md in wire format to out (marketDataWireSize bytes).
+    static void encode(MarketData const& md, std::byte* out) noexcept {
+        std::memcpy(out, &md.timestamp, 8);
+        std::memcpy(out + 8, &md.price, 8);
+        std::memcpy(out + 16, &md.volume, 4);
+    }
+
+private:
+    template<typename T>
+    T load(std::size_t offset) const noexcept {
+        T v;
+        std::memcpy(&v, p_ + offset, sizeof(T));
+        return v;
+    }
+
+    std::byte const* p_;
+};
+
+
+/// The framers tell a feed handler where messages end within a byte stream.
+/// size(p, available) returns the length of the message starting at p, or 0
+/// if available bytes are not enough to tell; maxSize bounds any message.
+
+/// Fixed-size messages, e.g. the 20-byte MarketData frames
+template<std::size_t N>
+struct FixedFramer {
+    static constexpr std::size_t maxSize = N;
+
+    static constexpr std::size_t size(std::byte const*, std::size_t available) noexcept {
+        return available >= N ? N : 0;
+    }
+};
+
+using MarketDataFramer = FixedFramer<marketDataWireSize>;
@@ -0,0 +1,232 @@
+// Native market-data simulator: order-book event streams in the wire format.
+//
+//   g++ -std=c++20 -O2 -march=native market_sim.cpp -o market_sim
+//   ./market_sim --out tcp:5555 --rate 2000000 --symbols 8
+//   ./market_sim --out udp:239.1.1.1:5556 --rate 0 --batch 30
+//   ./market_sim --out file:events.bin --messages 10000000
+//
+// Per symbol it keeps a live order set around a random-walking mid and draws
+// adds, cancels and trades. Arrivals are Poisson at --rate msgs/s; with
+// --burst-prob a burst state multiplies the rate by --burst-mult for an
+// exponentially distributed --burst-us. --rate 0 sends as fast as the
+// transport takes it. Sequence numbers start at 1 and are shared across
+// symbols, as on an exchange unit feed.
+//
+// The TCP mode listens and serves one client, like dummy_market_server.py.
+// A UDP datagram carries up to --batch whole messages (<= 1472 bytes).
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sim_model.cpp"
+
+
+static void fail(char const* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+
+/// Where encoded bytes go; send() gets whole messages only.
+class Sink
+{
+public:
+    explicit Sink(std::string const& spec) {
+        auto colon = spec.find(':');
+        auto kind = spec.substr(0, colon);
+        auto rest = colon == std::string::npos ? std::string{} : spec.substr(colon + 1);
+        if (kind == "file") {
+            fd_ = ::open(rest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0) fail("open");
+            stream_ = true;
+        } else if (kind == "tcp") {
+            listenTcp(static_cast<std::uint16_t>(std::stoi(rest)));
+            stream_ = true;
+        } else if (kind == "udp") {
+            openUdp(rest);
+        } else {
+            throw std::invalid_argument("--out must be file:PATH, tcp:PORT or udp:GROUP:PORT");
+        }
+    }
+
+    Sink(Sink const&) = delete;
+    Sink& operator=(Sink const&) = delete;
+
+    ~Sink() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    /// Largest packet the transport takes in one send
+    std::size_t maxPacket() const noexcept { return stream_ ? std::size_t{1} << 16 : 1472; }
+
+    void send(std::byte const* data, std::size_t size) {
+        if (not stream_) {
+            if (::sendto(fd_, data, size, 0, reinterpret_cast<sockaddr const*>(&group_), sizeof(group_)) < 0
+                && errno != ENOBUFS) {
+                fail("sendto");
+            }
+            return;
+        }
+        while (size != 0) {
+            auto n = ::write(fd_, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                fail("write");
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+
+private:
+    void listenTcp(std::uint16_t port) {
+        int server = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (::bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) fail("bind");
+        if (::listen(server, 1) < 0) fail("listen");
+        std::fprintf(stderr, "listening on tcp port %u\n", port);
+        fd_ = ::accept(server, nullptr, nullptr);
+        ::close(server);
+        if (fd_ < 0) fail("accept");
+        ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    void openUdp(std::string const& spec) {
+        auto colon = spec.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("udp:GROUP:PORT");
+        }
+        fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) fail("socket");
+        group_.sin_family = AF_INET;
+        group_.sin_port = htons(static_cast<std::uint16_t>(std::stoi(spec.substr(colon + 1))));
+        if (::inet_pton(AF_INET, spec.substr(0, colon).c_str(), &group_.sin_addr) != 1) {
+            throw std::invalid_argument("bad udp address " + spec);
+        }
+        unsigned char ttl = 1, loop = 1;
+        ::setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        ::setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        int sndbuf = 8 << 20;
+        ::setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+
+    int fd_ = -1;
+    bool stream_ = false;
+    sockaddr_in group_{};
+};
+
+
+static std::uint64_t nowNs() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static std::uint64_t wallNs() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// A count option's value; zero or negative is a usage error
+static std::size_t positive(std::string const& option, std::string const& value) {
+    auto n = std::stoll(value);
+    if (n <= 0) {
+        throw std::invalid_argument(option + " must be at least 1, got " + value);
+    }
+    return static_cast<std::size_t>(n);
+}
+
+int main(int argc, char** argv) {
+    SimConfig cfg;
+    try {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string k = argv[i], v = argv[i + 1];
+            if (k == "--out") cfg.out = v;
+            else if (k == "--messages") cfg.messages = std::stoull(v);
+            else if (k == "--rate") cfg.rate = std::stod(v);
+            else if (k == "--burst-prob") cfg.burstProb = std::stod(v);
+            else if (k == "--burst-mult") cfg.burstMult = std::stod(v);
+            else if (k == "--burst-us") cfg.burstUs = std::stod(v);
+            else if (k == "--symbols") cfg.symbols = positive(k, v);
+            else if (k == "--batch") cfg.batch = positive(k, v);
+            else if (k == "--cancel") cfg.cancelRatio = std::stod(v);
+            else if (k == "--trade") cfg.tradeRatio = std::stod(v);
+            else if (k == "--depth") cfg.depth = positive(k, v);
+            else if (k == "--seed") cfg.seed = std::stoull(v);
+            else { std::fprintf(stderr, "unknown option %s\n", k.c_str()); return 1; }
+        }
+        if (cfg.symbols > 65536) {
+            throw std::invalid_argument("--symbols must be at most 65536 (16-bit symbol ids)");
+        }
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "market_sim: bad arguments: %s\n", e.what());
+        return 1;
+    }
+
+    try {
+        Sink sink(cfg.out);
+        std::vector<SymbolModel> models;
+        for (std::size_t s = 0; s < cfg.symbols; ++s) {
+            models.emplace_back(static_cast<std::uint16_t>(s), cfg, cfg.seed * 7919 + s);
+        }
+        ArrivalClock clock(cfg, cfg.seed);
+        std::mt19937_64 pick(cfg.seed + 1);
+
+        auto batchBytes = std::min(cfg.batch * wire::orderEventSize, sink.maxPacket());
+        batchBytes -= batchBytes % wire::orderEventSize;
+        std::vector<std::byte> packet(batchBytes);
+
+        std::uint64_t seq = 0, orderId = 1, sent = 0;
+        auto start = nowNs();
+        double due = 0;   // ns after start the next message is due
+        while (cfg.messages == 0 || sent < cfg.messages) {
+            std::size_t used = 0;
+            while (used + wire::orderEventSize <= batchBytes && (cfg.messages == 0 || sent < cfg.messages)) {
+                auto e = models[pick() % models.size()].next(orderId);
+                e.seq = ++seq;
+                e.timestamp = wallNs();
+                used += wire::encodeOrderEvent(&packet[used], e);
+                ++sent;
+                due += clock.gapNs();
+                // Flush early rather than hold messages that are already due
+                if (cfg.rate != 0 && start + static_cast<std::uint64_t>(due) > nowNs()) {
+                    break;
+                }
+            }
+            sink.send(packet.data(), used);
+            if (cfg.rate != 0) {
+                auto target = start + static_cast<std::uint64_t>(due);
+                while (nowNs() < target) {}
+            }
+        }
+        double secs = double(nowNs() - start) / 1e9;
+        std::fprintf(stderr, "%llu messages in %.3f s: %.2f M msgs/s\n", static_cast<unsigned long long>(sent), secs,
+                     sent / secs / 1e6);
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "market_sim: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "wire_format.cpp"
+
+
+/// Order-event model behind market_sim, for anything that needs a
+/// synthetic stream in process: benches, replay and snapshot demos.
+/// SymbolModel draws one symbol's adds, cancels and trades around a
+/// random-walk mid, ArrivalClock spaces them Poisson with bursts, and
+/// SimFeed puts the two together as sequenced, timestamped packets.
+
+struct SimConfig {
+    std::string out = "file:events.bin";
+    std::uint64_t messages = 1'000'000;   // 0: run until killed
+    double rate = 1'000'000;              // msgs/s, 0 = unthrottled
+    double burstProb = 0.0001;            // chance per message of entering a burst
+    double burstMult = 10;
+    double burstUs = 200;
+    std::size_t symbols = 4;
+    std::size_t batch = 16;               // messages per send
+    double cancelRatio = 0.45;
+    double tradeRatio = 0.1;
+    std::size_t depth = 20;               // ticks from mid for new orders
+    std::size_t targetOrders = 0;         // while fewer rest, cancels become adds (book build-up)
+    std::uint64_t seed = 1;
+};
+
+/// Order-event model for one symbol: live orders around a random-walk mid
+class SymbolModel
+{
+public:
+    SymbolModel(std::uint16_t symbol, SimConfig cfg, std::uint64_t seed)
+        : symbol_{symbol}
+        , cfg_{cfg}
+        , rng_{seed}
+        , offset_{4.0 / double(std::max<std::size_t>(cfg.depth, 1))}
+    {
+        if (cfg.depth == 0) {
+            throw std::invalid_argument("SymbolModel: depth must be at least 1");
+        }
+    }
+
+    wire::OrderEvent next(std::uint64_t& nextOrderId) {
+        wire::OrderEvent e{};
+        e.symbol = symbol_;
+        if (rng_() % 64 == 0) {
+            mid_ += std::uniform_int_distribution<int>(-2, 2)(rng_) * tick;
+        }
+        double r = unit_(rng_);
+        bool building = live_.size() < cfg_.targetOrders;
+        if (live_.empty() || r >= cfg_.cancelRatio + cfg_.tradeRatio || (building && r < cfg_.cancelRatio)) {
+            bool buy = rng_() & 1;
+            auto ticksAway = 1 + std::min<std::int64_t>(offset_(rng_), std::int64_t(cfg_.depth) - 1);
+            Live o{nextOrderId++, mid_ + (buy ? -ticksAway : ticksAway) * tick,
+                   static_cast<std::uint32_t>(1 + rng_() % 500), buy};
+            live_.push_back(o);
+            e.type = wire::WireType::Add;
+            e.order_id = o.id;
+            e.price = o.price;
+            e.quantity = o.quantity;
+            e.is_buy = o.is_buy;
+            return e;
+        }
+        auto k = rng_() % live_.size();
+        auto& o = live_[k];
+        e.order_id = o.id;
+        e.price = o.price;
+        e.is_buy = o.is_buy;
+        if (r < cfg_.cancelRatio) {
+            e.type = wire::WireType::Cancel;
+            e.quantity = 0;
+            live_[k] = live_.back();
+            live_.pop_back();
+        } else {
+            e.type = wire::WireType::Trade;
+            e.quantity = std::min<std::uint32_t>(o.quantity, 1 + rng_() % 200);
+            o.quantity -= e.quantity;
+            if (o.quantity == 0) {
+                live_[k] = live_.back();
+                live_.pop_back();
+            }
+        }
+        return e;
+    }
+
+private:
+    static constexpr std::int64_t tick = 100;   // 0.01 in 1e-4 units
+
+    struct Live {
+        std::uint64_t id;
+        std::int64_t price;
+        std::uint32_t quantity;
+        bool is_buy;
+    };
+
+    std::uint16_t symbol_;
+    SimConfig cfg_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> unit_{0, 1};
+    std::geometric_distribution<std::int64_t> offset_;
+    std::int64_t mid_ = 100 * 10000;
+    std::vector<Live> live_;
+};
+
+
+/// Poisson arrival clock with a two-state (normal, burst) rate
+class ArrivalClock
+{
+public:
+    ArrivalClock(SimConfig cfg, std::uint64_t seed) : cfg_{std::move(cfg)}, rng_{seed} {}
+
+    /// Nanoseconds from the previous arrival to the next
+    double gapNs() {
+        if (cfg_.rate == 0) {
+            return 0;
+        }
+        if (burstLeftNs_ <= 0 && unit_(rng_) < cfg_.burstProb) {
+            burstLeftNs_ = std::exponential_distribution<double>(1.0 / (cfg_.burstUs * 1e3))(rng_);
+        }
+        double rate = cfg_.rate * (burstLeftNs_ > 0 ? cfg_.burstMult : 1.0);
+        double gap = std::exponential_distribution<double>(rate)(rng_) * 1e9;
+        burstLeftNs_ -= gap;
+        return gap;
+    }
+
+private:
+    SimConfig cfg_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> unit_{0, 1};
+    double burstLeftNs_ = 0;
+};
+
+
+/// One symbol's stream as a feed would deliver it: sequence numbers from 1,
+/// receive times from an ArrivalClock at cfg.rate (so cfg.rate must not be
+/// 0 for distinct times), and packets of 1..maxEvents whole messages.
+///
+///     SimFeed feed(cfg);
+///     std::vector<std::byte> buf(20 * wire::orderEventSize);
+///     auto rx = feed.rxNs();                          // the packet's stamp
+///     auto used = feed.nextPacket(buf.data(), 20);
+class SimFeed
+{
+public:
+    explicit SimFeed(SimConfig const& cfg, std::uint64_t startNs = 1'000'000'000, std::uint16_t symbol = 0)
+        : model_{symbol, cfg, cfg.seed * 7919 + symbol}
+        , clock_{cfg, cfg.seed}
+        , rng_{cfg.seed + 1}
+        , nowNs_{double(startNs)}
+    {}
+
+    /// Next event, with seq and timestamp set
+    wire::OrderEvent next() {
+        auto e = model_.next(nextOrderId_);
+        e.seq = ++seq_;
+        nowNs_ += clock_.gapNs();
+        e.timestamp = rxNs();
+        return e;
+    }
+
+    /// Encodes 1..maxEvents events (a uniform count) into out, which holds
+    /// maxEvents * wire::orderEventSize bytes; every event carries the
+    /// packet's receive time, rxNs() as it was before the call. Returns the
+    /// bytes written.
+    std::size_t nextPacket(std::byte* out, std::size_t maxEvents) {
+        std::size_t n = 1 + rng_() % std::max<std::size_t>(maxEvents, 1), used = 0;
+        auto rx = rxNs();
+        for (std::size_t k = 0; k < n; ++k) {
+            auto e = next();
+            e.timestamp = rx;
+            used += wire::encodeOrderEvent(out + used, e);
+        }
+        return used;
+    }
+
+    /// Receive time of the latest event drawn, which is also the time
+    /// nextPacket() stamps on the packet it cuts next
+    std::uint64_t rxNs() const noexcept { return static_cast<std::uint64_t>(nowNs_); }
+    std::uint64_t sequence() const noexcept { return seq_; }
+
+private:
+    SymbolModel model_;
+    ArrivalClock clock_;
+    std::mt19937_64 rng_;
+    double nowNs_;
+    std::uint64_t seq_ = 0;
+    std::uint64_t nextOrderId_ = 1;
+};
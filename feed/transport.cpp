@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Packet transports sit under PacketFeedHandler (feed_handler.cpp). A
+/// transport delivers whole packets, each carrying whole messages:
+///
+///   std::size_t receive(std::span<RxPacket> out)
+///
+/// fills up to out.size() packets without blocking and returns how many;
+/// batch() is the most one call returns.
+/// Packet bytes stay valid until the next receive() call, which lets a ring
+/// transport hand frames back to the producer lazily. Replacing the kernel
+/// socket with a kernel-bypass ring then changes the transport type only;
+/// framing, parsing and the book never see the difference.
+
+/// Where a packet's timestamp came from, best first
+enum class TimestampSource : std::uint8_t { None, User, Kernel, Hardware };
+
+struct RxPacket {
+    std::byte const* data;
+    std::uint32_t length;
+    bool truncated;                // longer than the transport's buffer; length is 0
+    TimestampSource source;
+    std::uint64_t timestampNs;     // CLOCK_REALTIME (NIC clock for Hardware)
+
+    std::span<std::byte const> bytes() const noexcept { return {data, length}; }
+};
+
+inline std::uint64_t realtimeNs() noexcept {
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+
+struct SocketOptions {
+    /// SO_BUSY_POLL budget in microseconds; 0 leaves it alone. Raising it
+    /// above net.core.busy_read needs CAP_NET_ADMIN.
+    unsigned busyPollUs = 0;
+    /// Ask for SO_TIMESTAMPING receive timestamps (hardware when the NIC has
+    /// been set up with enableHardwareTimestamps(), software otherwise).
+    bool timestamps = false;
+};
+
+/// Turn on receive timestamping for every packet at the NIC (SIOCSHWTSTAMP).
+/// Needs CAP_NET_ADMIN and a NIC that supports it.
+/// @return `false` if the driver or the permissions refuse.
+inline bool enableHardwareTimestamps(int fd, std::string const& interface) noexcept {
+    hwtstamp_config config{};
+    config.tx_type = HWTSTAMP_TX_OFF;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+    ifreq request{};
+    std::strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    request.ifr_data = reinterpret_cast<char*>(&config);
+    return ::ioctl(fd, SIOCSHWTSTAMP, &request) == 0;
+}
+
+
+/// Kernel UDP socket transport: one non-blocking recvmmsg() per receive().
+///
+/// With SocketOptions::timestamps every packet carries its SCM_TIMESTAMPING
+/// stamp, the raw hardware one when present and the kernel software one
+/// otherwise. Without it (or when the kernel attaches none) all packets of a
+/// batch share one clock read taken after the recvmmsg() returned.
+/// The fd is not owned.
+class SocketTransport
+{
+public:
+    explicit SocketTransport(int fd, std::size_t batch = 64, std::size_t maxPacket = 2048, SocketOptions options = {})
+        : fd_{fd}
+        , batch_{batch}
+        , maxPacket_{maxPacket}
+        , buffer_{std::make_unique<std::byte[]>(batch * maxPacket)}
+        , control_(options.timestamps ? batch * controlSize : 0)
+        , iov_(batch)
+        , headers_(batch)
+    {
+        for (std::size_t i = 0; i < batch; ++i) {
+            iov_[i] = {buffer_.get() + i * maxPacket, maxPacket};
+        }
+        if (options.busyPollUs != 0) {
+            int us = static_cast<int>(options.busyPollUs);
+            busyPoll_ = ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) == 0;
+#ifdef SO_PREFER_BUSY_POLL
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+        }
+        if (options.timestamps) {
+            int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+                        | SOF_TIMESTAMPING_SOFTWARE;
+            if (::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "SO_TIMESTAMPING");
+            }
+        }
+    }
+
+    std::size_t receive(std::span<RxPacket> out) {
+        auto batch = std::min(batch_, out.size());
+        for (std::size_t i = 0; i < batch; ++i) {
+            auto& h = headers_[i].msg_hdr;
+            h = {};
+            h.msg_iov = &iov_[i];
+            h.msg_iovlen = 1;
+            if (not control_.empty()) {
+                h.msg_control = &control_[i * controlSize];
+                h.msg_controllen = controlSize;
+            }
+        }
+        auto n = ::recvmmsg(fd_, headers_.data(), static_cast<unsigned>(batch), MSG_DONTWAIT, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            throw std::system_error(errno, std::generic_category(), "recvmmsg");
+        }
+        auto count = static_cast<std::size_t>(n);
+        auto now = count != 0 ? realtimeNs() : 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            auto& h = headers_[i];
+            bool truncated = (h.msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            out[i] = {buffer_.get() + i * maxPacket_, truncated ? 0u : h.msg_len, truncated, TimestampSource::User, now};
+            if (not control_.empty()) {
+                stamp(h.msg_hdr, out[i]);
+            }
+        }
+        return count;
+    }
+
+    std::size_t batch() const noexcept { return batch_; }
+
+    /// SO_BUSY_POLL was requested and accepted
+    bool busyPolling() const noexcept { return busyPoll_; }
+
+private:
+    static constexpr std::size_t controlSize = 64;   // CMSG_SPACE(sizeof(scm_timestamping))
+    static_assert(CMSG_SPACE(sizeof(scm_timestamping)) <= controlSize);
+
+    static void stamp(msghdr& h, RxPacket& packet) noexcept {
+        for (auto* c = CMSG_FIRSTHDR(&h); c != nullptr; c = CMSG_NXTHDR(&h, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPING) {
+                continue;
+            }
+            scm_timestamping ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            if (ts.ts[2].tv_sec != 0 || ts.ts[2].tv_nsec != 0) {
+                packet.timestampNs = toNs(ts.ts[2]);
+                packet.source = TimestampSource::Hardware;
+            } else if (ts.ts[0].tv_sec != 0 || ts.ts[0].tv_nsec != 0) {
+                packet.timestampNs = toNs(ts.ts[0]);
+                packet.source = TimestampSource::Kernel;
+            }
+        }
+    }
+
+    static std::uint64_t toNs(timespec const& t) noexcept {
+        return static_cast<std::uint64_t>(t.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(t.tv_nsec);
+    }
+
+    int fd_;
+    std::size_t batch_;
+    std::size_t maxPacket_;
+    std::unique_ptr<std::byte[]> buffer_;
+    std::vector<std::byte> control_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> headers_;
+    bool busyPoll_ = false;
+};
+
+
+/// Descriptor of one received frame in a kernel-bypass style rx ring
+struct RxDescriptor {
+    std::uint64_t addr;            // frame offset in the ring's packet memory
+    std::uint32_t length;
+    std::uint64_t timestampNs;     // 0 if the ring has none
+};
+
+/// Transport over a descriptor ring, the slot for AF_XDP sockets, DPDK
+/// queues or vendor NIC libraries. The Ring supplies:
+///
+///   std::size_t peek(std::span<RxDescriptor> out)   newly received frames
+///   void release(std::size_t n)                     return the oldest n frames
+///   std::byte const* frame(std::uint64_t addr)      map addr into packet memory
+///
+/// For AF_XDP peek/release map onto the rx ring and the fill ring over a
+/// UMEM; frames are handed back on the next receive(), once the handler is
+/// done with them, so packets are parsed in place without a copy.
+template<typename Ring>
+class RingTransport
+{
+public:
+    template<typename... Args>
+    explicit RingTransport(std::size_t batch, Args&&... args)
+        : ring_(std::forward<Args>(args)...)
+        , descriptors_(batch)
+    {}
+
+    std::size_t receive(std::span<RxPacket> out) {
+        if (held_ != 0) {
+            ring_.release(held_);
+            held_ = 0;
+        }
+        auto batch = std::min(descriptors_.size(), out.size());
+        held_ = ring_.peek({descriptors_.data(), batch});
+        auto now = held_ != 0 ? realtimeNs() : 0;
+        for (std::size_t i = 0; i < held_; ++i) {
+            auto& d = descriptors_[i];
+            bool stamped = d.timestampNs != 0;
+            out[i] = {ring_.frame(d.addr), d.length, false,
+                      stamped ? TimestampSource::Hardware : TimestampSource::User, stamped ? d.timestampNs : now};
+        }
+        return held_;
+    }
+
+    std::size_t batch() const noexcept { return descriptors_.size(); }
+
+    Ring& ring() noexcept { return ring_; }
+
+private:
+    Ring ring_;
+    std::vector<RxDescriptor> descriptors_;
+    std::size_t held_ = 0;
+};
+
+
+/// In-process frame ring for RingTransport: a single producer thread copies
+/// packets into fixed-size frames (as a NIC DMAs into UMEM) and publishes
+/// descriptors; the consumer reads frames in place. Useful for testing the
+/// ring path and for injecting captured traffic without a socket.
+class MemoryRing
+{
+public:
+    explicit MemoryRing(std::size_t frames = 4096, std::size_t frameSize = 2048)
+        : mask_{frames - 1}
+        , frameSize_{frameSize}
+        , memory_{std::make_unique<std::byte[]>(frames * frameSize)}
+        , slots_{std::make_unique<RxDescriptor[]>(frames)}
+    {
+        if ((frames & mask_) != 0) {
+            throw std::invalid_argument("MemoryRing: frames must be a power of two");
+        }
+    }
+
+    /// Producer side; false when the packet doesn't fit or the ring is full.
+    bool produce(std::span<std::byte const> packet, std::uint64_t timestampNs = 0) noexcept {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (packet.size() > frameSize_ || tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        auto addr = (tail & mask_) * frameSize_;
+        std::memcpy(memory_.get() + addr, packet.data(), packet.size());
+        slots_[tail & mask_] = {addr, static_cast<std::uint32_t>(packet.size()), timestampNs};
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t peek(std::span<RxDescriptor> out) noexcept {
+        auto tail = tail_.load(std::memory_order_acquire);
+        auto n = std::min<std::size_t>(tail - next_, out.size());
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = slots_[(next_ + i) & mask_];
+        }
+        next_ += n;
+        return n;
+    }
+
+    void release(std::size_t n) noexcept { head_.store(head_.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+    std::byte const* frame(std::uint64_t addr) const noexcept { return memory_.get() + addr; }
+
+private:
+    std::size_t mask_;
+    std::size_t frameSize_;
+    std::unique_ptr<std::byte[]> memory_;
+    std::unique_ptr<RxDescriptor[]> slots_;
+    alignas(cacheLineSize) std::atomic<std::uint64_t> tail_{0};
+    alignas(cacheLineSize) std::atomic<std::uint64_t> head_{0};
+    std::uint64_t next_ = 0;   // consumer's peek cursor
+};
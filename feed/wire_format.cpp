@@ -0,0 +1,392 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "market_data.cpp"
+#include "../runtime/probe.cpp"
+
+
+/// Versioned feed wire format. All fields are little-endian and unaligned;
+/// messages are packed back to back, each starting with a 12-byte header:
+///
+///   offset  size  field
+///        0     2  length   total message bytes, header included
+///        2     1  type     WireType
+///        3     1  version  layout version of this type's body
+///        4     8  seq      per-feed sequence number
+///
+/// Tick (version 1) body, 32 bytes in total:
+///
+///       12     8  timestamp  ns since epoch
+///       20     8  price      IEEE-754 double
+///       28     4  volume
+///
+/// Add, Cancel and Trade (version 1) share one order-event body, 44 bytes
+/// in total:
+///
+///       12     8  timestamp  ns since epoch
+///       20     8  order_id   for Trade, the resting order
+///       28     8  price      signed fixed point, 1e-4 units (orderbook Price)
+///       36     4  quantity   for Cancel, 0; for Trade, the traded size
+///       40     2  symbol
+///       42     1  side       0 buy, 1 sell (the resting side for Trade)
+///       43     1  reserved
+///
+/// Newer versions may only append fields and grow length, so a v1 decoder
+/// reads the prefix it knows and skips the rest using length.
+namespace wire {
+
+enum class WireType : std::uint8_t { Heartbeat = 0, Tick = 1, Add = 2, Cancel = 3, Trade = 4 };
+
+inline constexpr std::size_t headerSize = 12;
+inline constexpr std::size_t tickSize = 32;
+inline constexpr std::uint8_t tickVersion = 1;
+inline constexpr std::size_t orderEventSize = 44;
+inline constexpr std::uint8_t orderEventVersion = 1;
+
+namespace offset {
+inline constexpr std::size_t length = 0;
+inline constexpr std::size_t type = 2;
+inline constexpr std::size_t version = 3;
+inline constexpr std::size_t seq = 4;
+inline constexpr std::size_t timestamp = 12;
+inline constexpr std::size_t price = 20;
+inline constexpr std::size_t volume = 28;
+inline constexpr std::size_t orderId = 20;
+inline constexpr std::size_t orderPrice = 28;
+inline constexpr std::size_t quantity = 36;
+inline constexpr std::size_t symbol = 40;
+inline constexpr std::size_t side = 42;
+}
+
+/// First four bytes of every v1 tick: length 32, type Tick, version 1
+inline constexpr std::uint32_t tickHeaderWord =
+    tickSize | std::uint32_t(WireType::Tick) << 16 | std::uint32_t(tickVersion) << 24;
+
+template<typename T>
+T load(std::byte const* p) noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if constexpr (std::endian::native == std::endian::little) {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    } else {
+        std::byte swapped[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            swapped[i] = p[sizeof(T) - 1 - i];
+        }
+        T v;
+        std::memcpy(&v, swapped, sizeof(T));
+        return v;
+    }
+}
+
+template<typename T>
+void store(std::byte* p, T v) noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    std::memcpy(p, &v, sizeof(T));
+    if constexpr (std::endian::native != std::endian::little) {
+        for (std::size_t i = 0; i < sizeof(T) / 2; ++i) {
+            std::swap(p[i], p[sizeof(T) - 1 - i]);
+        }
+    }
+}
+
+inline void storeHeader(std::byte* out, std::uint16_t length, WireType type, std::uint8_t version,
+                        std::uint64_t seq) noexcept {
+    store(out + offset::length, length);
+    store(out + offset::type, static_cast<std::uint8_t>(type));
+    store(out + offset::version, version);
+    store(out + offset::seq, seq);
+}
+
+/// Write a v1 tick; returns its size (tickSize).
+inline std::size_t encodeTick(std::byte* out, std::uint64_t seq, MarketData const& md) noexcept {
+    storeHeader(out, tickSize, WireType::Tick, tickVersion, seq);
+    store(out + offset::timestamp, md.timestamp);
+    store(out + offset::price, md.price);
+    store(out + offset::volume, md.volume);
+    return tickSize;
+}
+
+/// Write a header-only heartbeat; returns its size (headerSize).
+inline std::size_t encodeHeartbeat(std::byte* out, std::uint64_t seq) noexcept {
+    storeHeader(out, headerSize, WireType::Heartbeat, 1, seq);
+    return headerSize;
+}
+
+/// Decoded Add, Cancel or Trade
+struct OrderEvent {
+    WireType type;
+    bool is_buy;
+    std::uint16_t symbol;
+    std::uint32_t quantity;
+    std::uint64_t seq;
+    std::uint64_t timestamp;
+    std::uint64_t order_id;
+    std::int64_t price;
+};
+
+/// Write a v1 order event; returns its size (orderEventSize).
+inline std::size_t encodeOrderEvent(std::byte* out, OrderEvent const& e) noexcept {
+    storeHeader(out, orderEventSize, e.type, orderEventVersion, e.seq);
+    store(out + offset::timestamp, e.timestamp);
+    store(out + offset::orderId, e.order_id);
+    store(out + offset::orderPrice, e.price);
+    store(out + offset::quantity, e.quantity);
+    store(out + offset::symbol, e.symbol);
+    store(out + offset::side, std::uint8_t(e.is_buy ? 0 : 1));
+    store(out + offset::side + 1, std::uint8_t(0));
+    return orderEventSize;
+}
+
+/// Decode a framed message of length bytes if it is an order event.
+/// @return `true` if out was filled.
+inline bool decodeOrderEvent(std::byte const* p, std::size_t length, OrderEvent& out) noexcept {
+    auto type = load<std::uint8_t>(p + offset::type);
+    if (type < std::uint8_t(WireType::Add) || type > std::uint8_t(WireType::Trade)
+        || load<std::uint8_t>(p + offset::version) < orderEventVersion || length < orderEventSize) {
+        return false;
+    }
+    out.type = WireType(type);
+    out.seq = load<std::uint64_t>(p + offset::seq);
+    out.timestamp = load<std::uint64_t>(p + offset::timestamp);
+    out.order_id = load<std::uint64_t>(p + offset::orderId);
+    out.price = load<std::int64_t>(p + offset::orderPrice);
+    out.quantity = load<std::uint32_t>(p + offset::quantity);
+    out.symbol = load<std::uint16_t>(p + offset::symbol);
+    out.is_buy = load<std::uint8_t>(p + offset::side) == 0;
+    return true;
+}
+
+/// Framer for the feed handlers. A length below the header size is treated
+/// as a header-only message so a corrupt stream still makes progress; the
+/// decoder then skips it.
+struct Framer {
+    static constexpr std::size_t maxSize = 0xffff;
+
+    static std::size_t size(std::byte const* p, std::size_t available) noexcept {
+        if (available < sizeof(std::uint16_t)) {
+            return 0;
+        }
+        std::size_t length = load<std::uint16_t>(p + offset::length);
+        return length < headerSize ? headerSize : length;
+    }
+};
+
+
+/// Decoded ticks as structure-of-arrays columns with fixed capacity.
+class TickColumns
+{
+public:
+    explicit TickColumns(std::size_t capacity)
+        : capacity_{capacity}
+        , seq_{std::make_unique_for_overwrite<std::uint64_t[]>(capacity)}
+        , timestamp_{std::make_unique_for_overwrite<std::uint64_t[]>(capacity)}
+        , price_{std::make_unique_for_overwrite<double[]>(capacity)}
+        , volume_{std::make_unique_for_overwrite<std::uint32_t[]>(capacity)}
+    {}
+
+    std::size_t size() const noexcept { return size_; }
+    std::size_t capacity() const noexcept { return capacity_; }
+    bool full() const noexcept { return size_ == capacity_; }
+    void clear() noexcept { size_ = 0; }
+
+    std::span<std::uint64_t const> seq() const noexcept { return {seq_.get(), size_}; }
+    std::span<std::uint64_t const> timestamp() const noexcept { return {timestamp_.get(), size_}; }
+    std::span<double const> price() const noexcept { return {price_.get(), size_}; }
+    std::span<std::uint32_t const> volume() const noexcept { return {volume_.get(), size_}; }
+
+    MarketData operator[](std::size_t i) const noexcept { return {timestamp_[i], price_[i], volume_[i]}; }
+
+    /// Ticks decoded per SIMD step
+    static constexpr std::size_t lanes = 8;
+
+private:
+    friend struct Decoder;
+
+    std::size_t capacity_;
+    std::size_t size_ = 0;
+    std::unique_ptr<std::uint64_t[]> seq_;
+    std::unique_ptr<std::uint64_t[]> timestamp_;
+    std::unique_ptr<double[]> price_;
+    std::unique_ptr<std::uint32_t[]> volume_;
+};
+
+
+struct DecodeResult {
+    std::size_t consumed = 0;   // bytes of whole messages used
+    std::size_t ticks = 0;      // ticks appended to the columns
+    std::size_t skipped = 0;    // other message types, unknown versions
+};
+
+/// Block decoder: appends every tick in a buffer of whole messages to SoA
+/// columns. Runs of v1 ticks (32-byte stride) are decoded eight at a time
+/// with AVX2 gathers: one gather checks eight header words, then one gather
+/// per column loads the fields. Everything else goes through the scalar path.
+struct Decoder {
+    /// Decode messages from block until it or out runs out. A partial message
+    /// at the end is left unconsumed.
+    static DecodeResult decode(std::span<std::byte const> block, TickColumns& out) noexcept {
+        LATENCY_PROBE_SCOPE("wire::Decoder::decode");
+        DecodeResult r;
+        auto p = block.data();
+        auto end = block.data() + block.size();
+        while (p != end && not out.full()) {
+#if defined(__AVX2__)
+            if (std::endian::native == std::endian::little) {
+                auto n = decodeRun(p, end, out);
+                p += n * tickSize;
+                r.ticks += n;
+                if (p == end || out.full()) {
+                    break;
+                }
+            }
+#endif
+            auto available = static_cast<std::size_t>(end - p);
+            auto length = Framer::size(p, available);
+            if (length == 0 || length > available) {
+                break;
+            }
+            if (decodeOne(p, length, out)) {
+                ++r.ticks;
+            } else {
+                ++r.skipped;
+            }
+            p += length;
+        }
+        r.consumed = static_cast<std::size_t>(p - block.data());
+        return r;
+    }
+
+    /// Scalar decode of one framed message.
+    /// @return `true` if it was a tick and was appended.
+    static bool decodeOne(std::byte const* p, std::size_t length, TickColumns& out) noexcept {
+        auto type = load<std::uint8_t>(p + offset::type);
+        auto version = load<std::uint8_t>(p + offset::version);
+        if (type != std::uint8_t(WireType::Tick) || version < tickVersion || length < tickSize) {
+            return false;
+        }
+        auto i = out.size_++;
+        out.seq_[i] = load<std::uint64_t>(p + offset::seq);
+        out.timestamp_[i] = load<std::uint64_t>(p + offset::timestamp);
+        out.price_[i] = load<double>(p + offset::price);
+        out.volume_[i] = load<std::uint32_t>(p + offset::volume);
+        return true;
+    }
+
+#if defined(__AVX2__)
+    /// Decode whole groups of eight consecutive v1 ticks starting at p.
+    /// @return the number of ticks decoded (a multiple of eight).
+    static std::size_t decodeRun(std::byte const* p, std::byte const* end, TickColumns& out) noexcept {
+        auto const stride = _mm256_setr_epi32(0, 32, 64, 96, 128, 160, 192, 224);
+        auto const lo = _mm_setr_epi32(0, 32, 64, 96);
+        auto const hi = _mm_setr_epi32(128, 160, 192, 224);
+        auto const expected = _mm256_set1_epi32(static_cast<int>(tickHeaderWord));
+        auto const all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        std::size_t n = 0;
+        while (static_cast<std::size_t>(end - p) >= TickColumns::lanes * tickSize
+               && out.capacity_ - out.size_ >= TickColumns::lanes) {
+            auto base = reinterpret_cast<char const*>(p);
+            auto headers = _mm256_i32gather_epi32(reinterpret_cast<int const*>(base), stride, 1);
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(headers, expected)) != -1) {
+                break;
+            }
+            auto i = out.size_;
+            auto seq = reinterpret_cast<long long const*>(base + offset::seq);
+            auto ts = reinterpret_cast<long long const*>(base + offset::timestamp);
+            auto px = reinterpret_cast<double const*>(base + offset::price);
+            auto vol = reinterpret_cast<int const*>(base + offset::volume);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.seq_[i]), _mm256_i32gather_epi64(seq, lo, 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.seq_[i + 4]), _mm256_i32gather_epi64(seq, hi, 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.timestamp_[i]), _mm256_i32gather_epi64(ts, lo, 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.timestamp_[i + 4]), _mm256_i32gather_epi64(ts, hi, 1));
+            _mm256_storeu_pd(&out.price_[i], _mm256_mask_i32gather_pd(_mm256_setzero_pd(), px, lo, all, 1));
+            _mm256_storeu_pd(&out.price_[i + 4], _mm256_mask_i32gather_pd(_mm256_setzero_pd(), px, hi, all, 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.volume_[i]), _mm256_i32gather_epi32(vol, stride, 1));
+            out.size_ += TickColumns::lanes;
+            p += TickColumns::lanes * tickSize;
+            n += TickColumns::lanes;
+        }
+        return n;
+    }
+#endif
+};
+
+} // namespace wire
+
+
+#ifdef WIRE_FORMAT_DEMO
+// -DALLOC_TRACKING checks that decoding never touches the heap.
+#include "../memory/alloc_tracking.cpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Mixed stream of ticks with the odd heartbeat and a future v2 tick, decoded
+// block by block and checked against what was encoded.
+int main() {
+    constexpr std::size_t count = 2'000'000;
+    std::mt19937 rng(7);
+    std::vector<std::byte> stream(count * 48);
+    std::vector<MarketData> sent;
+    std::size_t at = 0;
+    std::uint64_t seq = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto r = rng() % 64;
+        if (r == 0) {
+            at += wire::encodeHeartbeat(&stream[at], ++seq);
+        } else if (r == 1) {
+            // v2 tick: v1 fields plus 8 bytes a v1 decoder must skip
+            MarketData md{i, 99.5, 7};
+            wire::encodeTick(&stream[at], ++seq, md);
+            wire::store<std::uint16_t>(&stream[at], 40);
+            wire::store<std::uint8_t>(&stream[at + wire::offset::version], 2);
+            at += 40;
+            sent.push_back(md);
+        } else {
+            MarketData md{i, 100.0 + double(i % 1000) / 100, static_cast<std::uint32_t>(i % 500)};
+            at += wire::encodeTick(&stream[at], ++seq, md);
+            sent.push_back(md);
+        }
+    }
+    stream.resize(at);
+
+    wire::TickColumns columns(4096);
+    std::size_t checked = 0, skipped = 0, blocks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t pos = 0; pos < stream.size(); ++blocks) {
+        ALLOC_HOT_REGION("decode block");
+        // Block boundaries land mid-message, like reads off a socket
+        auto block = std::span<std::byte const>(stream).subspan(pos, std::min<std::size_t>(65000, stream.size() - pos));
+        columns.clear();
+        auto r = wire::Decoder::decode(block, columns);
+        for (std::size_t i = 0; i < columns.size(); ++i, ++checked) {
+            auto md = columns[i];
+            if (md.timestamp != sent[checked].timestamp || md.price != sent[checked].price
+                || md.volume != sent[checked].volume) {
+                std::printf("mismatch at tick %zu\n", checked);
+                return 1;
+            }
+        }
+        skipped += r.skipped;
+        pos += r.consumed;
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%zu ticks, %zu skipped, %zu blocks, %.1f M ticks/s (with checks)\n", checked, skipped, blocks,
+                checked / secs.count() / 1e6);
+    return checked != sent.size();
+}
+#endif
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Work-stealing deque (Chase and Lev, 2005), with the C11 orderings of Lê,
+/// Pop, Cohen and Zappa Nardelli (2013).
+///
+/// One owner thread push()es and pop()s at the bottom, LIFO, so it keeps
+/// working on what it touched last; any number of thieves steal() from the
+/// top, FIFO, taking the oldest and normally largest pieces of work. Owner
+/// operations are a few plain loads and stores, with one fence in pop(); only
+/// the race for the last element and steals use a CAS on top_.
+///
+/// The ring grows by doubling when full. A thief may still be reading the
+/// old ring, so retired rings are kept until the deque dies: total memory
+/// stays under twice the largest ring.
+template<typename T>
+class ChaseLevDeque
+{
+    static_assert(std::is_trivially_copyable_v<T>, "slots are read racily by thieves, so T must copy as bytes");
+
+    class Ring
+    {
+    public:
+        explicit Ring(std::int64_t capacity)
+            : mask_{capacity - 1}
+            , slots_{std::make_unique<std::atomic<T>[]>(static_cast<std::size_t>(capacity))}
+        {}
+
+        std::int64_t capacity() const noexcept { return mask_ + 1; }
+        T get(std::int64_t i) const noexcept { return slots_[i & mask_].load(std::memory_order_relaxed); }
+        void put(std::int64_t i, T v) noexcept { slots_[i & mask_].store(v, std::memory_order_relaxed); }
+
+    private:
+        std::int64_t mask_;
+        std::unique_ptr<std::atomic<T>[]> slots_;
+    };
+
+public:
+    /// Capacity is rounded up to a power of two.
+    explicit ChaseLevDeque(std::size_t capacity = 256) {
+        std::int64_t c = 2;
+        while (c < static_cast<std::int64_t>(capacity)) {
+            c <<= 1;
+        }
+        rings_.push_back(std::make_unique<Ring>(c));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    ChaseLevDeque(ChaseLevDeque const&) = delete;
+    ChaseLevDeque& operator=(ChaseLevDeque const&) = delete;
+
+    /// Owner only: add v at the bottom, growing the ring if it is full.
+    void push(T v) {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        auto t = top_.load(std::memory_order_acquire);
+        auto* ring = ring_.load(std::memory_order_relaxed);
+        if (b - t > ring->capacity() - 1) [[unlikely]] {
+            ring = grow(ring, t, b);
+        }
+        ring->put(b, v);
+        // Release store rather than the paper's fence + relaxed store: same
+        // ordering, and visible to ThreadSanitizer
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    /// Owner only: take the most recently pushed element.
+    /// @return `true` if out was set; `false` if the deque was empty or a
+    ///         thief won the last element.
+    bool pop(T& out) noexcept {
+        auto b = bottom_.load(std::memory_order_relaxed) - 1;
+        auto* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        out = ring->get(b);
+        if (t < b) {
+            return true;
+        }
+        // Last element: thieves may be after it too
+        bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    /// Any thread: take the oldest element.
+    /// @return `true` if out was set; `false` if the deque was empty or
+    ///         another thread took the element first (worth retrying).
+    bool steal(T& out) noexcept {
+        auto t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        // Acquire pairs with grow()'s release, so a new ring's copy is visible
+        T v = ring_.load(std::memory_order_acquire)->get(t);
+        if (not top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        out = v;
+        return true;
+    }
+
+    /// Returns the number of elements; approximate while others steal
+    std::size_t size() const noexcept {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        auto t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+
+private:
+    Ring* grow(Ring* old, std::int64_t t, std::int64_t b) {
+        auto next = std::make_unique<Ring>(old->capacity() * 2);
+        for (auto i = t; i < b; ++i) {
+            next->put(i, old->get(i));
+        }
+        auto* ring = next.get();
+        rings_.push_back(std::move(next));      // old ring stays alive for late thieves
+        ring_.store(ring, std::memory_order_release);
+        return ring;
+    }
+
+    /// Thieves CAS top_; keep it off the owner's bottom_ line
+    alignas(cacheLineSize) std::atomic<std::int64_t> top_{0};
+    alignas(cacheLineSize) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<Ring*> ring_{nullptr};
+    std::vector<std::unique_ptr<Ring>> rings_;      // owner's; every ring ever used
+};
+
+
+#ifdef CHASE_LEV_DEQUE_DEMO
+// g++ -std=c++20 -O2 -march=native -pthread -DCHASE_LEV_DEQUE_DEMO -x c++ chaseLevDeque.cpp -o chaseLevDeque
+#include <cstdio>
+#include <thread>
+
+int main() {
+    // The owner pushes bursts and pops some back while thieves steal; every
+    // value must come out exactly once.
+    constexpr std::uint32_t items = 2'000'000;
+    constexpr int thieves = 3;
+    ChaseLevDeque<std::uint32_t> deque(16);         // small, so it grows under load
+    std::vector<std::atomic<std::uint8_t>> seen(items);
+    std::atomic<bool> done{false};
+    std::atomic<std::uint64_t> stolen{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thieves; ++i) {
+        threads.emplace_back([&] {
+            std::uint64_t n = 0;
+            std::uint32_t v;
+            while (not done.load(std::memory_order_acquire) || not deque.empty()) {
+                if (deque.steal(v)) {
+                    seen[v].fetch_add(1, std::memory_order_relaxed);
+                    ++n;
+                }
+            }
+            stolen += n;
+        });
+    }
+
+    std::uint64_t popped = 0;
+    std::uint32_t v;
+    for (std::uint32_t next = 0; next < items;) {
+        for (int k = 0; k < 64 && next < items; ++k) {
+            deque.push(next++);
+        }
+        for (int k = 0; k < 40 && deque.pop(v); ++k) {
+            seen[v].fetch_add(1, std::memory_order_relaxed);
+            ++popped;
+        }
+    }
+    while (deque.pop(v)) {
+        seen[v].fetch_add(1, std::memory_order_relaxed);
+        ++popped;
+    }
+    done.store(true, std::memory_order_release);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::uint64_t bad = 0;
+    for (auto& s : seen) {
+        bad += s.load() != 1;
+    }
+    std::printf("%llu popped by the owner, %llu stolen, %llu lost or duplicated\n", (unsigned long long)popped,
+                (unsigned long long)stolen.load(), (unsigned long long)bad);
+    return bad != 0;
+}
+#endif
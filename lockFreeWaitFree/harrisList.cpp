@@ -0,0 +1,318 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include "hazardPointers.cpp"
+
+
+/// Lock-free ordered set (Harris' marked-pointer list with Michael's
+/// hazard-pointer-safe traversal).
+///
+/// remove() first sets the low bit of the victim's next pointer -- after that
+/// no insert can link behind it -- and then swings the predecessor past it.
+/// Any traversal that meets a marked node finishes the unlink itself, so a
+/// stalled remover never blocks anyone. Unlinked nodes are retired to
+/// HazardPointers and recycled through a per-thread ThreadNodePool.
+///
+/// insert, remove and contains are lock-free; contains never writes shared
+/// memory other than the caller's own hazard slots.
+template<typename Key, typename Compare = std::less<Key>>
+class HarrisList
+{
+    struct Node {
+        Key key;
+        std::atomic<std::uintptr_t> next;
+
+        template<typename K>
+        explicit Node(K&& k) : key(std::forward<K>(k)), next{0} {}
+    };
+
+    using Pool = ThreadNodePool<Node>;
+    using Link = std::atomic<std::uintptr_t>;
+
+    static_assert(alignof(Node) >= 2, "the low bit of a node address is the deletion mark");
+
+public:
+    using key_type = Key;
+
+    explicit HarrisList(Compare const& compare = Compare{})
+        : compare_{compare}
+    {}
+
+    HarrisList(HarrisList const&) = delete;
+    HarrisList& operator=(HarrisList const&) = delete;
+
+    /// Not thread-safe: no other thread may be using the list.
+    ~HarrisList() {
+        for (auto p = node(head_.load(std::memory_order_relaxed)); p != nullptr;) {
+            auto next = node(p->next.load(std::memory_order_relaxed));
+            Pool::destroy(p);
+            p = next;
+        }
+    }
+
+    /// Add key unless it is present.
+    /// @return `true` if inserted.
+    template<typename K>
+    bool insert(K&& key) {
+        HazardPointers::Guard guard;
+        Node* fresh = nullptr;
+        for (;;) {
+            // After the first attempt key may have been moved into fresh
+            auto w = fresh != nullptr ? find(guard, fresh->key) : find(guard, key);
+            if (w.found) {
+                if (fresh != nullptr) {
+                    Pool::destroy(fresh);   // never published
+                }
+                return false;
+            }
+            if (fresh == nullptr) {
+                fresh = Pool::create(std::forward<K>(key));
+            }
+            fresh->next.store(bits(w.curr), std::memory_order_relaxed);
+            auto expected = bits(w.curr);
+            if (w.prev->compare_exchange_strong(expected, bits(fresh), std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    /// Remove key if present.
+    /// @return `true` if this call removed it.
+    bool remove(Key const& key) {
+        HazardPointers::Guard guard;
+        for (;;) {
+            auto w = find(guard, key);
+            if (not w.found) {
+                return false;
+            }
+            auto next = w.curr->next.load(std::memory_order_acquire);
+            if (marked(next)) {
+                continue;   // another remover got there first; find() will unlink it
+            }
+            // Logical delete: the mark freezes curr's next pointer
+            if (not w.curr->next.compare_exchange_strong(next, next | markBit, std::memory_order_acq_rel)) {
+                continue;
+            }
+            // Physical delete, or leave it to the next traversal
+            auto expected = bits(w.curr);
+            if (w.prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel)) {
+                HazardPointers::retire(w.curr, &Pool::reclaim);
+            } else {
+                find(guard, key);
+            }
+            return true;
+        }
+    }
+
+    /// Returns whether key is present.
+    bool contains(Key const& key) const {
+        HazardPointers::Guard guard;
+        return const_cast<HarrisList*>(this)->find(guard, key).found;
+    }
+
+    /// Visit every key in order, each at most once. Not linearizable against
+    /// concurrent updates; meant for snapshots and debugging. A walk that
+    /// loses its place to a concurrent remove resumes after the last key it
+    /// passed to f rather than from the head. f may itself use this or any
+    /// other hazard-protected structure: its guards nest inside this one's.
+    template<typename F>
+    void for_each(F&& f) const {
+        auto self = const_cast<HarrisList*>(this);
+        HazardPointers::Guard guard;
+        std::optional<Key> last;
+        Link* prev = &self->head_;
+    restart:
+        auto curr = node(prev->load(std::memory_order_acquire));
+        while (curr != nullptr) {
+            guard.set(currSlot, curr);
+            if (prev->load(std::memory_order_acquire) != bits(curr)) {
+                if (not last) {
+                    prev = &self->head_;
+                    goto restart;
+                }
+                // First node not less than last; it is skipped below if equal
+                auto w = self->find(guard, *last);
+                prev = w.prev;
+                curr = w.curr;
+                continue;
+            }
+            auto next = curr->next.load(std::memory_order_acquire);
+            if (not marked(next) && (not last || compare_(*last, curr->key))) {
+                last = curr->key;
+                f(std::as_const(curr->key));
+            }
+            guard.set(prevSlot, curr);
+            prev = &curr->next;
+            curr = node(next);
+        }
+    }
+
+private:
+    static constexpr std::uintptr_t markBit = 1;
+    static constexpr std::size_t prevSlot = 0;
+    static constexpr std::size_t currSlot = 1;
+
+    static Node* node(std::uintptr_t link) noexcept { return reinterpret_cast<Node*>(link & ~markBit); }
+    static std::uintptr_t bits(Node* p) noexcept { return reinterpret_cast<std::uintptr_t>(p); }
+    static bool marked(std::uintptr_t link) noexcept { return (link & markBit) != 0; }
+
+    /// prev is the link that points to curr; curr is the first node with key
+    /// not less than the search key (or nullptr). Both nodes are protected by
+    /// guard on return.
+    struct Window {
+        Link* prev;
+        Node* curr;
+        bool found;
+    };
+
+    template<typename K>
+    Window find(HazardPointers::Guard& guard, K const& key) {
+    restart:
+        Link* prev = &head_;
+        auto curr = node(prev->load(std::memory_order_acquire));
+        for (;;) {
+            if (curr == nullptr) {
+                return {prev, nullptr, false};
+            }
+            guard.set(currSlot, curr);
+            // curr is safe to touch only if prev still points at it unmarked
+            if (prev->load(std::memory_order_acquire) != bits(curr)) {
+                goto restart;
+            }
+            auto next = curr->next.load(std::memory_order_acquire);
+            if (marked(next)) {
+                auto expected = bits(curr);
+                if (not prev->compare_exchange_strong(expected, next & ~markBit, std::memory_order_acq_rel)) {
+                    goto restart;
+                }
+                HazardPointers::retire(curr, &Pool::reclaim);
+                curr = node(next);
+                continue;
+            }
+            if (not compare_(curr->key, key)) {
+                return {prev, curr, not compare_(key, curr->key)};
+            }
+            guard.set(prevSlot, curr);
+            prev = &curr->next;
+            curr = node(next);
+        }
+    }
+
+    Link head_{0};
+    [[no_unique_address]] Compare compare_;
+};
+
+
+#ifdef HARRIS_LIST_DEMO
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+int main() {
+    HarrisList<long> subscriptions;
+    constexpr long keys = 512;
+    constexpr int writers = 3;
+    constexpr long rounds = 20000;
+    std::atomic<bool> done{false};
+    std::atomic<long> hits{0};
+
+    // Readers probe while writers churn disjoint key ranges
+    std::thread reader([&] {
+        long n = 0;
+        while (not done.load(std::memory_order_relaxed)) {
+            for (long k = 0; k < keys * writers; k += 7) {
+                n += subscriptions.contains(k);
+            }
+        }
+        hits = n;
+    });
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            for (long r = 0; r < rounds; ++r) {
+                long k = w * keys + r % keys;
+                if (not subscriptions.insert(k) || not subscriptions.remove(k) || not subscriptions.insert(k)) {
+                    std::printf("writer %d lost key %ld\n", w, k);
+                    std::abort();
+                }
+                subscriptions.remove(k);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    done = true;
+    reader.join();
+
+    long left = 0, last = -1;
+    subscriptions.for_each([&](long k) {
+        if (k <= last) {
+            std::printf("out of order\n");
+            std::abort();
+        }
+        last = k;
+        ++left;
+    });
+
+    // Deterministically: a hazard set by an outer guard survives an inner
+    // guard's lifetime and a scan that reclaims everything else.
+    static bool protectedReclaimed, anyReclaimed;
+    {
+        static int victim, filler;
+        HazardPointers::Guard outer;
+        outer.set(0, &victim);
+        { HazardPointers::Guard inner; inner.set(0, &filler); }
+        HazardPointers::retire(&victim, [](void*) { protectedReclaimed = true; });
+        for (int i = 0; i < 1024; ++i) {
+            HazardPointers::retire(&filler, [](void*) { anyReclaimed = true; });
+        }
+        if (protectedReclaimed || not anyReclaimed) {
+            std::printf("outer hazard dropped by a nested guard\n");
+            std::abort();
+        }
+    }
+
+    // A for_each callback probing the list while a writer removes the very
+    // nodes being walked: the callback's guard must not clear the walk's.
+    constexpr long nested = 4096;
+    for (long k = 0; k < nested; ++k) {
+        subscriptions.insert(k);
+    }
+    std::atomic<bool> walking{true};
+    std::thread remover([&] {
+        for (long r = 0; walking.load(std::memory_order_relaxed); ++r) {
+            long k = r % nested;
+            subscriptions.remove(k);
+            subscriptions.insert(k);
+        }
+    });
+    long probes = 0;
+    for (int pass = 0; pass < 50; ++pass) {
+        long prevKey = -1;
+        subscriptions.for_each([&](long k) {
+            if (k <= prevKey) {
+                std::printf("for_each under churn repeated or reordered key %ld after %ld\n", k, prevKey);
+                std::abort();
+            }
+            prevKey = k;
+            probes += subscriptions.contains(k) + subscriptions.contains(k + 1);
+        });
+    }
+    walking = false;
+    remover.join();
+    for (long k = 0; k < nested; ++k) {
+        subscriptions.remove(k);
+    }
+
+    std::printf("%ld keys left, reader saw %ld hits, %ld nested probes hit\n", left, hits.load(), probes);
+    return left != 0;
+}
+#endif
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Hazard-pointer reclamation (Michael, 2004).
+///
+/// A reader publishes the node it is about to dereference in one of its
+/// hazard slots, then re-checks that the node is still reachable. A writer
+/// that unlinks a node retire()s it; the node is reclaimed only once a scan
+/// finds it in nobody's slots. Every thread gets one record of slotsPerThread
+/// slots the first time it touches the domain and hands it back at thread exit.
+///
+/// Each Guard owns slotsPerGuard of those slots, stacked by nesting depth, so
+/// a guarded operation may call another (a for_each callback probing any
+/// hazard-protected structure) without dropping the outer guard's hazards.
+/// Guards nest at most maxNesting deep and must be destroyed in reverse order
+/// of construction, which scoped guards are.
+class HazardPointers
+{
+public:
+    static constexpr std::size_t maxThreads = 256;
+    static constexpr std::size_t slotsPerGuard = 2;
+    static constexpr std::size_t maxNesting = 4;
+    static constexpr std::size_t slotsPerThread = slotsPerGuard * maxNesting;
+
+    /// Called with the retired pointer once no hazard slot holds it
+    using Reclaim = void (*)(void*);
+
+private:
+    struct alignas(cacheLineSize) Record {
+        std::atomic<bool> active{false};
+        std::atomic<void*> slots[slotsPerThread]{};
+    };
+
+    struct Retired {
+        void* p;
+        Reclaim reclaim;
+    };
+
+    class ThreadState;
+
+public:
+    /// slotsPerGuard of the calling thread's hazard slots, the next ones up
+    /// from any enclosing guard's; cleared on destruction.
+    class Guard
+    {
+    public:
+        Guard() : state_{&threadState()}, slots_{state_->push()} {}
+
+        Guard(Guard const&) = delete;
+        Guard& operator=(Guard const&) = delete;
+
+        ~Guard() {
+            for (std::size_t i = 0; i < slotsPerGuard; ++i) {
+                slots_[i].store(nullptr, std::memory_order_release);
+            }
+            state_->pop();
+        }
+
+        /// Publish p in slot i (< slotsPerGuard). The caller must re-validate
+        /// that p is still reachable before dereferencing it.
+        void set(std::size_t i, void const* p) noexcept {
+            slots_[i].store(const_cast<void*>(p), std::memory_order_seq_cst);
+        }
+
+        void clear(std::size_t i) noexcept {
+            slots_[i].store(nullptr, std::memory_order_release);
+        }
+
+    private:
+        ThreadState* state_;
+        std::atomic<void*>* slots_;
+    };
+
+    /// Reclaim p once it is no longer protected; p must already be unreachable.
+    static void retire(void* p, Reclaim reclaim) {
+        auto& state = threadState();
+        state.retired.push_back({p, reclaim});
+        if (state.retired.size() >= retireThreshold()) {
+            scan(state.retired);
+        }
+    }
+
+    /// Nodes retired by this thread and not reclaimed yet
+    static std::size_t pending() noexcept { return threadState().retired.size(); }
+
+private:
+    struct Domain {
+        Record records[maxThreads];
+        std::atomic<std::size_t> highWater{0};
+
+        /// Retired nodes still protected when their thread exited
+        std::mutex orphansMutex;
+        std::vector<Retired> orphans;
+
+        ~Domain() {
+            for (auto& r : orphans) {
+                r.reclaim(r.p);
+            }
+        }
+    };
+
+    static Domain& domain() {
+        static Domain d;
+        return d;
+    }
+
+    class ThreadState
+    {
+    public:
+        ThreadState() = default;
+        ThreadState(ThreadState const&) = delete;
+        ThreadState& operator=(ThreadState const&) = delete;
+
+        ~ThreadState() {
+            if (record_ == nullptr) {
+                return;
+            }
+            scan(retired);
+            if (not retired.empty()) {
+                auto& d = domain();
+                std::lock_guard lock{d.orphansMutex};
+                d.orphans.insert(d.orphans.end(), retired.begin(), retired.end());
+            }
+            record_->active.store(false, std::memory_order_release);
+        }
+
+        Record& record() {
+            if (record_ == nullptr) {
+                record_ = acquire();
+            }
+            return *record_;
+        }
+
+        /// Slots for a new innermost guard
+        std::atomic<void*>* push() {
+            auto& r = record();
+            if (depth_ == maxNesting) {
+                throw std::runtime_error("HazardPointers: guards nested deeper than maxNesting");
+            }
+            return &r.slots[slotsPerGuard * depth_++];
+        }
+
+        void pop() noexcept { --depth_; }
+
+        std::vector<Retired> retired;
+
+    private:
+        static Record* acquire() {
+            auto& d = domain();
+            for (std::size_t i = 0; i < maxThreads; ++i) {
+                bool expected = false;
+                if (not d.records[i].active.load(std::memory_order_relaxed)
+                    && d.records[i].active.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                    auto high = d.highWater.load(std::memory_order_relaxed);
+                    while (high < i + 1 && not d.highWater.compare_exchange_weak(high, i + 1)) {}
+                    return &d.records[i];
+                }
+            }
+            throw std::runtime_error("HazardPointers: more than maxThreads threads");
+        }
+
+        Record* record_ = nullptr;
+        std::size_t depth_ = 0;
+    };
+
+    static ThreadState& threadState() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    /// Scanning costs O(threads * slots); amortise it over as many retires
+    static std::size_t retireThreshold() noexcept {
+        return 2 * slotsPerThread * domain().highWater.load(std::memory_order_relaxed) + 64;
+    }
+
+    static void scan(std::vector<Retired>& retired) {
+        auto& d = domain();
+        {
+            std::unique_lock lock{d.orphansMutex, std::try_to_lock};
+            if (lock.owns_lock() && not d.orphans.empty()) {
+                retired.insert(retired.end(), d.orphans.begin(), d.orphans.end());
+                d.orphans.clear();
+            }
+        }
+
+        // Pairs with the seq_cst store in Guard::set: a slot set before the
+        // node was unlinked is visible here, one set after fails validation
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::vector<void*> hazards;
+        auto high = d.highWater.load(std::memory_order_acquire);
+        hazards.reserve(high * slotsPerThread);
+        for (std::size_t i = 0; i < high; ++i) {
+            for (auto& slot : d.records[i].slots) {
+                if (auto p = slot.load(std::memory_order_acquire)) {
+                    hazards.push_back(p);
+                }
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+
+        auto keep = std::partition(retired.begin(), retired.end(), [&](Retired const& r) {
+            return std::binary_search(hazards.begin(), hazards.end(), r.p);
+        });
+        for (auto it = keep; it != retired.end(); ++it) {
+            it->reclaim(it->p);
+        }
+        retired.erase(keep, retired.end());
+    }
+};
+
+
+/// Per-thread free list of raw node storage. Nodes reclaimed on a thread go
+/// to that thread's list, so steady churn runs without touching the heap.
+template<typename Node, std::size_t maxCached = 4096>
+class ThreadNodePool
+{
+public:
+    template<typename... Args>
+    static Node* create(Args&&... args) {
+        auto& cache = local().free;
+        void* p;
+        if (cache.empty()) {
+            p = ::operator new(sizeof(Node), std::align_val_t{alignof(Node)});
+        } else {
+            p = cache.back();
+            cache.pop_back();
+        }
+        return new (p) Node(std::forward<Args>(args)...);
+    }
+
+    static void destroy(Node* node) noexcept {
+        node->~Node();
+        // Reclaims can run from thread-exit and static destructors after
+        // this thread's cache is gone
+        if (cacheAlive && local().free.size() < maxCached) {
+            local().free.push_back(node);
+        } else {
+            ::operator delete(static_cast<void*>(node), std::align_val_t{alignof(Node)});
+        }
+    }
+
+    /// Matches HazardPointers::Reclaim
+    static void reclaim(void* p) noexcept { destroy(static_cast<Node*>(p)); }
+
+private:
+    struct Cache {
+        std::vector<void*> free;
+
+        Cache() {
+            free.reserve(maxCached);
+            cacheAlive = true;
+        }
+
+        ~Cache() {
+            cacheAlive = false;
+            for (auto p : free) {
+                ::operator delete(p, std::align_val_t{alignof(Node)});
+            }
+        }
+    };
+
+    static Cache& local() {
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    static inline thread_local bool cacheAlive = false;
+};
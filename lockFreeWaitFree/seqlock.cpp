@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Single-writer seqlock holding one T.
+///
+/// The writer makes the sequence odd, writes the value and makes it even
+/// again; it never waits. Readers copy the value and retry if the sequence
+/// was odd or moved while they copied, so they never block or slow the
+/// writer beyond sharing its cache lines. The value is copied as relaxed
+/// 64-bit atomics between fences, which keeps the racing reads well defined.
+template<typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    Seqlock() noexcept {
+        std::uint64_t buffer[words]{};
+        T value{};
+        std::memcpy(buffer, &value, sizeof(T));
+        for (std::size_t i = 0; i < words; ++i) {
+            data_[i].store(buffer[i], std::memory_order_relaxed);
+        }
+    }
+
+    Seqlock(Seqlock const&) = delete;
+    Seqlock& operator=(Seqlock const&) = delete;
+
+    /// Publish value; only one thread may call store().
+    void store(T const& value) noexcept {
+        std::uint64_t buffer[words]{};
+        std::memcpy(buffer, &value, sizeof(T));
+
+        auto seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < words; ++i) {
+            data_[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /// Copy the value if no store() overlaps the read.
+    /// @return `true` on a consistent copy; `false` if the caller should retry.
+    bool try_load(T& value) const noexcept {
+        auto before = seq_.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        std::uint64_t buffer[words];
+        for (std::size_t i = 0; i < words; ++i) {
+            buffer[i] = data_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+        std::memcpy(&value, buffer, sizeof(T));
+        return true;
+    }
+
+    /// Copy the latest value, retrying while the writer is mid-store.
+    T load() const noexcept {
+        T value;
+        while (not try_load(value)) {}
+        return value;
+    }
+
+    /// Number of completed stores
+    auto version() const noexcept { return seq_.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr std::size_t words = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    /// Even when stable, odd while the writer is storing. The alignment also
+    /// rounds the object up to whole cache lines, so neighbours never share them.
+    alignas(cacheLineSize) std::atomic<std::uint64_t> seq_{0};
+    std::atomic<std::uint64_t> data_[words];
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Lock-free LIFO of 32-bit slot indices (Treiber stack) for free lists.
+///
+/// The head packs {tag, index} into one 64-bit word and every successful pop
+/// or push bumps the tag, so a head that was popped and pushed back between
+/// another thread's load and CAS no longer compares equal (ABA). Links live
+/// in a side array owned by the stack rather than inside the slots, so a
+/// racing pop that reads a stale link reads a valid atomic, never freed or
+/// reused object memory; its CAS then fails on the tag.
+///
+/// Indices avoid a 128-bit pointer+counter CAS (cmpxchg16b / libatomic) and
+/// leave 32 bits of tag, which would have to wrap while one thread sits
+/// between its load and its CAS.
+class TaggedIndexStack
+{
+public:
+    using index_type = std::uint32_t;
+    static constexpr index_type npos = ~index_type{0};
+
+    /// Room for indices [0, capacity); starts empty.
+    explicit TaggedIndexStack(std::size_t capacity)
+        : capacity_{capacity}
+        , next_{std::make_unique<std::atomic<index_type>[]>(capacity)}
+    {}
+
+    TaggedIndexStack(TaggedIndexStack const&) = delete;
+    TaggedIndexStack& operator=(TaggedIndexStack const&) = delete;
+
+    auto capacity() const noexcept { return capacity_; }
+
+    /// Push index i, which must not already be on the stack.
+    void push(index_type i) noexcept {
+        auto head = head_.load(std::memory_order_relaxed);
+        do {
+            next_[i].store(index(head), std::memory_order_relaxed);
+        } while (not head_.compare_exchange_weak(head, pack(tag(head) + 1, i), std::memory_order_release,
+                                                 std::memory_order_relaxed));
+    }
+
+    /// Pop the most recently pushed index.
+    /// @return the index, or npos if the stack is empty.
+    index_type pop() noexcept {
+        auto head = head_.load(std::memory_order_acquire);
+        for (;;) {
+            auto top = index(head);
+            if (top == npos) {
+                return npos;
+            }
+            // May be stale if top was popped meanwhile; the tag then fails the CAS
+            auto next = next_[top].load(std::memory_order_relaxed);
+            if (head_.compare_exchange_weak(head, pack(tag(head) + 1, next), std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+                return top;
+            }
+        }
+    }
+
+    /// Returns whether the stack was empty at the time of the call
+    bool empty() const noexcept { return index(head_.load(std::memory_order_relaxed)) == npos; }
+
+private:
+    using Head = std::uint64_t;
+    static_assert(std::atomic<Head>::is_always_lock_free);
+
+    static constexpr Head pack(Head tag, index_type i) noexcept { return (tag << 32) | i; }
+    static constexpr index_type index(Head h) noexcept { return static_cast<index_type>(h); }
+    static constexpr Head tag(Head h) noexcept { return h >> 32; }
+
+    std::size_t capacity_;
+    std::unique_ptr<std::atomic<index_type>[]> next_;
+
+    /// Every push and pop CASes this word; keep it off the links' lines
+    alignas(cacheLineSize) std::atomic<Head> head_{pack(0, npos)};
+    char padding_[cacheLineSize - sizeof(Head)];
+};
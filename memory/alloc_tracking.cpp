@@ -0,0 +1,335 @@
+#pragma once
+
+#if defined(ALLOC_TRACKING_DEMO) && !defined(ALLOC_TRACKING)
+#define ALLOC_TRACKING
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <unistd.h>
+
+
+/// Heap-traffic accounting for enforcing allocation-free hot paths.
+///
+/// Built with -DALLOC_TRACKING, this file replaces the global operator
+/// new/delete (so include it in exactly one translation unit, the program's
+/// main file) and counts every heap operation per thread and per tagged
+/// scope:
+///
+///     ALLOC_SCOPE("decode");                 // attribute the block's heap traffic
+///     ALLOC_HOT_REGION("book update");       // any heap traffic here is a violation
+///
+/// A violation is reported when the hot region closes, or aborts the process
+/// on the spot under OnViolation::Abort (so a debugger or core shows the
+/// offending stack). Without -DALLOC_TRACKING the macros compile to nothing
+/// and operator new is the library's.
+namespace alloc_tracking {
+
+enum class OnViolation : std::uint8_t { Report, Abort };
+
+struct Counts {
+    std::uint64_t allocations = 0;
+    std::uint64_t deallocations = 0;
+    std::uint64_t bytes = 0;          // requested by allocations
+};
+
+inline constexpr std::size_t maxTags = 64;
+
+namespace detail {
+
+/// Zero-initialised and trivially destructible, so operator new can use it
+/// from any thread at any point in the thread's life.
+struct ThreadState {
+    Counts counts;
+    std::uint32_t hotDepth;
+    char const* hotName;
+    std::uint64_t violations;
+    std::uint32_t tag;                // index + 1 into tags; 0: untagged
+};
+
+inline thread_local ThreadState state{};
+
+struct Tag {
+    char const* name;
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::uint64_t> bytes;
+};
+
+inline Tag tags[maxTags]{};
+inline std::atomic<std::uint32_t> tagCount{0};
+inline std::atomic<std::uint64_t> totalViolations{0};
+inline std::atomic<OnViolation> onViolation{OnViolation::Report};
+
+inline void violation(char const* what, std::size_t bytes) noexcept {
+    ++state.violations;
+    totalViolations.fetch_add(1, std::memory_order_relaxed);
+    if (onViolation.load(std::memory_order_relaxed) == OnViolation::Abort) {
+        // Straight to the fd: FILE streams may allocate
+        char line[256];
+        auto n = std::snprintf(line, sizeof(line), "alloc_tracking: %s of %zu bytes inside hot region '%s'\n", what,
+                               bytes, state.hotName);
+        [[maybe_unused]] auto written = ::write(STDERR_FILENO, line, n > 0 ? static_cast<std::size_t>(n) : 0);
+        std::abort();
+    }
+}
+
+inline void onAllocate(std::size_t bytes) noexcept {
+    auto& s = state;
+    ++s.counts.allocations;
+    s.counts.bytes += bytes;
+    if (s.tag != 0) {
+        tags[s.tag - 1].allocations.fetch_add(1, std::memory_order_relaxed);
+        tags[s.tag - 1].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    if (s.hotDepth != 0) [[unlikely]] {
+        violation("allocation", bytes);
+    }
+}
+
+inline void onDeallocate() noexcept {
+    auto& s = state;
+    ++s.counts.deallocations;
+    if (s.hotDepth != 0) [[unlikely]] {
+        violation("deallocation", 0);
+    }
+}
+
+} // namespace detail
+
+
+/// Default for every hot region: report at region end, or abort at once.
+inline void setOnViolation(OnViolation policy) noexcept { detail::onViolation.store(policy, std::memory_order_relaxed); }
+
+/// This thread's heap operations so far
+inline Counts counts() noexcept { return detail::state.counts; }
+
+/// Heap operations seen inside any hot region, all threads
+inline std::uint64_t violations() noexcept { return detail::totalViolations.load(std::memory_order_relaxed); }
+
+/// Tag id for name; call once per site (ALLOC_SCOPE keeps it in a static).
+/// Ids past maxTags fold into the last tag.
+inline std::uint32_t registerTag(char const* name) noexcept {
+    auto i = detail::tagCount.fetch_add(1, std::memory_order_relaxed);
+    if (i >= maxTags) {
+        return maxTags;
+    }
+    detail::tags[i].name = name;
+    return i + 1;
+}
+
+/// Attributes this thread's heap traffic to a tag until it closes; nests.
+class Scope
+{
+public:
+    explicit Scope(std::uint32_t tag) noexcept : previous_{detail::state.tag} { detail::state.tag = tag; }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+    ~Scope() { detail::state.tag = previous_; }
+
+private:
+    std::uint32_t previous_;
+};
+
+/// Marks code that must not touch the heap on this thread; nests.
+class HotRegion
+{
+public:
+    explicit HotRegion(char const* name) noexcept
+        : name_{name}
+        , outerName_{detail::state.hotName}
+        , violationsAtEntry_{detail::state.violations}
+    {
+        ++detail::state.hotDepth;
+        detail::state.hotName = name;
+    }
+
+    HotRegion(HotRegion const&) = delete;
+    HotRegion& operator=(HotRegion const&) = delete;
+
+    ~HotRegion() {
+        auto n = violations();
+        --detail::state.hotDepth;
+        detail::state.hotName = outerName_;
+        if (n != 0 && detail::state.hotDepth == 0) {
+            std::fprintf(stderr, "alloc_tracking: %llu heap operations inside hot region '%s'\n",
+                         static_cast<unsigned long long>(n), name_);
+        }
+    }
+
+    /// Heap operations on this thread since the region opened
+    std::uint64_t violations() const noexcept { return detail::state.violations - violationsAtEntry_; }
+
+private:
+    char const* name_;
+    char const* outerName_;
+    std::uint64_t violationsAtEntry_;
+};
+
+/// Per-tag allocation table
+inline void report(std::FILE* out = stdout) {
+    auto n = detail::tagCount.load(std::memory_order_relaxed);
+    if (n > maxTags) {
+        n = maxTags;
+    }
+    std::fprintf(out, "%-32s %12s %14s\n", "scope", "allocations", "bytes");
+    for (std::uint32_t i = 0; i < n; ++i) {
+        auto& t = detail::tags[i];
+        std::fprintf(out, "%-32s %12llu %14llu\n", t.name,
+                     static_cast<unsigned long long>(t.allocations.load(std::memory_order_relaxed)),
+                     static_cast<unsigned long long>(t.bytes.load(std::memory_order_relaxed)));
+    }
+    std::fprintf(out, "hot region violations: %llu\n", static_cast<unsigned long long>(violations()));
+}
+
+} // namespace alloc_tracking
+
+
+#ifdef ALLOC_TRACKING
+// Replacement functions may not be inline; this is why the file belongs to a
+// single translation unit in tracking builds.
+
+namespace alloc_tracking::detail {
+
+inline void* allocateOrThrow(std::size_t bytes, std::size_t align = 0) {
+    onAllocate(bytes);
+    void* p = nullptr;
+    if (align <= alignof(std::max_align_t)) {
+        p = std::malloc(bytes != 0 ? bytes : 1);
+    } else if (::posix_memalign(&p, align, bytes != 0 ? bytes : 1) != 0) {
+        p = nullptr;
+    }
+    if (p == nullptr) [[unlikely]] {
+        throw std::bad_alloc{};
+    }
+    return p;
+}
+
+template<typename F>
+void* noThrow(F&& f) noexcept {
+    try {
+        return f();
+    } catch (std::bad_alloc const&) {
+        return nullptr;
+    }
+}
+
+inline void release(void* p) noexcept {
+    if (p != nullptr) {
+        onDeallocate();
+        std::free(p);
+    }
+}
+
+} // namespace alloc_tracking::detail
+
+void* operator new(std::size_t n) { return alloc_tracking::detail::allocateOrThrow(n); }
+void* operator new[](std::size_t n) { return alloc_tracking::detail::allocateOrThrow(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return alloc_tracking::detail::allocateOrThrow(n, std::size_t(a)); }
+void* operator new[](std::size_t n, std::align_val_t a) { return alloc_tracking::detail::allocateOrThrow(n, std::size_t(a)); }
+
+void* operator new(std::size_t n, std::nothrow_t const&) noexcept {
+    return alloc_tracking::detail::noThrow([&] { return alloc_tracking::detail::allocateOrThrow(n); });
+}
+void* operator new[](std::size_t n, std::nothrow_t const&) noexcept {
+    return alloc_tracking::detail::noThrow([&] { return alloc_tracking::detail::allocateOrThrow(n); });
+}
+void* operator new(std::size_t n, std::align_val_t a, std::nothrow_t const&) noexcept {
+    return alloc_tracking::detail::noThrow([&] { return alloc_tracking::detail::allocateOrThrow(n, std::size_t(a)); });
+}
+void* operator new[](std::size_t n, std::align_val_t a, std::nothrow_t const&) noexcept {
+    return alloc_tracking::detail::noThrow([&] { return alloc_tracking::detail::allocateOrThrow(n, std::size_t(a)); });
+}
+
+void operator delete(void* p) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p) noexcept { alloc_tracking::detail::release(p); }
+void operator delete(void* p, std::size_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p, std::size_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alloc_tracking::detail::release(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { alloc_tracking::detail::release(p); }
+void operator delete(void* p, std::align_val_t, std::nothrow_t const&) noexcept { alloc_tracking::detail::release(p); }
+void operator delete[](void* p, std::align_val_t, std::nothrow_t const&) noexcept { alloc_tracking::detail::release(p); }
+
+#define ALLOC_TRACKING_CONCAT_(a, b) a##b
+#define ALLOC_TRACKING_CONCAT(a, b) ALLOC_TRACKING_CONCAT_(a, b)
+#define ALLOC_SCOPE(name)                                                                                  \
+    static std::uint32_t const ALLOC_TRACKING_CONCAT(allocTag_, __LINE__) = ::alloc_tracking::registerTag(name); \
+    ::alloc_tracking::Scope const ALLOC_TRACKING_CONCAT(allocScope_, __LINE__){ALLOC_TRACKING_CONCAT(allocTag_, __LINE__)}
+#define ALLOC_HOT_REGION(name) ::alloc_tracking::HotRegion const ALLOC_TRACKING_CONCAT(allocHot_, __LINE__){name}
+#else
+#define ALLOC_SCOPE(name) static_cast<void>(0)
+#define ALLOC_HOT_REGION(name) static_cast<void>(0)
+#endif
+
+
+#ifdef ALLOC_TRACKING_DEMO
+// g++ -std=c++20 -O2 -march=native -pthread -DALLOC_TRACKING_DEMO -x c++ alloc_tracking.cpp -o alloc_tracking
+//
+// A warmed-up pooled book stays off the heap inside a hot region; a plain
+// vector growing inside one is caught; tagged scopes split the rest.
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../orderbook/order_book.cpp"
+
+int main() {
+    PoolResource resource;
+    PooledOrderBook<> book(allocator_arg, PoolAllocator<char>(resource));
+    auto churn = [&](std::uint64_t base) {
+        for (std::uint64_t i = 0; i < 4096; ++i)
+            book.add_order({base + i, i % 2 == 0, Price::from_double(100 + (i % 2 ? 1 : -1) * double(i % 64) / 100), 10, i});
+        for (std::uint64_t i = 0; i < 4096; ++i)
+            book.cancel_order(base + i);
+    };
+    {
+        ALLOC_SCOPE("book warm-up");
+        book.reserve(4096, 256);
+        churn(0);
+    }
+    std::uint64_t clean;
+    {
+        alloc_tracking::HotRegion hot{"pooled book churn"};
+        for (std::uint64_t round = 1; round <= 10; ++round) {
+            churn(round * 100000);
+        }
+        clean = hot.violations();
+    }
+
+    std::uint64_t caught;
+    {
+        std::vector<int> grows;
+        alloc_tracking::HotRegion hot{"vector push_back"};
+        for (int i = 0; i < 100; ++i) {
+            grows.push_back(i);
+        }
+        caught = hot.violations();
+    }
+
+    std::thread worker([] {
+        ALLOC_SCOPE("worker strings");
+        std::vector<std::string> names;
+        for (int i = 0; i < 1000; ++i) {
+            names.push_back("order-" + std::to_string(i) + "-with-a-long-enough-name");
+        }
+    });
+    worker.join();
+
+    auto mine = alloc_tracking::counts();
+    alloc_tracking::report(stdout);
+    std::printf("main thread: %llu allocations, %llu deallocations\n",
+                static_cast<unsigned long long>(mine.allocations), static_cast<unsigned long long>(mine.deallocations));
+    bool ok = clean == 0 && caught > 0;
+    std::printf("pooled churn %llu violations, vector growth %llu: %s\n", static_cast<unsigned long long>(clean),
+                static_cast<unsigned long long>(caught), ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <system_error>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/// Options for Arena's mapping
+struct ArenaOptions {
+    /// Try MAP_HUGETLB first; fall back to normal pages with MADV_HUGEPAGE so
+    /// transparent hugepages can still back the region.
+    bool hugePages = false;
+    /// Touch every page at construction so the hot path never page-faults.
+    bool prefault = true;
+    /// mlock the region so it is never paged out; throws std::system_error
+    /// when RLIMIT_MEMLOCK doesn't allow it.
+    bool lock = false;
+};
+
+
+/// Bump arena over one fixed mmap'd region. Unlike MemoryPool it never grows:
+/// capacity is reserved (and by default faulted in) up front, allocate()
+/// honours any power-of-two alignment, and memory comes back only by
+/// rewinding to a mark or resetting the whole arena.
+///
+///     Arena scratch(16 << 20);
+///     for (auto& msg : packet) {
+///         Arena::Scope scope{scratch};      // everything below is freed at '}'
+///         auto* tmp = scratch.make<Buffer>();
+///         ...
+///     }
+///
+/// Not threadsafe; give each thread its own.
+class Arena
+{
+public:
+    /// Position to rewind() to
+    struct Marker { std::size_t offset; };
+
+    /// Rewinds the arena to where it was at construction.
+    class Scope
+    {
+    public:
+        explicit Scope(Arena& arena) noexcept : arena_{arena}, mark_{arena.mark()} {}
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+        ~Scope() { arena_.rewind(mark_); }
+
+    private:
+        Arena& arena_;
+        Marker mark_;
+    };
+
+    explicit Arena(std::size_t capacity, ArenaOptions options = {}) {
+        auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto populate = options.prefault ? MAP_POPULATE : 0;
+        if (options.hugePages) {
+            capacity_ = roundUp(capacity, hugePageSize);
+            base_ = map(capacity_, MAP_HUGETLB | populate);
+            hugeTlb_ = base_ != nullptr;
+        }
+        if (base_ == nullptr) {
+            capacity_ = roundUp(capacity, options.hugePages ? hugePageSize : page);
+            base_ = map(capacity_, populate);
+            if (base_ == nullptr) {
+                throw std::system_error(errno, std::generic_category(), "Arena: mmap");
+            }
+            if (options.hugePages) {
+                ::madvise(base_, capacity_, MADV_HUGEPAGE);   // best effort
+            }
+            if (options.prefault) {
+                // MAP_POPULATE is only a hint for private anonymous maps
+                for (std::size_t i = 0; i < capacity_; i += page) {
+                    static_cast<volatile char*>(base_)[i] = 0;
+                }
+            }
+        }
+        if (options.lock && ::mlock(base_, capacity_) != 0) {
+            auto err = errno;
+            ::munmap(base_, capacity_);
+            throw std::system_error(err, std::generic_category(), "Arena: mlock");
+        }
+    }
+
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    ~Arena() { ::munmap(base_, capacity_); }
+
+    /// size bytes aligned to align (a power of two), or nullptr if full.
+    void* tryAllocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept {
+        auto address = reinterpret_cast<std::uintptr_t>(base_) + offset_;
+        auto aligned = roundUp(address, align);
+        auto end = aligned - reinterpret_cast<std::uintptr_t>(base_) + size;
+        if (end > capacity_) [[unlikely]] {
+            return nullptr;
+        }
+        offset_ = end;
+        if (offset_ > highWater_) {
+            highWater_ = offset_;
+        }
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    /// As tryAllocate, throwing std::bad_alloc when full.
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+        auto p = tryAllocate(size, align);
+        if (p == nullptr) [[unlikely]] {
+            throw std::bad_alloc{};
+        }
+        return p;
+    }
+
+    /// Construct a T in the arena. Its destructor never runs, so T should be
+    /// trivially destructible or own nothing outside the arena.
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    Marker mark() const noexcept { return {offset_}; }
+
+    /// Release everything allocated since m.
+    void rewind(Marker m) noexcept { offset_ = m.offset; }
+
+    void reset() noexcept { offset_ = 0; }
+
+    std::size_t used() const noexcept { return offset_; }
+    std::size_t capacity() const noexcept { return capacity_; }
+    /// Largest used() seen, for sizing the arena
+    std::size_t highWater() const noexcept { return highWater_; }
+    /// Whether the region is backed by explicit (hugetlbfs) hugepages
+    bool hugeTlb() const noexcept { return hugeTlb_; }
+
+private:
+    static constexpr std::size_t hugePageSize = std::size_t{2} << 20;
+
+    static constexpr std::size_t roundUp(std::size_t n, std::size_t align) noexcept {
+        return (n + align - 1) & ~(align - 1);
+    }
+
+    static void* map(std::size_t size, int flags) noexcept {
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    void* base_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t offset_ = 0;
+    std::size_t highWater_ = 0;
+    bool hugeTlb_ = false;
+};
+
+
+/// std::pmr adapter so standard containers (and BasicOrderBook through
+/// pmr::polymorphic_allocator) can draw from an Arena. Deallocation is a
+/// no-op; memory returns when the arena is rewound or reset. Scratch
+/// containers can use it directly; long-lived ones that churn nodes should
+/// sit behind a pmr::unsynchronized_pool_resource so freed blocks recycle:
+///
+///     ArenaResource arenaResource{arena};
+///     std::pmr::unsynchronized_pool_resource pool{&arenaResource};
+///     PmrOrderBook<> book(std::allocator_arg, std::pmr::polymorphic_allocator<char>(&pool));
+class ArenaResource : public std::pmr::memory_resource
+{
+public:
+    explicit ArenaResource(Arena& arena) noexcept : arena_{arena} {}
+
+    Arena& arena() const noexcept { return arena_; }
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t align) override { return arena_.allocate(bytes, align); }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+
+    Arena& arena_;
+};
+
+
+#ifdef ARENA_DEMO
+// g++ -std=c++20 -O2 -march=native -DARENA_DEMO -x c++ arena.cpp -o arena
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+struct Box { char tag; double value; };   // the padding demo's misalignment case
+
+int main() {
+    Arena arena(64 << 20, {.hugePages = true, .prefault = true});
+    std::printf("arena %zu MiB, %s\n", arena.capacity() >> 20, arena.hugeTlb() ? "hugetlb" : "normal pages (THP advised)");
+
+    // Alignment after an odd-sized allocation
+    arena.allocate(1, 1);
+    auto* box = arena.make<Box>(Box{'x', 1.5});
+    auto* line = arena.allocate(64, 64);
+    auto* page = arena.allocate(4096, 4096);
+    assert(reinterpret_cast<std::uintptr_t>(box) % alignof(Box) == 0);
+    assert(reinterpret_cast<std::uintptr_t>(line) % 64 == 0);
+    assert(reinterpret_cast<std::uintptr_t>(page) % 4096 == 0);
+
+    // Per-message scratch: the arena returns to the same point every time
+    auto base = arena.used();
+    constexpr int messages = 1'000'000;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; ++i) {
+        Arena::Scope scope{arena};
+        auto* a = static_cast<std::uint64_t*>(arena.allocate(32 * sizeof(std::uint64_t), 32));
+        auto* b = arena.make<Box>(Box{'y', double(i)});
+        a[i % 32] = static_cast<std::uint64_t>(b->value);
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    assert(arena.used() == base);
+    std::printf("scoped scratch: %.1f ns/message, high water %zu bytes\n", ns / messages, arena.highWater());
+
+    // pmr containers on the arena
+    ArenaResource resource{arena};
+    {
+        Arena::Scope scope{arena};
+        std::pmr::vector<int> v{&resource};
+        v.reserve(1000);
+        for (int i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        assert(arena.used() >= base + 1000 * sizeof(int));
+    }
+    assert(arena.used() == base);
+
+    // Exhaustion
+    Arena small(4096, {.hugePages = false, .prefault = false});
+    assert(small.tryAllocate(8192) == nullptr);
+    bool threw = false;
+    try {
+        small.allocate(8192);
+    } catch (std::bad_alloc const&) {
+        threw = true;
+    }
+    assert(threw);
+    std::printf("ok\n");
+}
+#endif
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "../lockFreeWaitFree/treiberStack.cpp"
+
+
+/// Fixed-capacity object pool shared by many threads. Free slots sit on a
+/// TaggedIndexStack, so create() and destroy() are one lock-free CAS each and
+/// an object may be destroyed by a different thread than the one that created
+/// it (e.g. orders built by the feed thread and released by the book thread).
+///
+/// The capacity is fixed at construction: slot indices must stay stable, so
+/// size it for the session's peak live count up front.
+template<typename T, typename Alloc = std::allocator<T>>
+class ConcurrentObjectPool : private std::allocator_traits<Alloc>::template rebind_alloc<T>
+{
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    using allocator_traits = std::allocator_traits<SlotAlloc>;
+
+public:
+    explicit ConcurrentObjectPool(std::size_t capacity, Alloc const& alloc = Alloc{})
+        : SlotAlloc{alloc}
+        , slots_{allocator_traits::allocate(*this, capacity)}
+        , free_{capacity}
+    {
+        assert(capacity < TaggedIndexStack::npos);
+        for (auto i = capacity; i-- > 0;) {
+            free_.push(static_cast<TaggedIndexStack::index_type>(i));
+        }
+    }
+
+    ConcurrentObjectPool(ConcurrentObjectPool const&) = delete;
+    ConcurrentObjectPool& operator=(ConcurrentObjectPool const&) = delete;
+
+    /// Live objects are not destroyed; they must be trivially destructible or
+    /// released by the owner first.
+    ~ConcurrentObjectPool() {
+        allocator_traits::deallocate(*this, slots_, free_.capacity());
+    }
+
+    /// Construct a T in a free slot; callable from any thread.
+    /// @return the object, or nullptr if every slot is in use.
+    template<typename... Args>
+    T* create(Args&&... args) {
+        auto i = free_.pop();
+        if (i == TaggedIndexStack::npos) {
+            return nullptr;
+        }
+        return new (&slots_[i]) T(std::forward<Args>(args)...);
+    }
+
+    /// Destroy obj and return its slot; callable from any thread.
+    void destroy(T* obj) noexcept {
+        assert(owns(obj));
+        obj->~T();
+        free_.push(static_cast<TaggedIndexStack::index_type>(obj - slots_));
+    }
+
+    /// Returns whether obj points into this pool's slots
+    bool owns(T const* obj) const noexcept {
+        return obj >= slots_ && obj < slots_ + free_.capacity();
+    }
+
+    auto capacity() const noexcept { return free_.capacity(); }
+
+private:
+    T* slots_;
+    TaggedIndexStack free_;
+};
+
+
+#ifdef CONCURRENT_POOL_DEMO
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+#include "../orderbook/order_book.cpp"
+
+// A feed thread creates orders and hands them to a book thread, which
+// releases them; a third thread churns the same pool on its own.
+int main() {
+    constexpr std::size_t live = 4096;
+    constexpr std::uint64_t orders = 500'000;
+    ConcurrentObjectPool<Order> pool(live);
+    Fifo3<Order*> handoff(1024);
+    std::atomic<bool> done{false};
+
+    std::thread book([&] {
+        Order* order;
+        std::uint64_t expected = 0;
+        while (expected < orders) {
+            if (handoff.pop(order)) {
+                if (order->order_id != expected++) {
+                    std::printf("out of order\n");
+                    std::abort();
+                }
+                pool.destroy(order);
+            }
+        }
+    });
+
+    std::thread churn([&] {
+        std::vector<Order*> held;
+        while (not done.load(std::memory_order_relaxed)) {
+            if (auto o = pool.create(Order{~0ULL, true, Price{}, 1, 0})) {
+                held.push_back(o);
+            }
+            if (held.size() > 64 || (not held.empty() && held.size() % 7 == 0)) {
+                pool.destroy(held.back());
+                held.pop_back();
+            }
+        }
+        for (auto o : held) {
+            pool.destroy(o);
+        }
+    });
+
+    for (std::uint64_t id = 0; id < orders;) {
+        if (auto o = pool.create(Order{id, id % 2 == 0, Price{100}, 10, id})) {
+            while (not handoff.push(o)) {}
+            ++id;
+        }
+    }
+    book.join();
+    done = true;
+    churn.join();
+
+    // Every slot must be back on the free list exactly once
+    std::vector<Order*> all;
+    while (auto o = pool.create()) {
+        all.push_back(o);
+    }
+    std::printf("%zu of %zu slots free after %llu orders\n", all.size(), pool.capacity(),
+                static_cast<unsigned long long>(orders));
+    return all.size() != pool.capacity();
+}
+#endif
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+/// Chunked bump allocator: the L5 MemoryPool, but growing in fixed-size chunks
+/// from the global heap instead of embedding one huge buffer. Never frees
+/// individual allocations; everything is released when the pool is destroyed.
+class MemoryPool
+{
+public:
+    explicit MemoryPool(std::size_t chunkSize = std::size_t{1} << 20)
+        : chunkSize_{chunkSize}
+    {}
+
+    MemoryPool(MemoryPool const&) = delete;
+    MemoryPool& operator=(MemoryPool const&) = delete;
+
+    ~MemoryPool() {
+        for (auto [chunk, size] : chunks_) {
+            ::operator delete(chunk, size);
+        }
+    }
+
+    /// Bump-allocate bytesNeeded bytes aligned to align.
+    void* getMemory(std::size_t bytesNeeded, std::size_t align = alignof(std::max_align_t)) {
+        auto offset = alignedOffset(offset_, align);
+        if (current_ == nullptr || offset + bytesNeeded > currentSize_) {
+            newChunk(bytesNeeded + align);
+            offset = alignedOffset(0, align);
+        }
+        offset_ = offset + bytesNeeded;
+        return current_ + offset;
+    }
+
+    /// Number of times the pool has gone to the global heap
+    auto upstreamAllocations() const noexcept { return chunks_.size(); }
+
+private:
+    /// First offset at or after from whose address is aligned; chunks are
+    /// only as aligned as operator new makes them, so align the address
+    std::size_t alignedOffset(std::size_t from, std::size_t align) const noexcept {
+        auto base = reinterpret_cast<std::uintptr_t>(current_);
+        return ((base + from + align - 1) & ~(align - 1)) - base;
+    }
+
+    void newChunk(std::size_t minSize) {
+        auto size = minSize > chunkSize_ ? minSize : chunkSize_;
+        current_ = static_cast<char*>(::operator new(size));
+        currentSize_ = size;
+        offset_ = 0;
+        chunks_.emplace_back(current_, size);
+    }
+
+    std::size_t chunkSize_;
+    char* current_{};
+    std::size_t currentSize_{};
+    std::size_t offset_{};
+    std::vector<std::pair<char*, std::size_t>> chunks_;
+};
+
+
+/// Size-class free lists on top of a MemoryPool. Blocks up to maxSmall bytes
+/// are recycled per 16-byte class; larger blocks (e.g. hash bucket arrays) go
+/// to the global heap and are counted so warm-up can be verified.
+class PoolResource
+{
+public:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t maxSmall = 512;
+
+    explicit PoolResource(std::size_t chunkSize = std::size_t{1} << 20)
+        : pool_{chunkSize}
+    {}
+
+    void* allocate(std::size_t bytes) {
+        if (bytes > maxSmall) {
+            ++largeAllocations_;
+            return ::operator new(bytes);
+        }
+        auto& head = freeLists_[sizeClass(bytes)];
+        if (head != nullptr) {
+            auto block = head;
+            head = block->next;
+            return block;
+        }
+        return pool_.getMemory((sizeClass(bytes) + 1) * granularity, granularity);
+    }
+
+    void deallocate(void* p, std::size_t bytes) noexcept {
+        if (bytes > maxSmall) {
+            ::operator delete(p);
+            return;
+        }
+        auto& head = freeLists_[sizeClass(bytes)];
+        head = new (p) FreeBlock{head};
+    }
+
+    /// Global heap allocations made so far; constant once the book is warm
+    auto upstreamAllocations() const noexcept {
+        return pool_.upstreamAllocations() + largeAllocations_;
+    }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    static std::size_t sizeClass(std::size_t bytes) noexcept {
+        return bytes == 0 ? 0 : (bytes - 1) / granularity;
+    }
+
+    MemoryPool pool_;
+    FreeBlock* freeLists_[maxSmall / granularity]{};
+    std::size_t largeAllocations_{};
+};
+
+
+/// Standard allocator handle onto a PoolResource; not threadsafe.
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(PoolResource& resource) noexcept : resource_{&resource} {}
+
+    template<typename U>
+    PoolAllocator(PoolAllocator<U> const& other) noexcept : resource_{other.resource()} {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(resource_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        resource_->deallocate(p, n * sizeof(T));
+    }
+
+    PoolResource* resource() const noexcept { return resource_; }
+
+    template<typename U>
+    bool operator==(PoolAllocator<U> const& other) const noexcept { return resource_ == other.resource(); }
+
+private:
+    PoolResource* resource_;
+};
+
+
+/// Fixed-size object pool: slabs of objectsPerSlab slots come from Alloc and
+/// released objects are recycled through an intrusive free list.
+template<typename T, typename Alloc = std::allocator<T>, std::size_t objectsPerSlab = 256>
+class ObjectPool : private std::allocator_traits<Alloc>::template rebind_alloc<T>
+{
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    using allocator_traits = std::allocator_traits<SlotAlloc>;
+
+public:
+    static_assert(sizeof(T) >= sizeof(void*) && alignof(T) >= alignof(void*));
+
+    explicit ObjectPool(Alloc const& alloc = Alloc{})
+        : SlotAlloc{alloc}
+        , slabs_{SlabListAlloc{alloc}}
+    {}
+
+    ObjectPool(ObjectPool const&) = delete;
+    ObjectPool& operator=(ObjectPool const&) = delete;
+
+    /// Live objects are not destroyed; they must be trivially destructible or
+    /// released by the owner first.
+    ~ObjectPool() {
+        for (auto slab : slabs_) {
+            allocator_traits::deallocate(*this, slab, objectsPerSlab);
+        }
+    }
+
+    /// Construct a T in a recycled or fresh slot.
+    template<typename... Args>
+    T* create(Args&&... args) {
+        if (freeList_ == nullptr) {
+            grow();
+        }
+        auto slot = freeList_;
+        freeList_ = slot->next;
+        return new (slot) T(std::forward<Args>(args)...);
+    }
+
+    /// Destroy obj and return its slot to the free list.
+    void destroy(T* obj) noexcept {
+        obj->~T();
+        freeList_ = new (obj) FreeSlot{freeList_};
+    }
+
+    /// Pre-allocate slabs so that count objects can be live without growing.
+    void reserve(std::size_t count) {
+        while (capacity() < count) {
+            grow();
+        }
+    }
+
+    auto capacity() const noexcept { return slabs_.size() * objectsPerSlab; }
+
+private:
+    struct FreeSlot { FreeSlot* next; };
+    using SlabListAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T*>;
+
+    void grow() {
+        auto slab = allocator_traits::allocate(*this, objectsPerSlab);
+        slabs_.push_back(slab);
+        for (auto i = objectsPerSlab; i-- > 0;) {
+            freeList_ = new (&slab[i]) FreeSlot{freeList_};
+        }
+    }
+
+    FreeSlot* freeList_{};
+    std::vector<T*, SlabListAlloc> slabs_;
+};
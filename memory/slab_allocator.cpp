@@ -0,0 +1,395 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// General-purpose size-class allocator for multi-threaded runs.
+///
+/// Memory comes from one large reserved region carved into 256 KiB slabs,
+/// each holding blocks of a single size class. Every thread owns a cache:
+/// allocate() pops the cache's free list for the class (or bumps through the
+/// thread's current slab), and deallocate() by the owning thread pushes it
+/// back, so the common case touches no shared state at all. A block freed by
+/// another thread is pushed onto its owner's per-class remote list with one
+/// CAS; the owner takes the whole list with an exchange when its local list
+/// runs dry. New slabs come from an atomic bump over the region. No path
+/// takes a lock except thread start and exit.
+///
+/// Blocks are 16-byte aligned; larger alignments and requests above
+/// maxSmall go to the global heap, as does everything once the region is
+/// exhausted. deallocate() tells the two apart by address.
+namespace slab {
+
+inline constexpr std::size_t maxSmall = 32 << 10;
+inline constexpr std::size_t slabSize = 256 << 10;
+inline constexpr std::size_t regionSize = std::size_t{16} << 30;   // reserved, faulted on use
+inline constexpr std::size_t minAlign = 16;
+
+namespace detail {
+
+/// 16-byte steps to 128, then four classes per power of two up to maxSmall
+inline constexpr std::size_t classCount = 8 + (std::bit_width(maxSmall - 1) - 7) * 4;
+
+constexpr std::size_t classOf(std::size_t size) noexcept {
+    if (size <= 128) {
+        return size == 0 ? 0 : (size - 1) >> 4;
+    }
+    auto bits = static_cast<std::size_t>(std::bit_width(size - 1));
+    return 8 + (bits - 8) * 4 + (((size - 1) >> (bits - 3)) & 3);
+}
+
+constexpr std::size_t classSize(std::size_t c) noexcept {
+    if (c < 8) {
+        return (c + 1) * 16;
+    }
+    auto bits = 8 + (c - 8) / 4;
+    return (std::size_t{1} << (bits - 1)) + (((c - 8) % 4 + 1) << (bits - 3));
+}
+
+static_assert(classSize(classOf(129)) == 160 && classSize(classOf(256)) == 256 && classSize(classOf(257)) == 320);
+static_assert(classSize(classCount - 1) == maxSmall && classOf(maxSmall) == classCount - 1);
+
+struct FreeBlock { FreeBlock* next; };
+
+struct ThreadCache;
+
+/// First bytes of every slab
+struct alignas(cacheLineSize) SlabHeader {
+    ThreadCache* owner;
+    std::size_t sizeClass;
+};
+
+struct ThreadCache {
+    struct Class {
+        FreeBlock* free = nullptr;
+        char* bump = nullptr;        // next never-used block in the current slab
+        char* end = nullptr;
+    };
+
+    Class classes[classCount];
+
+    /// Pushed by other threads, taken by the owner
+    alignas(cacheLineSize) std::atomic<FreeBlock*> remote[classCount]{};
+};
+
+class Region
+{
+public:
+    /// Never destroyed: blocks may be freed from static destructors
+    static Region& instance() {
+        static Region* region = new Region;
+        return *region;
+    }
+
+    /// A fresh slab, or nullptr when the region is used up
+    char* newSlab() noexcept {
+        if (base_ == nullptr) {
+            return nullptr;
+        }
+        auto offset = next_.fetch_add(slabSize, std::memory_order_relaxed);
+        return offset + slabSize <= regionSize ? base_ + offset : nullptr;
+    }
+
+    bool owns(void const* p) const noexcept {
+        return reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(base_) < regionSize
+            && base_ != nullptr;
+    }
+
+    std::size_t slabs() const noexcept {
+        auto used = next_.load(std::memory_order_relaxed);
+        return (used < regionSize ? used : regionSize) / slabSize;
+    }
+
+    std::uint64_t fallbacks() const noexcept { return fallbacks_.load(std::memory_order_relaxed); }
+    void countFallback() noexcept { fallbacks_.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Thread start: reuse a cache left by an exited thread, with whatever
+    /// it had cached and whatever was freed to it since.
+    ThreadCache* adopt() {
+        std::lock_guard lock{mutex_};
+        if (abandoned_.empty()) {
+            return new ThreadCache;
+        }
+        auto cache = abandoned_.back();
+        abandoned_.pop_back();
+        return cache;
+    }
+
+    void abandon(ThreadCache* cache) {
+        std::lock_guard lock{mutex_};
+        abandoned_.push_back(cache);
+    }
+
+private:
+    Region() {
+        // Over-reserve by a slab so the base can be slab-aligned; pointers
+        // find their header by masking.
+        auto p = ::mmap(nullptr, regionSize + slabSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            auto aligned = (reinterpret_cast<std::uintptr_t>(p) + slabSize - 1) & ~(slabSize - 1);
+            base_ = reinterpret_cast<char*>(aligned);
+        }
+    }
+
+    char* base_ = nullptr;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::uint64_t> fallbacks_{0};
+    std::mutex mutex_;
+    std::vector<ThreadCache*> abandoned_;
+};
+
+// Plain pointers stay readable through thread exit, unlike the guard
+inline thread_local ThreadCache* tlsCache = nullptr;
+inline thread_local bool tlsExited = false;
+
+struct CacheGuard {
+    CacheGuard() { tlsCache = Region::instance().adopt(); }
+    ~CacheGuard() {
+        Region::instance().abandon(tlsCache);
+        tlsCache = nullptr;
+        tlsExited = true;
+    }
+};
+
+/// This thread's cache; nullptr once the thread is exiting, after which its
+/// frees go the remote path and its allocations to the heap.
+inline ThreadCache* localCache() noexcept {
+    if (tlsCache != nullptr) [[likely]] {
+        return tlsCache;
+    }
+    if (tlsExited) {
+        return nullptr;
+    }
+    static thread_local CacheGuard guard;
+    return tlsCache;
+}
+
+inline SlabHeader* headerOf(void const* p) noexcept {
+    return reinterpret_cast<SlabHeader*>(reinterpret_cast<std::uintptr_t>(p) & ~(slabSize - 1));
+}
+
+inline void* refill(ThreadCache& cache, std::size_t c) noexcept {
+    auto& cls = cache.classes[c];
+    if (auto remote = cache.remote[c].exchange(nullptr, std::memory_order_acquire)) {
+        cls.free = remote->next;
+        return remote;
+    }
+    auto slab = Region::instance().newSlab();
+    if (slab == nullptr) [[unlikely]] {
+        return nullptr;
+    }
+    new (slab) SlabHeader{&cache, c};
+    auto size = classSize(c);
+    cls.bump = slab + sizeof(SlabHeader) + size;
+    cls.end = slab + sizeof(SlabHeader) + (slabSize - sizeof(SlabHeader)) / size * size;
+    return slab + sizeof(SlabHeader);
+}
+
+inline void* heapAllocate(std::size_t bytes, std::size_t align) {
+    Region::instance().countFallback();
+    return ::operator new(bytes, std::align_val_t{align > minAlign ? align : minAlign});
+}
+
+} // namespace detail
+
+
+/// bytes aligned to align (a power of two). Throws std::bad_alloc only if
+/// the heap fallback does.
+inline void* allocate(std::size_t bytes, std::size_t align = minAlign) {
+    auto cache = detail::localCache();
+    if (bytes > maxSmall || align > minAlign || cache == nullptr) [[unlikely]] {
+        return detail::heapAllocate(bytes, align);
+    }
+    auto c = detail::classOf(bytes);
+    auto& cls = cache->classes[c];
+    if (auto block = cls.free) [[likely]] {
+        cls.free = block->next;
+        return block;
+    }
+    if (cls.bump != cls.end) {
+        auto p = cls.bump;
+        cls.bump += detail::classSize(c);
+        return p;
+    }
+    if (auto p = detail::refill(*cache, c)) {
+        return p;
+    }
+    return detail::heapAllocate(bytes, align);
+}
+
+/// Free p from any thread; align must match the allocation's.
+inline void deallocate(void* p, std::size_t align = minAlign) noexcept {
+    if (p == nullptr) {
+        return;
+    }
+    if (not detail::Region::instance().owns(p)) [[unlikely]] {
+        ::operator delete(p, std::align_val_t{align > minAlign ? align : minAlign});
+        return;
+    }
+    auto header = detail::headerOf(p);
+    auto block = static_cast<detail::FreeBlock*>(p);
+    auto owner = header->owner;
+    if (owner == detail::localCache()) [[likely]] {
+        auto& cls = owner->classes[header->sizeClass];
+        block->next = cls.free;
+        cls.free = block;
+        return;
+    }
+    auto& remote = owner->remote[header->sizeClass];
+    auto head = remote.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (not remote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/// Usable size of a block from allocate(); 0 for heap fallbacks
+inline std::size_t blockSize(void const* p) noexcept {
+    if (not detail::Region::instance().owns(p)) {
+        return 0;
+    }
+    return detail::classSize(detail::headerOf(p)->sizeClass);
+}
+
+/// Slabs carved so far (each slabSize bytes of address space)
+inline std::size_t slabs() noexcept { return detail::Region::instance().slabs(); }
+
+/// Allocations that went to the global heap
+inline std::uint64_t fallbacks() noexcept { return detail::Region::instance().fallbacks(); }
+
+} // namespace slab
+
+
+/// Standard allocator onto the slab heap; stateless, so any two compare
+/// equal and memory may be freed through a copy on another thread.
+template<typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    SlabAllocator() noexcept = default;
+
+    template<typename U>
+    SlabAllocator(SlabAllocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(slab::allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        slab::deallocate(p, alignof(T));
+    }
+
+    template<typename U>
+    bool operator==(SlabAllocator<U> const&) const noexcept { return true; }
+};
+
+
+#ifdef SLAB_ALLOCATOR_DEMO
+// g++ -std=c++20 -O2 -march=native -pthread -DSLAB_ALLOCATOR_DEMO -x c++ slab_allocator.cpp -o slab_allocator
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+#include "../orderbook/order_book.cpp"
+
+template<typename F>
+double nsPerOp(std::size_t ops, F&& f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / double(ops);
+}
+
+int main() {
+    // The L4 baseline: 100k new int[100], then the same through the slabs
+    constexpr std::size_t n = 100'000;
+    std::vector<int*> ptrs(n);
+    for (int round = 0; round < 2; ++round) {   // first round warms both
+        auto heap = nsPerOp(2 * n, [&] {
+            for (auto& p : ptrs) p = new int[100];
+            for (auto p : ptrs) delete[] p;
+        });
+        auto slabbed = nsPerOp(2 * n, [&] {
+            for (auto& p : ptrs) p = static_cast<int*>(slab::allocate(100 * sizeof(int)));
+            for (auto p : ptrs) slab::deallocate(p);
+        });
+        if (round == 1) {
+            std::printf("new/delete int[100]:      %5.1f ns/op\n", heap);
+            std::printf("slab allocate/deallocate: %5.1f ns/op\n", slabbed);
+        }
+    }
+
+    // Mixed sizes, interleaved alloc/free
+    std::size_t live = 4096;
+    std::vector<void*> held(live);
+    std::uint64_t x = 1;
+    for (auto& p : held) p = slab::allocate(16 + (x = x * 6364136223846793005ULL + 1) % 1024);
+    auto mixed = nsPerOp(2'000'000, [&] {
+        for (int i = 0; i < 1'000'000; ++i) {
+            x = x * 6364136223846793005ULL + 1;
+            auto& p = held[(x >> 20) % live];
+            slab::deallocate(p);
+            p = slab::allocate(16 + (x >> 40) % 1024);
+        }
+    });
+    for (auto p : held) slab::deallocate(p);
+    std::printf("mixed 16-1040 bytes:      %5.1f ns/op\n", mixed);
+
+    // Cross-thread frees: orders allocated by a feed thread through a Fifo3
+    // that itself lives on the slabs, freed by the book thread
+    constexpr std::uint64_t orders = 1'000'000;
+    auto slabsBefore = slab::slabs();
+    {
+        Fifo3<Order*, SlabAllocator<Order*>> handoff(1024);
+        SlabAllocator<Order> alloc;
+        std::thread book([&] {
+            Order* o;
+            for (std::uint64_t expected = 0; expected < orders;) {
+                if (handoff.pop(o)) {
+                    assert(o->order_id == expected);
+                    ++expected;
+                    alloc.deallocate(o, 1);
+                }
+            }
+        });
+        for (std::uint64_t id = 0; id < orders; ++id) {
+            auto o = new (alloc.allocate(1)) Order{id, true, Price{100}, 1, id};
+            while (not handoff.push(o)) {}
+        }
+        book.join();
+    }
+    // Remote frees recycle, so a million orders fit in a handful of slabs
+    auto crossSlabs = slab::slabs() - slabsBefore;
+    std::printf("cross-thread: %llu orders through %zu new slabs\n", static_cast<unsigned long long>(orders), crossSlabs);
+
+    // A whole book on the slab heap
+    BasicOrderBook<SortedLevels, SlabAllocator<char>> ob;
+    for (std::uint64_t round = 0; round < 10; ++round) {
+        for (std::uint64_t i = 0; i < 4096; ++i)
+            ob.add_order({round * 10000 + i, i % 2 == 0, Price::from_double(100 + (i % 2 ? 1 : -1) * double(i % 64) / 100), 10, i});
+        for (std::uint64_t i = 0; i < 4096; ++i)
+            ob.cancel_order(round * 10000 + i);
+    }
+    assert(ob.order_count() == 0);
+
+    // Only the book's large arrays (journal, id index buckets) go to the heap
+    bool ok = crossSlabs < 16;
+    std::printf("%zu slabs, %llu large allocations on the heap: %s\n", slab::slabs(),
+                static_cast<unsigned long long>(slab::fallbacks()), ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+#endif
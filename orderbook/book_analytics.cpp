@@ -0,0 +1,328 @@
+// Book signals kept up to date per level change instead of recomputed from
+// get_snapshot() per query.
+//
+// BookAnalytics holds each side's levels as two arrays, prices in ticks and
+// quantities, best first (maintained like SortedLevels' price vector). Input
+// is LevelDelta, the same as BasicLevelBook: an order book's changes_since()
+// journal or an L2 feed. Per delta it keeps the touch and the top-N
+// quantities current, so microprice() and imbalance() are O(1). Sweep
+// queries (vwap_to_size, depth_curve, quantity_within) run the soa_simd
+// kernels over the arrays: scan_fill finds the levels a size reaches and dot
+// sums their notional, 8 levels per instruction with AVX-512.
+//
+//   g++ -std=c++20 -O2 -march=native -DBOOK_ANALYTICS_DEMO -x c++ book_analytics.cpp -o book_analytics
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "soa_level.cpp"
+using namespace std;
+
+// Cost of taking size from one side: filled may fall short when the side is
+// too thin. worst is the last level reached, vwap is in price units.
+struct SweepCost {
+    uint64_t filled = 0;
+    size_t levels = 0;
+    Price worst{};
+    double vwap = 0;
+};
+
+class BookAnalytics {
+public:
+    // imbalance_depth: levels per side that imbalance() weighs.
+    explicit BookAnalytics(size_t imbalance_depth = 5) : top_n(max<size_t>(imbalance_depth, 1)) {}
+
+    void reserve(size_t max_levels_per_side) {
+        for (auto& s : sides) {
+            s.ticks.reserve(max_levels_per_side);
+            s.qty.reserve(max_levels_per_side);
+        }
+    }
+
+    void apply(const LevelDelta& d) {
+        seq = d.seq;
+        auto& s = sides[d.is_buy];
+        int64_t px = d.price.ticks;
+        auto it = d.is_buy ? lower_bound(s.ticks.begin(), s.ticks.end(), px, greater<>{})
+                           : lower_bound(s.ticks.begin(), s.ticks.end(), px);
+        size_t p = size_t(it - s.ticks.begin());
+        bool found = p < s.ticks.size() && s.ticks[p] == px;
+        if (d.total_quantity == 0) {
+            if (!found) return;
+            uint64_t gone = s.qty[p];
+            s.ticks.erase(s.ticks.begin() + p);
+            s.qty.erase(s.qty.begin() + p);
+            if (p < top_n) {
+                s.top_sum -= gone;
+                if (s.qty.size() >= top_n) s.top_sum += s.qty[top_n - 1];   // moved up into the top
+            }
+        } else if (found) {
+            if (p < top_n) s.top_sum += d.total_quantity - s.qty[p];
+            s.qty[p] = d.total_quantity;
+        } else {
+            s.ticks.insert(s.ticks.begin() + p, px);
+            s.qty.insert(s.qty.begin() + p, d.total_quantity);
+            if (p < top_n) {
+                s.top_sum += d.total_quantity;
+                if (s.qty.size() > top_n) s.top_sum -= s.qty[top_n];        // pushed out of the top
+            }
+        }
+    }
+
+    void apply_batch(span<const LevelDelta> deltas) {
+        for (const auto& d : deltas) apply(d);
+    }
+
+    // Rebuilds from the book's full depth, for startup and after
+    // changes_since() reports a wrapped journal.
+    template<typename Book>
+    void resync(const Book& book) {
+        vector<PriceLevel> bids, asks;
+        book.get_snapshot(SIZE_MAX, bids, asks);
+        auto load = [&](Side& s, const vector<PriceLevel>& levels) {
+            s.ticks.clear();
+            s.qty.clear();
+            s.top_sum = 0;
+            for (size_t i = 0; i < levels.size(); ++i) {
+                s.ticks.push_back(levels[i].price.ticks);
+                s.qty.push_back(levels[i].total_quantity);
+                if (i < top_n) s.top_sum += levels[i].total_quantity;
+            }
+        };
+        load(sides[bid], bids);
+        load(sides[ask], asks);
+        seq = book.sequence();
+    }
+
+    optional<PriceLevel> best_bid() const { return top(sides[bid]); }
+    optional<PriceLevel> best_ask() const { return top(sides[ask]); }
+
+    optional<double> mid() const {
+        if (sides[bid].qty.empty() || sides[ask].qty.empty()) return nullopt;
+        return double(sides[bid].ticks[0] + sides[ask].ticks[0]) / 2 / double(Price::scale);
+    }
+
+    // Touch prices weighted by the opposite side's size, so the estimate
+    // leans toward the thinner side: the price it is about to move to.
+    optional<double> microprice() const {
+        auto& b = sides[bid];
+        auto& a = sides[ask];
+        if (b.qty.empty() || a.qty.empty()) return nullopt;
+        double bq = double(b.qty[0]), aq = double(a.qty[0]);
+        return (double(b.ticks[0]) * aq + double(a.ticks[0]) * bq) / (bq + aq) / double(Price::scale);
+    }
+
+    // (bids - asks) / (bids + asks) over the top imbalance_depth levels per
+    // side, in [-1, 1]; 0 for an empty book.
+    double imbalance() const {
+        double b = double(sides[bid].top_sum), a = double(sides[ask].top_sum);
+        return b + a == 0 ? 0 : (b - a) / (b + a);
+    }
+
+    uint64_t top_quantity(bool is_buy) const { return sides[is_buy].top_sum; }
+
+    // Sweeping size off the resting is_buy side (false: a buy lifting asks).
+    SweepCost vwap_to_size(bool is_buy, uint64_t size) const {
+        SweepCost c;
+        depth_curve(is_buy, span(&size, 1), span(&c, 1));
+        return c;
+    }
+
+    // vwap_to_size for each of sizes, which must be ascending, in one walk
+    // down the side.
+    void depth_curve(bool is_buy, span<const uint64_t> sizes, span<SweepCost> out) const {
+        const auto& s = sides[is_buy];
+        const int64_t* t = s.ticks.data();
+        const uint64_t* q = s.qty.data();
+        size_t n = s.qty.size();
+        // Levels [0, i) are taken whole by every size still to come
+        size_t i = 0;
+        uint64_t cum = 0;
+        int64_t notional = 0;
+        for (size_t k = 0; k < sizes.size() && k < out.size(); ++k) {
+            uint64_t size = sizes[k];
+            SweepCost& c = out[k];
+            if (size <= cum) {   // size 0
+                c = {cum, i, Price{i ? t[i - 1] : 0}, i ? double(notional) / double(cum) / double(Price::scale) : 0};
+                continue;
+            }
+            auto scan = soa_simd::scan_fill(q + i, n - i, size - cum);
+            if (scan.filled < size - cum) {   // ran out: the whole side
+                notional += soa_simd::dot(t + i, q + i, n - i);
+                cum += scan.filled;
+                i = n;
+                c = {cum, n, Price{n ? t[n - 1] : 0}, cum ? double(notional) / double(cum) / double(Price::scale) : 0};
+                continue;
+            }
+            size_t whole = scan.end - 1;
+            notional += soa_simd::dot(t + i, q + i, whole);
+            cum += scan.filled - q[i + whole];
+            i += whole;
+            int64_t total = notional + t[i] * int64_t(size - cum);
+            c = {size, i + 1, Price{t[i]}, double(total) / double(size) / double(Price::scale)};
+        }
+    }
+
+    // Quantity resting within distance of the side's best price, inclusive.
+    uint64_t quantity_within(bool is_buy, Price distance) const {
+        const auto& s = sides[is_buy];
+        if (s.qty.empty()) return 0;
+        auto end = is_buy ? upper_bound(s.ticks.begin(), s.ticks.end(), s.ticks[0] - distance.ticks, greater<>{})
+                          : upper_bound(s.ticks.begin(), s.ticks.end(), s.ticks[0] + distance.ticks);
+        return soa_simd::sum(s.qty.data(), size_t(end - s.ticks.begin()));
+    }
+
+    size_t level_count(bool is_buy) const { return sides[is_buy].qty.size(); }
+
+    // seq of the last delta applied.
+    uint64_t sequence() const { return seq; }
+
+private:
+    struct Side {
+        vector<int64_t> ticks;
+        vector<uint64_t> qty;
+        uint64_t top_sum = 0;
+    };
+
+    static constexpr size_t ask = 0, bid = 1;
+    array<Side, 2> sides;
+    size_t top_n;
+    uint64_t seq = 0;
+
+    static optional<PriceLevel> top(const Side& s) {
+        if (s.qty.empty()) return nullopt;
+        return PriceLevel{Price{s.ticks[0]}, s.qty[0]};
+    }
+};
+
+#ifdef BOOK_ANALYTICS_DEMO
+// What strategies did before: the same signals from a get_snapshot() copy
+// of AoS levels, recomputed per query.
+struct SnapshotSignals {
+    optional<double> microprice;
+    double imbalance = 0;
+    SweepCost sweep;
+};
+
+static SnapshotSignals from_snapshot(const OrderBook& book, size_t depth, uint64_t size, vector<PriceLevel>& bids,
+                                     vector<PriceLevel>& asks) {
+    book.get_snapshot(SIZE_MAX, bids, asks);
+    SnapshotSignals r;
+    if (!bids.empty() && !asks.empty()) {
+        double bq = double(bids[0].total_quantity), aq = double(asks[0].total_quantity);
+        r.microprice = (double(bids[0].price.ticks) * aq + double(asks[0].price.ticks) * bq) / (bq + aq) / double(Price::scale);
+    }
+    uint64_t b = 0, a = 0;
+    for (size_t i = 0; i < depth && i < bids.size(); ++i) b += bids[i].total_quantity;
+    for (size_t i = 0; i < depth && i < asks.size(); ++i) a += asks[i].total_quantity;
+    r.imbalance = b + a == 0 ? 0 : (double(b) - double(a)) / (double(b) + double(a));
+    uint64_t left = size;
+    int64_t notional = 0;
+    for (auto& l : asks) {
+        if (left == 0) break;
+        uint64_t take = min(left, l.total_quantity);
+        notional += l.price.ticks * int64_t(take);
+        left -= take;
+        ++r.sweep.levels;
+        r.sweep.worst = l.price;
+    }
+    r.sweep.filled = size - left;
+    r.sweep.vwap = r.sweep.filled ? double(notional) / double(r.sweep.filled) / double(Price::scale) : 0;
+    return r;
+}
+
+static bool same(const SweepCost& a, const SweepCost& b) {
+    return a.filled == b.filled && a.levels == b.levels && a.worst == b.worst && a.vwap == b.vwap;
+}
+
+int main() {
+    constexpr size_t depth = 5;
+    constexpr uint64_t sweep_size = 20'000;
+    OrderBook book;
+    BookAnalytics analytics(depth);
+    mt19937_64 rng(11);
+    vector<uint64_t> live;
+    vector<LevelDelta> deltas;
+    vector<PriceLevel> bids, asks;
+    uint64_t next_id = 1, cursor = 0, checks = 0;
+    bool ok = true;
+    double incr_ns = 0, snap_ns = 0;
+    volatile double sink = 0;   // keeps the timed results alive
+
+    // A few hundred levels per side, the depth a sweep query walks
+    for (int step = 0; step < 300'000; ++step) {
+        if (live.size() < 30'000 || rng() % 100 < 50) {
+            bool buy = rng() & 1;
+            auto off = int64_t(1 + rng() % 300) * 100;
+            book.add_order({next_id, buy, Price{1'000'000 + (buy ? -off : off)}, 1 + rng() % 500, uint64_t(step)});
+            live.push_back(next_id++);
+        } else {
+            size_t k = rng() % live.size();
+            if (rng() % 4) book.cancel_order(live[k]);
+            else book.execute_order(live[k], 1 + rng() % 200);
+            if (!book.find_order(live[k])) {
+                live[k] = live.back();
+                live.pop_back();
+            }
+        }
+        if (step % 16 != 15) continue;
+
+        auto t0 = chrono::steady_clock::now();
+        if (!book.changes_since(cursor, deltas)) analytics.resync(book);
+        else analytics.apply_batch(deltas);
+        cursor = book.sequence();
+        auto mp = analytics.microprice();
+        double imb = analytics.imbalance();
+        auto sweep = analytics.vwap_to_size(false, sweep_size);
+        auto t1 = chrono::steady_clock::now();
+        auto ref = from_snapshot(book, depth, sweep_size, bids, asks);
+        auto t2 = chrono::steady_clock::now();
+        incr_ns += chrono::duration<double, nano>(t1 - t0).count();
+        snap_ns += chrono::duration<double, nano>(t2 - t1).count();
+        sink = sink + imb + sweep.vwap;
+        ok &= mp == ref.microprice && imb == ref.imbalance && same(sweep, ref.sweep);
+        ++checks;
+    }
+    ok &= analytics.level_count(true) == bids.size() && analytics.level_count(false) == asks.size();
+    uint64_t near = 0;
+    for (auto& l : bids) near += l.price.ticks >= bids[0].price.ticks - 1000 ? l.total_quantity : 0;
+    ok &= analytics.quantity_within(true, Price{1000}) == near;
+    printf("%zu bid / %zu ask levels, %llu signal updates\n", analytics.level_count(true), analytics.level_count(false),
+           (unsigned long long)checks);
+    printf("incremental + kernels: %6.0f ns per update\n", incr_ns / double(checks));
+    printf("get_snapshot + AoS:    %6.0f ns per update\n", snap_ns / double(checks));
+
+    // Depth curve against one vwap_to_size per size
+    vector<uint64_t> sizes;
+    for (uint64_t s = 1'000; s <= 200'000; s += 1'000) sizes.push_back(s);
+    vector<SweepCost> curve(sizes.size());
+    analytics.depth_curve(true, sizes, curve);
+    for (size_t k = 0; k < sizes.size(); ++k) ok &= same(curve[k], analytics.vwap_to_size(true, sizes[k]));
+
+    // The dot kernel on its own, the whole ask side at once
+    const int reps = 20'000;
+    vector<int64_t> t(analytics.level_count(false));
+    vector<uint64_t> q(t.size());
+    for (size_t i = 0; i < t.size(); ++i) {
+        t[i] = 1'000'000 + int64_t(i) * 100;
+        q[i] = 1 + rng() % 5000;
+    }
+    ok &= soa_simd::dot(t.data(), q.data(), t.size()) == soa_simd::dot_scalar(t.data(), q.data(), t.size());
+    auto time_dot = [&](auto&& f) {
+        auto t0 = chrono::steady_clock::now();
+        int64_t s = 0;
+        for (int r = 0; r < reps; ++r) {
+            s += f(t.data(), q.data(), t.size());
+            asm volatile("" : : "r"(t.data()) : "memory");
+        }
+        sink = sink + double(s);
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / reps;
+    };
+    double simd = time_dot(soa_simd::dot), scalar = time_dot(soa_simd::dot_scalar);
+    printf("notional over %zu levels: %s %.0f ns, scalar %.0f ns\n", t.size(), soa_simd::isa, simd, scalar);
+    printf("curve: 20k lifts to %.4f over %zu levels, imbalance %.3f\n", curve[19].vwap, curve[19].levels,
+           analytics.imbalance());
+
+    printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif
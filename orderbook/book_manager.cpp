@@ -0,0 +1,265 @@
+// One book per instrument, indexed densely by symbol id, fed from decoded
+// feed messages and optionally sharded across pinned worker threads.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread -DBOOK_MANAGER_DEMO -x c++ book_manager.cpp -o book_manager
+//   ./book_manager [symbols] [messages] [max_shards]
+//
+// With shards == 0 route() applies on the calling thread. Otherwise symbol s
+// belongs to shard s % shards; the routing thread stages messages per shard
+// and hands them over in batches through that shard's Fifo3, and only the
+// shard's worker touches its books. Each worker pins itself first and then
+// constructs its fifo and books, so with the default first-touch policy
+// their memory lands on the worker's NUMA node.
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "feed_decode.cpp"
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+#include "../SPSC_QUEUES/cache_line.cpp"
+#include "../runtime/cpu_topology.cpp"
+using namespace std;
+
+struct SymbolMsg {
+    uint32_t symbol;
+    BookMsg msg;
+};
+
+template<typename Book>
+inline void apply_msg(Book& book, const BookMsg& m) {
+    switch (m.type) {
+    case MsgType::Add: book.add_order({m.order_id, m.is_buy, m.price, m.quantity, m.timestamp_ns}); break;
+    case MsgType::Cancel: book.cancel_order(m.order_id); break;
+    case MsgType::Amend: book.amend_order(m.order_id, m.price, m.quantity); break;
+    case MsgType::Execute: book.execute_order(m.order_id, m.quantity); break;
+    }
+}
+
+struct ShardConfig {
+    size_t shards = 0;                // 0: no workers, apply on the routing thread
+    vector<int> cpus;                 // shard i pins to cpus[i % cpus.size()]; empty: no pinning
+    size_t queue_capacity = 1 << 16;  // messages per shard fifo
+};
+
+template<typename Book = OrderBook>
+class BookManager {
+public:
+    using Factory = function<unique_ptr<Book>(uint32_t symbol)>;
+
+    explicit BookManager(size_t symbols, ShardConfig cfg = {},
+                         Factory make_book = [](uint32_t) { return make_unique<Book>(); })
+        : cfg(std::move(cfg)), make_book(std::move(make_book)), books(symbols) {
+        if (this->cfg.shards == 0) {
+            for (uint32_t s = 0; s < symbols; ++s) books[s] = this->make_book(s);
+            return;
+        }
+        for (size_t i = 0; i < this->cfg.shards; ++i) {
+            shards.push_back(make_unique<Shard>());
+            shards.back()->stage.reserve(stage_size);
+        }
+        for (size_t i = 0; i < shards.size(); ++i) shards[i]->worker = thread([this, i] { work(i); });
+        for (auto& sh : shards)
+            while (sh->queue.load(memory_order_acquire) == nullptr) this_thread::yield();
+    }
+
+    BookManager(const BookManager&) = delete;
+    BookManager& operator=(const BookManager&) = delete;
+
+    ~BookManager() {
+        if (shards.empty()) return;
+        drain();
+        for (auto& sh : shards) sh->stop.store(true, memory_order_release);
+        for (auto& sh : shards) sh->worker.join();
+    }
+
+    size_t symbols() const { return books.size(); }
+    size_t shard_count() const { return shards.size(); }
+    size_t shard_of(uint32_t symbol) const { return shards.empty() ? 0 : symbol % shards.size(); }
+
+    // Route one message; unknown symbols are counted and dropped. Sharded
+    // messages may sit in the staging buffer until flush().
+    void route(uint32_t symbol, const BookMsg& m) {
+        if (symbol >= books.size()) {
+            ++dropped;
+            return;
+        }
+        if (shards.empty()) {
+            apply_msg(*books[symbol], m);
+            return;
+        }
+        auto& sh = *shards[symbol % shards.size()];
+        sh.stage.push_back({symbol, m});
+        if (sh.stage.size() == stage_size) hand_over(sh);
+    }
+
+    // Decode a wire packet and route its order events, then flush.
+    void route_packet(span<const byte> packet, uint64_t rx_ns = 0) {
+        for_each_order_event(packet, [&](const wire::OrderEvent& e) { route(e.symbol, to_book_msg(e, rx_ns)); });
+        flush();
+    }
+
+    // Hand every staged message to its shard.
+    void flush() {
+        for (auto& sh : shards)
+            if (!sh->stage.empty()) hand_over(*sh);
+    }
+
+    // flush() and wait until the workers have applied everything routed.
+    void drain() {
+        flush();
+        for (auto& sh : shards)
+            while (sh->applied.load(memory_order_acquire) != sh->pushed) this_thread::yield();
+    }
+
+    // The routing thread may read a sharded book between drain() and the
+    // next route(); worker writes happen-before drain() returns.
+    Book& book(uint32_t symbol) { return *books[symbol]; }
+    const Book& book(uint32_t symbol) const { return *books[symbol]; }
+
+    uint64_t dropped_messages() const { return dropped; }
+
+private:
+    static constexpr size_t stage_size = 64;
+    static constexpr size_t pop_batch = 256;
+
+    struct alignas(cacheLineSize) Shard {
+        // Worker side
+        atomic<Fifo3<SymbolMsg>*> queue{nullptr};   // owned by the worker, set once ready
+        alignas(cacheLineSize) atomic<uint64_t> applied{0};
+        atomic<bool> stop{false};
+        // Routing side
+        alignas(cacheLineSize) vector<SymbolMsg> stage;
+        uint64_t pushed = 0;
+        thread worker;
+    };
+
+    void hand_over(Shard& sh) {
+        auto* q = sh.queue.load(memory_order_relaxed);
+        size_t done = 0;
+        while (done < sh.stage.size()) {
+            size_t n = q->push_n(sh.stage.begin() + done, sh.stage.size() - done);
+            if (n == 0) this_thread::yield();   // shard is behind
+            done += n;
+        }
+        sh.pushed += done;
+        sh.stage.clear();
+    }
+
+    void work(size_t index) {
+        auto& sh = *shards[index];
+        if (!cfg.cpus.empty()) tryPinCurrentThread(cfg.cpus[index % cfg.cpus.size()]);
+        // First touch after pinning keeps the shard's memory node-local.
+        auto queue = make_unique<Fifo3<SymbolMsg>>(cfg.queue_capacity);
+        for (size_t s = index; s < books.size(); s += shards.size()) books[s] = make_book(uint32_t(s));
+        vector<SymbolMsg> batch(pop_batch);
+        sh.queue.store(queue.get(), memory_order_release);
+
+        size_t idle = 0;
+        for (;;) {
+            size_t n = queue->pop_n(batch.begin(), pop_batch);
+            if (n == 0) {
+                if (sh.stop.load(memory_order_acquire)) break;
+                if (++idle > 64) this_thread::yield();
+                continue;
+            }
+            idle = 0;
+            for (size_t i = 0; i < n; ++i) apply_msg(*books[batch[i].symbol], batch[i].msg);
+            sh.applied.store(sh.applied.load(memory_order_relaxed) + n, memory_order_release);
+        }
+    }
+
+    ShardConfig cfg;
+    Factory make_book;
+    vector<unique_ptr<Book>> books;   // dense by symbol id
+    vector<unique_ptr<Shard>> shards;
+    uint64_t dropped = 0;
+};
+
+#ifdef BOOK_MANAGER_DEMO
+// Per-symbol add/cancel/execute flow spread over symbols with a Zipf-ish
+// skew, as real instrument activity is.
+static vector<SymbolMsg> generate(size_t symbols, size_t messages) {
+    mt19937_64 rng(5);
+    vector<vector<uint64_t>> live(symbols);
+    vector<SymbolMsg> out;
+    out.reserve(messages);
+    uint64_t next_id = 1;
+    for (size_t i = 0; i < messages; ++i) {
+        auto s = uint32_t(min<double>(symbols - 1, double(symbols) * pow(double(rng() % 1'000'000) / 1e6, 2)));
+        auto& l = live[s];
+        auto r = rng() % 100;
+        if (l.empty() || r < 50) {
+            bool buy = rng() & 1;
+            auto px = Price::from_double(100) + Price{(buy ? -1 : 1) * int64_t(1 + rng() % 20) * 100};
+            l.push_back(next_id);
+            out.push_back({s, {MsgType::Add, buy, next_id++, px, 1 + rng() % 500, i}});
+        } else {
+            size_t k = rng() % l.size();
+            out.push_back({s, {r < 90 ? MsgType::Cancel : MsgType::Execute, false, l[k], {}, uint64_t(r < 90 ? 0 : 50), i}});
+            l[k] = l.back();
+            l.pop_back();
+        }
+    }
+    return out;
+}
+
+template<typename A, typename B>
+static bool same_books(A& a, B& b) {
+    for (uint32_t s = 0; s < a.symbols(); ++s) {
+        vector<pair<uint64_t, uint64_t>> x, y;
+        a.book(s).for_each_order([&](const Order& o) { x.push_back({o.order_id, o.quantity}); });
+        b.book(s).for_each_order([&](const Order& o) { y.push_back({o.order_id, o.quantity}); });
+        if (x != y) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t symbols = argc > 1 ? stoull(argv[1]) : 2000;
+    size_t messages = argc > 2 ? stoull(argv[2]) : 4'000'000;
+    size_t cores = max(1u, thread::hardware_concurrency());
+    size_t max_shards = argc > 3 ? stoull(argv[3]) : max<size_t>(2, cores - 1);
+    auto msgs = generate(symbols, messages);
+
+    auto timed = [&](BookManager<>& mgr) {
+        auto t0 = chrono::steady_clock::now();
+        for (auto& m : msgs) mgr.route(m.symbol, m.msg);
+        mgr.drain();
+        return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    };
+
+    BookManager<> inline_mgr(symbols);
+    double base = timed(inline_mgr);
+    printf("%zu symbols, %zu messages, %zu cpus\n", symbols, messages, cores);
+    printf("  inline:    %6.2f M msgs/s\n", messages / base / 1e6);
+
+    bool ok = true;
+    for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+        ShardConfig cfg;
+        cfg.shards = shards;
+        // Leave cpu 0 to the routing thread when there are enough cores.
+        for (size_t i = 0; i < shards && shards < cores; ++i) cfg.cpus.push_back(int(1 + i));
+        BookManager<> mgr(symbols, cfg);
+        double secs = timed(mgr);
+        bool same = same_books(mgr, inline_mgr);
+        ok &= same;
+        printf("  %2zu shards: %6.2f M msgs/s%s\n", shards, messages / secs / 1e6, same ? "" : "  BOOKS DIFFER");
+    }
+
+    // Wire packets route by their symbol field.
+    ShardConfig two;
+    two.shards = 2;
+    BookManager<> wire_mgr(4, two);
+    vector<byte> packet(3 * wire::orderEventSize);
+    size_t used = 0;
+    for (uint16_t s : {0, 3, 9}) {
+        wire::OrderEvent e{wire::WireType::Add, true, s, 10, s, 0, uint64_t(100 + s), 1'000'000};
+        used += wire::encodeOrderEvent(&packet[used], e);
+    }
+    wire_mgr.route_packet(span(packet.data(), used), 42);
+    wire_mgr.drain();
+    ok &= wire_mgr.book(0).order_count() == 1 && wire_mgr.book(3).order_count() == 1 && wire_mgr.dropped_messages() == 1;
+    wire_mgr.book(3).for_each_order([&](const Order& o) { ok &= o.order_id == 103 && o.timestamp_ns == 42; });
+    printf("wire routing %s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
+#endif
@@ -0,0 +1,222 @@
+// End-to-end book-building benchmark across threads:
+//
+//   sim --Fifo3--> feed parse --Fifo3--> book --Seqlock--> strategy
+//
+//   g++ -std=c++20 -O2 -march=native -pthread book_pipeline_bench.cpp -o book_pipeline_bench
+//   ./book_pipeline_bench --messages 2000000 --rates 0,1000000,4000000 --batches 1,8,32 --cpus 2,3,4,5
+//
+// The sim thread encodes a pre-generated order-event stream (market_sim's
+// model, feed/sim_model.cpp) into wire packets of --batch messages, paced
+// to --rate msgs/s (0: as fast as the ring takes them), and stamps each
+// packet with the TSC as it "hits the wire". The feed thread frames and
+// decodes packets into BookMsg batches, the book thread applies each batch
+// with apply_batch and publishes the BBO through a seqlock whenever it
+// changes, and the strategy thread polls the seqlock. Per (rate, batch) it
+// prints achieved throughput, wire -> stage-exit latency for the feed and
+// book stages and the wire -> BBO-visible latency the strategy observed.
+// --report adds the full per-stage pipeline report. cpus are sim, feed,
+// book, strategy; with fewer than five hardware threads nothing is pinned.
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "feed_decode.cpp"
+#include "../feed/sim_model.cpp"
+#include "../runtime/pipeline.cpp"
+using namespace std;
+
+struct BenchConfig {
+    size_t messages = 2'000'000;
+    vector<double> rates = {0, 1'000'000, 4'000'000};
+    vector<size_t> batches = {1, 8, 32};
+    vector<int> cpus = {1, 2, 3, 4};
+    string book = "ladder";            // sorted | ladder | dense
+    bool report = false;
+    uint64_t seed = 11;
+};
+
+// Whole messages in one datagram, as market_sim sends them.
+constexpr size_t max_packet = 1472;
+constexpr size_t max_batch = max_packet / wire::orderEventSize;
+
+struct WirePacket {
+    uint32_t size;
+    byte data[max_packet];
+};
+
+struct MsgBatch {
+    uint32_t count;
+    BookMsg msgs[max_batch];
+};
+
+struct Bbo {
+    Price bid, ask;
+    uint64_t bid_quantity, ask_quantity;
+    uint64_t wire_tsc;     // ingress stamp of the packet that moved it
+    uint64_t update;       // 1, 2, ... per change
+};
+
+static const Price kTick = Price::from_double(0.01);
+
+// market_sim's order model, so bench numbers line up with what the live
+// feed sends: dense ids, adds/cancels/trades around a random-walk mid.
+static vector<wire::OrderEvent> generate_events(size_t n, uint64_t seed) {
+    SimConfig sim;
+    sim.depth = 50;
+    sim.seed = seed;
+    SimFeed feed(sim);
+    vector<wire::OrderEvent> events;
+    events.reserve(n);
+    while (events.size() < n) events.push_back(feed.next());
+    return events;
+}
+
+struct RunResult {
+    double secs;
+    uint64_t bbo_updates, bbo_seen;
+    latency::Histogram wire_to_bbo;
+};
+
+template<typename Book>
+static RunResult run_once(const BenchConfig& cfg, const vector<wire::OrderEvent>& events, double rate, size_t batch,
+                          unique_ptr<Book> book) {
+    bool pinned = thread::hardware_concurrency() > 4;
+    auto cpu = [&](size_t i) { return pinned ? cfg.cpus[i % cfg.cpus.size()] : -1; };
+
+    Pipeline p;
+    auto& packets = p.ring<WirePacket>(1 << 12);
+    auto& batches = p.ring<MsgBatch>(1 << 12);
+
+    // Sim: encode and pace packets, stamping each as it goes out
+    size_t next = 0;
+    uint64_t ticks_per_packet = rate > 0 ? TscClock::fromNs(1e9 * double(batch) / rate) : 0;
+    uint64_t deadline = 0;
+    p.source("sim", {cpu(0)}, packets, [&](StageOutput<WirePacket>& out) {
+        WirePacket pkt;
+        pkt.size = 0;
+        for (size_t i = 0; i < batch && next < events.size(); ++i)
+            pkt.size += uint32_t(wire::encodeOrderEvent(pkt.data + pkt.size, events[next++]));
+        if (ticks_per_packet) {
+            if (deadline == 0) deadline = readTsc();
+            deadline += ticks_per_packet;
+            while (readTsc() < deadline) cpuRelax();
+        }
+        out.emit(pkt, readTsc());
+        return next < events.size();
+    });
+
+    // Feed: frame and decode into book messages
+    p.stage("feed", {cpu(1)}, packets, batches, [&](Stamped<WirePacket> const& in, StageOutput<MsgBatch>& out) {
+        MsgBatch b;
+        b.count = 0;
+        for_each_order_event(span<const byte>(in.value.data, in.value.size), [&](const wire::OrderEvent& e) {
+            b.msgs[b.count++] = to_book_msg(e, 0);
+        });
+        out.emit(b, in.ingressTsc);
+    });
+
+    // Book: apply, then publish the BBO if it moved
+    Seqlock<Bbo> bbo;
+    Bbo last{};
+    p.sink("book", {cpu(2)}, batches, [&](Stamped<MsgBatch> const& in) {
+        book->apply_batch(span<const BookMsg>(in.value.msgs, in.value.count));
+        auto bid = book->best_bid(), ask = book->best_ask();
+        Bbo now{bid ? bid->price : Price{}, ask ? ask->price : Price{},
+                bid ? bid->total_quantity : 0, ask ? ask->total_quantity : 0, in.ingressTsc, last.update};
+        if (now.bid != last.bid || now.ask != last.ask || now.bid_quantity != last.bid_quantity || now.ask_quantity != last.ask_quantity) {
+            now.update = last.update + 1;
+            last = now;
+            bbo.store(now);
+        }
+    });
+
+    // Strategy: sees whatever the seqlock holds when it looks (conflated)
+    RunResult res{};
+    atomic<bool> done{false};
+    thread strategy([&] {
+        if (cpu(3) >= 0) tryPinCurrentThread(cpu(3));
+        uint64_t seen = 0;
+        size_t idle = 0;
+        while (!done.load(memory_order_acquire)) {
+            Bbo b = bbo.load();
+            if (b.update == seen) {
+                ++idle > 1024 ? this_thread::yield() : cpuRelax();
+                continue;
+            }
+            idle = 0;
+            res.wire_to_bbo.record(readTscOrdered() - b.wire_tsc);
+            seen = b.update;
+            ++res.bbo_seen;
+        }
+    });
+
+    auto t0 = chrono::steady_clock::now();
+    p.start();
+    p.join();
+    res.secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    done.store(true, memory_order_release);
+    strategy.join();
+    res.bbo_updates = last.update;
+
+    auto ns = [](uint64_t ticks) { return TscClock::toNs(ticks); };
+    auto& feed = p.stats()[1]->latency;
+    auto& apply = p.stats()[2]->latency;
+    printf("%10.0f %5zu %9.2f   %8.0f %8.0f   %8.0f %8.0f %9.0f   %7llu/%-7llu %llu\n",
+           rate, batch, double(events.size()) / res.secs / 1e6,
+           ns(feed.quantile(0.5)), ns(apply.quantile(0.5)),
+           ns(res.wire_to_bbo.quantile(0.5)), ns(res.wire_to_bbo.quantile(0.99)), ns(res.wire_to_bbo.quantile(0.999)),
+           (unsigned long long)res.bbo_seen, (unsigned long long)res.bbo_updates,
+           (unsigned long long)(p.stats()[0]->fullStalls + p.stats()[1]->fullStalls));
+    if (cfg.report) p.report();
+    return res;
+}
+
+template<typename T>
+static vector<T> parse_list(const string& s) {
+    vector<T> out;
+    stringstream in(s);
+    for (string item; getline(in, item, ',');) out.push_back(T(stod(item)));
+    return out;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        string k = argv[i];
+        if (k == "--report") { cfg.report = true; continue; }
+        if (i + 1 >= argc) { fprintf(stderr, "missing value for %s\n", k.c_str()); return 1; }
+        string v = argv[++i];
+        if (k == "--messages") cfg.messages = stoull(v);
+        else if (k == "--rates") cfg.rates = parse_list<double>(v);
+        else if (k == "--batches") cfg.batches = parse_list<size_t>(v);
+        else if (k == "--cpus") cfg.cpus = parse_list<int>(v);
+        else if (k == "--book") cfg.book = v;
+        else if (k == "--seed") cfg.seed = stoull(v);
+        else { fprintf(stderr, "unknown option %s\n", k.c_str()); return 1; }
+    }
+    for (size_t b : cfg.batches)
+        if (b == 0 || b > max_batch) { fprintf(stderr, "batch must be 1..%zu\n", max_batch); return 1; }
+
+    auto events = generate_events(cfg.messages, cfg.seed);
+    printf("%zu events, book %s, %s, %.3f ns/tick\n", events.size(), cfg.book.c_str(),
+           thread::hardware_concurrency() > 4 ? "pinned" : "unpinned", TscClock::nsPerTick());
+    printf("%10s %5s %9s   %8s %8s   %8s %8s %9s   %15s %s\n", "rate", "batch", "M msg/s",
+           "feed p50", "book p50", "bbo p50", "bbo p99", "bbo p99.9", "bbo seen/moved", "stalls");
+
+    Price lo = Price::from_double(0), hi = Price::from_double(1000);
+    for (double rate : cfg.rates) {
+        for (size_t batch : cfg.batches) {
+            if (cfg.book == "sorted") {
+                auto book = make_unique<OrderBook>();
+                book->reserve(1 << 16, 256);
+                run_once(cfg, events, rate, batch, std::move(book));
+            } else if (cfg.book == "dense") {
+                auto book = make_unique<DenseIdOrderBook<PriceLadder>>(lo, hi, kTick);
+                book->reserve(1 << 16, 256);
+                run_once(cfg, events, rate, batch, std::move(book));
+            } else {
+                auto book = make_unique<LadderOrderBook>(lo, hi, kTick);
+                book->reserve(1 << 16, 256);
+                run_once(cfg, events, rate, batch, std::move(book));
+            }
+        }
+    }
+}
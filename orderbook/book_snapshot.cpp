@@ -0,0 +1,510 @@
+// Book snapshots for warm restart.
+//
+// A snapshot file is the whole book as flat records: a header, every resting
+// order in queue order (level by level, bids then asks, best first) and one
+// record per level saying how many of those orders it holds. Prices and
+// sides live on the level, so an order costs 24 bytes.
+//
+// BookCheckpointer takes snapshots off the book thread's critical path: the
+// book thread only copies its state (copy_state: a memcpy of the order store
+// and a list of level heads) into an image it owns and swaps it into a
+// pending slot; a writer thread walks the pending image into the file format
+// and replaces the file (write tmp, fdatasync, rename), so a crash leaves the
+// previous or the new snapshot, never a torn one. A snapshot taken while the
+// previous one is still pending supersedes it. MappedSnapshot maps a file
+// read-only, validates it and rebuilds a book level by level through
+// restore_level(); the feed since the snapshot's feed_seq is then replayed
+// with decode_tail().
+//
+//   g++ -std=c++20 -O2 -march=native -pthread -DBOOK_SNAPSHOT_DEMO -x c++ book_snapshot.cpp -o book_snapshot
+#pragma once
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "order_book.cpp"
+#include "feed_decode.cpp"
+using namespace std;
+
+struct SnapshotHeader {
+    static constexpr uint64_t magic_value = 0x31504e534b4f4f42;   // "BOOKSNP1"
+    static constexpr uint32_t current_version = 1;
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t feed_seq;        // last feed event reflected in the book
+    uint64_t rx_ns;           // receive time of the packet that carried it
+    uint64_t order_count;
+    uint64_t level_count;
+    uint64_t checksum;        // of everything after the header
+    uint64_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 64);
+
+struct SnapshotOrder {
+    uint64_t order_id;
+    uint64_t quantity;
+    uint64_t timestamp_ns;
+};
+
+struct SnapshotLevel {
+    int64_t price;
+    uint64_t total_quantity;
+    uint32_t order_count;
+    uint32_t is_buy;
+};
+
+// Word-at-a-time multiply/xor hash: catches truncated or corrupted files at
+// memory bandwidth; not meant to resist anything deliberate.
+inline uint64_t snapshot_checksum(span<const byte> data) {
+    uint64_t h = 0x9e3779b97f4a7c15 ^ data.size();
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t w;
+        memcpy(&w, data.data() + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccd;
+        h ^= h >> 32;
+    }
+    for (; i < data.size(); ++i) h = (h ^ uint64_t(data[i])) * 0xc4ceb9fe1a85ec53;
+    return h ^ (h >> 29);
+}
+
+// Serializes book (or a BookImage of one) into out, reusing its capacity.
+// The queue walk costs a cache miss or two per order, which is why the
+// checkpointer runs it on its own thread. The checksum is left for
+// whoever writes the image out (see seal_snapshot).
+template<typename Book>
+void save_snapshot(const Book& book, uint64_t feed_seq, uint64_t rx_ns, vector<byte>& out) {
+    SnapshotHeader h{SnapshotHeader::magic_value, SnapshotHeader::current_version, sizeof(SnapshotHeader),
+                     feed_seq, rx_ns, book.order_count(), 0, 0, 0};
+    out.resize(sizeof(h) + h.order_count * sizeof(SnapshotOrder));
+    // Offsets, not pointers: appending levels may move the buffer
+    size_t at = sizeof(h);
+    SnapshotLevel level{};
+    auto close_level = [&] {
+        if (level.order_count == 0) return;
+        size_t end = out.size();
+        out.resize(end + sizeof(level));
+        memcpy(out.data() + end, &level, sizeof(level));
+        ++h.level_count;
+    };
+    book.for_each_order([&](const Order& o) {
+        if (level.order_count == 0 || o.price.ticks != level.price || o.is_buy != (level.is_buy != 0)) {
+            close_level();
+            level = {o.price.ticks, 0, 0, o.is_buy};
+        }
+        level.total_quantity += o.quantity;
+        ++level.order_count;
+        SnapshotOrder s{o.order_id, o.quantity, o.timestamp_ns};
+        memcpy(out.data() + at, &s, sizeof(s));
+        at += sizeof(s);
+    });
+    close_level();
+    memcpy(out.data(), &h, sizeof(h));
+}
+
+// Stamps the checksum into a save_snapshot image.
+inline void seal_snapshot(vector<byte>& image) {
+    SnapshotHeader h;
+    memcpy(&h, image.data(), sizeof(h));
+    h.checksum = snapshot_checksum(span<const byte>(image).subspan(sizeof(h)));
+    memcpy(image.data(), &h, sizeof(h));
+}
+
+// Background snapshot writer for one book. checkpoint() runs on the book
+// thread and never waits for I/O or serialization; the writer thread owns
+// the file.
+class BookCheckpointer {
+public:
+    struct Stats {
+        uint64_t taken = 0;         // checkpoint() calls
+        uint64_t written = 0;       // snapshots that reached the file
+        uint64_t superseded = 0;    // replaced while still pending
+        uint64_t last_written_seq = 0;
+    };
+
+    // sync: fdatasync before the rename, so the file survives power loss,
+    // not just a process crash.
+    explicit BookCheckpointer(string path, bool sync = true)
+        : path(std::move(path)), sync(sync), writer([this] { run(); }) {}
+
+    BookCheckpointer(const BookCheckpointer&) = delete;
+    BookCheckpointer& operator=(const BookCheckpointer&) = delete;
+
+    ~BookCheckpointer() {
+        {
+            lock_guard lock(mu);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+    }
+
+    // Book thread: copy book's state as of feed_seq and queue it for
+    // writing. Rethrows a failure from an earlier write.
+    template<typename Book>
+    void checkpoint(const Book& book, uint64_t feed_seq, uint64_t rx_ns) {
+        book.copy_state(spare.image);
+        spare.feed_seq = feed_seq;
+        spare.rx_ns = rx_ns;
+        {
+            lock_guard lock(mu);
+            if (error) [[unlikely]] rethrow_exception(exchange(error, nullptr));
+            swap(spare, pending);
+            counters.superseded += has_pending;
+            has_pending = true;
+            ++counters.taken;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until everything queued so far is on disk.
+    void flush() {
+        unique_lock lock(mu);
+        done.wait(lock, [&] { return (!has_pending && !busy) || error; });
+        if (error) rethrow_exception(exchange(error, nullptr));
+    }
+
+    Stats stats() const {
+        lock_guard lock(mu);
+        return counters;
+    }
+
+private:
+    struct Slot {
+        BookImage image;
+        uint64_t feed_seq = 0, rx_ns = 0;
+    };
+
+    void run() {
+        unique_lock lock(mu);
+        for (;;) {
+            wake.wait(lock, [&] { return has_pending || stopping; });
+            if (!has_pending) return;
+            swap(pending, writing);
+            has_pending = false;
+            busy = true;
+            lock.unlock();
+            exception_ptr failed;
+            try {
+                save_snapshot(writing.image, writing.feed_seq, writing.rx_ns, bytes);
+                seal_snapshot(bytes);
+                write_file(bytes);
+            } catch (...) {
+                failed = current_exception();
+            }
+            lock.lock();
+            busy = false;
+            if (failed) {
+                error = failed;
+            } else {
+                ++counters.written;
+                counters.last_written_seq = writing.feed_seq;
+            }
+            done.notify_all();
+        }
+    }
+
+    void write_file(span<const byte> image) const {
+        string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw system_error(errno, generic_category(), "open " + tmp);
+        for (size_t off = 0; off < image.size();) {
+            ssize_t n = ::write(fd, image.data() + off, image.size() - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                int e = errno;
+                ::close(fd);
+                throw system_error(e, generic_category(), "write " + tmp);
+            }
+            off += size_t(n);
+        }
+        if (sync && ::fdatasync(fd) != 0) {
+            int e = errno;
+            ::close(fd);
+            throw system_error(e, generic_category(), "fdatasync " + tmp);
+        }
+        ::close(fd);
+        if (::rename(tmp.c_str(), path.c_str()) != 0) throw system_error(errno, generic_category(), "rename " + tmp);
+    }
+
+    string path;
+    bool sync;
+    // One state copy per role: spare is the book thread's, writing the
+    // writer's, pending changes hands under mu. Capacity is reused, so
+    // steady-state checkpoints don't allocate.
+    Slot spare, pending, writing;
+    vector<byte> bytes;    // writer's file image
+    mutable mutex mu;
+    condition_variable wake, done;
+    bool has_pending = false, busy = false, stopping = false;
+    exception_ptr error;
+    Stats counters;
+    thread writer;
+};
+
+// Read-only mapping of a snapshot file, validated on open.
+class MappedSnapshot {
+public:
+    explicit MappedSnapshot(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw system_error(errno, generic_category(), "open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int e = errno;
+            ::close(fd);
+            throw system_error(e, generic_category(), "fstat " + path);
+        }
+        bytes = size_t(st.st_size);
+        if (bytes < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            throw runtime_error("snapshot truncated: " + path);
+        }
+        // Populate up front: restore touches every page once, in order
+        void* p = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw system_error(errno, generic_category(), "mmap " + path);
+        base = static_cast<const byte*>(p);
+        try {
+            validate();
+        } catch (...) {
+            ::munmap(const_cast<byte*>(base), bytes);
+            throw;
+        }
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+    ~MappedSnapshot() { ::munmap(const_cast<byte*>(base), bytes); }
+
+    const SnapshotHeader& header() const { return h; }
+
+    // The records sit 8-byte aligned in a page-aligned read-only mapping.
+    span<const SnapshotOrder> orders() const {
+        return {reinterpret_cast<const SnapshotOrder*>(base + sizeof(h)), size_t(h.order_count)};
+    }
+    span<const SnapshotLevel> levels() const {
+        return {reinterpret_cast<const SnapshotLevel*>(base + sizeof(h) + h.order_count * sizeof(SnapshotOrder)),
+                size_t(h.level_count)};
+    }
+
+    // Rebuilds the snapshot into an empty book; returns its feed_seq.
+    template<typename Book>
+    uint64_t restore(Book& book) const {
+        uint64_t per_side[2] = {0, 0};
+        for (auto& l : levels()) ++per_side[l.is_buy != 0];
+        book.reserve(h.order_count, max(per_side[0], per_side[1]));
+        auto queue = orders();
+        for (auto& l : levels()) {
+            book.restore_level(l.is_buy != 0, Price{l.price}, queue.first(l.order_count));
+            queue = queue.subspan(l.order_count);
+        }
+        return h.feed_seq;
+    }
+
+private:
+    void validate() {
+        memcpy(&h, base, sizeof(h));
+        if (h.magic != SnapshotHeader::magic_value || h.version != SnapshotHeader::current_version
+            || h.header_size != sizeof(h))
+            throw runtime_error("not a book snapshot");
+        // Bound each count by the bytes left before multiplying, so neither
+        // product can wrap into a size that happens to match
+        if (h.order_count > (bytes - sizeof(h)) / sizeof(SnapshotOrder))
+            throw runtime_error("snapshot size does not match its header");
+        size_t level_bytes = bytes - sizeof(h) - h.order_count * sizeof(SnapshotOrder);
+        if (h.level_count > level_bytes / sizeof(SnapshotLevel) || level_bytes != h.level_count * sizeof(SnapshotLevel))
+            throw runtime_error("snapshot size does not match its header");
+        if (snapshot_checksum(span(base, bytes).subspan(sizeof(h))) != h.checksum)
+            throw runtime_error("snapshot checksum mismatch");
+        uint64_t total = 0;
+        for (auto& l : levels()) total += l.order_count;
+        if (total != h.order_count) throw runtime_error("snapshot levels do not cover its orders");
+    }
+
+    const byte* base = nullptr;
+    size_t bytes = 0;
+    SnapshotHeader h{};
+};
+
+// Convenience: map, validate and restore path into an empty book.
+template<typename Book>
+SnapshotHeader load_snapshot(const string& path, Book& book) {
+    MappedSnapshot snap(path);
+    snap.restore(book);
+    return snap.header();
+}
+
+// decode_packet for the feed tail after a snapshot: drops events at or
+// before after_seq, for the packet that straddles the snapshot point or a
+// recovery stream that starts early.
+inline void decode_tail(span<const byte> packet, int symbol, uint64_t rx_ns, uint64_t after_seq,
+                        vector<BookMsg>& out, uint64_t& last_seq) {
+    for_each_order_event(packet, [&](const wire::OrderEvent& e) {
+        if (e.seq <= after_seq || (symbol >= 0 && e.symbol != symbol)) return;
+        out.push_back(to_book_msg(e, rx_ns));
+        last_seq = e.seq;
+    });
+}
+
+#ifdef BOOK_SNAPSHOT_DEMO
+#include "../feed/sim_model.cpp"
+
+// Same orders in the same queue order.
+template<typename A, typename B>
+static bool same_book(const A& a, const B& b) {
+    vector<Order> x, y;
+    a.for_each_order([&](const Order& o) { x.push_back(o); });
+    b.for_each_order([&](const Order& o) { y.push_back(o); });
+    return x.size() == y.size() && equal(x.begin(), x.end(), y.begin(), [](const Order& p, const Order& q) {
+        return p.order_id == q.order_id && p.is_buy == q.is_buy && p.price == q.price && p.quantity == q.quantity
+            && p.timestamp_ns == q.timestamp_ns;
+    });
+}
+
+struct Packet {
+    uint64_t rx_ns;
+    vector<byte> data;
+};
+
+// Synthetic session from market_sim's model: packets of 1-20 order events,
+// with the book growing to ~orders resting orders.
+static vector<Packet> make_session(size_t packets, size_t orders) {
+    SimConfig sim;
+    sim.depth = 500;
+    sim.targetOrders = orders;
+    sim.seed = 7;
+    SimFeed feed(sim);
+    vector<Packet> out;
+    out.reserve(packets);
+    for (size_t i = 0; i < packets; ++i) {
+        Packet p{feed.rxNs(), vector<byte>(20 * wire::orderEventSize)};
+        p.data.resize(feed.nextPacket(p.data.data(), 20));
+        out.push_back(std::move(p));
+    }
+    return out;
+}
+
+static double ms_since(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+int main() {
+    string path = "/tmp/book_snapshot_demo.snap";
+    auto session = make_session(400'000, 200'000);
+    size_t crash_at = session.size() - 3'000;   // ~30 ms of feed after the last checkpoint
+    size_t every = 20'000;
+
+    // Live book, checkpointed every `every` packets, then "crashes".
+    OrderBook live;
+    live.reserve(1 << 18, 1024);
+    vector<BookMsg> msgs;
+    uint64_t feed_seq = 0;
+    vector<double> checkpoint_us;
+    {
+        BookCheckpointer cp(path);
+        for (size_t i = 0; i < crash_at; ++i) {
+            msgs.clear();
+            decode_packet(session[i].data, -1, session[i].rx_ns, msgs, feed_seq);
+            live.apply_batch(msgs);
+            if ((i + 1) % every == 0 || i + 1 == crash_at - 2'500) {
+                auto t0 = chrono::steady_clock::now();
+                cp.checkpoint(live, feed_seq, session[i].rx_ns);
+                checkpoint_us.push_back(ms_since(t0) * 1000);
+            }
+        }
+        cp.flush();
+        auto s = cp.stats();
+        // The first use of each slot also pays for growing it
+        sort(checkpoint_us.begin(), checkpoint_us.end());
+        printf("%zu orders resting; %llu checkpoints, %llu written, %llu superseded; book thread paid %.0f us median, %.0f us worst\n",
+               live.order_count(), (unsigned long long)s.taken, (unsigned long long)s.written,
+               (unsigned long long)s.superseded, checkpoint_us[checkpoint_us.size() / 2], checkpoint_us.back());
+        if (s.written == 0) return 1;
+    }
+
+    // Cold restart: replay the whole session.
+    auto t0 = chrono::steady_clock::now();
+    OrderBook cold;
+    uint64_t cold_seq = 0;
+    for (size_t i = 0; i < crash_at; ++i) {
+        msgs.clear();
+        decode_packet(session[i].data, -1, session[i].rx_ns, msgs, cold_seq);
+        cold.apply_batch(msgs);
+    }
+    double cold_ms = ms_since(t0);
+
+    // Warm restart: map the snapshot, then apply only the tail. Any packet
+    // still holding events past the snapshot seq is part of the tail.
+    t0 = chrono::steady_clock::now();
+    OrderBook warm;
+    MappedSnapshot snap(path);
+    uint64_t warm_seq = snap.restore(warm);
+    double load_ms = ms_since(t0);
+    size_t tail_packets = 0;
+    for (size_t i = crash_at; i-- > 0 && session[i].rx_ns > snap.header().rx_ns;) ++tail_packets;
+    for (size_t i = crash_at - tail_packets - 1; i < crash_at; ++i) {
+        msgs.clear();
+        decode_tail(session[i].data, -1, session[i].rx_ns, snap.header().feed_seq, msgs, warm_seq);
+        warm.apply_batch(msgs);
+    }
+    double warm_ms = ms_since(t0);
+
+    auto file_bytes = filesystem::file_size(path);
+    printf("snapshot: %llu orders on %llu levels, %.1f MB, taken at seq %llu\n",
+           (unsigned long long)snap.header().order_count, (unsigned long long)snap.header().level_count,
+           double(file_bytes) / 1e6, (unsigned long long)snap.header().feed_seq);
+    printf("cold restart %.1f ms (%zu packets); warm restart %.1f ms (load %.1f ms + %zu tail packets)\n",
+           cold_ms, crash_at, warm_ms, load_ms, tail_packets);
+    bool ok = same_book(warm, live) && same_book(cold, live) && warm_seq == feed_seq;
+    assert(warm.best_bid() && warm.best_bid()->total_quantity == live.best_bid()->total_quantity);
+
+    // Any backend restores from the same file.
+    LadderOrderBook ladder(Price::from_double(0), Price::from_double(1000), Price::from_double(0.01));
+    load_snapshot(path, ladder);
+    vector<PriceLevel> a, b, c, d;
+    ladder.get_snapshot(20, a, b);
+    OrderBook at_snapshot;
+    snap.restore(at_snapshot);
+    at_snapshot.get_snapshot(20, c, d);
+    ok &= same_book(ladder, at_snapshot) && a.size() == c.size() && equal(a.begin(), a.end(), c.begin(),
+          [](const PriceLevel& x, const PriceLevel& y) { return x.price == y.price && x.total_quantity == y.total_quantity; });
+
+    // A damaged file is refused rather than half loaded.
+    {
+        string bad = path + ".bad";
+        filesystem::copy_file(path, bad, filesystem::copy_options::overwrite_existing);
+        fstream f(bad, ios::in | ios::out | ios::binary);
+        f.seekp(sizeof(SnapshotHeader) + 1000);
+        f.put(char(0x5a));
+        f.close();
+        bool refused = false;
+        try {
+            MappedSnapshot broken(bad);
+        } catch (const runtime_error& e) {
+            refused = string(e.what()).find("checksum") != string::npos;
+        }
+        ok &= refused;
+
+        // A level count that wraps the size arithmetic back to the file size
+        filesystem::copy_file(path, bad, filesystem::copy_options::overwrite_existing);
+        SnapshotHeader h = snap.header();
+        h.level_count += uint64_t(1) << 61;   // * sizeof(SnapshotLevel) (24) wraps to 0
+        f.open(bad, ios::in | ios::out | ios::binary);
+        f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        f.close();
+        refused = false;
+        try {
+            MappedSnapshot broken(bad);
+        } catch (const runtime_error& e) {
+            refused = string(e.what()).find("size") != string::npos;
+        }
+        ok &= refused;
+        filesystem::remove(bad);
+    }
+
+    printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif
@@ -0,0 +1,40 @@
+// Wire order events (feed/wire_format.cpp) to BookMsgs.
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "../feed/wire_format.cpp"
+#include "../runtime/probe.cpp"
+using namespace std;
+
+// timestamp_ns is rx_ns, the packet's receive time (RxPacket::timestampNs,
+// NIC-stamped when available), or the exchange timestamp when rx_ns is 0.
+inline BookMsg to_book_msg(const wire::OrderEvent& e, uint64_t rx_ns) {
+    MsgType t = e.type == wire::WireType::Add ? MsgType::Add
+              : e.type == wire::WireType::Cancel ? MsgType::Cancel : MsgType::Execute;
+    return {t, e.is_buy, e.order_id, Price{e.price}, e.quantity, rx_ns ? rx_ns : e.timestamp};
+}
+
+// Calls f(event) for each order event in a packet. Other message types are
+// skipped; a torn last message ends the walk.
+template<typename F>
+void for_each_order_event(span<const byte> packet, F&& f) {
+    LATENCY_PROBE_SCOPE("feed.decode_packet");
+    size_t off = 0;
+    while (off + wire::headerSize <= packet.size()) {
+        size_t len = wire::Framer::size(packet.data() + off, packet.size() - off);
+        if (len == 0 || off + len > packet.size()) break;
+        wire::OrderEvent e;
+        if (wire::decodeOrderEvent(packet.data() + off, len, e)) f(e);
+        off += len;
+    }
+}
+
+// Order events of one symbol (symbol < 0: all) appended to out as BookMsgs;
+// last_seq is the feed sequence of the last event decoded.
+inline void decode_packet(span<const byte> packet, int symbol, uint64_t rx_ns, vector<BookMsg>& out, uint64_t& last_seq) {
+    for_each_order_event(packet, [&](const wire::OrderEvent& e) {
+        if (symbol >= 0 && e.symbol != symbol) return;
+        out.push_back(to_book_msg(e, rx_ns));
+        last_seq = e.seq;
+    });
+}
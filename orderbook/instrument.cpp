@@ -0,0 +1,122 @@
+#pragma once
+
+#include <bits/stdc++.h>
+#include "price.cpp"
+#include "order_store.cpp"
+using namespace std;
+
+// PriceLadder with its band fixed by an InstrumentSpec: the same best-first
+// slot layout, but slots and the occupancy bitmap live inline and the
+// price -> slot mapping divides by a constant.
+template<typename Spec, typename Node, typename Alloc = allocator<Node>>
+class StaticLadder {
+public:
+    static constexpr size_t slots = Spec::levels;
+
+    // Alloc is accepted for BasicOrderBook's sake; nothing is allocated.
+    explicit StaticLadder(bool is_buy, const Alloc& = Alloc{})
+        : origin(is_buy ? Spec::max_price.ticks : Spec::min_price.ticks), dir(is_buy ? -1 : 1) {}
+
+    void reserve(size_t) {}
+
+    Node* find(Price price) {
+        size_t i;
+        if (!slot_of(price, i) || !is_set(i)) return nullptr;
+        return &levels[i];
+    }
+
+    Node& insert(Price price) {
+        size_t i;
+        if (!slot_of(price, i)) throw out_of_range("price outside instrument band");
+        if (!is_set(i)) {
+            levels[i] = Node{};
+            levels[i].price = price;
+            occupied[i >> 6] |= 1ULL << (i & 63);
+            if (count++ == 0 || i < best) best = i;
+        }
+        return levels[i];
+    }
+
+    void erase(Price price) {
+        size_t i;
+        if (!slot_of(price, i) || !is_set(i)) return;
+        occupied[i >> 6] &= ~(1ULL << (i & 63));
+        levels[i] = Node{};
+        if (--count > 0 && i == best) best = next_from(i);
+    }
+
+    size_t size() const { return count; }
+
+    Node* best_level() { return count ? &levels[best] : nullptr; }
+    const Node* best_level() const { return count ? &levels[best] : nullptr; }
+
+    // Visits levels from the best price outwards while f returns true.
+    template<typename F>
+    void walk(F&& f) const {
+        if (count == 0) return;
+        size_t i = best;
+        for (size_t n = 0; f(levels[i]) && n + 1 < count; ++n)
+            i = next_from(i);
+    }
+
+    // Visits up to depth levels from the best price outwards.
+    template<typename F>
+    void for_each(size_t depth, F&& f) const {
+        if (depth == 0) return;
+        walk([&](const Node& n){ f(n); return --depth > 0; });
+    }
+
+private:
+    static constexpr uint64_t tick = Spec::tick_size.ticks;
+
+    int64_t origin, dir;
+    array<Node, slots> levels{};
+    array<uint64_t, (slots + 63) / 64> occupied{};
+    size_t best = 0, count = 0;
+
+    // Prices below the origin wrap to huge offsets and fail the range check.
+    bool slot_of(Price price, size_t& i) const {
+        auto off = static_cast<uint64_t>((price.ticks - origin) * dir);
+        if constexpr (tick == 1) {
+            i = off;
+        } else if constexpr (has_single_bit(tick)) {
+            if (off & (tick - 1)) return false;
+            i = off >> countr_zero(tick);
+        } else {
+            if (off % tick) return false;
+            i = off / tick;
+        }
+        return i < slots;
+    }
+    bool is_set(size_t i) const { return occupied[i >> 6] >> (i & 63) & 1; }
+
+    // Next occupied slot after i; caller guarantees one exists.
+    size_t next_from(size_t i) const {
+        size_t w = i >> 6;
+        uint64_t bits = occupied[w] & ~((2ULL << (i & 63)) - 1);
+        while (!bits) bits = occupied[++w];
+        return (w << 6) + __builtin_ctzll(bits);
+    }
+};
+
+// Compile-time description of an instrument class: the tick grid, the band
+// of prices the book accepts and the number of resting orders it is sized
+// for. Slot count, bitmap size and the price -> slot mapping all follow as
+// constants, so every instrument class gets its own fully inlined book.
+//
+//     using ESLike = InstrumentSpec<Price::literal(4000), Price::literal(6000), Price::literal(0.25), 1 << 20>;
+//     InstrumentOrderBook<ESLike> book;
+template<Price MinPrice, Price MaxPrice, Price TickSize, size_t MaxOrders>
+struct InstrumentSpec {
+    static_assert(TickSize.ticks > 0, "tick size must be positive");
+    static_assert(MinPrice < MaxPrice, "empty price band");
+    static_assert((MaxPrice - MinPrice).ticks % TickSize.ticks == 0, "band must be a whole number of ticks");
+    static_assert(MaxOrders > 0 && MaxOrders <= OrderRef::buy_bit, "order count outside what OrderStore can index");
+
+    static constexpr Price min_price = MinPrice, max_price = MaxPrice, tick_size = TickSize;
+    static constexpr size_t levels = static_cast<size_t>((MaxPrice - MinPrice).ticks / TickSize.ticks) + 1;
+    static constexpr size_t max_orders = MaxOrders;
+
+    template<typename Node, typename Alloc>
+    using Ladder = StaticLadder<InstrumentSpec, Node, Alloc>;
+};
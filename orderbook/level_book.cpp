@@ -0,0 +1,234 @@
+// Market-by-price book: one aggregate per price level, no orders.
+//
+// For consumers that only read price x size. Input is LevelDelta, the new
+// aggregate for one level (0 removes it), either from an L2 feed or from an
+// order-level BasicOrderBook's changes_since() journal. With no order store,
+// no id index and no journal, a book is its two level containers and a
+// level costs 16 bytes, so one core can carry many more symbols than
+// full-depth order books allow.
+//
+// Levels is the same per-side container BasicOrderBook takes (SortedLevels,
+// PriceLadder, a StaticLadder), with its constructor arguments forwarded.
+//
+//   g++ -std=c++20 -O2 -march=native -DLEVEL_BOOK_DEMO -x c++ level_book.cpp -o level_book
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+using namespace std;
+
+template<template<typename, typename> class Levels = SortedLevels, typename Alloc = allocator<char>>
+class BasicLevelBook {
+public:
+    template<typename... Args>
+    explicit BasicLevelBook(const Args&... args) : BasicLevelBook(allocator_arg, Alloc{}, args...) {}
+
+    template<typename... Args>
+    BasicLevelBook(allocator_arg_t, const Alloc& alloc, const Args&... args)
+        : sides{SideLevels(false, args..., alloc), SideLevels(true, args..., alloc)} {}
+
+    void reserve(size_t max_levels_per_side) {
+        for (auto& levels : sides) levels.reserve(max_levels_per_side);
+    }
+
+    // Sets one level's aggregate; 0 removes the level. Returns whether the
+    // book changed.
+    bool set_level(bool is_buy, Price price, uint64_t total_quantity) {
+        auto& levels = sides[is_buy];
+        if (total_quantity == 0) {
+            if (!levels.find(price)) return false;
+            levels.erase(price);
+            return true;
+        }
+        auto& level = levels.insert(price);
+        if (level.total_quantity == total_quantity) return false;
+        level.total_quantity = total_quantity;
+        return true;
+    }
+
+    bool apply(const LevelDelta& d) {
+        seq = d.seq;
+        return set_level(d.is_buy, d.price, d.total_quantity);
+    }
+
+    // Applies deltas in order; returns how many changed the book.
+    size_t apply_batch(span<const LevelDelta> deltas) {
+        size_t changed = 0;
+        for (const auto& d : deltas) changed += apply(d);
+        return changed;
+    }
+
+    // Same as BasicOrderBook: nullopt when the side is empty.
+    optional<PriceLevel> best_bid() const { return top(sides[bid]); }
+    optional<PriceLevel> best_ask() const { return top(sides[ask]); }
+
+    // Total quantity resting at price, 0 if there is no level.
+    uint64_t quantity_at(bool is_buy, Price price) const {
+        auto* n = const_cast<SideLevels&>(sides[is_buy]).find(price);
+        return n ? n->total_quantity : 0;
+    }
+
+    size_t level_count(bool is_buy) const { return sides[is_buy].size(); }
+
+    // seq of the last delta applied.
+    uint64_t sequence() const { return seq; }
+
+    template<typename Out>
+    void get_snapshot(size_t depth, Out& bids, Out& asks) const {
+        bids.clear(); asks.clear();
+        sides[bid].for_each(depth, [&](const LevelNode& n){ bids.push_back({n.price, n.total_quantity}); });
+        sides[ask].for_each(depth, [&](const LevelNode& n){ asks.push_back({n.price, n.total_quantity}); });
+    }
+
+    void print_book(size_t depth = 10) const {
+        SmallVector<PriceLevel, 16> bids, asks;
+        get_snapshot(depth, bids, asks);
+        cout << "------ LEVEL BOOK ------\n";
+        size_t rows = max(bids.size(), asks.size());
+        for (size_t i = 0; i < rows; ++i) {
+            if (i < bids.size()) cout << fixed << setprecision(2) << bids[i].price.to_double() << " x " << bids[i].total_quantity;
+            else cout << string(15, ' ');
+            cout << string(20, ' ');
+            if (i < asks.size()) cout << fixed << setprecision(2) << asks[i].price.to_double() << " x " << asks[i].total_quantity;
+            cout << '\n';
+        }
+        cout << "------------------------\n";
+    }
+
+    void log_book(size_t depth = 10) const {
+        sides[bid].for_each(depth, [&](const LevelNode& n){ LOG_INFO("bid %.4f x %llu", n.price.to_double(), (unsigned long long)n.total_quantity); });
+        sides[ask].for_each(depth, [&](const LevelNode& n){ LOG_INFO("ask %.4f x %llu", n.price.to_double(), (unsigned long long)n.total_quantity); });
+    }
+
+private:
+    struct LevelNode {
+        Price price;
+        uint64_t total_quantity = 0;
+    };
+    static_assert(sizeof(LevelNode) == 16);
+
+    using SideLevels = Levels<LevelNode, typename allocator_traits<Alloc>::template rebind_alloc<LevelNode>>;
+    static constexpr size_t ask = 0, bid = 1;
+    array<SideLevels, 2> sides;
+    uint64_t seq = 0;
+
+    static optional<PriceLevel> top(const SideLevels& levels) {
+        auto* n = levels.best_level();
+        if (!n) return nullopt;
+        return PriceLevel{n->price, n->total_quantity};
+    }
+};
+
+using LevelBook = BasicLevelBook<SortedLevels>;
+// Tick-indexed, constructed with (min_price, max_price, tick_size).
+using LadderLevelBook = BasicLevelBook<PriceLadder>;
+
+#ifdef LEVEL_BOOK_DEMO
+// Counts bytes held by whatever uses it, per tag type.
+template<typename Tag>
+inline size_t live_bytes = 0;
+
+template<typename T, typename Tag>
+struct CountingAlloc {
+    using value_type = T;
+
+    CountingAlloc() = default;
+    template<typename U>
+    CountingAlloc(const CountingAlloc<U, Tag>&) {}
+
+    T* allocate(size_t n) {
+        live_bytes<Tag> += n * sizeof(T);
+        return allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        live_bytes<Tag> -= n * sizeof(T);
+        allocator<T>{}.deallocate(p, n);
+    }
+    template<typename U> struct rebind { using other = CountingAlloc<U, Tag>; };
+    bool operator==(const CountingAlloc&) const { return true; }
+};
+
+struct L3Tag {};
+struct L2Tag {};
+using CountedOrderBook = BasicOrderBook<SortedLevels, CountingAlloc<char, L3Tag>>;
+using CountedLevelBook = BasicLevelBook<SortedLevels, CountingAlloc<char, L2Tag>>;
+
+template<typename A, typename B>
+static bool same_levels(const A& a, const B& b, size_t depth) {
+    vector<PriceLevel> ab, aa, bb, ba;
+    a.get_snapshot(depth, ab, aa);
+    b.get_snapshot(depth, bb, ba);
+    auto eq = [](const vector<PriceLevel>& x, const vector<PriceLevel>& y) {
+        return x.size() == y.size() && equal(x.begin(), x.end(), y.begin(), [](const PriceLevel& p, const PriceLevel& q) {
+            return p.price == q.price && p.total_quantity == q.total_quantity;
+        });
+    };
+    return eq(ab, bb) && eq(aa, ba);
+}
+
+int main() {
+    // An order-level book drives each L2 consumer through its journal, the
+    // way a shared L3 book would fan out to L2-only strategies.
+    CountedOrderBook l3;
+    CountedLevelBook l2;
+    LadderLevelBook ladder(Price::from_double(50), Price::from_double(150), Price::from_double(0.01));
+    mt19937_64 rng(5);
+    vector<uint64_t> live;
+    vector<LevelDelta> deltas;
+    uint64_t next_id = 1, cursor = 0, delta_count = 0;
+    for (int step = 0; step < 400'000; ++step) {
+        if (live.empty() || rng() % 100 < 55 || live.size() < 20'000) {
+            bool buy = rng() & 1;
+            auto off = int64_t(1 + rng() % 400) * 100;
+            l3.add_order({next_id, buy, Price{1'000'000 + (buy ? -off : off)}, 1 + rng() % 500, uint64_t(step)});
+            live.push_back(next_id++);
+        } else {
+            size_t k = rng() % live.size();
+            if (rng() % 4) l3.cancel_order(live[k]);
+            else l3.execute_order(live[k], 1 + rng() % 200);
+            if (!l3.find_order(live[k])) {
+                live[k] = live.back();
+                live.pop_back();
+            }
+        }
+        if (step % 64 == 63) {
+            if (!l3.changes_since(cursor, deltas)) return 1;   // journal never wraps at this rate
+            cursor = l3.sequence();
+            l2.apply_batch(deltas);
+            ladder.apply_batch(deltas);
+            delta_count += deltas.size();
+        }
+    }
+    l3.changes_since(cursor, deltas);
+    l2.apply_batch(deltas);
+    ladder.apply_batch(deltas);
+    delta_count += deltas.size();
+
+    bool ok = same_levels(l3, l2, SIZE_MAX) && same_levels(l3, ladder, SIZE_MAX);
+    ok &= l2.sequence() == l3.sequence() && l2.level_count(true) + l2.level_count(false) == 800;
+    ok &= l2.quantity_at(true, l3.best_bid()->price) == l3.best_bid()->total_quantity;
+    ok &= !l2.set_level(true, Price::from_double(1), 0);   // removing a missing level is a no-op
+    l2.print_book(5);
+
+    size_t l3_bytes = live_bytes<L3Tag>, l2_bytes = live_bytes<L2Tag>;
+    printf("%zu resting orders on %zu levels from %llu deltas\n", l3.order_count(),
+           l2.level_count(true) + l2.level_count(false), (unsigned long long)delta_count);
+    printf("order book %.2f MB, level book %.1f KB (%.0fx smaller)\n", double(l3_bytes) / 1e6,
+           double(l2_bytes) / 1e3, double(l3_bytes) / double(l2_bytes));
+
+    // Delta apply rate with the levels in cache, the per-symbol cost once many
+    // symbols share a core.
+    vector<LevelDelta> stream;
+    for (int i = 0; i < 1'000'000; ++i) {
+        bool buy = rng() & 1;
+        auto off = int64_t(1 + rng() % 400) * 100;
+        stream.push_back({uint64_t(i), buy, Price{1'000'000 + (buy ? -off : off)}, rng() % 8 ? 1 + rng() % 5000 : 0});
+    }
+    auto t0 = chrono::steady_clock::now();
+    ladder.apply_batch(stream);
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / double(stream.size());
+    printf("ladder level book: %.1f ns per delta\n", ns);
+
+    printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif
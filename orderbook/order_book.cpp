@@ -1,150 +1,1002 @@
+#pragma once
+
 #include <bits/stdc++.h>
+#include "price.cpp"
+#include "price_ladder.cpp"
+#include "instrument.cpp"
+#include "order_store.cpp"
+#include "../memory/memory_pool.cpp"
+#include "../memory/arena.cpp"
+#include "../containers/flat_id_map.cpp"
+#include "../containers/paged_id_map.cpp"
+#include "../containers/small_vector.cpp"
+#include "../lockFreeWaitFree/seqlock.cpp"
+#include "../runtime/probe.cpp"
+#include "../runtime/logger.cpp"
 using namespace std;
 
 struct Order {
     uint64_t order_id;
     bool is_buy;
-    double price;
+    Price price;
     uint64_t quantity;
     uint64_t timestamp_ns;
 };
 
 struct PriceLevel {
-    double price;
+    Price price;
+    uint64_t total_quantity;
+};
+
+// Limit rests any unfilled remainder; IOC drops it; FOK fills completely or not at all.
+enum class TimeInForce : uint8_t { Limit, IOC, FOK };
+
+struct Trade {
+    uint64_t aggressor_id;
+    uint64_t resting_id;
+    Price price;
+    uint64_t quantity;
+    uint64_t timestamp_ns;
+};
+
+// One level's new aggregate after a change; total_quantity 0 means the level is gone.
+struct LevelDelta {
+    uint64_t seq;
+    bool is_buy;
+    Price price;
     uint64_t total_quantity;
 };
 
-class OrderBook {
+// Top of book as published to other threads: up to depth levels per side and
+// the book sequence() it was taken at. Changes below the top don't republish,
+// so seq can trail the book's.
+struct BookTop {
+    static constexpr size_t depth = 5;
+    uint64_t seq;
+    uint32_t bid_count, ask_count;
+    PriceLevel bids[depth], asks[depth];
+};
+
+// Book thread stores, strategy threads load() a consistent copy without locking.
+using TopOfBook = Seqlock<BookTop>;
+
+// One feed message for apply_batch; Cancel only uses order_id, Execute
+// (a fill against a resting order) uses order_id and the filled quantity.
+enum class MsgType : uint8_t { Add, Cancel, Amend, Execute };
+
+struct BookMsg {
+    MsgType type;
+    bool is_buy;
+    uint64_t order_id;
+    Price price;
+    uint64_t quantity;
+    uint64_t timestamp_ns;
+};
+
+struct MatchResult {
+    uint64_t filled_quantity = 0;
+    uint64_t remaining_quantity = 0;   // not filled and not resting
+    size_t trade_count = 0;
+    bool rested = false;
+    bool truncated = false;            // trade buffer ran out before the sweep finished
+};
+
+// Hash map of levels plus a price vector kept sorted best-first.
+template<typename Node, typename Alloc = allocator<Node>>
+class SortedLevels {
 public:
+    explicit SortedLevels(bool is_buy, const Alloc& alloc = Alloc{})
+        : is_buy(is_buy), mp(0, hash<Price>{}, equal_to<Price>{}, alloc), prices(alloc) {}
+
+    void reserve(size_t levels) {
+        mp.reserve(levels);
+        prices.reserve(levels);
+    }
+
+    Node* find(Price price) {
+        auto it = mp.find(price);
+        return it == mp.end() ? nullptr : &it->second;
+    }
+
+    Node& insert(Price price) {
+        auto [it, inserted] = mp.try_emplace(price);
+        if (inserted) {
+            it->second.price = price;
+            prices.push_back(price);
+            // Best first for either side: bids descend, asks ascend.
+            int64_t sign = int64_t(is_buy) * 2 - 1;
+            sort(prices.begin(), prices.end(), [sign](Price a, Price b){ return (a.ticks - b.ticks) * sign > 0; });
+        }
+        return it->second;
+    }
+
+    void erase(Price price) {
+        mp.erase(price);
+        prices.erase(remove(prices.begin(), prices.end(), price), prices.end());
+    }
+
+    size_t size() const { return prices.size(); }
+
+    Node* best_level() { return prices.empty() ? nullptr : &mp.find(prices.front())->second; }
+    const Node* best_level() const { return prices.empty() ? nullptr : &mp.find(prices.front())->second; }
+
+    // Visits levels from the best price outwards while f returns true.
+    template<typename F>
+    void walk(F&& f) const {
+        for (Price p : prices)
+            if (!f(mp.at(p))) break;
+    }
+
+    template<typename F>
+    void for_each(size_t depth, F&& f) const {
+        for (size_t i = 0; i < min(depth, prices.size()); ++i)
+            f(mp.at(prices[i]));
+    }
+
+private:
+    template<typename T>
+    using rebind = typename allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    bool is_buy;
+    unordered_map<Price, Node, hash<Price>, equal_to<Price>, rebind<pair<const Price, Node>>> mp;
+    vector<Price, rebind<Price>> prices;
+};
+
+// Flat copy of a book's resting state from copy_state(), for walking on
+// another thread: the store's records verbatim plus each level's price and
+// queue head, levels in for_each_order() order.
+struct BookImage {
+    struct Level {
+        Price price;
+        uint32_t head;
+        bool is_buy;
+    };
+    vector<HotOrder> hot;
+    vector<ColdOrder> cold;
+    vector<Level> levels;
+    size_t orders = 0;
+
+    size_t order_count() const { return orders; }
+
+    // Same orders in the same order as the book's for_each_order().
+    template<typename F>
+    void for_each_order(F&& f) const {
+        for (const auto& l : levels)
+            for (uint32_t i = l.head; i != OrderStore<>::npos; i = hot[i].next)
+                f(Order{hot[i].order_id, l.is_buy, l.price, hot[i].quantity, cold[i].timestamp_ns});
+    }
+};
+
+// Levels is the per-side price level container: SortedLevels, PriceLadder or
+// an InstrumentSpec's StaticLadder.
+// Constructor arguments after the side flag are forwarded to both sides.
+// Resting orders are hot/cold records in an OrderStore, threaded through an
+// intrusive FIFO per level by index. Alloc is rebound for the store, the id
+// index and level storage; with a PoolAllocator and reserve() the steady
+// state does no global allocation. IdIndex maps order ids to resting orders:
+// FlatIdMap hashes any id, PagedIdMap indexes dense per-session ids directly.
+template<template<typename, typename> class Levels = SortedLevels, typename Alloc = allocator<char>,
+         template<typename, typename> class IdIndex = FlatIdMap>
+class BasicOrderBook {
+public:
+    template<typename... Args>
+    explicit BasicOrderBook(const Args&... args) : BasicOrderBook(allocator_arg, Alloc{}, args...) {}
+
+    template<typename... Args>
+    BasicOrderBook(allocator_arg_t, const Alloc& alloc, const Args&... args)
+        : sides{SideLevels(false, args..., alloc), SideLevels(true, args..., alloc)},
+          order_lookup(alloc), store(alloc), journal(journal_size, LevelDelta{}, alloc), batch_touched(alloc) {
+        batch_touched.reserve(1024);
+    }
+
+    void reserve(size_t max_orders, size_t max_levels_per_side) {
+        order_lookup.reserve(max_orders);
+        store.reserve(max_orders);
+        for (auto& levels : sides) levels.reserve(max_levels_per_side);
+    }
+
     void add_order(const Order& order);
+    // Sweeps the opposite side in price-time order, writing one Trade per resting
+    // fill into trades. If trades fills up the sweep stops, nothing rests and
+    // the rest is reported in remaining_quantity so the caller can resubmit.
+    MatchResult match_order(const Order& order, TimeInForce tif, span<Trade> trades);
+    // Same sweep appending to a per-message fill list, which grows as needed
+    // so the sweep never truncates; up to N fills stay off the heap.
+    template<size_t N, typename A>
+    MatchResult match_order(const Order& order, TimeInForce tif, SmallVector<Trade, N, A>& fills) {
+        fills.clear();
+        return sweep(order, tif, SIZE_MAX, [&](const Trade& t) { fills.push_back(t); });
+    }
     bool cancel_order(uint64_t order_id);
-    bool amend_order(uint64_t order_id, double new_price, uint64_t new_quantity);
-    void get_snapshot(size_t depth, vector<PriceLevel>& bids, vector<PriceLevel>& asks) const;
+    bool amend_order(uint64_t order_id, Price new_price, uint64_t new_quantity);
+    // Fill quantity of a resting order, keeping its queue position; the order
+    // goes once nothing is left.
+    bool execute_order(uint64_t order_id, uint64_t quantity);
+    // Out is any PriceLevel container with clear() and push_back(): a vector,
+    // or a SmallVector sized for depth so the snapshot stays off the heap.
+    template<typename Out>
+    void get_snapshot(size_t depth, Out& bids, Out& asks) const;
     void print_book(size_t depth = 10) const;
+    // Same levels through the async logger: no formatting or I/O on the
+    // calling thread, unlike print_book.
+    void log_book(size_t depth = 10) const;
+
+    // Applies a packet's worth of messages in order, prefetching id lookups a
+    // few messages ahead. Level deltas and cache invalidation are deferred to
+    // the end so each touched level publishes once. Returns how many messages
+    // applied (unknown ids and duplicate adds are skipped).
+    size_t apply_batch(span<const BookMsg> msgs);
+
+    // Every resting order, bids then asks, best price first and in queue
+    // order within a level; re-adding them in this order rebuilds the book.
+    template<typename F>
+    void for_each_order(F&& f) const {
+        auto walk = [&](const auto& levels, bool is_buy) {
+            levels.walk([&](const PriceLevelNode& level) {
+                for (uint32_t i = level.head; i != Store::npos; i = store.hot(i).next) f(order_at(i, is_buy));
+                return true;
+            });
+        };
+        walk(sides[bid], true);
+        walk(sides[ask], false);
+    }
+    size_t order_count() const { return order_lookup.size(); }
+
+    // Copies the resting state into image, reusing its capacity, so a
+    // snapshot can be serialized off the book thread: a memcpy of the store
+    // plus one entry per level, no queue walking.
+    void copy_state(BookImage& image) const;
+
+    // Warm restart: rests queue's orders on one level in the given order with
+    // no matching and one publication for the level instead of one per order.
+    // Elements need order_id, quantity and timestamp_ns; duplicate ids and
+    // empty orders are skipped. Meant for rebuilding an empty book from a
+    // snapshot, whose levels never cross.
+    template<typename Queue>
+    void restore_level(bool is_buy, Price price, const Queue& queue);
+
+    // The resting order with this id as an Order, or nullopt.
+    optional<Order> find_order(uint64_t order_id) const {
+        auto* ref = order_lookup.find(order_id);
+        if (!ref) [[unlikely]] return nullopt;
+        return order_at(ref->index(), ref->is_buy());
+    }
+
+    // O(1) top of book; nullopt when the side is empty.
+    optional<PriceLevel> best_bid() const { return top(sides[bid]); }
+    optional<PriceLevel> best_ask() const { return top(sides[ask]); }
+
+    // Sequence of the latest level change. Consumers remember it and later ask
+    // for what changed since; false means the journal has wrapped past seq and
+    // the consumer must resync from get_snapshot().
+    uint64_t sequence() const { return seq; }
+    bool changes_since(uint64_t since, vector<LevelDelta>& out) const;
+
+    // Top-K levels per side, rebuilt only when a change lands inside them;
+    // k == 0 turns the cache off (cached_depth() is then empty).
+    void set_cached_depth(size_t k);
+    span<const PriceLevel> cached_depth(bool is_buy) const;
+
+    // Republish BookTop to out after every operation that changes the top
+    // BookTop::depth levels of either side; nullptr stops publishing.
+    void publish_top(TopOfBook* out);
 
 private:
+    using Store = OrderStore<Alloc>;
+
+    // Half a cache line: the level's aggregate plus its queue's ends.
     struct PriceLevelNode {
-        double price;
+        Price price;
         uint64_t total_quantity = 0;
-        deque<Order> orders;
+        uint32_t order_count = 0;
+        uint32_t head = Store::npos;   // oldest order, first to fill
+        uint32_t tail = Store::npos;
+
+        void push_back(Store& store, uint32_t i) {
+            auto& n = store.hot(i);
+            n.prev = tail;
+            n.next = Store::npos;
+            (tail != Store::npos ? store.hot(tail).next : head) = i;
+            tail = i;
+            total_quantity += n.quantity;
+            ++order_count;
+        }
+
+        void unlink(Store& store, uint32_t i) {
+            auto& n = store.hot(i);
+            (n.prev != Store::npos ? store.hot(n.prev).next : head) = n.next;
+            (n.next != Store::npos ? store.hot(n.next).prev : tail) = n.prev;
+            total_quantity -= n.quantity;
+            --order_count;
+        }
     };
+    static_assert(sizeof(PriceLevelNode) == 32);
+
+    template<typename T>
+    using rebind = typename allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    // Everything per side is indexed by is_buy, so a mixed buy/sell flow
+    // selects its side with an index rather than a branch.
+    static constexpr size_t ask = 0, bid = 1;
+    using SideLevels = Levels<PriceLevelNode, rebind<PriceLevelNode>>;
+    array<SideLevels, 2> sides;
+    IdIndex<OrderRef, rebind<OrderRef>> order_lookup;
+    Store store;
+
+    Order order_at(uint32_t i, bool is_buy) const {
+        const auto& h = store.hot(i);
+        return {h.order_id, is_buy, h.price, h.quantity, store.cold(i).timestamp_ns};
+    }
+
+    // Unlinks order i from its level, dropping the level if it empties, and
+    // frees it; the id index entry is the caller's.
+    void remove_resting(uint32_t i, bool is_buy);
+
+    // Ring of recent level changes indexed by seq. A change to the same level
+    // as the tail entry marks the tail superseded (seq 0, which changes_since
+    // skips) and appends the new state under the next seq, so a reader sees
+    // only the latest of a run while every seq still has its own slot.
+    static constexpr size_t journal_size = 4096;
+    vector<LevelDelta, rebind<LevelDelta>> journal;
+    uint64_t seq = 0;
+
+    struct DepthCache {
+        SmallVector<PriceLevel, 16> levels;
+        bool dirty = true;
+    };
+    size_t cache_depth = 10;
+    mutable array<DepthCache, 2> caches;
+
+    TopOfBook* top_out = nullptr;
+    BookTop top_last{};
+    bool top_dirty = false;
 
-    unordered_map<double, PriceLevelNode> bid_map, ask_map;
-    vector<double> bid_prices, ask_prices;
-    unordered_map<uint64_t, pair<bool, pair<double, size_t>>> order_lookup;
+    // Levels touched inside apply_batch, published once the batch ends. A
+    // repeat of the last touch is skipped and a full vector is sorted and
+    // deduplicated in place, so it only grows past its reserve when a single
+    // batch touches more distinct levels than that.
+    bool in_batch = false;
+    vector<pair<Price, bool>, rebind<pair<Price, bool>>> batch_touched;
 
-    void insert_price_level(bool is_buy, double price);
-    void remove_price_level(bool is_buy, double price);
+    void level_changed(bool is_buy, Price price, uint64_t total_quantity);
+    void coalesce_touched();
+    void publish_level(bool is_buy, Price price, uint64_t total_quantity);
+    void flush_top();
+
+    template<typename L>
+    static optional<PriceLevel> top(const L& levels) {
+        auto* n = levels.best_level();
+        if (!n) return nullopt;
+        return PriceLevel{n->price, n->total_quantity};
+    }
+
+    // a is at b or better for the side: a >= b for bids, a <= b for asks.
+    // The side becomes the sign of the difference instead of a branch.
+    static bool at_or_better(bool is_buy, Price a, Price b) {
+        return (a.ticks - b.ticks) * (int64_t(is_buy) * 2 - 1) >= 0;
+    }
+    static bool crosses(const Order& order, Price resting) { return at_or_better(order.is_buy, order.price, resting); }
+    bool can_fill(const Order& order, size_t max_trades) const;
+    // match_order's sweep, handing each trade to emit; stops short once
+    // max_trades have been emitted.
+    template<typename Emit>
+    MatchResult sweep(const Order& order, TimeInForce tif, size_t max_trades, Emit&& emit);
 };
 
-void OrderBook::insert_price_level(bool is_buy, double price) {
-    auto& prices = is_buy ? bid_prices : ask_prices;
-    auto& mp = is_buy ? bid_map : ask_map;
-    if (mp.find(price) == mp.end()) {
-        mp[price] = {price, 0, {}};
-        prices.push_back(price);
-        if (is_buy)
-            sort(prices.begin(), prices.end(), greater<>());
-        else
-            sort(prices.begin(), prices.end());
-    }
-}
-
-void OrderBook::remove_price_level(bool is_buy, double price) {
-    auto& prices = is_buy ? bid_prices : ask_prices;
-    auto& mp = is_buy ? bid_map : ask_map;
-    mp.erase(price);
-    prices.erase(remove(prices.begin(), prices.end(), price), prices.end());
-}
-
-void OrderBook::add_order(const Order& order) {
-    if (order.quantity == 0) return;
-    bool is_buy = order.is_buy;
-    auto& mp = is_buy ? bid_map : ask_map;
-    insert_price_level(is_buy, order.price);
-    auto& node = mp[order.price];
-    node.orders.push_back(order);
-    node.total_quantity += order.quantity;
-    order_lookup[order.order_id] = {is_buy, {order.price, node.orders.size() - 1}};
-}
-
-bool OrderBook::cancel_order(uint64_t order_id) {
-    auto it = order_lookup.find(order_id);
-    if (it == order_lookup.end()) return false;
-    bool is_buy = it->second.first;
-    double price = it->second.second.first;
-    size_t idx = it->second.second.second;
-    auto& mp = is_buy ? bid_map : ask_map;
-    auto& node = mp[price];
-    if (idx >= node.orders.size()) return false;
-    uint64_t qty = node.orders[idx].quantity;
-    node.orders[idx].quantity = 0;
-    node.total_quantity -= qty;
-    if (all_of(node.orders.begin(), node.orders.end(), [](const Order& o){ return o.quantity == 0; }))
-        remove_price_level(is_buy, price);
-    order_lookup.erase(it);
+// Original backend: O(n log n) per new level, O(n) per removed level.
+using OrderBook = BasicOrderBook<SortedLevels>;
+// Tick-indexed backend: O(1) add/remove level, constructed with (min_price, max_price, tick_size).
+using LadderOrderBook = BasicOrderBook<PriceLadder>;
+// Either backend on a PoolResource: construct with (allocator_arg, PoolAllocator<char>(resource), ...).
+template<template<typename, typename> class Levels = SortedLevels>
+using PooledOrderBook = BasicOrderBook<Levels, PoolAllocator<char>>;
+// Either backend on any pmr resource, e.g. a pool over an ArenaResource.
+template<template<typename, typename> class Levels = SortedLevels>
+using PmrOrderBook = BasicOrderBook<Levels, pmr::polymorphic_allocator<char>>;
+// Either backend for feeds that number orders densely: cancels and amends
+// find their order by direct indexing instead of hashing.
+template<template<typename, typename> class Levels = SortedLevels>
+using DenseIdOrderBook = BasicOrderBook<Levels, allocator<char>, PagedIdMap>;
+
+// One instrument class fixed at compile time: StaticLadder levels, with the
+// store and id index sized for Spec::max_orders up front.
+template<typename Spec, typename Alloc = allocator<char>>
+class InstrumentOrderBook : public BasicOrderBook<Spec::template Ladder, Alloc> {
+public:
+    explicit InstrumentOrderBook(const Alloc& alloc = Alloc{})
+        : BasicOrderBook<Spec::template Ladder, Alloc>(allocator_arg, alloc) {
+        this->reserve(Spec::max_orders, Spec::levels);
+    }
+};
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::add_order(const Order& order) {
+    LATENCY_PROBE_SCOPE("OrderBook::add_order");
+    if (order.quantity == 0) [[unlikely]] return;
+    auto [ref, inserted] = order_lookup.try_emplace(order.order_id, OrderRef{});
+    if (!inserted) [[unlikely]] return;
+    auto& levels = sides[order.is_buy];
+    uint32_t i = store.create({order.order_id, order.price, order.quantity, 0, 0}, {order.timestamp_ns});
+    *ref = OrderRef::make(i, order.is_buy);
+    auto& level = levels.insert(order.price);
+    level.push_back(store, i);
+    level_changed(order.is_buy, order.price, level.total_quantity);
+    flush_top();
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::copy_state(BookImage& image) const {
+    image.orders = order_count();
+    image.hot.resize(store.high_water());
+    image.cold.resize(store.high_water());
+    size_t at = 0;
+    store.for_each_chunk([&](const HotOrder* hot, const ColdOrder* cold, size_t n) {
+        memcpy(image.hot.data() + at, hot, n * sizeof(HotOrder));
+        memcpy(image.cold.data() + at, cold, n * sizeof(ColdOrder));
+        at += n;
+    });
+    image.levels.clear();
+    auto add = [&](const SideLevels& levels, bool is_buy) {
+        levels.walk([&](const PriceLevelNode& n) {
+            image.levels.push_back({n.price, n.head, is_buy});
+            return true;
+        });
+    };
+    add(sides[bid], true);
+    add(sides[ask], false);
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+template<typename Queue>
+void BasicOrderBook<Levels, Alloc, IdIndex>::restore_level(bool is_buy, Price price, const Queue& queue) {
+    auto& levels = sides[is_buy];
+    auto& level = levels.insert(price);
+    for (const auto& o : queue) {
+        if (o.quantity == 0) [[unlikely]] continue;
+        auto [ref, inserted] = order_lookup.try_emplace(o.order_id, OrderRef{});
+        if (!inserted) [[unlikely]] continue;
+        uint32_t i = store.create({o.order_id, price, o.quantity, 0, 0}, {o.timestamp_ns});
+        *ref = OrderRef::make(i, is_buy);
+        level.push_back(store, i);
+    }
+    if (level.order_count == 0) [[unlikely]] {
+        levels.erase(price);
+        return;
+    }
+    level_changed(is_buy, price, level.total_quantity);
+    flush_top();
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+bool BasicOrderBook<Levels, Alloc, IdIndex>::can_fill(const Order& order, size_t max_trades) const {
+    uint64_t need = order.quantity;
+    size_t trades = 0;
+    auto& opp = sides[!order.is_buy];
+    opp.walk([&](const PriceLevelNode& level) {
+        if (!crosses(order, level.price)) return false;
+        for (uint32_t i = level.head; i != Store::npos && need; i = store.hot(i).next) {
+            need -= min(need, store.hot(i).quantity);
+            ++trades;
+        }
+        return need > 0;
+    });
+    return need == 0 && trades <= max_trades;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+MatchResult BasicOrderBook<Levels, Alloc, IdIndex>::match_order(const Order& order, TimeInForce tif, span<Trade> trades) {
+    size_t n = 0;
+    return sweep(order, tif, trades.size(), [&](const Trade& t) { trades[n++] = t; });
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+template<typename Emit>
+MatchResult BasicOrderBook<Levels, Alloc, IdIndex>::sweep(const Order& order, TimeInForce tif, size_t max_trades, Emit&& emit) {
+    LATENCY_PROBE_SCOPE("OrderBook::match_order");
+    MatchResult res;
+    res.remaining_quantity = order.quantity;
+    if (order.quantity == 0 || order_lookup.contains(order.order_id)) [[unlikely]] return res;
+    if (tif == TimeInForce::FOK && !can_fill(order, max_trades)) return res;
+
+    auto& opp = sides[!order.is_buy];
+    uint64_t remaining = order.quantity;
+    PriceLevelNode* level;
+    while (remaining && (level = opp.best_level()) && crosses(order, level->price)) {
+        uint32_t i = level->head;
+        while (i != Store::npos && remaining) {
+            if (res.trade_count == max_trades) [[unlikely]] {
+                res.truncated = true;
+                break;
+            }
+            auto& n = store.hot(i);
+            uint64_t q = min(remaining, n.quantity);
+            emit(Trade{order.order_id, n.order_id, level->price, q, order.timestamp_ns});
+            ++res.trade_count;
+            remaining -= q;
+            n.quantity -= q;
+            level->total_quantity -= q;
+            uint32_t next = n.next;
+            if (n.quantity == 0) {
+                level->unlink(store, i);
+                order_lookup.erase(n.order_id);
+                store.destroy(i);
+            }
+            i = next;
+        }
+        level_changed(!order.is_buy, level->price, level->total_quantity);
+        if (level->order_count == 0) [[unlikely]] opp.erase(level->price);
+        if (res.truncated) break;
+    }
+
+    res.filled_quantity = order.quantity - remaining;
+    res.remaining_quantity = remaining;
+    if (remaining && tif == TimeInForce::Limit && !res.truncated) {
+        Order rest = order;
+        rest.quantity = remaining;
+        add_order(rest);
+        res.rested = true;
+        res.remaining_quantity = 0;
+    }
+    flush_top();
+    return res;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::remove_resting(uint32_t i, bool is_buy) {
+    auto& levels = sides[is_buy];
+    Price price = store.hot(i).price;
+    auto* level = levels.find(price);
+    level->unlink(store, i);
+    level_changed(is_buy, price, level->total_quantity);
+    if (level->order_count == 0) [[unlikely]]
+        levels.erase(price);
+    store.destroy(i);
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+bool BasicOrderBook<Levels, Alloc, IdIndex>::cancel_order(uint64_t order_id) {
+    LATENCY_PROBE_SCOPE("OrderBook::cancel_order");
+    auto* ref = order_lookup.find(order_id);
+    if (!ref) [[unlikely]] return false;
+    remove_resting(ref->index(), ref->is_buy());
+    order_lookup.erase(order_id);
+    flush_top();
     return true;
 }
 
-bool OrderBook::amend_order(uint64_t order_id, double new_price, uint64_t new_quantity) {
-    auto it = order_lookup.find(order_id);
-    if (it == order_lookup.end()) return false;
-    bool is_buy = it->second.first;
-    double price = it->second.second.first;
-    size_t idx = it->second.second.second;
-    auto& mp = is_buy ? bid_map : ask_map;
-    auto& node = mp[price];
-    if (idx >= node.orders.size()) return false;
-    auto& ord = node.orders[idx];
-    if (new_price != price) {
-        cancel_order(order_id);
-        Order updated = ord;
-        updated.price = new_price;
-        updated.quantity = new_quantity;
-        add_order(updated);
-    } else {
-        node.total_quantity -= ord.quantity;
-        ord.quantity = new_quantity;
-        node.total_quantity += new_quantity;
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+bool BasicOrderBook<Levels, Alloc, IdIndex>::amend_order(uint64_t order_id, Price new_price, uint64_t new_quantity) {
+    auto* ref = order_lookup.find(order_id);
+    if (!ref) [[unlikely]] return false;
+    if (new_quantity == 0) return cancel_order(order_id);
+    uint32_t i = ref->index();
+    bool is_buy = ref->is_buy();
+    auto& n = store.hot(i);
+    auto& levels = sides[is_buy];
+    auto* level = levels.find(n.price);
+
+    if (new_price == n.price) {
+        if (new_quantity <= n.quantity) {
+            // Size-down keeps queue position.
+            level->total_quantity -= n.quantity - new_quantity;
+            n.quantity = new_quantity;
+        } else {
+            // Size-up goes to the back of the same level.
+            level->unlink(store, i);
+            n.quantity = new_quantity;
+            level->push_back(store, i);
+        }
+        level_changed(is_buy, new_price, level->total_quantity);
+        flush_top();
+        return true;
     }
+
+    // Price change: relink the same record at the back of the new level; the
+    // id index already points at it.
+    Price old_price = n.price;
+    level->unlink(store, i);
+    level_changed(is_buy, old_price, level->total_quantity);
+    if (level->order_count == 0) [[unlikely]]
+        levels.erase(old_price);
+    n.price = new_price;
+    n.quantity = new_quantity;
+    auto& target = levels.insert(new_price);
+    target.push_back(store, i);
+    level_changed(is_buy, new_price, target.total_quantity);
+    flush_top();
     return true;
 }
 
-void OrderBook::get_snapshot(size_t depth, vector<PriceLevel>& bids, vector<PriceLevel>& asks) const {
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+bool BasicOrderBook<Levels, Alloc, IdIndex>::execute_order(uint64_t order_id, uint64_t quantity) {
+    auto* ref = order_lookup.find(order_id);
+    if (!ref) [[unlikely]] return false;
+    const auto& n = store.hot(ref->index());
+    if (quantity >= n.quantity) return cancel_order(order_id);
+    return amend_order(order_id, n.price, n.quantity - quantity);
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+size_t BasicOrderBook<Levels, Alloc, IdIndex>::apply_batch(span<const BookMsg> msgs) {
+    LATENCY_PROBE_SCOPE("OrderBook::apply_batch");
+    constexpr size_t prefetch_distance = 8;
+    for (size_t i = 0; i < min(prefetch_distance, msgs.size()); ++i)
+        order_lookup.prefetch(msgs[i].order_id);
+
+    in_batch = true;
+    size_t applied = 0;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        if (i + prefetch_distance < msgs.size())
+            order_lookup.prefetch(msgs[i + prefetch_distance].order_id);
+        const auto& m = msgs[i];
+        switch (m.type) {
+        case MsgType::Add: {
+            size_t before = order_lookup.size();
+            add_order({m.order_id, m.is_buy, m.price, m.quantity, m.timestamp_ns});
+            applied += order_lookup.size() != before;
+            break;
+        }
+        case MsgType::Cancel: applied += cancel_order(m.order_id); break;
+        case MsgType::Amend: applied += amend_order(m.order_id, m.price, m.quantity); break;
+        case MsgType::Execute: applied += execute_order(m.order_id, m.quantity); break;
+        }
+    }
+    in_batch = false;
+
+    coalesce_touched();
+    for (auto [price, is_buy] : batch_touched) {
+        auto* level = sides[is_buy].find(price);
+        publish_level(is_buy, price, level ? level->total_quantity : 0);
+    }
+    batch_touched.clear();
+    flush_top();
+    return applied;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::level_changed(bool is_buy, Price price, uint64_t total_quantity) {
+    if (!in_batch) {
+        publish_level(is_buy, price, total_quantity);
+        return;
+    }
+    pair touched{price, is_buy};
+    if (!batch_touched.empty() && batch_touched.back() == touched) return;
+    if (batch_touched.size() == batch_touched.capacity()) coalesce_touched();
+    batch_touched.push_back(touched);
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::coalesce_touched() {
+    sort(batch_touched.begin(), batch_touched.end());
+    batch_touched.erase(unique(batch_touched.begin(), batch_touched.end()), batch_touched.end());
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::publish_level(bool is_buy, Price price, uint64_t total_quantity) {
+    auto& tail = journal[seq & (journal_size - 1)];
+    ++seq;
+    if (seq > 1 && tail.is_buy == is_buy && tail.price == price)
+        tail.seq = 0;   // superseded below
+    journal[seq & (journal_size - 1)] = {seq, is_buy, price, total_quantity};
+
+    // With depth 0 the cache stays empty and there is no edge level to test
+    auto& cache = caches[is_buy];
+    if (!cache.dirty && cache_depth > 0
+        && (cache.levels.size() < cache_depth || at_or_better(is_buy, price, cache.levels.back().price)))
+        cache.dirty = true;
+
+    if (top_out && !top_dirty) {
+        // Anything at or inside the last published level may move the top
+        uint32_t n = is_buy ? top_last.bid_count : top_last.ask_count;
+        Price edge = (is_buy ? top_last.bids : top_last.asks)[BookTop::depth - 1].price;
+        if (n < BookTop::depth || at_or_better(is_buy, price, edge))
+            top_dirty = true;
+    }
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::publish_top(TopOfBook* out) {
+    top_out = out;
+    top_dirty = out != nullptr;
+    flush_top();
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::flush_top() {
+    if (!top_dirty || in_batch) return;
+    top_last.seq = seq;
+    top_last.bid_count = top_last.ask_count = 0;
+    sides[bid].for_each(BookTop::depth, [&](const PriceLevelNode& n){
+        top_last.bids[top_last.bid_count++] = {n.price, n.total_quantity};
+    });
+    sides[ask].for_each(BookTop::depth, [&](const PriceLevelNode& n){
+        top_last.asks[top_last.ask_count++] = {n.price, n.total_quantity};
+    });
+    top_out->store(top_last);
+    top_dirty = false;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+bool BasicOrderBook<Levels, Alloc, IdIndex>::changes_since(uint64_t since, vector<LevelDelta>& out) const {
+    out.clear();
+    if (since > seq || seq - since > journal_size) return false;
+    for (uint64_t s = since + 1; s <= seq; ++s) {
+        const auto& d = journal[s & (journal_size - 1)];
+        if (d.seq == s) out.push_back(d);
+    }
+    return true;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::set_cached_depth(size_t k) {
+    cache_depth = k;
+    for (auto& cache : caches) {
+        cache.levels.reserve(k);
+        cache.dirty = true;
+    }
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+span<const PriceLevel> BasicOrderBook<Levels, Alloc, IdIndex>::cached_depth(bool is_buy) const {
+    auto& cache = caches[is_buy];
+    if (cache.dirty) {
+        cache.levels.clear();
+        sides[is_buy].for_each(cache_depth, [&](const PriceLevelNode& n){
+            cache.levels.push_back({n.price, n.total_quantity});
+        });
+        cache.dirty = false;
+    }
+    return cache.levels;
+}
+
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+template<typename Out>
+void BasicOrderBook<Levels, Alloc, IdIndex>::get_snapshot(size_t depth, Out& bids, Out& asks) const {
     bids.clear(); asks.clear();
-    for (size_t i = 0; i < min(depth, bid_prices.size()); ++i)
-        bids.push_back({bid_prices[i], bid_map.at(bid_prices[i]).total_quantity});
-    for (size_t i = 0; i < min(depth, ask_prices.size()); ++i)
-        asks.push_back({ask_prices[i], ask_map.at(ask_prices[i]).total_quantity});
+    sides[bid].for_each(depth, [&](const PriceLevelNode& n){ bids.push_back({n.price, n.total_quantity}); });
+    sides[ask].for_each(depth, [&](const PriceLevelNode& n){ asks.push_back({n.price, n.total_quantity}); });
 }
 
-void OrderBook::print_book(size_t depth) const {
-    vector<PriceLevel> bids, asks;
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::print_book(size_t depth) const {
+    SmallVector<PriceLevel, 16> bids, asks;
     get_snapshot(depth, bids, asks);
     cout << "------ ORDER BOOK ------\n";
     size_t rows = max(bids.size(), asks.size());
     for (size_t i = 0; i < rows; ++i) {
-        if (i < bids.size()) cout << fixed << setprecision(2) << bids[i].price << " x " << bids[i].total_quantity;
+        if (i < bids.size()) cout << fixed << setprecision(2) << bids[i].price.to_double() << " x " << bids[i].total_quantity;
         else cout << string(15, ' ');
         cout << string(20, ' ');
-        if (i < asks.size()) cout << fixed << setprecision(2) << asks[i].price << " x " << asks[i].total_quantity;
+        if (i < asks.size()) cout << fixed << setprecision(2) << asks[i].price.to_double() << " x " << asks[i].total_quantity;
         cout << '\n';
     }
     cout << "------------------------\n";
 }
 
+template<template<typename, typename> class Levels, typename Alloc, template<typename, typename> class IdIndex>
+void BasicOrderBook<Levels, Alloc, IdIndex>::log_book(size_t depth) const {
+    sides[bid].for_each(depth, [&](const PriceLevelNode& n){ LOG_INFO("bid %.4f x %llu", n.price.to_double(), (unsigned long long)n.total_quantity); });
+    sides[ask].for_each(depth, [&](const PriceLevelNode& n){ LOG_INFO("ask %.4f x %llu", n.price.to_double(), (unsigned long long)n.total_quantity); });
+}
+
 #ifdef ORDER_BOOK_DEMO
-int main() {
-    OrderBook ob;
+template<typename Book>
+void run_demo(Book& ob) {
     uint64_t ts = 0;
-    auto mk = [&](uint64_t id, bool buy, double p, uint64_t q){ return Order{id,buy,p,q,ts++}; };
+    auto mk = [&](uint64_t id, bool buy, double p, uint64_t q){ return Order{id,buy,Price::from_double(p),q,ts++}; };
     ob.add_order(mk(1,true,100,500));
     ob.add_order(mk(2,true,101,200));
     ob.add_order(mk(3,false,102,300));
     ob.add_order(mk(4,false,103,400));
     ob.print_book();
+    uint64_t seen = ob.sequence();
     ob.cancel_order(2);
-    ob.amend_order(1,102,600);
+    ob.amend_order(1,Price::from_double(102),600);
+    ob.print_book();
+    vector<LevelDelta> deltas;
+    ob.changes_since(seen, deltas);
+    for (auto& d : deltas)
+        cout << "delta #" << d.seq << (d.is_buy ? " bid " : " ask ") << d.price.to_double() << " -> " << d.total_quantity << '\n';
+}
+
+template<typename Book>
+void run_match_demo(Book& ob) {
+    array<Trade, 16> trades;
+    ob.add_order({10,false,Price::from_double(101),100,0});
+    ob.add_order({11,false,Price::from_double(101),50,1});
+    ob.add_order({12,false,Price::from_double(102),200,2});
+    auto fok = ob.match_order({20,true,Price::from_double(102),400,3}, TimeInForce::FOK, trades);
+    cout << "FOK 400 @ 102 filled " << fok.filled_quantity << '\n';
+    SmallVector<Trade, 8> fills;
+    auto lim = ob.match_order({21,true,Price::from_double(102),300,4}, TimeInForce::Limit, fills);
+    assert(fills.size() == lim.trade_count && fills.isInline());
+    for (const Trade& t : fills)
+        cout << "trade " << t.resting_id << " " << t.price.to_double() << " x " << t.quantity << '\n';
+    cout << "rested " << lim.rested << '\n';
     ob.print_book();
 }
-#endif
\ No newline at end of file
+
+// Size-down keeps queue priority, size-up loses it.
+template<typename Book>
+void run_amend_demo(Book& ob) {
+    array<Trade, 4> trades;
+    ob.add_order({30,false,Price::from_double(101),100,0});
+    ob.add_order({31,false,Price::from_double(101),100,1});
+    ob.amend_order(30, Price::from_double(101), 80);
+    ob.match_order({40,true,Price::from_double(101),10,2}, TimeInForce::IOC, trades);
+    cout << "after size-down first fill hits " << trades[0].resting_id << '\n';
+    ob.amend_order(30, Price::from_double(101), 200);
+    ob.match_order({41,true,Price::from_double(101),10,3}, TimeInForce::IOC, trades);
+    cout << "after size-up first fill hits " << trades[0].resting_id << '\n';
+}
+
+// Churns add/amend/cancel on a pooled book and checks that once warm it no
+// longer touches the global heap.
+template<template<typename, typename> class Levels, typename... Args>
+void run_pool_demo(const Args&... args) {
+    PoolResource resource;
+    PooledOrderBook<Levels> ob(allocator_arg, PoolAllocator<char>(resource), args...);
+    ob.reserve(4096, 256);
+    auto churn = [&](uint64_t base) {
+        for (uint64_t i = 0; i < 4096; ++i)
+            ob.add_order({base + i, i % 2 == 0, Price::from_double(100 + (i % 2 ? 1 : -1) * double(i % 64) / 100), 10 + i % 7, i});
+        for (uint64_t i = 0; i < 4096; i += 3)
+            ob.amend_order(base + i, Price::from_double(100 + (i % 2 ? 1 : -1) * double(i % 32) / 100), 5);
+        for (uint64_t i = 0; i < 4096; ++i)
+            ob.cancel_order(base + i);
+    };
+    churn(0);
+    size_t warm = resource.upstreamAllocations();
+    for (uint64_t round = 1; round <= 10; ++round)
+        churn(round * 100000);
+    cout << "pooled book upstream allocations: warm-up " << warm
+         << ", steady state " << resource.upstreamAllocations() - warm << '\n';
+    assert(resource.upstreamAllocations() == warm);
+}
+
+// The same churn on a pool over a pre-faulted arena: after warm-up the
+// arena's bump pointer stops moving.
+void run_arena_demo() {
+    Arena arena(64 << 20, {.hugePages = true, .prefault = true});
+    ArenaResource arena_resource(arena);
+    pmr::unsynchronized_pool_resource pool(&arena_resource);
+    PmrOrderBook<> ob(allocator_arg, pmr::polymorphic_allocator<char>(&pool));
+    ob.reserve(4096, 256);
+    auto churn = [&](uint64_t base) {
+        for (uint64_t i = 0; i < 4096; ++i)
+            ob.add_order({base + i, i % 2 == 0, Price::from_double(100 + (i % 2 ? 1 : -1) * double(i % 64) / 100), 10 + i % 7, i});
+        for (uint64_t i = 0; i < 4096; ++i)
+            ob.cancel_order(base + i);
+    };
+    churn(0);
+    size_t warm = arena.used();
+    for (uint64_t round = 1; round <= 10; ++round)
+        churn(round * 100000);
+    cout << "arena book: " << warm << " bytes after warm-up, steady state " << arena.used() - warm << '\n';
+    assert(arena.used() == warm);
+}
+
+// Session-dense ids marching forward: the paged index gives the same book as
+// the hashed one and keeps recycling a handful of pages.
+void run_dense_demo() {
+    OrderBook hashed;
+    DenseIdOrderBook<> dense;
+    dense.reserve(4096, 256);
+    mt19937_64 rng(7);
+    uint64_t next_id = 1'000'000'000, oldest = next_id;
+    for (int i = 0; i < 200000; ++i) {
+        if (next_id - oldest > 3000 || rng() % 3 == 0) {
+            uint64_t id = oldest + rng() % (next_id - oldest + 1);
+            hashed.cancel_order(id);
+            dense.cancel_order(id);
+            while (oldest < next_id && !hashed.find_order(oldest)) ++oldest;
+            continue;
+        }
+        Order o{next_id++, rng() % 2 == 0, Price::from_double(100 + (rng() % 2 ? 1 : -1) * double(1 + rng() % 50) / 100), 1 + rng() % 9, 0};
+        hashed.add_order(o);
+        dense.add_order(o);
+    }
+    vector<PriceLevel> hb, ha, db, da;
+    hashed.get_snapshot(100, hb, ha);
+    dense.get_snapshot(100, db, da);
+    assert(hashed.order_count() == dense.order_count() && hb.size() == db.size() && ha.size() == da.size());
+    for (size_t i = 0; i < hb.size(); ++i) assert(hb[i].total_quantity == db[i].total_quantity);
+    for (size_t i = 0; i < ha.size(); ++i) assert(ha[i].total_quantity == da[i].total_quantity);
+    cout << "dense-id book matches hashed book with " << dense.order_count() << " resting orders\n";
+}
+
+// A reader thread copies the published top while the book churns; every copy
+// must be a consistent, uncrossed book and the final one must match the book.
+void run_top_demo() {
+    OrderBook ob;
+    TopOfBook top;
+    ob.publish_top(&top);
+    atomic<bool> done{false};
+    thread reader([&] {
+        uint64_t last_seq = 0, reads = 0;
+        while (!done.load(memory_order_relaxed)) {
+            BookTop t = top.load();
+            assert(t.seq >= last_seq);
+            for (uint32_t i = 1; i < t.bid_count; ++i) assert(t.bids[i].price < t.bids[i - 1].price);
+            for (uint32_t i = 1; i < t.ask_count; ++i) assert(t.asks[i - 1].price < t.asks[i].price);
+            assert(!t.bid_count || !t.ask_count || t.bids[0].price < t.asks[0].price);
+            last_seq = t.seq;
+            ++reads;
+        }
+        cout << "top-of-book reader: " << reads << " consistent reads\n";
+    });
+    for (uint64_t i = 0; i < 200000; ++i) {
+        uint64_t id = i % 512;
+        if (!ob.cancel_order(id))
+            ob.add_order({id, id % 2 == 0, Price::from_double(100 + (id % 2 ? 1 : -1) * double(1 + id % 16) / 100), 1 + i % 9, i});
+        if (i % 4096 == 0) this_thread::yield();
+    }
+    done = true;
+    reader.join();
+
+    vector<PriceLevel> bids, asks;
+    ob.get_snapshot(BookTop::depth, bids, asks);
+    BookTop t = top.load();
+    assert(t.seq <= ob.sequence() && t.bid_count == bids.size() && t.ask_count == asks.size());
+    for (size_t i = 0; i < bids.size(); ++i) assert(t.bids[i].total_quantity == bids[i].total_quantity);
+    for (size_t i = 0; i < asks.size(); ++i) assert(t.asks[i].total_quantity == asks[i].total_quantity);
+}
+
+// The top-K cache follows the book at any depth, including none.
+void run_cache_demo() {
+    OrderBook ob;
+    ob.set_cached_depth(0);
+    for (uint64_t id = 1; id <= 6; ++id)
+        ob.add_order({id, true, Price::from_double(100 - double(id) / 100), 10, 0});
+    assert(ob.cached_depth(true).empty());
+    ob.add_order({7, true, Price::from_double(99.9), 10, 0});   // clean, empty cache
+    assert(ob.cached_depth(true).empty());
+    ob.set_cached_depth(3);
+    assert(ob.cached_depth(true).size() == 3 && ob.cached_depth(true)[0].price == Price::from_double(99.99));
+    ob.cancel_order(1);
+    assert(ob.cached_depth(true)[0].price == Price::from_double(99.98));
+}
+
+// A batch that hits the same few levels thousands of times publishes each
+// level once.
+void run_batch_demo() {
+    OrderBook ob;
+    auto px = [](uint64_t id) { return Price::from_double(100 + (id % 2 ? 1 : -1) * double(1 + id % 10) / 100); };
+    for (uint64_t id = 1; id <= 40; ++id) ob.add_order({id, id % 2 == 0, px(id), 10, 0});
+    vector<BookMsg> msgs;
+    for (uint64_t i = 0; i < 5000; ++i) msgs.push_back({MsgType::Amend, (1 + i % 40) % 2 == 0, 1 + i % 40, px(1 + i % 40), 5 + i % 7, 0});
+    auto before = ob.sequence();
+    ob.apply_batch(msgs);
+    assert(ob.sequence() - before == 10);
+}
+
+int main() {
+    OrderBook ob;
+    run_demo(ob);
+    {
+        logging::Logger log(stdout);
+        ob.log_book();
+    }
+    LadderOrderBook lob(Price::from_double(90), Price::from_double(110), Price::from_double(0.01));
+    run_demo(lob);
+    OrderBook mob;
+    run_match_demo(mob);
+    LadderOrderBook mlob(Price::from_double(90), Price::from_double(110), Price::from_double(0.01));
+    run_match_demo(mlob);
+    using DemoSpec = InstrumentSpec<Price::literal(90), Price::literal(110), Price::literal(0.01), 4096>;
+    static_assert(DemoSpec::levels == 2001);
+    InstrumentOrderBook<DemoSpec> sob;
+    run_demo(sob);
+    InstrumentOrderBook<DemoSpec> msob;
+    run_match_demo(msob);
+    OrderBook aob;
+    run_amend_demo(aob);
+    run_pool_demo<SortedLevels>();
+    run_pool_demo<PriceLadder>(Price::from_double(90), Price::from_double(110), Price::from_double(0.01));
+    run_arena_demo();
+    run_dense_demo();
+    run_top_demo();
+    run_cache_demo();
+    run_batch_demo();
+}
+#endif
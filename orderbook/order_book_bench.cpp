@@ -0,0 +1,181 @@
+// Replay benchmark for the OrderBook backends.
+//
+//   g++ -std=c++20 -O2 -march=native order_book_bench.cpp -o order_book_bench
+//   ./order_book_bench --messages 2000000 --depth 50 --cancel 0.6 --amend 0.2 --dist geometric
+//
+// Generates (or loads with --load) an add/cancel/amend stream, replays it
+// through every selected backend and prints throughput plus per-operation
+// latency percentiles from rdtsc timestamps (TscClock, runtime/tsc.cpp).
+// Add -DALLOC_TRACKING to count heap operations inside each timed replay.
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "../runtime/tsc.cpp"
+#include "../memory/alloc_tracking.cpp"
+using namespace std;
+
+struct BenchConfig {
+    size_t messages = 1'000'000;
+    size_t depth = 50;           // price levels either side of mid
+    double cancel_ratio = 0.6;
+    double amend_ratio = 0.2;
+    string dist = "geometric";   // uniform | geometric
+    uint64_t seed = 42;
+    string backend = "all";      // sorted | ladder | static-ladder | dense-ladder | pooled | pooled-ladder | all
+    string load, save;
+};
+
+// Mid is fixed at 100.00 with a 0.01 tick; offsets are drawn per config.
+static const Price kMid = Price::from_double(100), kTick = Price::from_double(0.01);
+
+static vector<BookMsg> generate_stream(const BenchConfig& cfg) {
+    mt19937_64 rng(cfg.seed);
+    uniform_real_distribution<double> u(0, 1);
+    geometric_distribution<int> geo(4.0 / double(cfg.depth));
+    auto offset = [&]() -> int64_t {
+        int64_t d = cfg.dist == "uniform" ? int64_t(rng() % cfg.depth) : min<int64_t>(geo(rng), cfg.depth - 1);
+        return d + 1;
+    };
+
+    vector<BookMsg> msgs;
+    msgs.reserve(cfg.messages);
+    vector<pair<uint64_t, bool>> live;
+    uint64_t next_id = 1, ts = 0;
+    while (msgs.size() < cfg.messages) {
+        double r = u(rng);
+        ts += 1 + rng() % 1000;
+        if (live.empty() || r >= cfg.cancel_ratio + cfg.amend_ratio) {
+            bool buy = rng() & 1;
+            Price p{kMid.ticks + (buy ? -1 : 1) * offset() * kTick.ticks};
+            msgs.push_back({MsgType::Add, buy, next_id, p, 1 + rng() % 500, ts});
+            live.push_back({next_id++, buy});
+        } else {
+            size_t k = rng() % live.size();
+            auto [id, buy] = live[k];
+            if (r < cfg.cancel_ratio) {
+                msgs.push_back({MsgType::Cancel, buy, id, {}, 0, ts});
+                live[k] = live.back();
+                live.pop_back();
+            } else {
+                Price p{kMid.ticks + (buy ? -1 : 1) * offset() * kTick.ticks};
+                msgs.push_back({MsgType::Amend, buy, id, p, 1 + rng() % 500, ts});
+            }
+        }
+    }
+    return msgs;
+}
+
+// Text format, one message per line: <A|X|M|E> order_id <B|S> price quantity timestamp_ns
+static vector<BookMsg> load_stream(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("cannot open " + path);
+    vector<BookMsg> msgs;
+    char type, side;
+    uint64_t id, qty, ts;
+    double price;
+    while (in >> type >> id >> side >> price >> qty >> ts) {
+        MsgType t = type == 'A' ? MsgType::Add : type == 'X' ? MsgType::Cancel : type == 'E' ? MsgType::Execute : MsgType::Amend;
+        msgs.push_back({t, side == 'B', id, Price::from_double(price), qty, ts});
+    }
+    return msgs;
+}
+
+static void save_stream(const string& path, const vector<BookMsg>& msgs) {
+    ofstream out(path);
+    out << fixed << setprecision(4);
+    for (auto& m : msgs)
+        out << "AXME"[int(m.type)] << ' ' << m.order_id << ' ' << (m.is_buy ? 'B' : 'S') << ' '
+            << m.price.to_double() << ' ' << m.quantity << ' ' << m.timestamp_ns << '\n';
+}
+
+struct OpStats {
+    vector<uint32_t> samples;   // ticks per operation
+    void report(const char* name, double ns_per_tick) {
+        if (samples.empty()) return;
+        sort(samples.begin(), samples.end());
+        auto pct = [&](double p) { return samples[min(samples.size() - 1, size_t(p * samples.size()))] * ns_per_tick; };
+        printf("    %-7s n=%-9zu p50=%7.1fns p99=%7.1fns p99.9=%8.1fns max=%9.1fns\n",
+               name, samples.size(), pct(0.50), pct(0.99), pct(0.999), samples.back() * ns_per_tick);
+    }
+};
+
+template<typename Book>
+static void run_backend(const char* name, Book& book, const vector<BookMsg>& msgs, double ns_per_tick) {
+    book.reserve(msgs.size(), 4096);
+    array<OpStats, 4> stats;
+    for (auto& s : stats) s.samples.reserve(msgs.size());
+
+    uint64_t start = readTscOrdered();
+    ALLOC_HOT_REGION(name);
+    for (const auto& m : msgs) {
+        uint64_t t0 = readTscOrdered();
+        switch (m.type) {
+        case MsgType::Add: book.add_order({m.order_id, m.is_buy, m.price, m.quantity, m.timestamp_ns}); break;
+        case MsgType::Cancel: book.cancel_order(m.order_id); break;
+        case MsgType::Amend: book.amend_order(m.order_id, m.price, m.quantity); break;
+        case MsgType::Execute: book.execute_order(m.order_id, m.quantity); break;
+        }
+        uint64_t t1 = readTscOrdered();
+        stats[int(m.type)].samples.push_back(uint32_t(min<uint64_t>(t1 - t0, UINT32_MAX)));
+    }
+    double secs = double(readTscOrdered() - start) * ns_per_tick / 1e9;
+
+    printf("%s: %.2f M msgs/s (%.3f s, timer overhead included)\n", name, msgs.size() / secs / 1e6, secs);
+    stats[0].report("add", ns_per_tick);
+    stats[1].report("cancel", ns_per_tick);
+    stats[2].report("amend", ns_per_tick);
+    stats[3].report("execute", ns_per_tick);
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string k = argv[i], v = argv[i + 1];
+        if (k == "--messages") cfg.messages = stoull(v);
+        else if (k == "--depth") cfg.depth = stoull(v);
+        else if (k == "--cancel") cfg.cancel_ratio = stod(v);
+        else if (k == "--amend") cfg.amend_ratio = stod(v);
+        else if (k == "--dist") cfg.dist = v;
+        else if (k == "--seed") cfg.seed = stoull(v);
+        else if (k == "--backend") cfg.backend = v;
+        else if (k == "--load") cfg.load = v;
+        else if (k == "--save") cfg.save = v;
+        else { fprintf(stderr, "unknown option %s\n", k.c_str()); return 1; }
+    }
+
+    auto msgs = cfg.load.empty() ? generate_stream(cfg) : load_stream(cfg.load);
+    if (!cfg.save.empty()) save_stream(cfg.save, msgs);
+    double ns_per_tick = TscClock::nsPerTick();
+    printf("%zu messages, %.3f ns/tick\n", msgs.size(), ns_per_tick);
+
+    // Band wide enough for any generated or loaded price around the mid.
+    Price lo = Price::from_double(0), hi = Price::from_double(1000);
+    auto want = [&](const char* b) { return cfg.backend == "all" || cfg.backend == b; };
+    if (want("sorted")) {
+        OrderBook book;
+        run_backend("sorted", book, msgs, ns_per_tick);
+    }
+    if (want("ladder")) {
+        LadderOrderBook book(lo, hi, kTick);
+        run_backend("ladder", book, msgs, ns_per_tick);
+    }
+    if (want("static-ladder")) {
+        // Same band as a compile-time spec; a few MB of inline slots, so on the heap
+        using BenchSpec = InstrumentSpec<Price::literal(0), Price::literal(1000), Price::literal(0.01), 1 << 20>;
+        auto book = make_unique<InstrumentOrderBook<BenchSpec>>();
+        run_backend("static-ladder", *book, msgs, ns_per_tick);
+    }
+    if (want("dense-ladder")) {
+        DenseIdOrderBook<PriceLadder> book(lo, hi, kTick);
+        run_backend("dense-ladder", book, msgs, ns_per_tick);
+    }
+    if (want("pooled")) {
+        PoolResource resource;
+        PooledOrderBook<SortedLevels> book(allocator_arg, PoolAllocator<char>(resource));
+        run_backend("pooled", book, msgs, ns_per_tick);
+    }
+    if (want("pooled-ladder")) {
+        PoolResource resource;
+        PooledOrderBook<PriceLadder> book(allocator_arg, PoolAllocator<char>(resource), lo, hi, kTick);
+        run_backend("pooled-ladder", book, msgs, ns_per_tick);
+    }
+}
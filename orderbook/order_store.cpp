@@ -0,0 +1,144 @@
+// Resting-order storage for BasicOrderBook, split by access pattern.
+//
+// The Order API struct is 40 bytes with 7 of them padding after is_buy, and
+// most of it is cold once the order rests: matching, cancels and level
+// FIFO walks read id, price, quantity and the queue links, never the
+// timestamp. So each resting order is a 32-byte HotOrder (two per cache
+// line) linked by 32-bit indices, with its ColdOrder at the same index in a
+// parallel array. Side lives in the id index's value (OrderRef), so a
+// cancel reaches the right side's levels without touching either record.
+//
+// Records sit in fixed chunks, so indices and references stay valid as the
+// store grows, and freed indices are reused through a free list threaded
+// through HotOrder::next.
+#pragma once
+#include <bits/stdc++.h>
+#include "price.cpp"
+#include "../SPSC_QUEUES/cache_line.cpp"
+using namespace std;
+
+struct HotOrder {
+    uint64_t order_id;
+    Price price;
+    uint64_t quantity;
+    uint32_t prev;   // toward the front of the level's queue
+    uint32_t next;
+};
+
+// Everything about a resting order the hot paths don't read.
+struct ColdOrder {
+    uint64_t timestamp_ns;
+};
+
+static_assert(sizeof(HotOrder) == 32 && 64 % sizeof(HotOrder) == 0, "two hot orders per cache line");
+static_assert(is_trivially_copyable_v<HotOrder> && is_trivially_copyable_v<ColdOrder>);
+
+// Store index plus side, as kept in the id index: bit 31 set for bids.
+struct OrderRef {
+    uint32_t bits;
+
+    static constexpr uint32_t buy_bit = 1u << 31;
+    static OrderRef make(uint32_t index, bool is_buy) { return {index | (is_buy ? buy_bit : 0)}; }
+    uint32_t index() const { return bits & ~buy_bit; }
+    bool is_buy() const { return bits & buy_bit; }
+};
+
+static_assert(sizeof(OrderRef) == 4);
+
+template<typename Alloc = allocator<char>>
+class OrderStore {
+    using ByteAlloc = typename allocator_traits<Alloc>::template rebind_alloc<char>;
+    using ByteTraits = allocator_traits<ByteAlloc>;
+    using ChunkAlloc = typename allocator_traits<Alloc>::template rebind_alloc<char*>;
+
+public:
+    static constexpr uint32_t npos = ~uint32_t{0};
+    static constexpr uint32_t max_orders = OrderRef::buy_bit;   // indices leave bit 31 to the side
+
+    explicit OrderStore(const Alloc& alloc = Alloc{}) : bytes(alloc), raw_hot(alloc), raw_cold(alloc), hot_chunks(alloc), cold_chunks(alloc) {}
+
+    OrderStore(const OrderStore&) = delete;
+    OrderStore& operator=(const OrderStore&) = delete;
+
+    ~OrderStore() {
+        for (size_t c = 0; c < raw_hot.size(); ++c) {
+            ByteTraits::deallocate(bytes, raw_hot[c], hot_chunk_bytes + cacheLineSize);
+            ByteTraits::deallocate(bytes, raw_cold[c], cold_chunk_bytes + cacheLineSize);
+        }
+    }
+
+    // Index for a new resting order with links cleared.
+    uint32_t create(const HotOrder& hot_part, const ColdOrder& cold_part) {
+        uint32_t i = free_head;
+        if (i != npos) {
+            free_head = hot(i).next;
+        } else {
+            if (used == capacity()) grow();
+            i = used++;
+        }
+        hot(i) = hot_part;
+        hot(i).prev = hot(i).next = npos;
+        cold(i) = cold_part;
+        ++live;
+        return i;
+    }
+
+    void destroy(uint32_t i) {
+        hot(i).next = free_head;
+        free_head = i;
+        --live;
+    }
+
+    HotOrder& hot(uint32_t i) { return hot_chunks[i >> chunk_bits][i & chunk_mask]; }
+    const HotOrder& hot(uint32_t i) const { return hot_chunks[i >> chunk_bits][i & chunk_mask]; }
+    ColdOrder& cold(uint32_t i) { return cold_chunks[i >> chunk_bits][i & chunk_mask]; }
+    const ColdOrder& cold(uint32_t i) const { return cold_chunks[i >> chunk_bits][i & chunk_mask]; }
+
+    void prefetch(uint32_t i) const { __builtin_prefetch(&hot(i)); }
+
+    void reserve(size_t n) {
+        while (capacity() < n) grow();
+    }
+
+    // Records [0, high_water()) a chunk at a time as f(hot, cold, count),
+    // for copying the store wholesale; freed slots come along too.
+    template<typename F>
+    void for_each_chunk(F&& f) const {
+        for (uint32_t first = 0; first < used; first += 1u << chunk_bits)
+            f(hot_chunks[first >> chunk_bits], cold_chunks[first >> chunk_bits], min<size_t>(used - first, size_t{1} << chunk_bits));
+    }
+    uint32_t high_water() const { return used; }
+
+    size_t capacity() const { return hot_chunks.size() << chunk_bits; }
+    size_t size() const { return live; }
+
+private:
+    static constexpr uint32_t chunk_bits = 12;
+    static constexpr uint32_t chunk_mask = (1u << chunk_bits) - 1;
+    static constexpr size_t hot_chunk_bytes = sizeof(HotOrder) << chunk_bits;
+    static constexpr size_t cold_chunk_bytes = sizeof(ColdOrder) << chunk_bits;
+
+    // Chunks are over-allocated and aligned by hand: pool allocators only
+    // promise 16 bytes, and a hot record must not straddle a cache line.
+    template<typename T>
+    T* aligned(char* raw) {
+        auto p = (reinterpret_cast<uintptr_t>(raw) + cacheLineSize - 1) & ~uintptr_t(cacheLineSize - 1);
+        return reinterpret_cast<T*>(p);
+    }
+
+    void grow() {
+        if (capacity() >= max_orders) throw length_error("OrderStore: more than 2^31 resting orders");
+        raw_hot.push_back(ByteTraits::allocate(bytes, hot_chunk_bytes + cacheLineSize));
+        raw_cold.push_back(ByteTraits::allocate(bytes, cold_chunk_bytes + cacheLineSize));
+        hot_chunks.push_back(aligned<HotOrder>(raw_hot.back()));
+        cold_chunks.push_back(aligned<ColdOrder>(raw_cold.back()));
+    }
+
+    ByteAlloc bytes;
+    vector<char*, ChunkAlloc> raw_hot, raw_cold;
+    vector<HotOrder*, typename allocator_traits<Alloc>::template rebind_alloc<HotOrder*>> hot_chunks;
+    vector<ColdOrder*, typename allocator_traits<Alloc>::template rebind_alloc<ColdOrder*>> cold_chunks;
+    uint32_t used = 0;          // indices handed out at least once
+    uint32_t free_head = npos;
+    size_t live = 0;
+};
@@ -0,0 +1,156 @@
+// Parallel backtest driver: replays many capture files (one per symbol-day)
+// through their own OrderBook on a WorkStealingPool and merges the results.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread parallel_replay.cpp -o parallel_replay
+//   ./parallel_replay                          # synthetic days, serial vs pool self-check
+//   ./parallel_replay [--threads N] [--cpus 0,1,...] day1.cap day2.cap ...
+//
+// Each job maps its capture file, replays it as fast as possible and writes
+// a DayResult into its own slot, so merging is a pass over the slots after
+// the pool drains. Days are sorted largest first and handed out by
+// parallelFor's recursive halving, so a worker that runs dry steals the far
+// half of someone else's remaining days.
+#include <bits/stdc++.h>
+#include "replay.cpp"
+#include "../runtime/work_stealing_pool.cpp"
+#include "../feed/sim_model.cpp"
+using namespace std;
+
+struct DayResult {
+    string path;
+    ReplayStats stats;
+    size_t resting_orders = 0;
+    optional<PriceLevel> bid, ask;
+    double secs = 0;
+    int worker = -1;
+};
+
+static DayResult replay_day(const string& path) {
+    auto t0 = chrono::steady_clock::now();
+    CaptureReader file(path);
+    CaptureReplay<OrderBook> replay(file);
+    replay.run();
+    DayResult r;
+    r.path = path;
+    r.stats = replay.stats();
+    r.resting_orders = replay.book().order_count();
+    r.bid = replay.book().best_bid();
+    r.ask = replay.book().best_ask();
+    r.secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    r.worker = WorkStealingPool::workerIndex();
+    return r;
+}
+
+static vector<DayResult> replay_days(WorkStealingPool& pool, vector<string> paths) {
+    // Biggest files first, so a long day doesn't start last and run alone
+    vector<size_t> order(paths.size());
+    iota(order.begin(), order.end(), size_t{0});
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return filesystem::file_size(paths[a]) > filesystem::file_size(paths[b]);
+    });
+    vector<DayResult> out(paths.size());
+    pool.parallelFor(0, order.size(), [&](size_t k) { out[order[k]] = replay_day(paths[order[k]]); });
+    return out;
+}
+
+static void print_summary(const vector<DayResult>& days, double wall) {
+    ReplayStats total;
+    double cpu = 0;
+    for (auto& d : days) {
+        total.packets += d.stats.packets;
+        total.messages += d.stats.messages;
+        total.applied += d.stats.applied;
+        total.seq_gaps += d.stats.seq_gaps;
+        cpu += d.secs;
+    }
+    printf("%zu days, %llu packets, %llu msgs (%llu applied), %llu seq gaps\n", days.size(),
+           (unsigned long long)total.packets, (unsigned long long)total.messages, (unsigned long long)total.applied,
+           (unsigned long long)total.seq_gaps);
+    // Per-day times are wall time, so on an oversubscribed box this counts
+    // days in flight rather than cores in use
+    printf("wall %.3f s, %.2f M msgs/s, %.1f s summed over days (%.1f days in flight)\n", wall,
+           double(total.messages) / wall / 1e6, cpu, cpu / wall);
+}
+
+// Synthetic symbol-day from market_sim's model: a few thousand packets with
+// a per-day seed and length, recorded like a live session.
+static void record_day(const string& path, uint64_t seed, size_t packets) {
+    OrderBook live;
+    CaptureRecorder rec(path, live, 5'000'000'000);
+    SimConfig sim;
+    sim.depth = 30;
+    sim.seed = seed;
+    SimFeed feed(sim);
+    vector<byte> packet(20 * wire::orderEventSize);
+    for (size_t i = 0; i < packets; ++i) {
+        auto rx = feed.rxNs();
+        rec.on_packet(rx, span(packet.data(), feed.nextPacket(packet.data(), 20)));
+    }
+    rec.close();
+}
+
+static bool same_results(const vector<DayResult>& a, const vector<DayResult>& b) {
+    auto eq = [](const optional<PriceLevel>& x, const optional<PriceLevel>& y) {
+        return x.has_value() == y.has_value() && (!x || (x->price == y->price && x->total_quantity == y->total_quantity));
+    };
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].path != b[i].path || a[i].stats.messages != b[i].stats.messages || a[i].stats.applied != b[i].stats.applied
+            || a[i].resting_orders != b[i].resting_orders || !eq(a[i].bid, b[i].bid) || !eq(a[i].ask, b[i].ask))
+            return false;
+    }
+    return true;
+}
+
+static int self_check(WorkStealingPool::Options options) {
+    // Uneven days, as real symbols are
+    vector<string> paths;
+    for (uint64_t d = 0; d < 24; ++d) {
+        paths.push_back("/tmp/parallel_replay_day" + to_string(d) + ".cap");
+        record_day(paths.back(), 100 + d, d % 5 == 0 ? 40'000 : 8'000);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    vector<DayResult> serial;
+    for (auto& p : paths) serial.push_back(replay_day(p));
+    double serial_wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    printf("serial:\n");
+    print_summary(serial, serial_wall);
+
+    WorkStealingPool pool(options);
+    t0 = chrono::steady_clock::now();
+    auto parallel = replay_days(pool, paths);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    printf("pool of %zu:\n", pool.threadCount());
+    print_summary(parallel, wall);
+
+    bool ok = same_results(serial, parallel);
+    printf("%s\n", ok ? "per-day results match" : "MISMATCH");
+    for (auto& p : paths) filesystem::remove(p);
+    return !ok;
+}
+
+int main(int argc, char** argv) {
+    WorkStealingPool::Options options;
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        string k = argv[i];
+        if (k == "--threads" && i + 1 < argc) options.threads = stoul(argv[++i]);
+        else if (k == "--cpus" && i + 1 < argc) {
+            stringstream in(argv[++i]);
+            for (string c; getline(in, c, ',');) options.cpus.push_back(stoi(c));
+        } else paths.push_back(k);
+    }
+    if (paths.empty()) return self_check(options);
+
+    WorkStealingPool pool(options);
+    auto t0 = chrono::steady_clock::now();
+    auto days = replay_days(pool, paths);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    for (auto& d : days) {
+        printf("%-40s %9llu msgs %7.3f s  worker %2d  ", d.path.c_str(), (unsigned long long)d.stats.messages, d.secs, d.worker);
+        if (d.bid && d.ask) printf("%.4f x %.4f\n", d.bid->price.to_double(), d.ask->price.to_double());
+        else printf("one-sided\n");
+    }
+    print_summary(days, wall);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Fixed-point price stored as a signed count of 1/Scale increments.
+// Doubles only appear at the edges (feed ingest, printing); everything in the
+// book compares, hashes and indexes the integer.
+template<int64_t Scale>
+struct FixedPrice {
+    static_assert(Scale > 0);
+    static constexpr int64_t scale = Scale;
+
+    int64_t ticks = 0;
+
+    static FixedPrice from_double(double p) { return {llround(p * Scale)}; }
+    // Same rounding at compile time, for prices in template arguments.
+    static consteval FixedPrice literal(double p) { return {static_cast<int64_t>(p * Scale + (p < 0 ? -0.5 : 0.5))}; }
+    double to_double() const { return static_cast<double>(ticks) / Scale; }
+
+    constexpr auto operator<=>(const FixedPrice&) const = default;
+    constexpr FixedPrice operator+(FixedPrice o) const { return {ticks + o.ticks}; }
+    constexpr FixedPrice operator-(FixedPrice o) const { return {ticks - o.ticks}; }
+};
+
+// Four decimal places covers every equity and futures tick we trade.
+using Price = FixedPrice<10000>;
+
+template<int64_t Scale>
+struct std::hash<FixedPrice<Scale>> {
+    size_t operator()(FixedPrice<Scale> p) const noexcept { return hash<int64_t>{}(p.ticks); }
+};
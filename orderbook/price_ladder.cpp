@@ -0,0 +1,102 @@
+#pragma once
+
+#include <bits/stdc++.h>
+#include "price.cpp"
+using namespace std;
+
+// One side of the book as a contiguous array of level slots indexed by tick.
+// Slots run best-first: slot i holds max_price - i * tick_size for bids and
+// min_price + i * tick_size for asks, so the side is only a sign in the
+// mapping and nothing else branches on it. Prices off the tick grid are
+// rejected rather than rounded. An occupancy bitmap lets the best-price
+// cursor and depth walks skip 64 empty ticks per word.
+template<typename Node, typename Alloc = allocator<Node>>
+class PriceLadder {
+public:
+    PriceLadder(bool is_buy, Price min_price, Price max_price, Price tick_size, const Alloc& alloc = Alloc{})
+        : origin(is_buy ? top_of_grid(min_price, max_price, tick_size) : min_price), dir(is_buy ? -1 : 1), tick_size(tick_size),
+          levels(static_cast<size_t>((max_price - min_price).ticks / tick_size.ticks) + 1, alloc),
+          occupied((levels.size() + 63) / 64, 0, alloc) {}
+
+    // Every slot is allocated up front.
+    void reserve(size_t) {}
+
+    Node* find(Price price) {
+        size_t i;
+        if (!index_of(price, i) || !is_set(i)) return nullptr;
+        return &levels[i];
+    }
+
+    Node& insert(Price price) {
+        size_t i;
+        if (!index_of(price, i)) throw out_of_range("price outside ladder band");
+        if (!is_set(i)) {
+            levels[i] = Node{};
+            levels[i].price = price;
+            occupied[i >> 6] |= 1ULL << (i & 63);
+            if (count++ == 0 || i < best) best = i;
+        }
+        return levels[i];
+    }
+
+    void erase(Price price) {
+        size_t i;
+        if (!index_of(price, i) || !is_set(i)) return;
+        occupied[i >> 6] &= ~(1ULL << (i & 63));
+        levels[i] = Node{};
+        if (--count > 0 && i == best) best = next_from(i);
+    }
+
+    size_t size() const { return count; }
+
+    Node* best_level() { return count ? &levels[best] : nullptr; }
+    const Node* best_level() const { return count ? &levels[best] : nullptr; }
+
+    // Visits levels from the best price outwards while f returns true.
+    template<typename F>
+    void walk(F&& f) const {
+        if (count == 0) return;
+        size_t i = best;
+        for (size_t n = 0; f(levels[i]) && n + 1 < count; ++n)
+            i = next_from(i);
+    }
+
+    // Visits up to depth levels from the best price outwards.
+    template<typename F>
+    void for_each(size_t depth, F&& f) const {
+        if (depth == 0) return;
+        walk([&](const Node& n){ f(n); return --depth > 0; });
+    }
+
+private:
+    Price origin;
+    int64_t dir;
+    Price tick_size;
+    vector<Node, Alloc> levels;
+    vector<uint64_t, typename allocator_traits<Alloc>::template rebind_alloc<uint64_t>> occupied;
+    size_t best = 0, count = 0;
+
+    // Highest price on the tick grid anchored at min_price, where bid slot 0 sits.
+    static Price top_of_grid(Price min_price, Price max_price, Price tick_size) {
+        return min_price + Price{(max_price - min_price).ticks / tick_size.ticks * tick_size.ticks};
+    }
+
+    bool index_of(Price price, size_t& i) const {
+        int64_t off = (price - origin).ticks * dir;
+        if (off < 0 || off % tick_size.ticks != 0) return false;
+        int64_t t = off / tick_size.ticks;
+        if (static_cast<size_t>(t) >= levels.size()) return false;
+        i = static_cast<size_t>(t);
+        return true;
+    }
+    bool is_set(size_t i) const { return occupied[i >> 6] >> (i & 63) & 1; }
+
+    // Next occupied slot after i, i.e. the next worse price; caller
+    // guarantees one exists.
+    size_t next_from(size_t i) const {
+        size_t w = i >> 6;
+        uint64_t bits = occupied[w] & ~((2ULL << (i & 63)) - 1);
+        while (!bits) bits = occupied[++w];
+        return (w << 6) + __builtin_ctzll(bits);
+    }
+};
@@ -0,0 +1,362 @@
+// Capture recording and replay for the order book.
+//
+// CaptureRecorder sits behind a feed handler: every packet is appended to a
+// capture file with its receive time, decoded and applied to the recorder's
+// own book, and every checkpoint_interval_ns of feed time the book is
+// serialized into a checkpoint record. CaptureReplay plays such a file back
+// through the same decode -> apply_batch path, as fast as possible or at the
+// recorded pacing, and seeks by restoring the nearest earlier checkpoint and
+// applying only the packets after it.
+//
+//   g++ -std=c++20 -O2 -march=native -DREPLAY_DEMO -x c++ replay.cpp -o replay
+//   ./replay                                  # record + replay self-check
+//   ./replay day.cap [--seek NS] [--until NS] [--pace original] [--speed 2] [--symbol N]
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "../feed/capture.cpp"
+#include "feed_decode.cpp"
+using namespace std;
+
+// Checkpoint payload: a header, then every resting order in for_each_order()
+// order so loading re-adds them with queue priority intact.
+struct BookCheckpointHeader {
+    static constexpr uint64_t magic_value = 0x325450434b4f4f42;   // "BOOKCPT2"
+    uint64_t magic;
+    uint64_t feed_seq;
+    uint64_t order_count;
+    int64_t symbol;          // decode filter the book was built with, -1: all
+};
+
+struct CheckpointOrder {
+    uint64_t order_id;
+    int64_t price;
+    uint64_t quantity;
+    uint64_t timestamp_ns;
+    uint64_t is_buy;
+};
+
+template<typename Book>
+void save_checkpoint(const Book& book, uint64_t feed_seq, int symbol, vector<byte>& out) {
+    BookCheckpointHeader h{BookCheckpointHeader::magic_value, feed_seq, book.order_count(), symbol};
+    out.resize(sizeof(h) + h.order_count * sizeof(CheckpointOrder));
+    memcpy(out.data(), &h, sizeof(h));
+    byte* p = out.data() + sizeof(h);
+    book.for_each_order([&](const Order& o) {
+        CheckpointOrder c{o.order_id, o.price.ticks, o.quantity, o.timestamp_ns, o.is_buy};
+        memcpy(p, &c, sizeof(c));
+        p += sizeof(c);
+    });
+}
+
+// Header of a checkpoint payload, checked for size and magic.
+inline BookCheckpointHeader checkpoint_header(span<const byte> in) {
+    BookCheckpointHeader h;
+    if (in.size() < sizeof(h)) throw runtime_error("checkpoint truncated");
+    memcpy(&h, in.data(), sizeof(h));
+    if (h.magic != BookCheckpointHeader::magic_value
+        || h.order_count > (in.size() - sizeof(h)) / sizeof(CheckpointOrder))
+        throw runtime_error("bad checkpoint");
+    return h;
+}
+
+// Rebuild a checkpoint into an empty book; returns the feed seq it was taken
+// at. The checkpoint must have been taken with the same symbol filter.
+template<typename Book>
+uint64_t load_checkpoint(span<const byte> in, int symbol, Book& book) {
+    auto h = checkpoint_header(in);
+    if (h.symbol != symbol)
+        throw runtime_error("checkpoint built for symbol " + to_string(h.symbol) + ", replaying " + to_string(symbol));
+    book.reserve(h.order_count, 0);
+    const byte* p = in.data() + sizeof(h);
+    for (uint64_t i = 0; i < h.order_count; ++i, p += sizeof(CheckpointOrder)) {
+        CheckpointOrder c;
+        memcpy(&c, p, sizeof(c));
+        book.add_order({c.order_id, c.is_buy != 0, Price{c.price}, c.quantity, c.timestamp_ns});
+    }
+    return h.feed_seq;
+}
+
+template<typename Book = OrderBook>
+class CaptureRecorder {
+public:
+    CaptureRecorder(const string& path, Book& book, uint64_t checkpoint_interval_ns = 60'000'000'000, int symbol = -1)
+        : writer(path), book(book), interval(checkpoint_interval_ns), symbol(symbol) {}
+
+    // Record and apply one received packet (a datagram or a stream read).
+    void on_packet(uint64_t rx_ns, span<const byte> packet, uint16_t line = 0) {
+        writer.append(rx_ns, packet, line);
+        msgs.clear();
+        decode_packet(packet, symbol, rx_ns, msgs, feed_seq);
+        book.apply_batch(msgs);
+        if (next_checkpoint == 0) next_checkpoint = rx_ns + interval;
+        if (rx_ns >= next_checkpoint) {
+            checkpoint(rx_ns);
+            next_checkpoint = rx_ns + interval;
+        }
+    }
+
+    void checkpoint(uint64_t rx_ns) {
+        save_checkpoint(book, feed_seq, symbol, snapshot);
+        writer.checkpoint(rx_ns, snapshot);
+    }
+
+    void close() { writer.close(); }
+    const CaptureWriter& file() const { return writer; }
+
+private:
+    CaptureWriter writer;
+    Book& book;
+    uint64_t interval, next_checkpoint = 0, feed_seq = 0;
+    int symbol;
+    vector<BookMsg> msgs;
+    vector<byte> snapshot;
+};
+
+enum class Pacing : uint8_t { Fast, Original };
+
+struct ReplayStats {
+    uint64_t packets = 0;
+    uint64_t messages = 0;
+    uint64_t applied = 0;    // messages that changed the book
+    uint64_t seq_gaps = 0;   // feed sequence jumps between decoded events
+};
+
+template<typename Book = OrderBook>
+class CaptureReplay {
+public:
+    using Factory = function<unique_ptr<Book>()>;
+
+    // symbol filters decoding the way the recorder's did; by default it is
+    // taken from the file's first checkpoint (all symbols if there is none).
+    explicit CaptureReplay(const CaptureReader& file, Factory make_book = [] { return make_unique<Book>(); },
+                           optional<int> symbol = nullopt)
+        : file(file), make_book(std::move(make_book)), book_ptr(this->make_book()), cursor(file.begin()),
+          symbol(symbol ? *symbol : recorded_symbol(file)) {}
+
+    static int recorded_symbol(const CaptureReader& file) {
+        CaptureReader::Record r;
+        if (file.checkpoints().empty() || !file.read(file.checkpoints().front().offset, r)) return -1;
+        return int(checkpoint_header(r.payload).symbol);
+    }
+
+    Book& book() { return *book_ptr; }
+    const ReplayStats& stats() const { return counters; }
+    // Receive time of the last packet applied and feed seq of its last event.
+    uint64_t position() const { return last_rx; }
+    uint64_t feed_sequence() const { return feed_seq; }
+
+    // Book as it stood after the last packet received at or before ns: a
+    // fresh book loaded from the latest checkpoint <= ns, then the packets
+    // between that checkpoint and ns.
+    void seek(uint64_t ns) {
+        book_ptr = make_book();
+        cursor = file.begin();
+        feed_seq = last_rx = 0;
+        counters = {};
+        if (auto* cp = file.checkpointAt(ns)) {
+            CaptureReader::Record r;
+            if (!file.read(cp->offset, r) || r.kind != capture::RecordKind::Checkpoint)
+                throw runtime_error("capture index points at a non-checkpoint record");
+            feed_seq = load_checkpoint(r.payload, symbol, *book_ptr);
+            last_rx = r.rxNs;
+            cursor = CaptureReader::next(r);
+        }
+        run(ns);
+    }
+
+    // Apply packets received at or before until_ns; returns how many. With
+    // Pacing::Original packets are released at their recorded spacing
+    // divided by speed, measured from the first packet of this call.
+    size_t run(uint64_t until_ns = UINT64_MAX, Pacing pacing = Pacing::Fast, double speed = 1.0) {
+        size_t applied_packets = 0;
+        uint64_t first_rx = 0;
+        auto wall0 = chrono::steady_clock::now();
+        CaptureReader::Record r;
+        while (file.read(cursor, r) && r.rxNs <= until_ns) {
+            cursor = CaptureReader::next(r);
+            if (r.kind != capture::RecordKind::Packet) continue;
+            if (pacing == Pacing::Original) {
+                if (applied_packets == 0) first_rx = r.rxNs;
+                wait_until(wall0 + chrono::nanoseconds(int64_t(double(r.rxNs - first_rx) / speed)));
+            }
+            apply(r);
+            ++applied_packets;
+        }
+        return applied_packets;
+    }
+
+    bool done() const {
+        CaptureReader::Record r;
+        return !file.read(cursor, r);
+    }
+
+private:
+    void apply(const CaptureReader::Record& r) {
+        msgs.clear();
+        uint64_t before = feed_seq;
+        decode_packet(r.payload, symbol, r.rxNs, msgs, feed_seq);
+        if (!msgs.empty() && before != 0 && feed_seq - before != msgs.size()) ++counters.seq_gaps;
+        counters.packets++;
+        counters.messages += msgs.size();
+        counters.applied += book_ptr->apply_batch(msgs);
+        last_rx = r.rxNs;
+    }
+
+    // Sleep off all but the last millisecond, then spin.
+    static void wait_until(chrono::steady_clock::time_point t) {
+        auto now = chrono::steady_clock::now();
+        if (t - now > chrono::milliseconds(2)) this_thread::sleep_for(t - now - chrono::milliseconds(1));
+        while (chrono::steady_clock::now() < t) {}
+    }
+
+    const CaptureReader& file;
+    Factory make_book;
+    unique_ptr<Book> book_ptr;
+    uint64_t cursor;
+    int symbol;
+    uint64_t feed_seq = 0, last_rx = 0;
+    vector<BookMsg> msgs;
+    ReplayStats counters;
+};
+
+#ifdef REPLAY_DEMO
+#include "../feed/sim_model.cpp"
+
+// Same levels and the same queue order on both sides.
+template<typename A, typename B>
+static bool same_book(const A& a, const B& b) {
+    vector<Order> x, y;
+    a.for_each_order([&](const Order& o) { x.push_back(o); });
+    b.for_each_order([&](const Order& o) { y.push_back(o); });
+    return x.size() == y.size() && equal(x.begin(), x.end(), y.begin(), [](const Order& p, const Order& q) {
+        return p.order_id == q.order_id && p.is_buy == q.is_buy && p.price == q.price && p.quantity == q.quantity
+            && p.timestamp_ns == q.timestamp_ns;
+    });
+}
+
+// Synthetic day from market_sim's model: packets of 1-20 order events at
+// ~1M msgs/s around a random-walk mid.
+static void record_demo(const string& path, OrderBook& live, size_t packets, uint64_t checkpoint_ns) {
+    CaptureRecorder rec(path, live, checkpoint_ns);
+    SimConfig sim;
+    sim.depth = 30;
+    sim.targetOrders = 1000;
+    sim.seed = 11;
+    SimFeed feed(sim);
+    vector<byte> packet(20 * wire::orderEventSize);
+    for (size_t i = 0; i < packets; ++i) {
+        auto rx = feed.rxNs();
+        rec.on_packet(rx, span(packet.data(), feed.nextPacket(packet.data(), 20)));
+    }
+    printf("recorded %zu packets, %zu bytes, %zu resting orders\n", packets, size_t(rec.file().bytes()), live.order_count());
+}
+
+static int self_check() {
+    string path = "/tmp/replay_demo.cap";
+    OrderBook live;
+    record_demo(path, live, 200'000, 50'000'000);
+
+    CaptureReader file(path);
+    printf("%zu checkpoints\n", file.checkpoints().size());
+
+    CaptureReplay<OrderBook> replay(file);
+    auto t0 = chrono::steady_clock::now();
+    replay.run();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    auto& s = replay.stats();
+    printf("full replay: %llu packets, %llu msgs in %.3f s (%.2f M msgs/s), %llu seq gaps\n",
+           (unsigned long long)s.packets, (unsigned long long)s.messages, secs, s.messages / secs / 1e6,
+           (unsigned long long)s.seq_gaps);
+    bool ok = same_book(replay.book(), live) && s.seq_gaps == 0;
+    printf("replayed book %s the recorded one\n", ok ? "matches" : "DIFFERS from");
+
+    // Seek a few points; each must match a replay from the open to that time.
+    uint64_t first = 0, last = 0;
+    CaptureReader::Record r;
+    for (uint64_t off = file.begin(); file.read(off, r); off = CaptureReader::next(r)) {
+        if (!first) first = r.rxNs;
+        last = r.rxNs;
+    }
+    for (double f : {0.0, 0.1, 0.37, 0.5, 0.999, 1.0}) {
+        uint64_t at = first + uint64_t(f * double(last - first));
+        CaptureReplay<OrderBook> seeker(file), linear(file);
+        auto t1 = chrono::steady_clock::now();
+        seeker.seek(at);
+        double seek_us = chrono::duration<double, micro>(chrono::steady_clock::now() - t1).count();
+        linear.run(at);
+        bool match = same_book(seeker.book(), linear.book()) && seeker.position() == linear.position()
+                     && seeker.feed_sequence() == linear.feed_sequence();
+        printf("  seek %.3f: %7.0f us, %6llu packets after checkpoint, %s\n", f, seek_us,
+               (unsigned long long)seeker.stats().packets, match ? "ok" : "MISMATCH");
+        ok &= match;
+    }
+
+    // A recording filtered to one symbol of an interleaved two-symbol feed
+    // (whose order ids collide across symbols) replays with that filter.
+    {
+        string fpath = "/tmp/replay_demo_filtered.cap";
+        OrderBook one;
+        {
+            CaptureRecorder frec(fpath, one, 5'000'000, 1);
+            SimConfig sim;
+            sim.targetOrders = 500;
+            SimFeed feeds[] = {SimFeed(sim, 1'000'000'000, 0), SimFeed(sim, 1'000'000'000, 1)};
+            vector<byte> packet(20 * wire::orderEventSize);
+            for (size_t i = 0; i < 40'000; ++i) {
+                auto& feed = feeds[i % 2];
+                auto rx = max(feeds[0].rxNs(), feeds[1].rxNs());
+                frec.on_packet(rx, span(packet.data(), feed.nextPacket(packet.data(), 20)));
+            }
+            frec.close();
+        }
+        CaptureReader ffile(fpath);
+        CaptureReplay<OrderBook> whole(ffile), sought(ffile);
+        whole.run();
+        sought.seek(UINT64_MAX - 1);
+        bool match = ffile.checkpoints().size() > 1 && same_book(whole.book(), one) && same_book(sought.book(), one);
+        printf("symbol-filtered recording: %zu orders, %zu checkpoints, replay %s\n", one.order_count(),
+               ffile.checkpoints().size(), match ? "matches" : "DIFFERS");
+        ok &= match;
+        filesystem::remove(fpath);
+    }
+
+    // Original pacing at 50x over ~20 ms of feed time should take ~0.4 ms.
+    CaptureReplay<OrderBook> paced(file);
+    paced.seek(first + (last - first) / 2);
+    auto t2 = chrono::steady_clock::now();
+    paced.run(paced.position() + 20'000'000, Pacing::Original, 50);
+    double paced_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t2).count();
+    printf("paced 20 ms of feed at 50x in %.2f ms\n", paced_ms);
+    ok &= paced_ms > 0.3 && paced_ms < 50;
+    return !ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return self_check();
+    uint64_t seek = 0, until = UINT64_MAX;
+    Pacing pacing = Pacing::Fast;
+    double speed = 1;
+    optional<int> symbol;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string k = argv[i], v = argv[i + 1];
+        if (k == "--seek") seek = stoull(v);
+        else if (k == "--until") until = stoull(v);
+        else if (k == "--pace") pacing = v == "original" ? Pacing::Original : Pacing::Fast;
+        else if (k == "--speed") speed = stod(v);
+        else if (k == "--symbol") symbol = stoi(v);
+        else { fprintf(stderr, "unknown option %s\n", k.c_str()); return 1; }
+    }
+    CaptureReader file(argv[1]);
+    CaptureReplay<OrderBook> replay(file, [] { return make_unique<OrderBook>(); }, symbol);
+    if (seek) replay.seek(seek);
+    auto t0 = chrono::steady_clock::now();
+    replay.run(until, pacing, speed);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    auto& s = replay.stats();
+    printf("%llu packets, %llu msgs (%llu applied) in %.3f s: %.2f M msgs/s, %llu seq gaps\n",
+           (unsigned long long)s.packets, (unsigned long long)s.messages, (unsigned long long)s.applied, secs,
+           s.messages / secs / 1e6, (unsigned long long)s.seq_gaps);
+    replay.book().print_book(5);
+}
+#endif
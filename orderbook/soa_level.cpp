@@ -0,0 +1,441 @@
+// Structure-of-arrays FIFO for one price level, with SIMD kernels for the
+// operations that touch a single field across many orders.
+//
+//   g++ -std=c++20 -O2 -march=native -DSOA_LEVEL_DEMO -x c++ soa_level.cpp -o soa_level
+//   ./soa_level [orders_per_level] [cancel_percent]
+//
+// Orders are addressed by slot, a sequence number assigned at push_back that
+// stays valid until the order leaves. Cancels zero the quantity in place and
+// leave a tombstone; the front is trimmed as fills and cancels reach it, and
+// compact() squeezes out the rest, reporting moved slots so an id index can
+// follow. Quantity, id and timestamp live in separate arrays, so the kernels
+// below (sum, first live order, fill scan) stream one array 4 (AVX2) or 8
+// (AVX-512) orders per instruction, skipping tombstones without branching.
+#pragma once
+#include <bits/stdc++.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+namespace soa_simd {
+
+// How far a walk from the front gets before need is met: filled is what the
+// first `end` entries hold (>= need unless the level ran out), and orders
+// counts the live ones among them, which is the trade count of the fill.
+struct FillScan {
+    size_t end = 0;
+    uint64_t filled = 0;
+    size_t orders = 0;
+};
+
+inline uint64_t sum_scalar(const uint64_t* q, size_t n) {
+    uint64_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += q[i];
+    return s;
+}
+
+inline size_t first_nonzero_scalar(const uint64_t* q, size_t n) {
+    size_t i = 0;
+    while (i < n && q[i] == 0) ++i;
+    return i;
+}
+
+// Sum of p[i] * q[i], wrapping like plain int64 arithmetic: prices in ticks
+// times quantities, so callers keep the notional in range.
+inline int64_t dot_scalar(const int64_t* p, const uint64_t* q, size_t n) {
+    uint64_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += uint64_t(p[i]) * q[i];
+    return int64_t(s);
+}
+
+inline FillScan scan_fill_scalar(const uint64_t* q, size_t n, uint64_t need, size_t from = 0, FillScan r = {}) {
+    for (r.end = from; r.end < n && r.filled < need; ++r.end) {
+        r.filled += q[r.end];
+        r.orders += q[r.end] != 0;
+    }
+    return r;
+}
+
+#if defined(__AVX512F__)
+inline constexpr size_t lanes = 8;
+inline const char* isa = "avx512";
+
+// By halves through the zero-masking extract: the cast, the plain extract
+// and _mm512_reduce_add_epi64 all trip a false -Wmaybe-uninitialized in GCC 12.
+inline uint64_t hsum(__m512i v) {
+    __m256i h = _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xFF, v, 0), _mm512_maskz_extracti64x4_epi64(0xFF, v, 1));
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+    return uint64_t(_mm_cvtsi128_si64(s)) + uint64_t(_mm_extract_epi64(s, 1));
+}
+
+inline uint64_t sum(const uint64_t* q, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) acc = _mm512_add_epi64(acc, _mm512_loadu_si512(q + i));
+    return hsum(acc) + sum_scalar(q + i, n - i);
+}
+
+inline size_t first_nonzero(const uint64_t* q, size_t n) {
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m512i v = _mm512_loadu_si512(q + i);
+        if (auto live = _mm512_test_epi64_mask(v, v)) return i + size_t(countr_zero(unsigned(live)));
+    }
+    return i + first_nonzero_scalar(q + i, n - i);
+}
+
+// Low 64 bits of the lane products; built from 32-bit multiplies when
+// AVX512DQ's vpmullq isn't there (zero-masking forms, for the same GCC 12
+// warning as hsum).
+inline __m512i mullo64(__m512i a, __m512i b) {
+#if defined(__AVX512DQ__)
+    return _mm512_mullo_epi64(a, b);
+#else
+    constexpr __mmask8 all = 0xFF;
+    __m512i cross = _mm512_add_epi64(_mm512_maskz_mul_epu32(all, _mm512_maskz_srli_epi64(all, a, 32), b),
+                                     _mm512_maskz_mul_epu32(all, a, _mm512_maskz_srli_epi64(all, b, 32)));
+    return _mm512_add_epi64(_mm512_maskz_mul_epu32(all, a, b), _mm512_maskz_slli_epi64(all, cross, 32));
+#endif
+}
+
+inline int64_t dot(const int64_t* p, const uint64_t* q, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) acc = _mm512_add_epi64(acc, mullo64(_mm512_loadu_si512(p + i), _mm512_loadu_si512(q + i)));
+    return int64_t(hsum(acc) + uint64_t(dot_scalar(p + i, q + i, n - i)));
+}
+
+// Whole blocks go at once while they cannot complete the fill; the block
+// that does is finished order by order.
+inline FillScan scan_fill(const uint64_t* q, size_t n, uint64_t need) {
+    FillScan r;
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m512i v = _mm512_loadu_si512(q + i);
+        uint64_t block = hsum(v);
+        if (r.filled + block >= need) break;
+        r.filled += block;
+        r.orders += size_t(popcount(unsigned(_mm512_test_epi64_mask(v, v))));
+    }
+    return scan_fill_scalar(q, n, need, i, r);
+}
+#elif defined(__AVX2__)
+inline constexpr size_t lanes = 4;
+inline const char* isa = "avx2";
+
+inline uint64_t hsum(__m256i v) {
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return uint64_t(_mm_cvtsi128_si64(s)) + uint64_t(_mm_extract_epi64(s, 1));
+}
+
+// Bit i set when lane i holds a live (nonzero) quantity
+inline unsigned live_mask(__m256i v) {
+    __m256i zero = _mm256_cmpeq_epi64(v, _mm256_setzero_si256());
+    return ~unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(zero))) & 0xF;
+}
+
+inline uint64_t sum(const uint64_t* q, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes)
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + i)));
+    return hsum(acc) + sum_scalar(q + i, n - i);
+}
+
+inline size_t first_nonzero(const uint64_t* q, size_t n) {
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes)
+        if (auto live = live_mask(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + i))))
+            return i + size_t(countr_zero(live));
+    return i + first_nonzero_scalar(q + i, n - i);
+}
+
+// No 64-bit multiply in AVX2: three 32-bit ones give the low 64 bits
+inline __m256i mullo64(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+inline int64_t dot(const int64_t* p, const uint64_t* q, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes)
+        acc = _mm256_add_epi64(acc, mullo64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + i))));
+    return int64_t(hsum(acc) + uint64_t(dot_scalar(p + i, q + i, n - i)));
+}
+
+inline FillScan scan_fill(const uint64_t* q, size_t n, uint64_t need) {
+    FillScan r;
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + i));
+        uint64_t block = hsum(v);
+        if (r.filled + block >= need) break;
+        r.filled += block;
+        r.orders += size_t(popcount(live_mask(v)));
+    }
+    return scan_fill_scalar(q, n, need, i, r);
+}
+#else
+inline constexpr size_t lanes = 1;
+inline const char* isa = "scalar";
+inline uint64_t sum(const uint64_t* q, size_t n) { return sum_scalar(q, n); }
+inline size_t first_nonzero(const uint64_t* q, size_t n) { return first_nonzero_scalar(q, n); }
+inline FillScan scan_fill(const uint64_t* q, size_t n, uint64_t need) { return scan_fill_scalar(q, n, need); }
+inline int64_t dot(const int64_t* p, const uint64_t* q, size_t n) { return dot_scalar(p, q, n); }
+#endif
+
+} // namespace soa_simd
+
+template<typename Alloc = allocator<char>>
+class SoaLevel {
+    template<typename T>
+    using rebind = typename allocator_traits<Alloc>::template rebind_alloc<T>;
+
+public:
+    explicit SoaLevel(const Alloc& alloc = Alloc{}) : quantity(alloc), order_id(alloc), timestamp(alloc) {}
+
+    void reserve(size_t n) {
+        quantity.reserve(n);
+        order_id.reserve(n);
+        timestamp.reserve(n);
+    }
+
+    // Appends at the back of the queue; returns the order's slot.
+    uint64_t push_back(uint64_t id, uint64_t qty, uint64_t ts) {
+        if (qty == 0) return npos;   // would read as a tombstone
+        quantity.push_back(qty);
+        order_id.push_back(id);
+        timestamp.push_back(ts);
+        total += qty;
+        ++live;
+        return base + quantity.size() - 1;
+    }
+
+    uint64_t quantity_at(uint64_t slot) const { return quantity[index(slot)]; }
+    uint64_t order_id_at(uint64_t slot) const { return order_id[index(slot)]; }
+    uint64_t timestamp_at(uint64_t slot) const { return timestamp[index(slot)]; }
+
+    // Size-down in place, keeping queue position; reducing to 0 cancels.
+    void reduce(uint64_t slot, uint64_t new_quantity) {
+        auto& q = quantity[index(slot)];
+        total -= q - new_quantity;
+        if (new_quantity == 0) --live;
+        q = new_quantity;
+        if (new_quantity == 0) trim_front();
+    }
+
+    void cancel(uint64_t slot) { reduce(slot, 0); }
+
+    uint64_t total_quantity() const { return total; }
+    size_t order_count() const { return live; }
+    bool empty() const { return live == 0; }
+    // Entries held, tombstones included
+    size_t stored() const { return quantity.size() - head; }
+
+    // Oldest live order's slot, npos when empty
+    uint64_t front() const {
+        size_t i = head + soa_simd::first_nonzero(quantity.data() + head, quantity.size() - head);
+        return i == quantity.size() ? npos : base + i;
+    }
+
+    // Recomputes total_quantity() from the quantity array (checks, rebuilds).
+    uint64_t recount() const { return soa_simd::sum(quantity.data() + head, quantity.size() - head); }
+
+    // How much of need the level can fill and across how many orders,
+    // without modifying it (FOK checks).
+    soa_simd::FillScan scan_fill(uint64_t need) const {
+        return soa_simd::scan_fill(quantity.data() + head, quantity.size() - head, need);
+    }
+
+    // Fills up to need from the front in time priority, calling
+    // on_fill(slot, order_id, quantity_filled, remaining) per order touched.
+    // Returns the quantity filled.
+    template<typename F>
+    uint64_t fill(uint64_t need, F&& on_fill) {
+        auto scan = scan_fill(need);
+        uint64_t filled = 0;
+        for (size_t i = head, end = head + scan.end; i < end && filled < need; ++i) {
+            uint64_t& q = quantity[i];
+            if (q == 0) continue;
+            uint64_t take = min(q, need - filled);
+            q -= take;
+            filled += take;
+            live -= q == 0;
+            on_fill(base + i, order_id[i], take, q);
+        }
+        total -= filled;
+        trim_front();
+        return filled;
+    }
+
+    // Drops every tombstone; on_move(old_slot, new_slot) for each live order
+    // whose slot changes.
+    template<typename F>
+    void compact(F&& on_move) {
+        size_t out = 0;
+        uint64_t new_base = base + quantity.size();   // fresh slot range: old and new never collide
+        for (size_t i = head; i < quantity.size(); ++i) {
+            if (quantity[i] == 0) continue;
+            quantity[out] = quantity[i];
+            order_id[out] = order_id[i];
+            timestamp[out] = timestamp[i];
+            on_move(base + i, new_base + out);
+            ++out;
+        }
+        quantity.resize(out);
+        order_id.resize(out);
+        timestamp.resize(out);
+        base = new_base;
+        head = 0;
+    }
+
+    static constexpr uint64_t npos = ~uint64_t{0};
+
+private:
+    size_t index(uint64_t slot) const { return size_t(slot - base); }
+
+    // Advance past dead entries at the front, and once they make up half the
+    // storage shift the live tail down so the arrays don't creep.
+    void trim_front() {
+        head += soa_simd::first_nonzero(quantity.data() + head, quantity.size() - head);
+        if (head == quantity.size()) {
+            base += head;
+            head = 0;
+            quantity.clear();
+            order_id.clear();
+            timestamp.clear();
+        } else if (head >= 64 && head * 2 >= quantity.size()) {
+            size_t n = quantity.size() - head;
+            copy(quantity.begin() + head, quantity.end(), quantity.begin());
+            copy(order_id.begin() + head, order_id.end(), order_id.begin());
+            copy(timestamp.begin() + head, timestamp.end(), timestamp.begin());
+            quantity.resize(n);
+            order_id.resize(n);
+            timestamp.resize(n);
+            base += head;
+            head = 0;
+        }
+    }
+
+    vector<uint64_t, rebind<uint64_t>> quantity;
+    vector<uint64_t, rebind<uint64_t>> order_id;
+    vector<uint64_t, rebind<uint64_t>> timestamp;
+    size_t head = 0;      // entries before head are dead
+    uint64_t base = 0;    // slot of quantity[0]
+    uint64_t total = 0;
+    size_t live = 0;
+};
+
+#ifdef SOA_LEVEL_DEMO
+#include "order_book.cpp"
+
+// The same deep level as an intrusive list of AoS Orders (what
+// BasicOrderBook walks) and as a SoaLevel, with a share of cancels spread
+// through it; each query is timed on both and the answers compared.
+struct ListNode {
+    Order order;
+    ListNode* next;
+};
+
+template<typename F>
+static double ns_per_call(int reps, F&& f) {
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i) f(i);
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / reps;
+}
+
+int main(int argc, char** argv) {
+    size_t depth = argc > 1 ? stoull(argv[1]) : 2000;
+    unsigned cancel_pct = argc > 2 ? unsigned(stoul(argv[2])) : 40;
+    mt19937_64 rng(11);
+
+    SoaLevel<> soa;
+    soa.reserve(depth);
+    vector<ListNode> nodes(depth);
+    vector<uint64_t> slots;
+    for (size_t i = 0; i < depth; ++i) {
+        uint64_t q = 1 + rng() % 500;
+        nodes[i] = {{i, true, Price::from_double(100), q, i}, nullptr};
+        if (i) nodes[i - 1].next = &nodes[i];
+        slots.push_back(soa.push_back(i, q, i));
+    }
+    // Cancels: gone from the list, tombstones in the SoA level
+    size_t cancelled = 0;
+    ListNode* head = &nodes[0];
+    ListNode* prev = nullptr;
+    for (size_t i = 0; i < depth; ++i) {
+        if (i > 0 && rng() % 100 < cancel_pct) {
+            soa.cancel(slots[i]);
+            prev->next = nodes[i].next;
+            ++cancelled;
+        } else {
+            prev = &nodes[i];
+        }
+    }
+
+    uint64_t list_total = 0;
+    for (auto* n = head; n; n = n->next) list_total += n->order.quantity;
+    bool ok = soa.recount() == list_total && soa.total_quantity() == list_total && soa.order_count() == depth - cancelled;
+
+    constexpr int reps = 20000;
+    volatile uint64_t sink = 0;
+    printf("level of %zu orders, %zu cancelled, %s kernels\n", depth, cancelled, soa_simd::isa);
+
+    double list_sum = ns_per_call(reps, [&](int) {
+        uint64_t s = 0;
+        for (auto* n = head; n; n = n->next) s += n->order.quantity;
+        sink = s;
+    });
+    double soa_sum = ns_per_call(reps, [&](int) { sink = soa.recount(); });
+    printf("  total quantity   list %8.1f ns   soa %8.1f ns\n", list_sum, soa_sum);
+
+    // FOK-style scans of increasing size: count orders needed to fill
+    for (double share : {0.1, 0.5, 0.9}) {
+        uint64_t need = uint64_t(double(list_total) * share);
+        size_t list_orders = 0;
+        double list_scan = ns_per_call(reps, [&](int) {
+            uint64_t got = 0;
+            size_t k = 0;
+            for (auto* n = head; n && got < need; n = n->next, ++k) got += n->order.quantity;
+            list_orders = k;
+            sink = got;
+        });
+        soa_simd::FillScan scan;
+        double soa_scan = ns_per_call(reps, [&](int) { scan = soa.scan_fill(need); sink = scan.filled; });
+        ok &= scan.orders == list_orders && scan.filled >= need;
+        printf("  fill scan %3.0f%%   list %8.1f ns   soa %8.1f ns   (%zu orders)\n", share * 100, list_scan, soa_scan,
+               scan.orders);
+    }
+
+    // Scalar reference for every kernel on random arrays with runs of zeros
+    for (int t = 0; t < 2000 && ok; ++t) {
+        vector<uint64_t> q(rng() % 100);
+        for (auto& x : q) x = rng() % 3 == 0 ? 0 : rng() % 1000;
+        uint64_t need = rng() % 30000;
+        auto a = soa_simd::scan_fill(q.data(), q.size(), need), b = soa_simd::scan_fill_scalar(q.data(), q.size(), need);
+        ok &= soa_simd::sum(q.data(), q.size()) == soa_simd::sum_scalar(q.data(), q.size());
+        ok &= soa_simd::first_nonzero(q.data(), q.size()) == soa_simd::first_nonzero_scalar(q.data(), q.size());
+        ok &= a.end == b.end && a.filled == b.filled && a.orders == b.orders;
+    }
+
+    // Fills consume from the front in time order and slots survive compaction
+    SoaLevel<> lvl;
+    vector<uint64_t> s;
+    for (uint64_t i = 0; i < 10; ++i) s.push_back(lvl.push_back(100 + i, 10, i));
+    lvl.cancel(s[1]);
+    lvl.cancel(s[5]);
+    vector<uint64_t> filled_ids;
+    lvl.fill(25, [&](uint64_t, uint64_t id, uint64_t, uint64_t) { filled_ids.push_back(id); });
+    ok &= filled_ids == vector<uint64_t>{100, 102, 103} && lvl.quantity_at(s[3]) == 5 && lvl.total_quantity() == 55;
+    map<uint64_t, uint64_t> moved;
+    lvl.compact([&](uint64_t from, uint64_t to) { moved[from] = to; });
+    ok &= lvl.stored() == lvl.order_count() && lvl.order_id_at(moved[s[9]]) == 109 && lvl.quantity_at(moved[s[3]]) == 5;
+    ok &= lvl.order_id_at(lvl.front()) == 103;
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return !ok;
+}
+#endif
@@ -0,0 +1,474 @@
+// Strategies as C++20 coroutines resumed inline by the book thread.
+//
+// A strategy is a coroutine that co_awaits the book events it cares about:
+//
+//   Strategy quoter(StrategyHost<OrderBook>& host, Params& p) {
+//       for (;;) {
+//           auto bbo = co_await host.next_bbo();
+//           if (bbo.bid && bbo.ask && (bbo.ask->price - bbo.bid->price).ticks > p.max_spread)
+//               host.match_order({...}, TimeInForce::IOC);
+//       }
+//   }
+//   host.spawn(quoter(host, params));
+//
+// StrategyHost wraps the book: after each apply_batch / match_order /
+// cancel_order it resumes the strategies waiting on what changed, on the
+// same thread and before the call returns. Per round, trades go first (feed
+// executions and the host's own match fills), then level deltas from the
+// book's changes_since() journal, then one BBO event if either top level
+// moved. An event resumes every strategy waiting on it in spawn order.
+//
+// Compared with virtual listeners there is no vtable call per event per
+// listener and no state machine to write by hand: the strategy's state is
+// its local variables. Frames come from the host's arena (the promise's
+// operator new takes the host as the coroutine's first parameter, and the
+// plain one is deleted), and an awaiter lives in the suspended frame and is
+// linked into the host's wait list intrusively, so steady state never
+// touches the heap.
+//
+// A strategy calling back into the host from inside an event is fine: the
+// new book changes are applied at once and their events dispatched after
+// the current ones, before the outermost host call returns. An exception a
+// strategy doesn't catch ends that strategy and propagates out of the host
+// call that resumed it; the rest of that round's events are dropped.
+//
+//   g++ -std=c++20 -O2 -march=native -DSTRATEGY_CORO_DEMO -x c++ strategy_coro.cpp -o strategy_coro
+#pragma once
+#include <bits/stdc++.h>
+#include "order_book.cpp"
+#include "../memory/arena.cpp"
+using namespace std;
+
+struct BboEvent {
+    optional<PriceLevel> bid, ask;
+    uint64_t seq;            // book sequence() after the change
+    uint64_t timestamp_ns;   // of the host call's last message or order
+};
+
+class Strategy {
+public:
+    struct promise_type {
+        // Frame from the host's arena. The host must be the coroutine's first
+        // parameter; lambdas and member functions are refused at compile time.
+        template<typename Host, typename... Args>
+            requires requires(Host& h) { h.frame_arena(); }
+        static void* operator new(size_t n, Host& host, Args&...) {
+            return host.frame_arena().allocate(n, alignof(max_align_t));
+        }
+        static void* operator new(size_t) = delete;
+        // Arena memory goes back with the host.
+        static void operator delete(void*, size_t) noexcept {}
+
+        Strategy get_return_object() { return Strategy{coroutine_handle<promise_type>::from_promise(*this)}; }
+        // Runs up to its first co_await at the call, so setup happens at spawn time
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; }
+    };
+
+    Strategy(Strategy&& o) noexcept : h(exchange(o.h, {})) {}
+    Strategy& operator=(Strategy&& o) noexcept {
+        if (this != &o) {
+            if (h) h.destroy();
+            h = exchange(o.h, {});
+        }
+        return *this;
+    }
+    ~Strategy() { if (h) h.destroy(); }
+
+    bool done() const { return !h || h.done(); }
+
+private:
+    explicit Strategy(coroutine_handle<promise_type> h) : h(h) {}
+    coroutine_handle<promise_type> h;
+};
+
+// Intrusive FIFO of suspended awaiters for one event type.
+template<typename Event>
+class WaitList {
+public:
+    struct Awaiter {
+        WaitList& list;
+        Awaiter* next = nullptr;
+        coroutine_handle<> handle = {};
+        const Event* event = nullptr;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) noexcept {
+            handle = h;
+            list.push(this);
+        }
+        Event await_resume() const noexcept { return *event; }
+    };
+
+    bool empty() const { return head == nullptr; }
+
+    // Resumes everyone waiting now; those who wait again join a fresh list
+    // and see the next event, not this one. Returns how many were resumed.
+    size_t fire(const Event& e) {
+        Awaiter* a = exchange(head, nullptr);
+        tail = nullptr;
+        size_t n = 0;
+        while (a) {
+            Awaiter* next = a->next;   // a's frame may be gone after resume
+            a->event = &e;
+            try {
+                a->handle.resume();
+            } catch (...) {
+                splice_front(next);    // the rest still wait for an event
+                throw;
+            }
+            ++n;
+            a = next;
+        }
+        return n;
+    }
+
+private:
+    Awaiter* head = nullptr;
+    Awaiter* tail = nullptr;
+
+    void push(Awaiter* a) {
+        a->next = nullptr;
+        if (tail) tail->next = a;
+        else head = a;
+        tail = a;
+    }
+
+    void splice_front(Awaiter* chain) {
+        if (!chain) return;
+        Awaiter* last = chain;
+        while (last->next) last = last->next;
+        last->next = head;
+        head = chain;
+        if (!tail) tail = last;
+    }
+};
+
+struct StrategyHostStats {
+    uint64_t bbo_events = 0;
+    uint64_t trade_events = 0;
+    uint64_t level_events = 0;
+    uint64_t resumes = 0;
+    uint64_t journal_resyncs = 0;   // level events lost to a wrapped journal
+};
+
+template<typename Book>
+class StrategyHost {
+public:
+    // frame_bytes bounds the total size of spawned strategies' frames.
+    explicit StrategyHost(Book& book, size_t frame_bytes = 1 << 20)
+        : book_(book), arena(frame_bytes), level_seq(book.sequence()), last_bid(book.best_bid()), last_ask(book.best_ask()) {
+        pending_trades.reserve(64);
+        firing_trades.reserve(64);
+        deltas.reserve(64);
+    }
+
+    StrategyHost(const StrategyHost&) = delete;
+    StrategyHost& operator=(const StrategyHost&) = delete;
+
+    ~StrategyHost() {
+        strategies.clear();   // frames before the arena they live in
+    }
+
+    Arena& frame_arena() { return arena; }
+    Book& book() { return book_; }
+    const StrategyHostStats& stats() const { return stats_; }
+
+    // Takes ownership of a strategy, already suspended at its first co_await.
+    void spawn(Strategy s) {
+        if (!s.done()) strategies.push_back(std::move(s));
+    }
+
+    // co_await host.next_bbo() / next_trade() / next_level() suspends until
+    // the next event of that kind and yields a copy of it.
+    typename WaitList<BboEvent>::Awaiter next_bbo() { return {bbo_waiters}; }
+    typename WaitList<Trade>::Awaiter next_trade() { return {trade_waiters}; }
+    typename WaitList<LevelDelta>::Awaiter next_level() { return {level_waiters}; }
+
+    // Book's apply_batch, then events. Trades are the feed's Execute messages
+    // as reported (resting side in resting_id, no aggressor).
+    size_t apply_batch(span<const BookMsg> msgs) {
+        size_t applied = book_.apply_batch(msgs);
+        if (!trade_waiters.empty()) {
+            for (const auto& m : msgs)
+                if (m.type == MsgType::Execute) pending_trades.push_back({0, m.order_id, m.price, m.quantity, m.timestamp_ns});
+        }
+        if (!msgs.empty()) last_ts = msgs.back().timestamp_ns;
+        dispatch();
+        return applied;
+    }
+
+    // Book's match_order with each fill dispatched as a trade event.
+    MatchResult match_order(const Order& order, TimeInForce tif) {
+        auto r = book_.match_order(order, tif, fills);
+        pending_trades.insert(pending_trades.end(), fills.begin(), fills.end());
+        last_ts = order.timestamp_ns;
+        dispatch();
+        return r;
+    }
+
+    bool cancel_order(uint64_t order_id) {
+        bool ok = book_.cancel_order(order_id);
+        if (ok) dispatch();
+        return ok;
+    }
+
+private:
+    Book& book_;
+    Arena arena;
+    vector<Strategy> strategies;
+    WaitList<BboEvent> bbo_waiters;
+    WaitList<Trade> trade_waiters;
+    WaitList<LevelDelta> level_waiters;
+    vector<Trade> pending_trades, firing_trades;
+    vector<LevelDelta> deltas;
+    SmallVector<Trade, 16> fills;
+    uint64_t level_seq;
+    optional<PriceLevel> last_bid, last_ask;
+    uint64_t last_ts = 0;
+    bool dispatching = false;
+    StrategyHostStats stats_;
+
+    static bool same(const optional<PriceLevel>& a, const optional<PriceLevel>& b) {
+        return a.has_value() == b.has_value() && (!a || (a->price == b->price && a->total_quantity == b->total_quantity));
+    }
+
+    void dispatch() {
+        // A strategy's own order placed from inside an event: the outer loop
+        // below picks its changes up after the current round.
+        if (dispatching) return;
+        dispatching = true;
+        struct Reset { bool& f; ~Reset() { f = false; } } reset{dispatching};
+        do {
+            swap(pending_trades, firing_trades);
+            for (const auto& t : firing_trades) {
+                ++stats_.trade_events;
+                stats_.resumes += trade_waiters.fire(t);
+            }
+            firing_trades.clear();
+
+            if (book_.sequence() != level_seq) {
+                if (level_waiters.empty()) deltas.clear();
+                else if (!book_.changes_since(level_seq, deltas)) ++stats_.journal_resyncs;
+                level_seq = book_.sequence();
+                for (const auto& d : deltas) {
+                    ++stats_.level_events;
+                    stats_.resumes += level_waiters.fire(d);
+                }
+            }
+
+            auto bid = book_.best_bid(), ask = book_.best_ask();
+            if (!same(bid, last_bid) || !same(ask, last_ask)) {
+                last_bid = bid;
+                last_ask = ask;
+                ++stats_.bbo_events;
+                stats_.resumes += bbo_waiters.fire(BboEvent{bid, ask, level_seq, last_ts});
+            }
+        } while (!pending_trades.empty() || book_.sequence() != level_seq);
+    }
+};
+
+#ifdef STRATEGY_CORO_DEMO
+#define ALLOC_TRACKING
+#include "../memory/alloc_tracking.cpp"
+#include "feed_decode.cpp"
+#include "../feed/sim_model.cpp"
+
+// The same three strategies twice: as coroutines and as virtual listeners.
+struct Tally {
+    uint64_t bbo = 0, wide = 0, trades = 0, volume = 0, levels = 0;
+    int64_t spread_sum = 0;
+    bool operator==(const Tally&) const = default;
+};
+
+Strategy spread_watch(StrategyHost<OrderBook>& host, Tally& t) {
+    for (;;) {
+        auto e = co_await host.next_bbo();
+        ++t.bbo;
+        if (e.bid && e.ask) {
+            int64_t spread = e.ask->price.ticks - e.bid->price.ticks;
+            t.spread_sum += spread;
+            t.wide += spread > 1000;
+        }
+    }
+}
+
+Strategy volume_count(StrategyHost<OrderBook>& host, Tally& t) {
+    for (;;) {
+        auto tr = co_await host.next_trade();
+        ++t.trades;
+        t.volume += tr.quantity;
+    }
+}
+
+Strategy level_count(StrategyHost<OrderBook>& host, Tally& t) {
+    for (;;) {
+        auto d = co_await host.next_level();
+        t.levels += d.total_quantity == 0;
+    }
+}
+
+// A reacting strategy: lifts thin offers near the bid with an IOC from
+// inside the BBO event, then waits for its own fills.
+Strategy lifter(StrategyHost<OrderBook>& host, uint64_t& next_id, uint64_t& lifted, uint64_t& fills_seen) {
+    for (;;) {
+        auto e = co_await host.next_bbo();
+        if (!e.bid || !e.ask || e.ask->price.ticks - e.bid->price.ticks > 200 || e.ask->total_quantity > 200) continue;
+        uint64_t id = next_id++;
+        auto r = host.match_order({id, true, e.ask->price, e.ask->total_quantity, e.timestamp_ns}, TimeInForce::IOC);
+        lifted += r.filled_quantity;
+        for (size_t k = 0; k < r.trade_count; ++k) {
+            auto tr = co_await host.next_trade();
+            fills_seen += tr.aggressor_id == id;
+        }
+    }
+}
+
+struct BookListener {
+    virtual ~BookListener() = default;
+    virtual void on_bbo(const BboEvent&) {}
+    virtual void on_trade(const Trade&) {}
+    virtual void on_level(const LevelDelta&) {}
+};
+
+struct SpreadWatch : BookListener {
+    Tally& t;
+    explicit SpreadWatch(Tally& t) : t(t) {}
+    void on_bbo(const BboEvent& e) override {
+        ++t.bbo;
+        if (e.bid && e.ask) {
+            int64_t spread = e.ask->price.ticks - e.bid->price.ticks;
+            t.spread_sum += spread;
+            t.wide += spread > 1000;
+        }
+    }
+};
+
+struct VolumeCount : BookListener {
+    Tally& t;
+    explicit VolumeCount(Tally& t) : t(t) {}
+    void on_trade(const Trade& tr) override { ++t.trades; t.volume += tr.quantity; }
+};
+
+struct LevelCount : BookListener {
+    Tally& t;
+    explicit LevelCount(Tally& t) : t(t) {}
+    void on_level(const LevelDelta& d) override { t.levels += d.total_quantity == 0; }
+};
+
+// Same event rounds as StrategyHost, through a vector of listeners.
+struct ListenerHost {
+    OrderBook& book;
+    vector<BookListener*> listeners;
+    vector<LevelDelta> deltas = {};
+    uint64_t level_seq = 0;
+    optional<PriceLevel> last_bid = {}, last_ask = {};
+
+    void apply_batch(span<const BookMsg> msgs) {
+        book.apply_batch(msgs);
+        for (const auto& m : msgs)
+            if (m.type == MsgType::Execute) {
+                Trade t{0, m.order_id, m.price, m.quantity, m.timestamp_ns};
+                for (auto* l : listeners) l->on_trade(t);
+            }
+        if (book.sequence() != level_seq) {
+            book.changes_since(level_seq, deltas);
+            level_seq = book.sequence();
+            for (const auto& d : deltas)
+                for (auto* l : listeners) l->on_level(d);
+        }
+        auto bid = book.best_bid(), ask = book.best_ask();
+        auto same = [](const optional<PriceLevel>& a, const optional<PriceLevel>& b) {
+            return a.has_value() == b.has_value() && (!a || (a->price == b->price && a->total_quantity == b->total_quantity));
+        };
+        if (!same(bid, last_bid) || !same(ask, last_ask)) {
+            last_bid = bid;
+            last_ask = ask;
+            BboEvent e{bid, ask, level_seq, msgs.empty() ? 0 : msgs.back().timestamp_ns};
+            for (auto* l : listeners) l->on_bbo(e);
+        }
+    }
+};
+
+// Packets of adds, cancels and executions from market_sim's model, around a
+// slowly moving mid, decoded the way the feed handler would.
+static vector<vector<BookMsg>> make_flow(size_t packets, uint64_t seed) {
+    SimConfig sim;
+    sim.targetOrders = 2000;
+    sim.seed = seed;
+    SimFeed feed(sim);
+    vector<vector<BookMsg>> out(packets);
+    vector<byte> packet(8 * wire::orderEventSize);
+    for (auto& msgs : out) {
+        auto rx = feed.rxNs();
+        size_t used = feed.nextPacket(packet.data(), 8);
+        for_each_order_event(span(packet.data(), used), [&](const wire::OrderEvent& e) { msgs.push_back(to_book_msg(e, rx)); });
+    }
+    return out;
+}
+
+int main() {
+    auto flow = make_flow(400'000, 7);
+
+    // The same flow through a bare book, also counting its own heap traffic
+    // (store chunks and new levels), so what remains is the dispatch's
+    auto timed = [&](auto&& apply) {
+        apply(flow[0]);   // warm-up: book and host buffers reach size
+        auto at = alloc_tracking::counts().allocations;
+        auto t0 = chrono::steady_clock::now();
+        for (size_t p = 1; p < flow.size(); ++p) apply(flow[p]);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        return pair{ms, alloc_tracking::counts().allocations - at};
+    };
+    OrderBook bare_book;
+    auto [bare_ms, bare_heap] = timed([&](span<const BookMsg> m) { bare_book.apply_batch(m); });
+
+    OrderBook coro_book;
+    Tally ct;
+    StrategyHost<OrderBook> host(coro_book);
+    host.spawn(spread_watch(host, ct));
+    host.spawn(volume_count(host, ct));
+    host.spawn(level_count(host, ct));
+    auto [coro_ms, coro_heap] = timed([&](span<const BookMsg> m) { host.apply_batch(m); });
+
+    OrderBook virt_book;
+    Tally vt;
+    SpreadWatch sw(vt);
+    VolumeCount vc(vt);
+    LevelCount lc(vt);
+    ListenerHost lh{virt_book, {&sw, &vc, &lc}};
+    auto [virt_ms, virt_heap] = timed([&](span<const BookMsg> m) { lh.apply_batch(m); });
+
+    auto& s = host.stats();
+    uint64_t events = s.bbo_events + s.trade_events + s.level_events;
+    printf("%llu events (%llu bbo, %llu trade, %llu level), %llu resumes, frames %zu bytes\n",
+           (unsigned long long)events, (unsigned long long)s.bbo_events, (unsigned long long)s.trade_events,
+           (unsigned long long)s.level_events, (unsigned long long)s.resumes, host.frame_arena().used());
+    auto row = [&](const char* name, double ms, uint64_t heap) {
+        printf("%-18s %7.1f ms, %5.1f ns per event over the bare book, %llu heap allocations beyond the book's\n", name, ms,
+               (ms - bare_ms) * 1e6 / double(events), (unsigned long long)(heap - bare_heap));
+    };
+    printf("%-18s %7.1f ms, %llu heap allocations after warm-up\n", "bare book", bare_ms, (unsigned long long)bare_heap);
+    row("coroutines", coro_ms, coro_heap);
+    row("virtual listeners", virt_ms, virt_heap);
+    bool ok = ct == vt && s.journal_resyncs == 0 && coro_heap == bare_heap;
+
+    // A strategy that trades from inside an event sees its own fills next
+    OrderBook book;
+    StrategyHost<OrderBook> live(book);
+    uint64_t next_id = 1'000'000'000, lifted = 0, fills_seen = 0;
+    Tally lt;
+    live.spawn(lifter(live, next_id, lifted, fills_seen));
+    live.spawn(volume_count(live, lt));
+    for (size_t p = 0; p < 50'000; ++p) live.apply_batch(flow[p]);
+    printf("lifter: %llu IOCs, %llu lifted, %llu own fills seen, %llu trades seen by volume_count\n",
+           (unsigned long long)(next_id - 1'000'000'000), (unsigned long long)lifted, (unsigned long long)fills_seen,
+           (unsigned long long)lt.trades);
+    ok &= next_id > 1'000'000'000 && fills_seen > 0 && lifted > 0;
+
+    printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif
@@ -0,0 +1,541 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/// Startup placement for low-jitter runs: what the machine looks like
+/// (CpuTopology), which thread goes where (ThreadPlacement), and what is
+/// wrong with that before the first message arrives (checkPlacement).
+///
+///     auto topo = CpuTopology::discover();
+///     auto placement = ThreadPlacement::fromEnv();     // CPU_PLACEMENT=feed=2,book=3,strategy=4
+///     auto report = checkPlacement(topo, placement, {.lockBytes = 1 << 30});
+///     report.print();
+///     report.enforce();                                // throws on errors
+///     lockAllMemory();                                 // arenas, rings and stacks stay resident
+///
+///     // on the book thread:
+///     placement.apply("book", topo);                   // pin, name, bind memory to the local node
+///
+/// Pipeline and WorkStealingPool take cpu numbers; cpuFor() hands them the
+/// configured ones. Everything is read from sysfs, so it reflects what a
+/// container actually sees: the affinity mask is the cpuset it was given.
+
+/// One logical cpu as sysfs and the affinity mask describe it
+struct CpuInfo {
+    int cpu = -1;
+    int core = -1;              // core_id, unique within a package
+    int package = -1;
+    int node = 0;
+    bool online = true;
+    bool isolated = false;      // isolcpus=
+    bool nohzFull = false;      // nohz_full=
+    bool allowed = false;       // in this process's affinity mask (the container's cpuset)
+    std::string governor;       // cpufreq scaling governor; empty when not exposed
+};
+
+/// Free and total pages of one hugepage size
+struct HugePagePool {
+    std::size_t pageBytes = 0;
+    long total = 0;
+    long free = 0;
+};
+
+/// "0-3,8,10-11" -> {0,1,2,3,8,10,11}. Throws std::invalid_argument.
+inline std::vector<int> parseCpuList(std::string_view list) {
+    std::vector<int> out;
+    while (not list.empty()) {
+        auto comma = list.find(',');
+        auto item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+        while (not item.empty() && (item.back() == '\n' || item.back() == ' ')) {
+            item.remove_suffix(1);
+        }
+        if (item.empty()) {
+            continue;
+        }
+        auto dash = item.find('-');
+        try {
+            int lo = std::stoi(std::string{item.substr(0, dash)});
+            int hi = dash == std::string_view::npos ? lo : std::stoi(std::string{item.substr(dash + 1)});
+            if (lo < 0 || hi < lo) {
+                throw std::invalid_argument{"range"};
+            }
+            for (int c = lo; c <= hi; ++c) {
+                out.push_back(c);
+            }
+        } catch (std::logic_error const&) {
+            throw std::invalid_argument{"parseCpuList: bad item '" + std::string{item} + "'"};
+        }
+    }
+    return out;
+}
+
+class CpuTopology
+{
+public:
+    /// Reads sysfs under sysRoot: "/sys" normally, a copy of it in tests.
+    static CpuTopology discover(std::string const& sysRoot = "/sys") {
+        CpuTopology t;
+        auto cpuDir = sysRoot + "/devices/system/cpu";
+        auto possible = parseCpuList(readFile(cpuDir + "/possible", "0"));
+        auto online = parseCpuList(readFile(cpuDir + "/online", readFile(cpuDir + "/possible", "0")));
+        auto isolated = parseCpuList(readFile(cpuDir + "/isolated"));
+        auto nohz = parseCpuList(readFile(cpuDir + "/nohz_full"));
+        auto has = [](std::vector<int> const& v, int c) { return std::find(v.begin(), v.end(), c) != v.end(); };
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        bool haveMask = ::sched_getaffinity(0, sizeof(mask), &mask) == 0;
+
+        for (int c : possible) {
+            CpuInfo info;
+            info.cpu = c;
+            auto dir = cpuDir + "/cpu" + std::to_string(c);
+            info.online = has(online, c);
+            info.core = readInt(dir + "/topology/core_id", c);
+            info.package = readInt(dir + "/topology/physical_package_id", 0);
+            info.isolated = has(isolated, c);
+            info.nohzFull = has(nohz, c);
+            info.allowed = haveMask ? CPU_ISSET(c, &mask) != 0 : info.online;
+            info.governor = readFile(dir + "/cpufreq/scaling_governor");
+            trim(info.governor);
+            t.cpus_.push_back(std::move(info));
+        }
+
+        for (int n : parseCpuList(readFile(sysRoot + "/devices/system/node/online", "0"))) {
+            t.nodeCount_ = std::max(t.nodeCount_, n + 1);
+            for (int c : parseCpuList(readFile(sysRoot + "/devices/system/node/node" + std::to_string(n) + "/cpulist"))) {
+                if (auto* info = t.findMutable(c)) {
+                    info->node = n;
+                }
+            }
+        }
+
+        auto hugeDir = sysRoot + "/kernel/mm/hugepages/hugepages-";
+        for (std::size_t kb : {std::size_t{2048}, std::size_t{1048576}}) {
+            auto dir = hugeDir + std::to_string(kb) + "kB";
+            auto total = readInt(dir + "/nr_hugepages", -1);
+            if (total >= 0) {
+                t.hugePages_.push_back({kb << 10, total, readInt(dir + "/free_hugepages", 0)});
+            }
+        }
+        // "always [madvise] never": the bracketed word is the mode
+        auto thp = readFile(sysRoot + "/kernel/mm/transparent_hugepage/enabled");
+        auto open = thp.find('['), close = thp.find(']');
+        if (open != std::string::npos && close > open) {
+            t.thpMode_ = thp.substr(open + 1, close - open - 1);
+        }
+        return t;
+    }
+
+    std::vector<CpuInfo> const& cpus() const noexcept { return cpus_; }
+
+    /// nullptr if cpu doesn't exist on this machine
+    CpuInfo const* find(int cpu) const noexcept {
+        for (auto& c : cpus_) {
+            if (c.cpu == cpu) {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Online cpus in the affinity mask
+    std::vector<int> allowed() const {
+        std::vector<int> out;
+        for (auto& c : cpus_) {
+            if (c.allowed && c.online) {
+                out.push_back(c.cpu);
+            }
+        }
+        return out;
+    }
+
+    /// Allowed cpus marked isolated, the ones to put hot threads on
+    std::vector<int> isolated() const {
+        std::vector<int> out;
+        for (auto& c : cpus_) {
+            if (c.allowed && c.online && c.isolated) {
+                out.push_back(c.cpu);
+            }
+        }
+        return out;
+    }
+
+    /// Hyperthread siblings of cpu: same package and core, cpu itself excluded
+    std::vector<int> siblings(int cpu) const {
+        std::vector<int> out;
+        auto* self = find(cpu);
+        if (self == nullptr) {
+            return out;
+        }
+        for (auto& c : cpus_) {
+            if (c.cpu != cpu && c.package == self->package && c.core == self->core) {
+                out.push_back(c.cpu);
+            }
+        }
+        return out;
+    }
+
+    int nodeCount() const noexcept { return nodeCount_; }
+    std::vector<HugePagePool> const& hugePages() const noexcept { return hugePages_; }
+    /// "always", "madvise" or "never"; empty when not exposed
+    std::string const& transparentHugePages() const noexcept { return thpMode_; }
+
+private:
+    CpuInfo* findMutable(int cpu) noexcept { return const_cast<CpuInfo*>(find(cpu)); }
+
+    static std::string readFile(std::string const& path, std::string fallback = {}) {
+        std::ifstream in{path};
+        if (not in) {
+            return fallback;
+        }
+        std::string s((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return s;
+    }
+
+    static long readInt(std::string const& path, long fallback) {
+        auto s = readFile(path);
+        try {
+            return s.empty() ? fallback : std::stol(s);
+        } catch (std::logic_error const&) {
+            return fallback;
+        }
+    }
+
+    static void trim(std::string& s) {
+        while (not s.empty() && (s.back() == '\n' || s.back() == ' ')) {
+            s.pop_back();
+        }
+    }
+
+    std::vector<CpuInfo> cpus_;
+    std::vector<HugePagePool> hugePages_;
+    std::string thpMode_;
+    int nodeCount_ = 1;
+};
+
+
+/// Pin the calling thread to one cpu.
+/// @return 0, or the pthread error (EINVAL for a cpu outside the cpuset).
+inline int tryPinCurrentThread(int cpu) noexcept {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return EINVAL;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+}
+
+/// Throwing form of tryPinCurrentThread. Throws std::system_error.
+inline void pinCurrentThread(int cpu) {
+    if (int err = tryPinCurrentThread(cpu); err != 0) {
+        throw std::system_error(err, std::generic_category(), "pin to cpu " + std::to_string(cpu));
+    }
+}
+
+
+/// Which named thread runs on which cpu, from "feed=2,book=3,strategy=4".
+class ThreadPlacement
+{
+public:
+    struct Entry {
+        std::string name;
+        int cpu;
+    };
+
+    /// Throws std::invalid_argument on bad syntax or a name given twice.
+    static ThreadPlacement parse(std::string_view spec) {
+        ThreadPlacement p;
+        while (not spec.empty()) {
+            auto comma = spec.find(',');
+            auto item = spec.substr(0, comma);
+            spec = comma == std::string_view::npos ? std::string_view{} : spec.substr(comma + 1);
+            if (item.empty()) {
+                continue;
+            }
+            auto eq = item.find('=');
+            if (eq == std::string_view::npos || eq == 0) {
+                throw std::invalid_argument{"ThreadPlacement: expected name=cpu, got '" + std::string{item} + "'"};
+            }
+            std::string name{item.substr(0, eq)};
+            int cpu;
+            try {
+                std::size_t used = 0;
+                cpu = std::stoi(std::string{item.substr(eq + 1)}, &used);
+                if (used != item.size() - eq - 1 || cpu < 0) {
+                    throw std::invalid_argument{"cpu"};
+                }
+            } catch (std::logic_error const&) {
+                throw std::invalid_argument{"ThreadPlacement: bad cpu in '" + std::string{item} + "'"};
+            }
+            if (p.cpuFor(name) >= 0) {
+                throw std::invalid_argument{"ThreadPlacement: '" + name + "' placed twice"};
+            }
+            p.entries_.push_back({std::move(name), cpu});
+        }
+        return p;
+    }
+
+    /// Placement from an environment variable; empty if it isn't set.
+    static ThreadPlacement fromEnv(char const* variable = "CPU_PLACEMENT") {
+        auto* spec = std::getenv(variable);
+        return spec != nullptr ? parse(spec) : ThreadPlacement{};
+    }
+
+    std::vector<Entry> const& entries() const noexcept { return entries_; }
+
+    /// Configured cpu for name, or -1 (the "leave affinity alone" value
+    /// StageOptions takes)
+    int cpuFor(std::string_view name) const noexcept {
+        for (auto& e : entries_) {
+            if (e.name == name) {
+                return e.cpu;
+            }
+        }
+        return -1;
+    }
+
+    /// On the thread itself: pin it to name's cpu, give it name (as top and
+    /// perf show it) and bind its future allocations to the cpu's NUMA node,
+    /// so first-touched memory stays local.
+    /// @return `false` if name has no cpu configured. Throws std::system_error.
+    bool apply(std::string_view name, CpuTopology const& topology) const {
+        int cpu = cpuFor(name);
+        if (cpu < 0) {
+            return false;
+        }
+        if (int err = tryPinCurrentThread(cpu); err != 0) {
+            throw std::system_error(err, std::generic_category(), "ThreadPlacement: pin " + std::string{name});
+        }
+        std::string shortName{name.substr(0, 15)};                // kernel limit, with the NUL
+        ::pthread_setname_np(::pthread_self(), shortName.c_str());
+        if (topology.nodeCount() > 1) {
+            auto* info = topology.find(cpu);
+            unsigned long mask = 1UL << (info != nullptr ? info->node : 0);
+            if (::syscall(SYS_set_mempolicy, MPOL_BIND, &mask, sizeof(mask) * 8) != 0) {
+                throw std::system_error(errno, std::generic_category(), "ThreadPlacement: set_mempolicy");
+            }
+        }
+        return true;
+    }
+
+private:
+    std::vector<Entry> entries_;
+};
+
+
+/// What checkPlacement should hold the run to
+struct PlacementRequirements {
+    bool requireIsolated = false;   // a placed cpu without isolcpus= is an error, not a warning
+    std::size_t lockBytes = 0;      // memory the process will mlock
+    std::size_t hugePageBytes = 0;  // memory it wants on explicit 2 MB hugepages
+};
+
+/// Findings from checkPlacement, worst first when printed
+class StartupReport
+{
+public:
+    enum class Level { Error, Warning, Info };
+
+    struct Finding {
+        Level level;
+        std::string message;
+    };
+
+    void add(Level level, std::string message) { findings_.push_back({level, std::move(message)}); }
+
+    std::vector<Finding> const& findings() const noexcept { return findings_; }
+
+    bool ok() const noexcept {
+        return std::none_of(findings_.begin(), findings_.end(), [](Finding const& f) { return f.level == Level::Error; });
+    }
+
+    void print(std::FILE* out = stderr) const {
+        static char const* const names[] = {"error", "warning", "info"};
+        for (auto level : {Level::Error, Level::Warning, Level::Info}) {
+            for (auto& f : findings_) {
+                if (f.level == level) {
+                    std::fprintf(out, "placement %s: %s\n", names[static_cast<int>(level)], f.message.c_str());
+                }
+            }
+        }
+    }
+
+    /// Throws std::runtime_error listing the errors, if there are any.
+    void enforce() const {
+        std::string what;
+        for (auto& f : findings_) {
+            if (f.level == Level::Error) {
+                what += (what.empty() ? "" : "; ") + f.message;
+            }
+        }
+        if (not what.empty()) {
+            throw std::runtime_error{"placement: " + what};
+        }
+    }
+
+private:
+    std::vector<Finding> findings_;
+};
+
+/// Everything about placement that would make latency irreproducible:
+/// cpus that don't exist or lie outside the cpuset, threads sharing a cpu or
+/// a core, cpus that aren't isolated or run a scaling governor, threads
+/// spread over NUMA nodes, and memlock or hugepage budgets the box can't meet.
+inline StartupReport checkPlacement(CpuTopology const& topology, ThreadPlacement const& placement,
+                                    PlacementRequirements const& req = {}) {
+    using Level = StartupReport::Level;
+    StartupReport r;
+    auto where = [](ThreadPlacement::Entry const& e) { return "'" + e.name + "' on cpu " + std::to_string(e.cpu); };
+
+    if (placement.entries().empty()) {
+        r.add(Level::Warning, "no threads placed; the scheduler will move them");
+    }
+    std::vector<int> nodes;
+    auto const& entries = placement.entries();
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        auto& e = entries[i];
+        auto* info = topology.find(e.cpu);
+        if (info == nullptr || not info->online) {
+            r.add(Level::Error, where(e) + ": no such online cpu");
+            continue;
+        }
+        if (not info->allowed) {
+            r.add(Level::Error, where(e) + ": outside this process's cpuset (docker --cpuset-cpus?)");
+        }
+        if (not info->isolated) {
+            r.add(req.requireIsolated ? Level::Error : Level::Warning, where(e) + ": not isolated (isolcpus=)");
+        } else if (not info->nohzFull) {
+            r.add(Level::Info, where(e) + ": isolated but still ticking (nohz_full=)");
+        }
+        if (e.cpu == 0) {
+            r.add(Level::Warning, where(e) + ": cpu 0 takes most housekeeping and interrupts");
+        }
+        if (not info->governor.empty() && info->governor != "performance") {
+            r.add(Level::Warning, where(e) + ": cpufreq governor is " + info->governor);
+        }
+        auto sib = topology.siblings(e.cpu);
+        for (std::size_t j = 0; j < i; ++j) {
+            auto& other = entries[j];
+            if (other.cpu == e.cpu) {
+                r.add(Level::Warning, where(e) + ": shared with '" + other.name + "'");
+            } else if (std::find(sib.begin(), sib.end(), other.cpu) != sib.end()) {
+                r.add(Level::Warning, where(e) + ": hyperthread sibling of '" + other.name + "'");
+            }
+        }
+        if (std::find(nodes.begin(), nodes.end(), info->node) == nodes.end()) {
+            nodes.push_back(info->node);
+        }
+    }
+    if (nodes.size() > 1) {
+        r.add(Level::Info, "threads span " + std::to_string(nodes.size()) + " NUMA nodes; rings between them cross the interconnect");
+    }
+
+    if (req.lockBytes != 0) {
+        rlimit limit{};
+        ::getrlimit(RLIMIT_MEMLOCK, &limit);
+        if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < req.lockBytes && ::geteuid() != 0) {
+            r.add(Level::Error, "RLIMIT_MEMLOCK is " + std::to_string(limit.rlim_cur >> 10) + " KB, need "
+                                    + std::to_string(req.lockBytes >> 10) + " KB (ulimit -l, or docker --ulimit memlock=-1)");
+        }
+    }
+    if (req.hugePageBytes != 0) {
+        long freeBytes = 0;
+        for (auto& pool : topology.hugePages()) {
+            if (pool.pageBytes == std::size_t{2} << 20) {
+                freeBytes = pool.free * static_cast<long>(pool.pageBytes);
+            }
+        }
+        if (static_cast<std::size_t>(freeBytes) < req.hugePageBytes) {
+            r.add(Level::Warning, std::to_string(freeBytes >> 20) + " MB of free 2 MB hugepages, want "
+                                      + std::to_string(req.hugePageBytes >> 20) + " MB (vm.nr_hugepages); Arena falls back to THP");
+            if (topology.transparentHugePages() == "never") {
+                r.add(Level::Warning, "transparent hugepages are disabled too");
+            }
+        }
+    }
+    return r;
+}
+
+/// Fault in and pin every current and future mapping: arenas, rings,
+/// stacks. Throws std::system_error (normally RLIMIT_MEMLOCK).
+inline void lockAllMemory() {
+    if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mlockall");
+    }
+}
+
+/// Fault in and pin one region. Throws std::system_error.
+inline void lockRegion(void const* p, std::size_t bytes) {
+    if (::mlock(p, bytes) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mlock");
+    }
+}
+
+
+#ifdef CPU_TOPOLOGY_DEMO
+// g++ -std=c++20 -O2 -DCPU_TOPOLOGY_DEMO -x c++ cpu_topology.cpp -o cpu_topology
+//   ./cpu_topology [name=cpu,...]      # default: CPU_PLACEMENT, else main on the last allowed cpu
+#include "../memory/arena.cpp"
+
+int main(int argc, char** argv) {
+    auto topo = CpuTopology::discover();
+    std::printf("cpu core pkg node online allowed isolated nohz governor\n");
+    for (auto& c : topo.cpus()) {
+        std::printf("%3d %4d %3d %4d %6d %7d %8d %4d %s\n", c.cpu, c.core, c.package, c.node, c.online, c.allowed,
+                    c.isolated, c.nohzFull, c.governor.empty() ? "-" : c.governor.c_str());
+    }
+    for (auto& h : topo.hugePages()) {
+        std::printf("hugepages %zu kB: %ld free of %ld\n", h.pageBytes >> 10, h.free, h.total);
+    }
+    std::printf("transparent hugepages: %s\n", topo.transparentHugePages().c_str());
+
+    auto placement = argc > 1 ? ThreadPlacement::parse(argv[1]) : ThreadPlacement::fromEnv();
+    if (placement.entries().empty()) {
+        placement = ThreadPlacement::parse("main=" + std::to_string(topo.allowed().back()));
+    }
+    constexpr std::size_t arenaBytes = 4 << 20;
+    auto report = checkPlacement(topo, placement, {false, arenaBytes, arenaBytes});
+    report.print(stdout);
+
+    bool ok = parseCpuList("0-2,5,7-8\n") == std::vector<int>{0, 1, 2, 5, 7, 8};
+    try {
+        ThreadPlacement::parse("a=1,a=2");
+        ok = false;
+    } catch (std::invalid_argument const&) {}
+
+    placement.apply("main", topo);
+    std::printf("main pinned to cpu %d\n", ::sched_getcpu());
+    try {
+        Arena arena(arenaBytes, {.hugePages = true, .lock = true});
+        std::printf("arena locked: %zu KB%s\n", arena.capacity() >> 10, arena.hugeTlb() ? " on hugetlb pages" : "");
+    } catch (std::system_error const& e) {
+        std::printf("arena not locked: %s\n", e.what());
+    }
+    std::printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tsc.cpp"
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// In-process latency probes.
+///
+///     void BookThread::onPacket(...) {
+///         LATENCY_PROBE_SCOPE("book.apply");   // probe.cpp; no-op unless LATENCY_PROBES
+///         ...
+///     }
+///     latency::Reporter reporter(std::chrono::seconds(1));   // drains and prints
+///
+/// A scope reads the counter on entry and rdtscp on exit and appends one
+/// 8-byte sample to a ring owned by the recording thread: no locks, no
+/// shared cache lines with other recorders, and no histogram work on the
+/// hot path. The drain (the Reporter's thread, or drain() by hand) folds
+/// the samples into one HDR-style histogram per probe.
+namespace latency {
+
+struct Sample {
+    std::uint32_t probe;
+    std::uint32_t ticks;   // saturated at 2^32 - 1 (over a second at 3 GHz)
+};
+
+
+/// Log-linear histogram: values below 2^subBits are exact, above that each
+/// power of two is split into 2^subBits buckets, so any recorded value is
+/// off by less than 2^-subBits (0.8% at 7) of itself. Covers 2^40 ticks.
+class Histogram
+{
+public:
+    static constexpr int subBits = 7;
+    static constexpr int maxBits = 40;
+    static constexpr std::size_t bucketCount = ((maxBits - subBits + 1) << subBits);
+
+    void record(std::uint64_t value, std::uint64_t n = 1) noexcept {
+        value = std::min(value, (std::uint64_t{1} << maxBits) - 1);
+        buckets_[index(value)] += n;
+        count_ += n;
+        sum_ += value * n;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(Histogram const& other) noexcept {
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() noexcept { *this = Histogram{}; }
+
+    std::uint64_t count() const noexcept { return count_; }
+    std::uint64_t min() const noexcept { return count_ ? min_ : 0; }
+    std::uint64_t max() const noexcept { return max_; }
+    double mean() const noexcept { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0; }
+
+    /// Highest value in the bucket holding the q-quantile (clamped to max)
+    std::uint64_t quantile(double q) const noexcept {
+        if (count_ == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(q * static_cast<double>(count_ - 1));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            seen += buckets_[i];
+            if (seen > rank) {
+                return std::min(max_, upper(i));
+            }
+        }
+        return max_;
+    }
+
+    static std::size_t index(std::uint64_t v) noexcept {
+        int m = std::bit_width(v) - 1;
+        if (m < subBits) {
+            return static_cast<std::size_t>(v);
+        }
+        auto shift = m - subBits;
+        return (static_cast<std::size_t>(shift + 1) << subBits) + static_cast<std::size_t>((v >> shift) - (std::uint64_t{1} << subBits));
+    }
+
+    static std::uint64_t upper(std::size_t i) noexcept {
+        if (i < (std::size_t{1} << subBits)) {
+            return i;
+        }
+        auto shift = static_cast<int>(i >> subBits) - 1;
+        auto top = (std::uint64_t{1} << subBits) + (i & ((std::size_t{1} << subBits) - 1));
+        return ((top + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<std::uint64_t> buckets_ = std::vector<std::uint64_t>(bucketCount);
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t min_ = ~std::uint64_t{0};
+    std::uint64_t max_ = 0;
+};
+
+
+/// Single-producer ring of samples; the producer is the owning thread and
+/// the consumer whoever holds the registry lock.
+class ThreadBuffer
+{
+public:
+    static constexpr std::size_t capacity = std::size_t{1} << 16;
+
+    void push(Sample s) noexcept {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head - cachedTail_ == capacity) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head - cachedTail_ == capacity) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        ring_[head & (capacity - 1)] = s;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    template<typename F>
+    std::size_t drain(F&& f) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto head = head_.load(std::memory_order_acquire);
+        for (auto i = tail; i != head; ++i) {
+            f(ring_[i & (capacity - 1)]);
+        }
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    std::atomic<bool> retired{false};   // owning thread has exited
+
+private:
+    alignas(cacheLineSize) std::atomic<std::uint64_t> head_{0};
+    std::uint64_t cachedTail_ = 0;
+    std::atomic<std::uint64_t> dropped_{0};
+    alignas(cacheLineSize) std::atomic<std::uint64_t> tail_{0};
+    std::unique_ptr<Sample[]> ring_ = std::make_unique<Sample[]>(capacity);
+};
+
+
+/// Probe names, thread buffers and the per-probe histograms.
+class Registry
+{
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    /// Id for name; registering a name twice returns the same id.
+    std::uint32_t add(char const* name) {
+        std::lock_guard lock{mutex_};
+        for (std::size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name) {
+                return static_cast<std::uint32_t>(i);
+            }
+        }
+        names_.emplace_back(name);
+        histograms_.emplace_back();
+        return static_cast<std::uint32_t>(names_.size() - 1);
+    }
+
+    /// This thread's sample ring, registered on first use
+    ThreadBuffer& buffer() {
+        thread_local Handle handle{*this};
+        return *handle.buffer;
+    }
+
+    /// Fold every pending sample into the histograms.
+    /// @return the number of samples folded.
+    std::size_t drain() {
+        std::lock_guard lock{mutex_};
+        return drainLocked();
+    }
+
+    struct Summary {
+        std::string name;
+        Histogram histogram;
+    };
+
+    /// Drain, then copy out every probe's histogram; with reset the
+    /// histograms start over (interval reporting).
+    std::vector<Summary> snapshot(bool reset = false) {
+        std::lock_guard lock{mutex_};
+        drainLocked();
+        std::vector<Summary> out;
+        for (std::size_t i = 0; i < names_.size(); ++i) {
+            out.push_back({names_[i], histograms_[i]});
+            if (reset) {
+                histograms_[i].reset();
+            }
+        }
+        return out;
+    }
+
+    /// Samples lost to full thread buffers (drain more often if non-zero)
+    std::uint64_t dropped() {
+        std::lock_guard lock{mutex_};
+        auto n = retiredDropped_;
+        for (auto& b : buffers_) {
+            n += b->dropped();
+        }
+        return n;
+    }
+
+private:
+    struct Handle {
+        explicit Handle(Registry& r) : registry{r}, buffer{std::make_shared<ThreadBuffer>()} {
+            std::lock_guard lock{r.mutex_};
+            r.buffers_.push_back(buffer);
+        }
+        ~Handle() { buffer->retired.store(true, std::memory_order_release); }
+
+        Registry& registry;
+        std::shared_ptr<ThreadBuffer> buffer;
+    };
+
+    std::size_t drainLocked() {
+        std::size_t n = 0;
+        for (auto it = buffers_.begin(); it != buffers_.end();) {
+            auto& b = **it;
+            bool retired = b.retired.load(std::memory_order_acquire);
+            n += b.drain([&](Sample s) {
+                if (s.probe < histograms_.size()) {
+                    histograms_[s.probe].record(s.ticks);
+                }
+            });
+            if (retired) {
+                retiredDropped_ += b.dropped();
+                it = buffers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return n;
+    }
+
+    std::mutex mutex_;
+    std::vector<std::string> names_;
+    std::vector<Histogram> histograms_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+    std::uint64_t retiredDropped_ = 0;
+};
+
+
+/// A named measurement point; construct once (a function-local static)
+class Probe
+{
+public:
+    explicit Probe(char const* name) : id_{Registry::instance().add(name)} {}
+
+    std::uint32_t id() const noexcept { return id_; }
+
+private:
+    std::uint32_t id_;
+};
+
+/// Record ticks against probe from the calling thread.
+inline void record(Probe const& probe, std::uint64_t ticks) noexcept {
+    static thread_local ThreadBuffer* buffer = &Registry::instance().buffer();
+    buffer->push({probe.id(), static_cast<std::uint32_t>(std::min<std::uint64_t>(ticks, UINT32_MAX))});
+}
+
+/// Times its own lifetime into probe
+class Scope
+{
+public:
+    explicit Scope(Probe const& probe) noexcept : probe_{probe}, start_{readTsc()} {}
+
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+    ~Scope() { record(probe_, readTscp() - start_); }
+
+private:
+    Probe const& probe_;
+    std::uint64_t start_;
+};
+
+
+/// Print one line per probe: count, mean and p50/p99/p99.99/max in ns
+inline void print(std::vector<Registry::Summary> const& summaries, std::FILE* out = stderr) {
+    for (auto const& s : summaries) {
+        auto& h = s.histogram;
+        if (h.count() == 0) {
+            continue;
+        }
+        auto ns = [](std::uint64_t ticks) { return TscClock::toNs(ticks); };
+        std::fprintf(out, "%-24s n=%-10llu mean=%8.1fns p50=%8.1fns p99=%8.1fns p99.99=%9.1fns max=%10.1fns\n",
+                     s.name.c_str(), static_cast<unsigned long long>(h.count()), h.mean() * TscClock::nsPerTick(),
+                     ns(h.quantile(0.5)), ns(h.quantile(0.99)), ns(h.quantile(0.9999)), ns(h.max()));
+    }
+}
+
+/// Background drain and report thread. Samples are folded in every
+/// drainEvery so thread buffers never fill; a report is printed every
+/// interval (cumulative, or per-interval with reset) and once more on
+/// destruction.
+class Reporter
+{
+public:
+    explicit Reporter(std::chrono::milliseconds interval = std::chrono::seconds(1), std::FILE* out = stderr,
+                      bool resetEachInterval = false, std::chrono::microseconds drainEvery = std::chrono::milliseconds(1))
+        : interval_{interval}
+        , drainEvery_{drainEvery}
+        , out_{out}
+        , reset_{resetEachInterval}
+        , thread_{[this] { run(); }}
+    {}
+
+    Reporter(Reporter const&) = delete;
+    Reporter& operator=(Reporter const&) = delete;
+
+    ~Reporter() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        print(Registry::instance().snapshot(reset_), out_);
+    }
+
+private:
+    void run() {
+        auto next = std::chrono::steady_clock::now() + interval_;
+        std::unique_lock lock{mutex_};
+        while (not wake_.wait_for(lock, drainEvery_, [this] { return stop_; })) {
+            Registry::instance().drain();
+            if (std::chrono::steady_clock::now() >= next) {
+                print(Registry::instance().snapshot(reset_), out_);
+                next += interval_;
+            }
+        }
+    }
+
+    std::chrono::milliseconds interval_;
+    std::chrono::microseconds drainEvery_;
+    std::FILE* out_;
+    bool reset_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace latency
+
+
+#ifdef LATENCY_DEMO
+#include <random>
+
+#include "probe.cpp"
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+#include "../orderbook/order_book.cpp"
+
+// Probe cost, then the probes built into OrderBook and Fifo3 under a
+// background reporter.
+int main() {
+    constexpr int n = 2'000'000;
+    static latency::Probe const empty{"empty scope"};
+    auto t0 = readTscOrdered();
+    for (int i = 0; i < n; ++i) {
+        latency::Scope s{empty};
+        asm volatile("" ::: "memory");
+        if ((i & 4095) == 0) {
+            latency::Registry::instance().drain();
+        }
+    }
+    auto perScope = TscClock::toNs(readTscOrdered() - t0) / n;
+    std::printf("scope + record: %.1f ns each (%.3f ns/tick)\n", perScope, TscClock::nsPerTick());
+
+    {
+        latency::Reporter reporter(std::chrono::milliseconds(200), stdout);
+        OrderBook book;
+        Fifo3<std::uint64_t> fifo(1024);
+        std::mt19937_64 rng(1);
+        std::uint64_t id = 1, x;
+        for (int i = 0; i < n / 2; ++i) {
+            bool buy = rng() & 1;
+            book.add_order({id, buy, Price{(buy ? 9900 : 10100) - std::int64_t(rng() % 50) * (buy ? 1 : -1)}, 10, 0});
+            if (id > 1000) {
+                book.cancel_order(id - 1000);
+            }
+            ++id;
+            fifo.push(id);
+            fifo.pop(x);
+        }
+    }
+    std::printf("dropped %llu samples\n", static_cast<unsigned long long>(latency::Registry::instance().dropped()));
+
+    // Histogram resolution check
+    latency::Histogram h;
+    for (std::uint64_t v = 1; v <= 1'000'000; ++v) {
+        h.record(v);
+    }
+    auto p99 = h.quantile(0.99);
+    bool ok = p99 >= 990'000 && p99 <= 990'000 * 1.01 && h.quantile(0) == 1 && h.max() == 1'000'000;
+    std::printf("histogram p99 of 1..1e6: %llu (%s)\n", static_cast<unsigned long long>(p99), ok ? "ok" : "OFF");
+    return not ok;
+}
+#endif
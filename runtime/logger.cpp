@@ -0,0 +1,540 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "tsc.cpp"
+#include "../SPSC_QUEUES/cache_line.cpp"
+
+
+/// Asynchronous binary logger.
+///
+///     logging::Logger logger("book.log");        // background formatter
+///     LOG_INFO("top %s bid %.4f x %llu", symbol, bid, qty);
+///
+/// Each LOG_* call site registers once (a function-local static) with its
+/// level, format string and a decoder generated from its argument types. The
+/// calling thread then writes only the site id, a counter timestamp and the
+/// raw argument bytes into its own ring; strings are copied, everything else
+/// is memcpy'd. Formatting, timestamps and file I/O all happen on the
+/// Logger's thread. A full ring drops the record and counts it: the hot
+/// thread never blocks and never allocates after its first record.
+///
+/// Formats are printf formats and are checked against the arguments at
+/// compile time; std::string and std::string_view arguments print with %s.
+namespace logging {
+
+enum class Level : std::uint8_t { Debug, Info, Warn, Error };
+
+inline char const* levelName(Level level) noexcept {
+    constexpr char const* names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+    return names[static_cast<int>(level)];
+}
+
+namespace detail {
+
+template<typename T>
+inline constexpr bool isString = std::is_same_v<T, char const*> || std::is_same_v<T, char*>
+                              || std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+template<typename T>
+std::string_view asView(T const& v) noexcept {
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+        return v;
+    } else {
+        return v != nullptr ? std::string_view{v} : std::string_view{"(null)"};
+    }
+}
+
+/// Encoded size of one argument: raw bytes, or u32 length + bytes + NUL
+template<typename T>
+std::size_t encodedSize(T const& v) noexcept {
+    if constexpr (isString<T>) {
+        return sizeof(std::uint32_t) + asView(v).size() + 1;
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>, "log arguments must be scalars or strings");
+        return sizeof(T);
+    }
+}
+
+template<typename T>
+std::byte* encode(std::byte* p, T const& v) noexcept {
+    if constexpr (isString<T>) {
+        auto s = asView(v);
+        auto n = static_cast<std::uint32_t>(s.size());
+        std::memcpy(p, &n, sizeof(n));
+        std::memcpy(p + sizeof(n), s.data(), n);
+        p[sizeof(n) + n] = std::byte{0};
+        return p + sizeof(n) + n + 1;
+    } else {
+        std::memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+}
+
+/// What the printf call on the formatting side receives for a T
+template<typename T>
+using Printed = std::conditional_t<isString<T>, char const*, T>;
+
+template<typename T>
+Printed<T> decode(std::byte const*& p) noexcept {
+    if constexpr (isString<T>) {
+        std::uint32_t n;
+        std::memcpy(&n, p, sizeof(n));
+        auto s = reinterpret_cast<char const*>(p + sizeof(n));
+        p += sizeof(n) + n + 1;
+        return s;
+    } else {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+}
+
+/// printf-compatible stand-in for an argument, for the compile-time check
+template<typename T>
+auto printable(T const& v) noexcept {
+    if constexpr (isString<std::decay_t<T>>) {
+        return asView<std::decay_t<T>>(v).data();
+    } else {
+        return v;
+    }
+}
+
+[[gnu::format(printf, 1, 2)]] inline void checkFormat(char const*, ...) noexcept {}
+
+using FormatFn = void (*)(std::FILE*, char const* format, std::byte const* args);
+
+template<typename... Args>
+struct Types {
+    static void format(std::FILE* out, char const* fmt, std::byte const* p) {
+        if constexpr (sizeof...(Args) == 0) {
+            std::fputs(fmt, out);
+        } else {
+            // Braced init evaluates the decodes left to right
+            std::tuple<Printed<Args>...> values{decode<Args>(p)...};
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+            std::apply([&](auto... v) { std::fprintf(out, fmt, v...); }, values);
+#pragma GCC diagnostic pop
+        }
+    }
+};
+
+template<typename... Args>
+Types<std::decay_t<Args>...> typesOf(Args&&...);   // unevaluated only
+
+struct Site {
+    Level level;
+    char const* format;
+    char const* file;
+    int line;
+    FormatFn formatFn;
+};
+
+struct RecordHeader {
+    std::uint32_t site;      // skipSite: padding to the end of the ring
+    std::uint32_t size;      // whole record, header included, multiple of 16
+    std::uint64_t tsc;
+};
+
+inline constexpr std::uint32_t skipSite = ~std::uint32_t{0};
+inline constexpr std::size_t recordAlign = 16;
+
+/// Per-thread ring of variable-length records; one producer (the owning
+/// thread), one consumer (the Logger thread).
+class Ring
+{
+public:
+    static constexpr std::size_t capacity = std::size_t{1} << 20;
+
+    /// Space for a record of size bytes (header included), or nullptr if
+    /// the ring is too full. Follow with commit().
+    std::byte* reserve(std::size_t size) noexcept {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto pos = head & (capacity - 1);
+        auto room = capacity - pos;
+        auto need = size <= room ? size : room + size;   // skip to the start when it doesn't fit
+        if (capacity - (head - cachedTail_) < need) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (capacity - (head - cachedTail_) < need) {
+                drop();
+                return nullptr;
+            }
+        }
+        if (need != size) {
+            RecordHeader skip{skipSite, static_cast<std::uint32_t>(room), 0};
+            std::memcpy(ring_.get() + pos, &skip, sizeof(skip));
+            pos = 0;
+        }
+        pending_ = need;
+        return ring_.get() + pos;
+    }
+
+    void commit() noexcept { head_.store(head_.load(std::memory_order_relaxed) + pending_, std::memory_order_release); }
+
+    /// Consumer: f(header, args) for each committed record
+    template<typename F>
+    std::size_t drain(F&& f) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto head = head_.load(std::memory_order_acquire);
+        std::size_t records = 0;
+        while (tail != head) {
+            RecordHeader h;
+            auto p = ring_.get() + (tail & (capacity - 1));
+            std::memcpy(&h, p, sizeof(h));
+            if (h.site != skipSite) {
+                f(h, p + sizeof(h));
+                ++records;
+            }
+            tail += h.size;
+        }
+        tail_.store(tail, std::memory_order_release);
+        return records;
+    }
+
+    /// Count a record the producer could not write
+    void drop() noexcept { dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    std::atomic<bool> retired{false};
+
+private:
+    alignas(cacheLineSize) std::atomic<std::uint64_t> head_{0};
+    std::uint64_t cachedTail_ = 0;
+    std::size_t pending_ = 0;
+    std::atomic<std::uint64_t> dropped_{0};
+    alignas(cacheLineSize) std::atomic<std::uint64_t> tail_{0};
+    std::unique_ptr<std::byte[]> ring_ = std::make_unique<std::byte[]>(capacity);
+};
+
+/// Call sites and thread rings
+class Registry
+{
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    std::uint32_t addSite(Site site) {
+        std::lock_guard lock{mutex_};
+        sites_.push_back(site);
+        return static_cast<std::uint32_t>(sites_.size() - 1);
+    }
+
+    Ring& ring() {
+        thread_local Handle handle{*this};
+        return *handle.ring;
+    }
+
+    /// Consumer: hand every pending record to f(site, header, args).
+    template<typename F>
+    std::size_t drain(F&& f) {
+        std::lock_guard lock{mutex_};
+        std::size_t n = 0;
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            auto& r = **it;
+            bool retired = r.retired.load(std::memory_order_acquire);
+            n += r.drain([&](RecordHeader const& h, std::byte const* args) { f(sites_[h.site], h, args); });
+            if (retired) {
+                retiredDropped_ += r.dropped();
+                it = rings_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return n;
+    }
+
+    std::uint64_t dropped() {
+        std::lock_guard lock{mutex_};
+        auto n = retiredDropped_;
+        for (auto& r : rings_) {
+            n += r->dropped();
+        }
+        return n;
+    }
+
+private:
+    struct Handle {
+        explicit Handle(Registry& registry) : ring{std::make_shared<Ring>()} {
+            std::lock_guard lock{registry.mutex_};
+            registry.rings_.push_back(ring);
+        }
+        ~Handle() { ring->retired.store(true, std::memory_order_release); }
+
+        std::shared_ptr<Ring> ring;
+    };
+
+    std::mutex mutex_;
+    std::deque<Site> sites_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::uint64_t retiredDropped_ = 0;
+};
+
+inline std::atomic<Level> minLevel{Level::Info};
+
+} // namespace detail
+
+
+/// Records below level are skipped at the call site.
+inline void setLevel(Level level) noexcept { detail::minLevel.store(level, std::memory_order_relaxed); }
+
+inline bool enabled(Level level) noexcept { return level >= detail::minLevel.load(std::memory_order_relaxed); }
+
+inline std::uint32_t registerSite(Level level, char const* format, char const* file, int line,
+                                  detail::FormatFn fn) {
+    return detail::Registry::instance().addSite({level, format, file, line, fn});
+}
+
+/// Hot path: one record into this thread's ring, or a counted drop.
+template<typename... Args>
+void write(std::uint32_t site, Args const&... args) noexcept {
+    static thread_local detail::Ring* ring = &detail::Registry::instance().ring();
+    auto size = (sizeof(detail::RecordHeader) + ... + detail::encodedSize<std::decay_t<Args>>(args));
+    size = (size + detail::recordAlign - 1) & ~(detail::recordAlign - 1);
+    if (size > detail::Ring::capacity / 4) [[unlikely]] {
+        ring->drop();
+        return;
+    }
+    auto* p = ring->reserve(size);
+    if (p == nullptr) [[unlikely]] {
+        return;
+    }
+    detail::RecordHeader h{site, static_cast<std::uint32_t>(size), readTsc()};
+    std::memcpy(p, &h, sizeof(h));
+    [[maybe_unused]] auto* q = p + sizeof(h);
+    ((q = detail::encode<std::decay_t<Args>>(q, args)), ...);
+    ring->commit();
+}
+
+/// Records lost to full rings since start
+inline std::uint64_t dropped() { return detail::Registry::instance().dropped(); }
+
+
+/// Background formatter: every pollEvery it drains all thread rings into
+/// out, prefixing each line with UTC time of day to the nanosecond, the
+/// level and the call site. The destructor drains what is left.
+class Logger
+{
+public:
+    explicit Logger(std::FILE* out, std::chrono::microseconds pollEvery = std::chrono::microseconds(200))
+        : out_{out}
+        , pollEvery_{pollEvery}
+    {
+        start();
+    }
+
+    explicit Logger(std::string const& path, std::chrono::microseconds pollEvery = std::chrono::microseconds(200))
+        : out_{std::fopen(path.c_str(), "a")}
+        , owned_{true}
+        , pollEvery_{pollEvery}
+    {
+        if (out_ == nullptr) {
+            throw std::runtime_error("Logger: cannot open " + path);
+        }
+        std::setvbuf(out_, nullptr, _IOFBF, 1 << 20);
+        start();
+    }
+
+    Logger(Logger const&) = delete;
+    Logger& operator=(Logger const&) = delete;
+
+    ~Logger() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        flush();
+        if (owned_) {
+            std::fclose(out_);
+        }
+    }
+
+    /// Format everything logged so far; safe from any thread.
+    std::size_t flush() {
+        std::lock_guard lock{flushMutex_};
+        auto n = detail::Registry::instance().drain(
+            [&](detail::Site const& site, detail::RecordHeader const& h, std::byte const* args) { print(site, h, args); });
+        if (n != 0) {
+            std::fflush(out_);
+        }
+        written_ += n;
+        return n;
+    }
+
+    /// Lines written so far
+    std::uint64_t written() const noexcept { return written_; }
+
+private:
+    void start() {
+        tsc0_ = readTsc();
+        wall0_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count();
+        thread_ = std::thread{[this] { run(); }};
+    }
+
+    void run() {
+        std::unique_lock lock{mutex_};
+        while (not wake_.wait_for(lock, pollEvery_, [this] { return stop_; })) {
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    void print(detail::Site const& site, detail::RecordHeader const& h, std::byte const* args) {
+        auto delta = static_cast<std::int64_t>(h.tsc - tsc0_);
+        auto ns = wall0_ + static_cast<std::int64_t>(static_cast<double>(delta) * TscClock::nsPerTick());
+        auto secs = static_cast<std::time_t>(ns / 1'000'000'000);
+        std::tm tm;
+        ::gmtime_r(&secs, &tm);
+        auto file = std::strrchr(site.file, '/');
+        std::fprintf(out_, "%02d:%02d:%02d.%09lld %s %s:%d ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     static_cast<long long>(ns % 1'000'000'000), levelName(site.level), file ? file + 1 : site.file,
+                     site.line);
+        site.formatFn(out_, site.format, args);
+        std::fputc('\n', out_);
+    }
+
+    std::FILE* out_;
+    bool owned_ = false;
+    std::chrono::microseconds pollEvery_;
+    std::uint64_t tsc0_ = 0;
+    std::int64_t wall0_ = 0;
+    std::mutex flushMutex_;
+    std::uint64_t written_ = 0;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace logging
+
+
+#define LOG_AT(level, fmt, ...)                                                                              \
+    do {                                                                                                     \
+        if (false) {                                                                                         \
+            [](auto const&... logArgs_) {                                                                    \
+                ::logging::detail::checkFormat(fmt, ::logging::detail::printable(logArgs_)...);              \
+            }(__VA_ARGS__);                                                                                  \
+        }                                                                                                    \
+        if (::logging::enabled(level)) {                                                                     \
+            static std::uint32_t const logSite_ = ::logging::registerSite(                                   \
+                level, fmt, __FILE__, __LINE__, &decltype(::logging::detail::typesOf(__VA_ARGS__))::format); \
+            ::logging::write(logSite_ __VA_OPT__(, ) __VA_ARGS__);                                           \
+        }                                                                                                    \
+    } while (0)
+
+#define LOG_DEBUG(fmt, ...) LOG_AT(::logging::Level::Debug, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_INFO(fmt, ...) LOG_AT(::logging::Level::Info, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_WARN(fmt, ...) LOG_AT(::logging::Level::Warn, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_AT(::logging::Level::Error, fmt __VA_OPT__(, ) __VA_ARGS__)
+
+
+#ifdef LOGGER_DEMO
+// g++ -std=c++20 -O2 -march=native -pthread -DLOGGER_DEMO -x c++ logger.cpp -o logger
+//
+// Times LOG_INFO on a book-update shaped record against fprintf of the same
+// line, then has several threads log concurrently and checks that every line
+// reached the file or was counted as dropped.
+#include <cinttypes>
+
+int main() {
+    using Clock = std::chrono::steady_clock;
+    constexpr int n = 200'000;
+    char const* path = "/tmp/logger_demo.log";
+    std::remove(path);
+
+    std::uint64_t logged = 0;
+    double asyncNs = 0;
+    {
+        logging::Logger logger(path);
+        std::string_view symbol = "ESZ6";
+        for (int round = 0; round < 100; ++round) {
+            auto t0 = Clock::now();
+            for (int i = 0; i < n / 100; ++i) {
+                LOG_INFO("book %s seq=%d bid=%.4f x %" PRIu64 " ask=%.4f", symbol, i, 100.25 + i * 1e-4,
+                         std::uint64_t(i % 500), 100.5);
+            }
+            asyncNs += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+            logged += n / 100;
+            // Let the formatter keep up between bursts the way it would between book updates
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 3; ++t) {
+            threads.emplace_back([t] {
+                for (int i = 0; i < 20'000; ++i) {
+                    LOG_WARN("thread %d message %d", t, i);
+                }
+                LOG_ERROR("thread done");
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        logged += 3 * 20'001;
+        // Too big for any ring: dropped, and counted like a full ring's drop
+        std::string oversized(logging::detail::Ring::capacity / 2, 'x');
+        LOG_WARN("oversized %s", std::string_view(oversized));
+        logged += 1;
+        LOG_DEBUG("filtered out at the default level %d", 1);
+    }
+
+    double syncNs;
+    {
+        std::FILE* out = std::fopen("/tmp/logger_demo_sync.log", "w");
+        auto t0 = Clock::now();
+        for (int i = 0; i < n; ++i) {
+            std::fprintf(out, "book %s seq=%d bid=%.4f x %" PRIu64 " ask=%.4f\n", "ESZ6", i, 100.25 + i * 1e-4,
+                         std::uint64_t(i % 500), 100.5);
+        }
+        syncNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+        std::fclose(out);
+        std::remove("/tmp/logger_demo_sync.log");
+    }
+
+    std::FILE* in = std::fopen(path, "r");
+    std::uint64_t lines = 0;
+    char line[512];
+    bool formatted = false;
+    while (std::fgets(line, sizeof(line), in)) {
+        ++lines;
+        formatted |= std::strstr(line, "INFO  logger.cpp") != nullptr && std::strstr(line, "book ESZ6 seq=7 bid=100.2507 x 7 ask=100.5000");
+    }
+    std::fclose(in);
+
+    auto dropped = logging::dropped();
+    std::printf("LOG_INFO  %6.1f ns/call (hot thread)\n", asyncNs / n);
+    std::printf("fprintf   %6.1f ns/call\n", syncNs / n);
+    std::printf("%" PRIu64 " logged, %" PRIu64 " lines, %" PRIu64 " dropped\n", logged, lines, dropped);
+    bool ok = formatted && lines + dropped == logged;
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+#endif
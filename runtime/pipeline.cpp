@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../SPSC_QUEUES/spsc_q3.cpp"
+#include "../SPSC_QUEUES/wait_strategy.cpp"
+#include "cpu_topology.cpp"
+#include "latency.cpp"
+#include "tsc.cpp"
+
+
+/// A value travelling down a pipeline with the counter reading taken when
+/// its input entered the process (packet receive, normally).
+template<typename T>
+struct Stamped {
+    T value;
+    std::uint64_t ingressTsc;
+};
+
+/// Ring between two stages: a Fifo3 plus the producer's end-of-stream flag.
+template<typename T>
+class StageRing
+{
+public:
+    explicit StageRing(std::size_t capacity) : fifo_{capacity} {}
+
+    Fifo3<Stamped<T>>& fifo() noexcept { return fifo_; }
+
+    void close() noexcept { closed_.store(true, std::memory_order_release); }
+    bool closed() const noexcept { return closed_.load(std::memory_order_acquire); }
+
+private:
+    Fifo3<Stamped<T>> fifo_;
+    std::atomic<bool> closed_{false};
+};
+
+/// Per-stage counters, written only by the stage's thread. Read them after
+/// Pipeline::stop().
+struct StageStats {
+    std::string name;
+    std::uint64_t processed = 0;     // inputs consumed (sources: emits)
+    std::uint64_t emitted = 0;
+    std::uint64_t fullStalls = 0;    // emits that found the output ring full
+    std::uint64_t stallTicks = 0;    // time spent waiting on a full output
+    std::uint64_t idlePolls = 0;     // polls that found the input empty
+    latency::Histogram latency;      // ingress -> stage exit, in ticks
+};
+
+/// What a stage writes its results to. emit() blocks while the downstream
+/// ring is full and charges the wait to the stage's backpressure counters.
+/// A source's output also records ingress -> emit as the source's latency.
+template<typename T>
+class StageOutput
+{
+public:
+    StageOutput(StageRing<T>& ring, StageStats& stats, bool recordLatency = false)
+        : ring_{ring}
+        , stats_{stats}
+        , recordLatency_{recordLatency}
+    {}
+
+    void emit(T const& value, std::uint64_t ingressTsc) {
+        auto& fifo = ring_.fifo();
+        if (not fifo.emplace(Stamped<T>{value, ingressTsc})) [[unlikely]] {
+            ++stats_.fullStalls;
+            auto start = readTsc();
+            for (std::size_t spins = 0; not fifo.emplace(Stamped<T>{value, ingressTsc}); ++spins) {
+                spins < 1024 ? cpuRelax() : std::this_thread::yield();
+            }
+            stats_.stallTicks += readTsc() - start;
+        }
+        ++stats_.emitted;
+        if (recordLatency_) {
+            stats_.latency.record(readTscOrdered() - ingressTsc);
+        }
+    }
+
+private:
+    StageRing<T>& ring_;
+    StageStats& stats_;
+    bool recordLatency_;
+};
+
+struct StageOptions {
+    int cpu = -1;                    // pin to this cpu; -1 leaves affinity alone
+    std::size_t idleSpins = 1024;    // empty polls before yielding; 0 never yields
+};
+
+
+/// Threads and rings of a feed -> book -> strategy style process.
+///
+/// Each stage gets its own thread, optionally pinned, and talks to its
+/// neighbours only through StageRing<T>s:
+///
+///     auto& ticks = p.ring<BookMsg>(1 << 16);
+///     auto& signals = p.ring<Signal>(1 << 12);
+///     p.source("feed", {1}, ticks, [&](StageOutput<BookMsg>& out) { ...; return more; });
+///     p.stage("book", {2}, ticks, signals, [&](Stamped<BookMsg> const& in, StageOutput<Signal>& out) { ... });
+///     p.sink("strategy", {3}, signals, [&](Stamped<Signal> const& in) { ... });
+///     p.start(); ...; p.stop(); p.report();
+///
+/// Every value carries the ingress counter its source stamped, so each
+/// stage records ingress -> exit latency and the sink's histogram is the
+/// wire-to-decision time. Shutdown drains: a source ends when its callback
+/// returns false or stop() is called, then closes its ring, and each stage
+/// finishes its input before closing its own output.
+class Pipeline
+{
+public:
+    Pipeline() = default;
+    Pipeline(Pipeline const&) = delete;
+    Pipeline& operator=(Pipeline const&) = delete;
+
+    ~Pipeline() { stop(); }
+
+    template<typename T>
+    StageRing<T>& ring(std::size_t capacity) {
+        auto ring = std::make_shared<StageRing<T>>(capacity);
+        auto& ref = *ring;
+        rings_.push_back(std::move(ring));
+        return ref;
+    }
+
+    /// f(StageOutput<Out>&) -> bool, called until it returns false or
+    /// stop(); stamp values with readTsc() as they arrive.
+    template<typename Out, typename F>
+    void source(std::string name, StageOptions options, StageRing<Out>& out, F f) {
+        auto& stats = addStage(std::move(name));
+        add(options, [this, &out, &stats, f = std::move(f)]() mutable {
+            StageOutput<Out> output{out, stats, true};
+            while (not stopping_.load(std::memory_order_relaxed) && f(output)) {}
+            stats.processed = stats.emitted;
+            out.close();
+        });
+    }
+
+    /// f(Stamped<In> const&, StageOutput<Out>&) for every input
+    template<typename In, typename Out, typename F>
+    void stage(std::string name, StageOptions options, StageRing<In>& in, StageRing<Out>& out, F f) {
+        auto& stats = addStage(std::move(name));
+        add(options, [&in, &out, &stats, options, f = std::move(f)]() mutable {
+            StageOutput<Out> output{out, stats};
+            consume(in, stats, options, [&](Stamped<In> const& v) { f(v, output); });
+            out.close();
+        });
+    }
+
+    /// f(Stamped<In> const&) for every input
+    template<typename In, typename F>
+    void sink(std::string name, StageOptions options, StageRing<In>& in, F f) {
+        auto& stats = addStage(std::move(name));
+        add(options, [&in, &stats, options, f = std::move(f)]() mutable { consume(in, stats, options, f); });
+    }
+
+    /// Launch every stage; they start consuming together.
+    void start() {
+        for (auto& s : pending_) {
+            threads_.emplace_back([this, s = std::move(s)] {
+                pin(s.options.cpu);
+                while (not started_.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                s.body();
+            });
+        }
+        pending_.clear();
+        started_.store(true, std::memory_order_release);
+    }
+
+    /// Wait for sources to finish on their own and the pipeline to drain.
+    void join() {
+        for (auto& t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+    }
+
+    /// Stop the sources, drain and join.
+    void stop() {
+        stopping_.store(true, std::memory_order_relaxed);
+        join();
+    }
+
+    std::vector<std::unique_ptr<StageStats>> const& stats() const noexcept { return stats_; }
+
+    /// One line per stage: counts, backpressure and latency percentiles
+    void report(std::FILE* out = stdout) const {
+        for (auto const& p : stats_) {
+            auto& s = *p;
+            auto ns = [&](double q) { return TscClock::toNs(s.latency.quantile(q)); };
+            std::fprintf(out,
+                         "%-10s in %10llu out %10llu  full %8llu (%7.3f ms)  idle %10llu  "
+                         "p50 %8.0fns p99 %8.0fns p99.99 %9.0fns max %10.0fns\n",
+                         s.name.c_str(), static_cast<unsigned long long>(s.processed),
+                         static_cast<unsigned long long>(s.emitted), static_cast<unsigned long long>(s.fullStalls),
+                         TscClock::toNs(s.stallTicks) / 1e6, static_cast<unsigned long long>(s.idlePolls), ns(0.5),
+                         ns(0.99), ns(0.9999), TscClock::toNs(s.latency.max()));
+        }
+    }
+
+private:
+    struct Pending {
+        StageOptions options;
+        std::function<void()> body;
+    };
+
+    StageStats& addStage(std::string name) {
+        if (started_.load(std::memory_order_relaxed)) {
+            throw std::logic_error("Pipeline: stages must be added before start()");
+        }
+        stats_.push_back(std::make_unique<StageStats>());
+        stats_.back()->name = std::move(name);
+        return *stats_.back();
+    }
+
+    void add(StageOptions options, std::function<void()> body) { pending_.push_back({options, std::move(body)}); }
+
+    /// Process inputs in place until the ring is closed and empty.
+    template<typename In, typename F>
+    static void consume(StageRing<In>& in, StageStats& stats, StageOptions options, F&& f) {
+        auto& fifo = in.fifo();
+        std::size_t idle = 0;
+        for (;;) {
+            auto* v = fifo.front();
+            if (v == nullptr) {
+                if (in.closed() && fifo.empty()) {
+                    return;
+                }
+                ++stats.idlePolls;
+                if (options.idleSpins != 0 && ++idle > options.idleSpins) {
+                    std::this_thread::yield();
+                } else {
+                    cpuRelax();
+                }
+                continue;
+            }
+            idle = 0;
+            f(*v);
+            stats.latency.record(readTscOrdered() - v->ingressTsc);
+            ++stats.processed;
+            fifo.pop();
+        }
+    }
+
+    static void pin(int cpu) {
+        if (cpu >= 0) {
+            tryPinCurrentThread(cpu);                             // best effort, as before
+        }
+    }
+
+    std::vector<std::shared_ptr<void>> rings_;
+    std::vector<std::unique_ptr<StageStats>> stats_;
+    std::vector<Pending> pending_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> started_{false};
+    std::atomic<bool> stopping_{false};
+};
+
+
+#ifdef PIPELINE_DEMO
+#include "../orderbook/order_book.cpp"
+
+// Feed -> book -> strategy: the book stage emits the top of book whenever it
+// changes and the strategy "decides" on a crossed-mid signal.
+struct TopChange {
+    Price bid, ask;
+};
+
+int main(int argc, char** argv) {
+    std::uint64_t messages = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+    unsigned cpus = std::thread::hardware_concurrency();
+    auto cpu = [&](int c) { return StageOptions{cpus > 3 ? c : -1}; };
+
+    Pipeline p;
+    auto& msgs = p.ring<BookMsg>(1 << 14);
+    auto& tops = p.ring<TopChange>(1 << 12);
+
+    std::uint64_t i = 0, nextId = 1;
+    std::mt19937_64 rng(9);
+    std::vector<std::uint64_t> live;
+    p.source("feed", cpu(1), msgs, [&](StageOutput<BookMsg>& out) {
+        auto r = rng() % 100;
+        BookMsg m{};
+        if (live.empty() || r < 55) {
+            m.type = MsgType::Add;
+            m.is_buy = rng() & 1;
+            m.order_id = nextId++;
+            m.price = Price::from_double(100) + Price{(m.is_buy ? -1 : 1) * std::int64_t(1 + rng() % 10) * 100};
+            m.quantity = 1 + rng() % 100;
+            live.push_back(m.order_id);
+        } else {
+            auto k = rng() % live.size();
+            m.type = MsgType::Cancel;
+            m.order_id = live[k];
+            live[k] = live.back();
+            live.pop_back();
+        }
+        out.emit(m, readTsc());
+        return ++i < messages;
+    });
+
+    OrderBook book;
+    Price lastBid{}, lastAsk{};
+    p.stage("book", cpu(2), msgs, tops, [&](Stamped<BookMsg> const& in, StageOutput<TopChange>& out) {
+        auto& m = in.value;
+        if (m.type == MsgType::Add) {
+            book.add_order({m.order_id, m.is_buy, m.price, m.quantity, 0});
+        } else {
+            book.cancel_order(m.order_id);
+        }
+        auto bid = book.best_bid(), ask = book.best_ask();
+        Price b = bid ? bid->price : Price{}, a = ask ? ask->price : Price{};
+        if (b != lastBid || a != lastAsk) {
+            lastBid = b;
+            lastAsk = a;
+            out.emit({b, a}, in.ingressTsc);
+        }
+    });
+
+    std::uint64_t decisions = 0;
+    p.sink("strategy", cpu(3), tops, [&](Stamped<TopChange> const& in) {
+        decisions += (in.value.ask - in.value.bid).ticks <= 200;
+    });
+
+    auto t0 = std::chrono::steady_clock::now();
+    p.start();
+    p.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%llu messages in %.3f s (%.2f M msgs/s), %llu top changes, %llu tight-spread decisions\n",
+                static_cast<unsigned long long>(messages), secs, messages / secs / 1e6,
+                static_cast<unsigned long long>(p.stats()[1]->emitted), static_cast<unsigned long long>(decisions));
+    p.report();
+    bool ok = p.stats()[1]->processed == messages && p.stats()[2]->processed == p.stats()[1]->emitted;
+    return not ok;
+}
+#endif
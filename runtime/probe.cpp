@@ -0,0 +1,17 @@
+#pragma once
+
+/// LATENCY_PROBE_SCOPE("name") times the rest of the enclosing block into
+/// the latency probe of that name (latency.cpp) when built with
+/// -DLATENCY_PROBES, and compiles to nothing otherwise, so hot paths can
+/// carry probes permanently.
+#ifdef LATENCY_PROBES
+#include "latency.cpp"
+
+#define LATENCY_CONCAT_(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_(a, b)
+#define LATENCY_PROBE_SCOPE(name)                                                   \
+    static ::latency::Probe const LATENCY_CONCAT(latencyProbe_, __LINE__){name};    \
+    ::latency::Scope const LATENCY_CONCAT(latencyScope_, __LINE__){LATENCY_CONCAT(latencyProbe_, __LINE__)}
+#else
+#define LATENCY_PROBE_SCOPE(name) static_cast<void>(0)
+#endif
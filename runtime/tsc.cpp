@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+/// Timestamp counter read for stamping: a plain rdtsc, which may execute a
+/// little early relative to surrounding loads. Falls back to steady_clock
+/// nanoseconds off x86.
+inline std::uint64_t readTsc() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/// rdtsc that waits for earlier instructions to complete, for the end of a
+/// timed region.
+inline std::uint64_t readTscOrdered() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#else
+    return readTsc();
+#endif
+}
+
+/// rdtscp: waits for earlier instructions to retire before reading, so it
+/// closes a timed region without a separate fence; later instructions may
+/// still start early.
+inline std::uint64_t readTscp() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    return __rdtscp(&aux);
+#else
+    return readTsc();
+#endif
+}
+
+/// Conversion from counter ticks to nanoseconds. Calibrated once against
+/// steady_clock on first use (about 20 ms); assumes an invariant TSC.
+class TscClock
+{
+public:
+    static double nsPerTick() noexcept {
+        static double const value = calibrate();
+        return value;
+    }
+
+    static double toNs(std::uint64_t ticks) noexcept { return static_cast<double>(ticks) * nsPerTick(); }
+
+    static std::uint64_t fromNs(double ns) noexcept { return static_cast<std::uint64_t>(ns / nsPerTick()); }
+
+private:
+    static double calibrate() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        auto t0 = std::chrono::steady_clock::now();
+        auto c0 = readTscOrdered();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto c1 = readTscOrdered();
+        auto t1 = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(c1 - c0);
+#else
+        return 1.0;
+#endif
+    }
+};
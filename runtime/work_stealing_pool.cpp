@@ -0,0 +1,393 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../lockFreeWaitFree/chaseLevDeque.cpp"
+#include "../SPSC_QUEUES/mpmc_q.cpp"
+#include "../SPSC_QUEUES/wait_strategy.cpp"
+#include "../SPSC_QUEUES/cache_line.cpp"
+#include "cpu_topology.cpp"
+
+
+struct WorkStealingPoolOptions {
+    std::size_t threads = std::thread::hardware_concurrency();
+    std::vector<int> cpus;                // worker i pins to cpus[i % size]; empty: no pinning
+    std::size_t injectCapacity = 4096;    // pending external submissions
+    std::size_t idleSpins = 256;          // empty rounds before sleeping
+};
+
+/// Work-stealing executor for coarse, independent jobs (a backtest per
+/// symbol-day, say) that may split themselves further.
+///
+/// Every worker owns a ChaseLevDeque. Work submitted from inside a task goes
+/// on the submitting worker's deque; work from other threads goes through a
+/// shared MpmcFifo. An idle worker checks its own deque, then the shared
+/// fifo, then steals from the top of the others' deques, oldest (largest)
+/// pieces first. After idleSpins fruitless rounds it sleeps on a futex until
+/// something is submitted. parallelFor() splits ranges recursively, so a
+/// worker that runs out steals half of someone else's remaining range.
+///
+/// Results are merged without locks: map() gives each index its own result
+/// slot, and workerIndex() lets tasks keep per-worker partials.
+class WorkStealingPool
+{
+public:
+    using Options = WorkStealingPoolOptions;
+
+    struct WorkerStats {
+        std::uint64_t executed;
+        std::uint64_t stolen;                 // of those, taken from another worker
+    };
+
+    explicit WorkStealingPool(Options options = {})
+        : options_{std::move(options)}
+        , inject_{options_.injectCapacity}
+    {
+        auto n = options_.threads == 0 ? std::size_t{1} : options_.threads;
+        workers_.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            workers_[i]->thread = std::thread{[this, i] { run(i); }};
+        }
+    }
+
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+
+    /// Finishes everything submitted, then stops the workers.
+    ~WorkStealingPool() {
+        waitIdle();
+        stopping_.store(true, std::memory_order_seq_cst);
+        wake(true);
+        for (auto& w : workers_) {
+            w->thread.join();
+        }
+    }
+
+    std::size_t threadCount() const noexcept { return workers_.size(); }
+
+    /// Index of the calling worker in this or any pool, -1 off the pool.
+    static int workerIndex() noexcept { return current().index; }
+
+    /// Queue f() to run on some worker; callable from any thread, including
+    /// from inside a running task.
+    template<typename F>
+    void submit(F&& f) {
+        auto* task = new TaskImpl<std::decay_t<F>>{std::forward<F>(f)};
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        auto& self = current();
+        if (self.pool == this) {
+            workers_[self.index]->deque.push(task);
+        } else {
+            for (std::size_t spins = 0; not inject_.emplace(task); ++spins) {
+                spins < 1024 ? cpuRelax() : std::this_thread::yield();
+            }
+        }
+        wake(false);
+    }
+
+    /// Block until every submitted task, and everything they submitted, has
+    /// run; rethrows the first exception a task threw. Not from a worker.
+    void wait() {
+        waitIdle();
+        if (failed_.load(std::memory_order_acquire)) {
+            failed_.store(false, std::memory_order_relaxed);
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    /// f(i) for every i in [begin, end), in chunks of at most grain. The
+    /// range is halved recursively, the upper halves left for thieves.
+    template<typename F>
+    void parallelFor(std::size_t begin, std::size_t end, F f, std::size_t grain = 1) {
+        if (begin < end) {
+            split(begin, end, grain == 0 ? 1 : grain, std::make_shared<F>(std::move(f)));
+        }
+        wait();
+    }
+
+    /// f(i) for every i in [0, n), result i in slot i of the returned vector:
+    /// each slot has one writer, so nothing is locked.
+    template<typename R, typename F>
+    std::vector<R> map(std::size_t n, F f, std::size_t grain = 1) {
+        std::vector<R> out(n);
+        parallelFor(0, n, [&out, &f](std::size_t i) { out[i] = f(i); }, grain);
+        return out;
+    }
+
+    /// Per-worker counters; exact once the pool is idle.
+    std::vector<WorkerStats> stats() const {
+        std::vector<WorkerStats> out;
+        for (auto& w : workers_) {
+            out.push_back({w->executed.load(std::memory_order_relaxed), w->stolen.load(std::memory_order_relaxed)});
+        }
+        return out;
+    }
+
+private:
+    struct Task {
+        void (*invoke)(Task*);
+    };
+
+    template<typename F>
+    struct TaskImpl : Task {
+        F f;
+
+        explicit TaskImpl(F fn) : Task{&TaskImpl::call}, f{std::move(fn)} {}
+
+        // Runs and frees the task
+        static void call(Task* t) {
+            std::unique_ptr<TaskImpl> self{static_cast<TaskImpl*>(t)};
+            self->f();
+        }
+    };
+
+    struct alignas(cacheLineSize) Worker {
+        ChaseLevDeque<Task*> deque;
+        std::atomic<std::uint64_t> executed{0};    // written by the owner only
+        std::atomic<std::uint64_t> stolen{0};
+        std::thread thread;
+    };
+
+    struct Current {
+        WorkStealingPool* pool = nullptr;
+        int index = -1;
+    };
+
+    static Current& current() noexcept {
+        thread_local Current c;
+        return c;
+    }
+
+    template<typename F>
+    void split(std::size_t begin, std::size_t end, std::size_t grain, std::shared_ptr<F> f) {
+        submit([this, begin, end, grain, f = std::move(f)]() mutable {
+            auto b = begin, e = end;
+            // Keep the lower half, leave the upper half on the deque for thieves
+            while (e - b > grain) {
+                auto mid = b + (e - b) / 2;
+                split(mid, e, grain, f);
+                e = mid;
+            }
+            for (auto i = b; i < e; ++i) {
+                (*f)(i);
+            }
+        });
+    }
+
+    void run(std::size_t index) {
+        current() = {this, static_cast<int>(index)};
+        if (not options_.cpus.empty()) {
+            tryPinCurrentThread(options_.cpus[index % options_.cpus.size()]);
+        }
+        auto& self = *workers_[index];
+        std::uint64_t rng = 0x9e3779b97f4a7c15 * (index + 1);
+        std::size_t idle = 0;
+        for (;;) {
+            if (auto* task = find(index, rng)) {
+                execute(self, task);
+                idle = 0;
+                continue;
+            }
+            if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (++idle < options_.idleSpins) {
+                cpuRelax();
+                continue;
+            }
+            // Announce, then look once more. Dekker-style with the fence in
+            // wake(): each side stores (sleepers_ here, the task there), then
+            // fences, then loads the other's, so a submit either sees the
+            // sleeper or its task is found here.
+            auto epoch = epoch_.load(std::memory_order_seq_cst);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto* task = find(index, rng);
+            if (task == nullptr && not stopping_.load(std::memory_order_seq_cst)) {
+                epoch_.wait(epoch, std::memory_order_seq_cst);
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            if (task) {
+                execute(self, task);
+            }
+            idle = 0;
+        }
+    }
+
+    Task* find(std::size_t index, std::uint64_t& rng) {
+        Task* task;
+        auto& self = *workers_[index];
+        if (self.deque.pop(task) || inject_.pop(task)) {
+            return task;
+        }
+        auto n = workers_.size();
+        if (n == 1) {
+            return nullptr;
+        }
+        // Random start so thieves spread over the victims
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        auto start = rng % n;
+        for (std::size_t k = 0; k < n; ++k) {
+            auto v = (start + k) % n;
+            if (v != index && workers_[v]->deque.steal(task)) {
+                self.stolen.store(self.stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void execute(Worker& self, Task* task) {
+        try {
+            task->invoke(task);
+        } catch (...) {
+            if (not failing_.exchange(true, std::memory_order_relaxed)) {
+                error_ = std::current_exception();
+                failed_.store(true, std::memory_order_release);
+            }
+        }
+        self.executed.store(self.executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            pending_.notify_all();
+        }
+    }
+
+    void wake(bool all) {
+        // The task was published with a release store; without this fence
+        // the sleepers_ load below may be satisfied before it is visible
+        // (store-buffering), and a worker going to sleep misses both.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_seq_cst) == 0) [[likely]] {
+            return;
+        }
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        all ? epoch_.notify_all() : epoch_.notify_one();
+    }
+
+    void waitIdle() {
+        assert(current().pool != this && "wait() on a worker would wait for itself");
+        for (auto p = pending_.load(std::memory_order_acquire); p != 0; p = pending_.load(std::memory_order_acquire)) {
+            pending_.wait(p, std::memory_order_acquire);
+        }
+        failing_.store(false, std::memory_order_relaxed);
+    }
+
+    Options options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MpmcFifo<Task*> inject_;
+
+    alignas(cacheLineSize) std::atomic<std::uint64_t> pending_{0};
+    alignas(cacheLineSize) std::atomic<std::uint32_t> epoch_{0};
+    std::atomic<std::uint32_t> sleepers_{0};
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> failing_{false}, failed_{false};
+    std::exception_ptr error_;
+};
+
+
+#ifdef WORK_STEALING_POOL_DEMO
+// g++ -std=c++20 -O2 -march=native -pthread -DWORK_STEALING_POOL_DEMO -x c++ work_stealing_pool.cpp -o work_stealing_pool
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <stdexcept>
+
+// Uneven jobs: some indices cost 50x others, as symbol-days do.
+static std::uint64_t work(std::size_t i) {
+    std::uint64_t x = i + 1, rounds = i % 17 == 0 ? 50'000 : 1'000;
+    for (std::uint64_t r = 0; r < rounds; ++r) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    return x;
+}
+
+int main() {
+    constexpr std::size_t jobs = 20'000;
+    std::vector<std::uint64_t> expect(jobs);
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < jobs; ++i) {
+        expect[i] = work(i);
+    }
+    double serialMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    bool ok = true;
+    for (std::size_t threads : {std::size_t{1}, std::size_t{4}, std::size_t{std::thread::hardware_concurrency()}}) {
+        WorkStealingPool::Options options;
+        options.threads = threads;
+        WorkStealingPool pool(options);
+        t0 = std::chrono::steady_clock::now();
+        auto got = pool.map<std::uint64_t>(jobs, work);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        ok &= got == expect;
+
+        // Nested submissions from tasks, counted per worker without locks
+        std::vector<std::atomic<std::uint64_t>> perWorker(pool.threadCount());
+        for (int root = 0; root < 64; ++root) {
+            pool.submit([&pool, &perWorker] {
+                for (int child = 0; child < 64; ++child) {
+                    pool.submit([&perWorker] { perWorker[WorkStealingPool::workerIndex()].fetch_add(1, std::memory_order_relaxed); });
+                }
+            });
+        }
+        pool.wait();
+        std::uint64_t nested = 0;
+        for (auto& n : perWorker) {
+            nested += n.load();
+        }
+        ok &= nested == 64 * 64;
+
+        std::uint64_t executed = 0, stolen = 0;
+        for (auto& s : pool.stats()) {
+            executed += s.executed;
+            stolen += s.stolen;
+        }
+        std::printf("%2zu threads: map %.1f ms (serial %.1f ms), %llu tasks, %llu stolen\n", threads, ms, serialMs,
+                    (unsigned long long)executed, (unsigned long long)stolen);
+    }
+
+    // A throwing task surfaces from wait(); the pool stays usable.
+    WorkStealingPool::Options two;
+    two.threads = 2;
+    WorkStealingPool pool(two);
+    pool.submit([] { throw std::runtime_error("bad day"); });
+    bool caught = false;
+    try {
+        pool.wait();
+    } catch (std::runtime_error const&) {
+        caught = true;
+    }
+    std::atomic<int> after{0};
+    pool.parallelFor(0, 100, [&](std::size_t) { after.fetch_add(1); });
+    ok &= caught && after == 100;
+
+    // Lost-wakeup stress: workers that sleep after one empty round, and one
+    // external submit at a time into the idle pool. A missed wake-up leaves
+    // every worker asleep and hangs wait().
+    WorkStealingPool::Options sleepy;
+    sleepy.threads = 3;
+    sleepy.idleSpins = 1;
+    WorkStealingPool idlePool(sleepy);
+    int rounds = 0;
+    for (int i = 0; i < 20'000; ++i) {
+        idlePool.submit([&rounds] { ++rounds; });
+        idlePool.wait();
+    }
+    ok &= rounds == 20'000;
+
+    std::printf("%s\n", ok ? "ok" : "MISMATCH");
+    return !ok;
+}
+#endif